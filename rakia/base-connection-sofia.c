@@ -28,35 +28,91 @@
 #define DEBUG_FLAG RAKIA_DEBUG_EVENTS
 #include "rakia/debug.h"
 
+/* Stacks shut down, waiting for priv_destroy_nuas () */
+static GQueue nuas_to_destroy = G_QUEUE_INIT;
+static guint destroy_nuas_id = 0;
+
+/* How long one dispatch of priv_destroy_nuas () goes on destroying
+ * stacks before it returns to the main loop, in microseconds */
+#define RAKIA_NUA_DESTROY_SLICE 5000
+
+static void
+priv_destroy_nua (nua_t *nua)
+{
+  /* The stack is destroyed once it has reported the end of its shutdown,
+   * from a low priority idle callback: by then the Sofia source, at
+   * default priority, has run every message left for the stack's clone,
+   * and as the clone shares the port of our root (which does not
+   * thread), the su_clone_wait () in nua_destroy () only has its root to
+   * free, without dispatching the source again. */
+  DEBUG("destroying Sofia-SIP NUA at address %p", nua);
+  nua_destroy (nua);
+}
+
+static gboolean
+priv_destroy_nuas (gpointer data)
+{
+  gint64 deadline = g_get_monotonic_time () + RAKIA_NUA_DESTROY_SLICE;
+  nua_t *nua;
+  guint n = 0;
+
+  /* As many stacks as fit in the time slice, so that a burst of
+   * disconnections is dealt with in batches without holding the loop */
+  while ((nua = g_queue_pop_head (&nuas_to_destroy)) != NULL)
+    {
+      priv_destroy_nua (nua);
+      n++;
+
+      if (g_get_monotonic_time () >= deadline)
+        break;
+    }
+
+  DEBUG("destroyed %u stacks, %u left", n,
+      g_queue_get_length (&nuas_to_destroy));
+
+  if (g_queue_is_empty (&nuas_to_destroy))
+    {
+      destroy_nuas_id = 0;
+      return FALSE;
+    }
+
+  return TRUE;
+}
+
 static void
 priv_r_shutdown(int status,
                 nua_t *nua)
 {
-  GSource *source;
-  gboolean source_recursive;
-
   if (status < 200)
     return;
 
-  /* Should be the source of the Sofia root */
-  source = g_main_current_source ();
+  g_queue_push_tail (&nuas_to_destroy, nua);
 
-  /* XXX: temporarily allow recursion in the Sofia source to work around
-   * nua_destroy() requiring nested mainloop iterations to complete
-   * (Sofia-SIP bug #1624446). Actual recursion safety of the source is to be
-   * examined. */
-  source_recursive = g_source_get_can_recurse (source);
-  if (!source_recursive)
-    {
-      DEBUG("forcing Sofia root GSource to be recursive");
-      g_source_set_can_recurse (source, TRUE);
-    }
+  if (destroy_nuas_id == 0)
+    destroy_nuas_id = g_idle_add_full (G_PRIORITY_LOW, priv_destroy_nuas,
+        NULL, NULL);
+}
 
-  DEBUG("destroying Sofia-SIP NUA at address %p", nua);
-  nua_destroy (nua);
+/**
+ * rakia_base_connection_sofia_flush:
+ *
+ * Destroys the stacks that have completed their shutdown right away,
+ * rather than in time slices when the main loop is idle. To be called
+ * before the Sofia root goes.
+ */
+void
+rakia_base_connection_sofia_flush (void)
+{
+  nua_t *nua;
+
+  if (destroy_nuas_id == 0)
+    return;
 
-  if (!source_recursive)
-    g_source_set_can_recurse (source, FALSE);
+  g_source_remove (destroy_nuas_id);
+  destroy_nuas_id = 0;
+
+  while ((nua = g_queue_pop_head (&nuas_to_destroy)) != NULL)
+    priv_destroy_nua (nua);
 }
 
 #if 0
@@ -132,10 +188,6 @@ rakia_base_connection_sofia_callback (nua_event_t event,
       break;
     }
 
-  g_assert (conn != NULL);
-
-  DEBUG("connection %p, refcount %d", conn, ((GObject *)conn)->ref_count);
-
   {
     RakiaNuaEvent ev = {
         event,
@@ -148,6 +200,11 @@ rakia_base_connection_sofia_callback (nua_event_t event,
 
     if (target == NULL)
       {
+        /* A stack shared by connections leaves it to the caller to tell
+         * which connection gets the events of unbound handles */
+        g_assert (conn != NULL);
+        DEBUG("connection %p, refcount %d", conn, ((GObject *)conn)->ref_count);
+
         target = (RakiaEventTarget *) conn;
         DEBUG("dispatching to connection %p (unbound handle %p)", conn, nh);
       }
@@ -215,6 +215,54 @@ rakia_base_connection_add_auth_handler (RakiaBaseConnection *self,
     cls->add_auth_handler (self, target);
 }
 
+/**
+ * rakia_base_connection_dup_authorization:
+ * @nh: a handle about to send its first request
+ * @method: the method of the request
+ *
+ * Returns: credentials to send with the request without waiting to be
+ *  challenged, as a string for #SIPTAG_HEADER_STR, or %NULL
+ */
+gchar *
+rakia_base_connection_dup_authorization (RakiaBaseConnection *self,
+                                         nua_handle_t *nh,
+                                         const gchar *method)
+{
+  RakiaBaseConnectionClass *cls = RAKIA_BASE_CONNECTION_GET_CLASS (self);
+
+  if (cls->dup_authorization == NULL)
+    return NULL;
+
+  return cls->dup_authorization (self, nh, method);
+}
+
+/**
+ * rakia_base_connection_fail_over_proxy:
+ * @nh: a handle whose first request got no response from the proxy, or
+ *  was turned down by it with 408 or 503
+ * @sent_time: the monotonic time the request was sent at
+ * @sip: the response, or %NULL
+ *
+ * Goes on to the next server of the proxy, unless the request went
+ * through one that has been given up on since.
+ *
+ * Returns: a new handle to send the request again with, to the same
+ *  destination as @nh, or %NULL if there is no other server to try
+ */
+nua_handle_t *
+rakia_base_connection_fail_over_proxy (RakiaBaseConnection *self,
+                                       nua_handle_t *nh,
+                                       gint64 sent_time,
+                                       const sip_t *sip)
+{
+  RakiaBaseConnectionClass *cls = RAKIA_BASE_CONNECTION_GET_CLASS (self);
+
+  if (cls->fail_over_proxy == NULL)
+    return NULL;
+
+  return cls->fail_over_proxy (self, nh, sent_time, sip);
+}
+
 void
 rakia_base_connection_save_event (RakiaBaseConnection *self,
                                   nua_saved_event_t ret_saved [1])
@@ -256,3 +304,26 @@ rakia_base_connection_handle_to_uri (RakiaBaseConnection *self,
 
   return url;
 }
+
+/**
+ * rakia_base_connection_get_uri_cache_usage:
+ *
+ * Returns: the bytes held by the URIs cached for contact handles
+ */
+gsize
+rakia_base_connection_get_uri_cache_usage (RakiaBaseConnection *self)
+{
+  GHashTableIter iter;
+  gpointer url;
+  gsize size = 0;
+
+  if (self->priv->uris == NULL)
+    return 0;
+
+  /* url_make () allocates the structure and the strings in one block */
+  g_hash_table_iter_init (&iter, self->priv->uris);
+  while (g_hash_table_iter_next (&iter, NULL, &url))
+    size += sizeof (url_t) + url_xtra (url);
+
+  return size;
+}
@@ -40,6 +40,10 @@ struct _RakiaBaseConnectionClass {
 
   nua_handle_t *(*create_handle) (RakiaBaseConnection *, TpHandle contact);
   void (*add_auth_handler) (RakiaBaseConnection *, RakiaEventTarget *);
+  gchar *(*dup_authorization) (RakiaBaseConnection *, nua_handle_t *nh,
+      const gchar *method);
+  nua_handle_t *(*fail_over_proxy) (RakiaBaseConnection *, nua_handle_t *nh,
+      gint64 sent_time, const sip_t *sip);
 };
 
 struct _RakiaBaseConnection {
@@ -75,6 +79,11 @@ nua_handle_t *rakia_base_connection_create_handle (RakiaBaseConnection *,
     TpHandle contact);
 void rakia_base_connection_add_auth_handler (RakiaBaseConnection *self,
     RakiaEventTarget *target);
+gchar *rakia_base_connection_dup_authorization (RakiaBaseConnection *self,
+    nua_handle_t *nh, const gchar *method);
+nua_handle_t *rakia_base_connection_fail_over_proxy (
+    RakiaBaseConnection *self, nua_handle_t *nh, gint64 sent_time,
+    const sip_t *sip);
 void rakia_base_connection_save_event (RakiaBaseConnection *self,
     nua_saved_event_t ret_saved [1]);
 
@@ -86,9 +95,13 @@ void rakia_base_connection_sofia_callback (nua_event_t event,
     sip_t const *sip,
     tagi_t tags[]);
 
+void rakia_base_connection_sofia_flush (void);
+
 const url_t *rakia_base_connection_handle_to_uri (
     RakiaBaseConnection *self, TpHandle handle);
 
+gsize rakia_base_connection_get_uri_cache_usage (RakiaBaseConnection *self);
+
 G_END_DECLS
 
 #endif /* #ifndef __RAKIA_BASE_CONNECTION_H__*/
@@ -24,14 +24,18 @@
 
 #include <string.h>
 
+#include "extensions/extensions.h"
+
 #include "rakia/call-content.h"
 #include "rakia/sip-session.h"
 
 #define DEBUG_FLAG RAKIA_DEBUG_CALL
 #include "rakia/debug.h"
 
-G_DEFINE_TYPE (RakiaCallChannel, rakia_call_channel,
-    TP_TYPE_BASE_MEDIA_CALL_CHANNEL)
+G_DEFINE_TYPE_WITH_CODE (RakiaCallChannel, rakia_call_channel,
+    TP_TYPE_BASE_MEDIA_CALL_CHANNEL,
+    G_IMPLEMENT_INTERFACE (RAKIA_TYPE_SVC_CHANNEL_INTERFACE_SETUP_TIMELINE,
+        NULL))
 
 static void rakia_call_channel_constructed (GObject *obj);
 static void rakia_call_channel_set_property (GObject *object,
@@ -95,6 +99,8 @@ enum
   PROP_SIP_SESSION = 1,
   PROP_STUN_SERVER,
   PROP_STUN_PORT,
+  PROP_CODEC_CACHE,
+  PROP_SETUP_TIMELINE,
   LAST_PROPERTY
 };
 
@@ -107,6 +113,12 @@ struct _RakiaCallChannelPrivate
   gchar *stun_server;
   guint stun_port;
 
+  RakiaCodecCache *codec_cache;
+
+  /* borrowed (RakiaSipMedia *) => borrowed (RakiaCallContent *), for the
+   * contents not yet removed from the channel */
+  GHashTable *contents_by_media;
+
   guint last_content_no;
 
 };
@@ -120,6 +132,8 @@ rakia_call_channel_init (RakiaCallChannel *self)
       RAKIA_TYPE_CALL_CHANNEL, RakiaCallChannelPrivate);
 
   self->priv = priv;
+
+  priv->contents_by_media = g_hash_table_new (NULL, NULL);
 }
 
 
@@ -131,6 +145,19 @@ rakia_call_channel_get_object_path_suffix (TpBaseChannel *base)
   return g_strdup_printf ("CallChannel%p", self);
 }
 
+static GPtrArray *
+rakia_call_channel_get_interfaces (TpBaseChannel *base)
+{
+  GPtrArray *interfaces;
+
+  interfaces = TP_BASE_CHANNEL_CLASS (
+      rakia_call_channel_parent_class)->get_interfaces (base);
+
+  g_ptr_array_add (interfaces, RAKIA_IFACE_CHANNEL_INTERFACE_SETUP_TIMELINE);
+
+  return interfaces;
+}
+
 
 
 static void
@@ -145,6 +172,10 @@ rakia_call_channel_class_init (
   TpBaseMediaCallChannelClass *base_media_call_class =
       TP_BASE_MEDIA_CALL_CHANNEL_CLASS (rakia_call_channel_class);
   GParamSpec *param_spec;
+  static TpDBusPropertiesMixinPropImpl setup_timeline_props[] = {
+      { "Milestones", "setup-timeline", NULL },
+      { NULL }
+  };
 
   g_type_class_add_private (rakia_call_channel_class,
       sizeof (RakiaCallChannelPrivate));
@@ -161,6 +192,7 @@ rakia_call_channel_class_init (
   base_channel_class->get_object_path_suffix =
       rakia_call_channel_get_object_path_suffix;
   base_channel_class->close = rakia_call_channel_close;
+  base_channel_class->get_interfaces = rakia_call_channel_get_interfaces;
 
   base_call_class->add_content = rakia_call_channel_add_content;
   base_call_class->hangup = rakia_call_channel_hangup;
@@ -187,6 +219,24 @@ rakia_call_channel_class_init (
       "UDP port of STUN server.", 0, G_MAXUINT16, 0,
       G_PARAM_CONSTRUCT_ONLY | G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS);
   g_object_class_install_property (object_class, PROP_STUN_PORT, param_spec);
+
+  param_spec = g_param_spec_pointer ("codec-cache", "RakiaCodecCache",
+      "Connection-wide cache of the codecs last agreed with each peer.",
+      G_PARAM_CONSTRUCT_ONLY | G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS);
+  g_object_class_install_property (object_class, PROP_CODEC_CACHE, param_spec);
+
+  param_spec = g_param_spec_boxed ("setup-timeline", "Call setup timeline",
+      "Map of the call setup milestones reached to the time in microseconds"
+      " since the start of the SIP session",
+      RAKIA_HASH_TYPE_MILESTONE_TIMELINE,
+      G_PARAM_READABLE | G_PARAM_STATIC_STRINGS);
+  g_object_class_install_property (object_class, PROP_SETUP_TIMELINE,
+      param_spec);
+
+  tp_dbus_properties_mixin_implement_interface (object_class,
+      RAKIA_IFACE_QUARK_CHANNEL_INTERFACE_SETUP_TIMELINE,
+      tp_dbus_properties_mixin_getter_gobject_properties, NULL,
+      setup_timeline_props);
 }
 
 
@@ -289,6 +339,12 @@ rakia_call_channel_get_property (GObject    *object,
     case PROP_STUN_PORT:
       g_value_set_uint (value, priv->stun_port);
       break;
+    case PROP_CODEC_CACHE:
+      g_value_set_pointer (value, priv->codec_cache);
+      break;
+    case PROP_SETUP_TIMELINE:
+      g_value_take_boxed (value, rakia_call_channel_dup_setup_timeline (self));
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
       break;
@@ -317,6 +373,10 @@ rakia_call_channel_set_property (GObject *object,
     case PROP_STUN_PORT:
       priv->stun_port = g_value_get_uint (value);
       break;
+    case PROP_CODEC_CACHE:
+      if (g_value_get_pointer (value) != NULL)
+        priv->codec_cache = rakia_codec_cache_ref (g_value_get_pointer (value));
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
       break;
@@ -345,6 +405,10 @@ rakia_call_channel_finalize (GObject *object)
   RakiaCallChannelPrivate *priv = self->priv;
 
   g_free (priv->stun_server);
+  g_hash_table_unref (priv->contents_by_media);
+
+  if (priv->codec_cache != NULL)
+    rakia_codec_cache_unref (priv->codec_cache);
 
   G_OBJECT_CLASS (rakia_call_channel_parent_class)->finalize (object);
 }
@@ -607,18 +671,21 @@ static RakiaCallContent *
 rakia_call_channel_get_content_by_media (RakiaCallChannel *self,
     RakiaSipMedia *media)
 {
-  GList *e;
+  return g_hash_table_lookup (self->priv->contents_by_media, media);
+}
 
-  for (e = tp_base_call_channel_get_contents (TP_BASE_CALL_CHANNEL (self));
-       e != NULL;
-       e = e->next)
-    {
-      RakiaCallContent *content = e->data;
-      if (rakia_call_content_get_media (content) == media)
-        return content;
-    }
+/*
+ * Called by RakiaCallContent when it is removed from the channel, either
+ * on request or because its media went away
+ */
+void
+rakia_call_channel_content_removed (RakiaCallChannel *self,
+    RakiaCallContent *content)
+{
+  RakiaSipMedia *media = rakia_call_content_get_media (content);
 
-  return NULL;
+  if (g_hash_table_lookup (self->priv->contents_by_media, media) == content)
+    g_hash_table_remove (self->priv->contents_by_media, media);
 }
 
 static void
@@ -676,6 +743,8 @@ new_content (RakiaCallChannel *self,
   g_free (free_name);
   g_free (object_path);
 
+  g_hash_table_insert (self->priv->contents_by_media, media, content);
+
   tp_base_call_channel_add_content (TP_BASE_CALL_CHANNEL (self),
       TP_BASE_CALL_CONTENT (content));
 
@@ -823,3 +892,42 @@ rakia_call_channel_hangup_error (RakiaCallChannel *self,
   tp_base_call_channel_set_state (TP_BASE_CALL_CHANNEL (self),
       TP_CALL_STATE_ENDED, self_handle, reason, dbus_reason, message);
 }
+
+RakiaCodecCache *
+rakia_call_channel_get_codec_cache (RakiaCallChannel *self)
+{
+  return self->priv->codec_cache;
+}
+
+/**
+ * rakia_call_channel_dup_setup_timeline:
+ *
+ * Returns: a new map of the names of the call setup milestones reached
+ * so far to the microseconds elapsed since the start of the session, as
+ * exported in the SetupTimeline interface
+ */
+GHashTable *
+rakia_call_channel_dup_setup_timeline (RakiaCallChannel *self)
+{
+  GHashTable *timeline;
+  guint i;
+
+  timeline = g_hash_table_new (g_str_hash, g_str_equal);
+
+  if (self->priv->session == NULL)
+    return timeline;
+
+  for (i = 0; i < NUM_RAKIA_SIP_SESSION_MILESTONES; i++)
+    {
+      gint64 usec = rakia_sip_session_get_milestone (self->priv->session, i);
+
+      if (usec < 0)
+        continue;
+
+      g_hash_table_insert (timeline,
+          (gpointer) rakia_sip_session_milestone_name (i),
+          GUINT_TO_POINTER ((guint) MIN (usec, G_MAXUINT32)));
+    }
+
+  return timeline;
+}
@@ -25,6 +25,8 @@
 
 #include <telepathy-glib/telepathy-glib.h>
 
+#include "rakia/codec-cache.h"
+
 G_BEGIN_DECLS
 
 typedef struct _RakiaCallChannel RakiaCallChannel;
@@ -66,6 +68,19 @@ rakia_call_channel_hangup_error (RakiaCallChannel *self,
     const gchar *dbus_reason,
     const gchar *message);
 
+RakiaCodecCache *
+rakia_call_channel_get_codec_cache (RakiaCallChannel *self);
+
+GHashTable *
+rakia_call_channel_dup_setup_timeline (RakiaCallChannel *self);
+
+/* rakia/call-content.h includes this header, hence the bare struct */
+struct _RakiaCallContent;
+
+void
+rakia_call_channel_content_removed (RakiaCallChannel *self,
+    struct _RakiaCallContent *content);
+
 G_END_DECLS
 
 #endif /* #ifndef __RAKIA_CALL_CHANNEL_H__*/
@@ -64,7 +64,22 @@ struct _RakiaCallContentPrivate
 
   RakiaCallStream *stream;
 
-  guint codec_offer_id;
+  /* offer number -> TpCallContentMediaDescription (not ref'd) for the
+   * remote offers still alive; a number is reused for the next
+   * .../OfferN once its description has gone away */
+  GHashTable *offer_mds;
+
+  /* remote codec lists (GPtrArray, ref'd) of the offers waiting for the
+   * streaming implementation, oldest first */
+  GQueue offered_remote_codecs;
+
+  /* the remote codecs of the last offer the streaming implementation
+   * accepted, which the local description currently answers */
+  GPtrArray *accepted_remote_codecs;
+
+  /* the pending remote offer was answered with the codecs cached for
+   * the peer, without waiting for the media description reply */
+  gboolean answered_from_cache;
 };
 
 static void
@@ -74,6 +89,9 @@ rakia_call_content_init (RakiaCallContent *self)
       RAKIA_TYPE_CALL_CONTENT, RakiaCallContentPrivate);
 
   self->priv = priv;
+
+  priv->offer_mds = g_hash_table_new (NULL, NULL);
+  g_queue_init (&priv->offered_remote_codecs);
 }
 
 static void
@@ -173,11 +191,46 @@ rakia_call_content_constructed (GObject *object)
   G_OBJECT_CLASS (rakia_call_content_parent_class)->constructed (object);
 }
 
+static void
+offer_md_finalized (gpointer data, GObject *where_the_object_was)
+{
+  RakiaCallContent *self = data;
+  GHashTableIter iter;
+  gpointer md;
+
+  g_hash_table_iter_init (&iter, self->priv->offer_mds);
+  while (g_hash_table_iter_next (&iter, NULL, &md))
+    if (md == (gpointer) where_the_object_was)
+      {
+        g_hash_table_iter_remove (&iter);
+        break;
+      }
+}
+
 static void
 rakia_call_content_dispose (GObject *object)
 {
   RakiaCallContent *self = RAKIA_CALL_CONTENT (object);
   RakiaCallContentPrivate *priv = self->priv;
+  GPtrArray *codecs;
+
+  if (priv->offer_mds != NULL)
+    {
+      GHashTableIter iter;
+      gpointer md;
+
+      g_hash_table_iter_init (&iter, priv->offer_mds);
+      while (g_hash_table_iter_next (&iter, NULL, &md))
+        g_object_weak_unref (md, offer_md_finalized, self);
+
+      g_hash_table_unref (priv->offer_mds);
+      priv->offer_mds = NULL;
+    }
+
+  while ((codecs = g_queue_pop_head (&priv->offered_remote_codecs)) != NULL)
+    g_ptr_array_unref (codecs);
+
+  tp_clear_pointer (&priv->accepted_remote_codecs, g_ptr_array_unref);
 
   tp_clear_object (&priv->media);
 
@@ -194,13 +247,16 @@ rakia_call_content_deinit (TpBaseCallContent *base)
 
   session = rakia_sip_media_get_session (priv->media);
 
+  /* The channel must not find this content any more if removing the
+   * media below emits media-removed */
+  rakia_call_channel_content_removed (priv->channel, self);
+
   /* If the media was removed, it means it's by user request, so we must
    * do a re-invite
    */
   if (rakia_sip_session_remove_media (session, priv->media, 0, NULL))
     rakia_sip_session_media_changed (session);
 
-
   tp_clear_object (&priv->stream);
   tp_clear_object (&priv->channel);
 
@@ -241,35 +297,35 @@ rakia_call_content_get_media (RakiaCallContent *self)
   return self->priv->media;
 }
 
-static void
-set_telepathy_codecs (RakiaCallContent *self, GHashTable *md_properties)
+/* Each codec of a media description is a GValueArray; its members are
+ * read in place rather than through tp_value_array_unpack (), and copied
+ * only once, into the codec list handed to RakiaSipMedia */
+static GPtrArray *
+codecs_from_telepathy (GHashTable *md_properties)
 {
-  RakiaCallContentPrivate *priv = self->priv;
   guint i;
   GPtrArray *tpcodecs = tp_asv_get_boxed (md_properties,
       TP_PROP_CALL_CONTENT_MEDIA_DESCRIPTION_CODECS,
       TP_ARRAY_TYPE_CODEC_LIST);
-  GPtrArray *sipcodecs = g_ptr_array_new_with_free_func (
-      (GDestroyNotify) rakia_sip_codec_free);
+  GPtrArray *sipcodecs = rakia_sip_codec_list_new (tpcodecs->len);
 
   for (i = 0; i < tpcodecs->len; i++)
     {
       GValueArray *tpcodec = g_ptr_array_index (tpcodecs, i);
-      guint id;
-      const gchar *name;
-      guint clock_rate;
-      guint channels;
-      gboolean updated;
       GHashTable *extra_params;
       RakiaSipCodec *sipcodec;
       GHashTableIter iter;
       gpointer key, value;
 
-      tp_value_array_unpack (tpcodec, 6, &id, &name, &clock_rate,
-          &channels, &updated, &extra_params);
+      g_assert (tpcodec->n_values >= 6);
 
-      sipcodec = rakia_sip_codec_new (id, name, clock_rate, channels);
+      sipcodec = rakia_sip_codec_new (
+          g_value_get_uint (tpcodec->values + 0),
+          g_value_get_string (tpcodec->values + 1),
+          g_value_get_uint (tpcodec->values + 2),
+          g_value_get_uint (tpcodec->values + 3));
 
+      extra_params = g_value_get_boxed (tpcodec->values + 5);
       g_hash_table_iter_init (&iter, extra_params);
 
       while (g_hash_table_iter_next (&iter, &key, &value))
@@ -278,9 +334,42 @@ set_telepathy_codecs (RakiaCallContent *self, GHashTable *md_properties)
       g_ptr_array_add (sipcodecs, sipcodec);
     }
 
+  return sipcodecs;
+}
+
+static void
+set_local_codecs (RakiaCallContent *self, GPtrArray *sipcodecs)
+{
+  RakiaCallContentPrivate *priv = self->priv;
+  RakiaCodecCache *cache =
+      rakia_call_channel_get_codec_cache (priv->channel);
+
+  /* Put what worked with this peer last time first in our initial offer,
+   * so the peer is likely to pick it without another round */
+  if (cache != NULL &&
+      rakia_sip_media_is_created_locally (priv->media) &&
+      !rakia_sip_media_has_remote_media (priv->media))
+    {
+      GPtrArray *filtered = rakia_codec_cache_filter_offer (cache,
+          tp_base_channel_get_target_handle (TP_BASE_CHANNEL (priv->channel)),
+          rakia_sip_media_get_media_type (priv->media), sipcodecs);
+
+      if (filtered != NULL)
+        {
+          g_ptr_array_unref (sipcodecs);
+          sipcodecs = filtered;
+        }
+    }
+
   rakia_sip_media_take_local_codecs (priv->media, sipcodecs);
 }
 
+static void
+set_telepathy_codecs (RakiaCallContent *self, GHashTable *md_properties)
+{
+  set_local_codecs (self, codecs_from_telepathy (md_properties));
+}
+
 static void
 md_offer_cb (GObject *obj, GAsyncResult *res, gpointer user_data)
 {
@@ -289,15 +378,37 @@ md_offer_cb (GObject *obj, GAsyncResult *res, gpointer user_data)
   TpBaseMediaCallContent *bmcc = TP_BASE_MEDIA_CALL_CONTENT (self);
   GError *error = NULL;
   gboolean is_initial_offer = GPOINTER_TO_UINT (user_data);
+  gboolean answered_from_cache = priv->answered_from_cache;
+  TpHandle peer =
+      tp_base_channel_get_target_handle (TP_BASE_CHANNEL (priv->channel));
+  RakiaCodecCache *cache =
+      rakia_call_channel_get_codec_cache (priv->channel);
+  GPtrArray *remote_codecs = NULL;
+
+  priv->answered_from_cache = FALSE;
+
+  if (!is_initial_offer)
+    remote_codecs = g_queue_pop_head (&priv->offered_remote_codecs);
+
+  tp_clear_pointer (&priv->accepted_remote_codecs, g_ptr_array_unref);
 
   if (tp_base_media_call_content_offer_media_description_finish (bmcc,
           res, &error))
     {
       GHashTable *local_md =
-          tp_base_media_call_content_get_local_media_description (bmcc,
-              tp_base_channel_get_target_handle (TP_BASE_CHANNEL (priv->channel)));
+          tp_base_media_call_content_get_local_media_description (bmcc, peer);
+      GPtrArray *sipcodecs = codecs_from_telepathy (local_md);
+
+      /* A reply to a remote description is the intersection of both
+       * sides' codecs; remember it for the next call with this peer */
+      if (!is_initial_offer && cache != NULL)
+        rakia_codec_cache_store (cache, peer,
+            rakia_sip_media_get_media_type (priv->media), sipcodecs);
+
+      priv->accepted_remote_codecs = remote_codecs;
+      remote_codecs = NULL;
 
-      set_telepathy_codecs (self, local_md);
+      set_local_codecs (self, sipcodecs);
     }
   else
     {
@@ -307,15 +418,71 @@ md_offer_cb (GObject *obj, GAsyncResult *res, gpointer user_data)
         {
           g_assert (!is_initial_offer);
 
-          rakia_sip_media_codecs_rejected (priv->media);
-
           DEBUG ("Codecs rejected: %s", error->message);
 
+          if (answered_from_cache)
+            {
+              /* The offer has been answered already; the cached set is
+               * stale, so let the next call negotiate from scratch */
+              if (cache != NULL)
+                rakia_codec_cache_store (cache, peer,
+                    rakia_sip_media_get_media_type (priv->media), NULL);
+            }
+          else
+            {
+              rakia_sip_media_codecs_rejected (priv->media);
+            }
+
         }
 
       /* FIXME: We need to allow for partial failures */
       g_clear_error (&error);
     }
+
+  if (remote_codecs != NULL)
+    g_ptr_array_unref (remote_codecs);
+}
+
+/* The remote end often sends the same codecs again, typically in session
+ * refreshes. If the streaming implementation accepted exactly these last
+ * time and nothing is pending, the local description it gave then is
+ * still the answer, so use it again without another offer round trip. */
+static gboolean
+reuse_accepted_remote_codecs (RakiaCallContent *self,
+    GPtrArray *remote_codecs)
+{
+  RakiaCallContentPrivate *priv = self->priv;
+  TpBaseMediaCallContent *bmcc = TP_BASE_MEDIA_CALL_CONTENT (self);
+  GHashTable *local_md;
+
+  if (priv->accepted_remote_codecs == NULL ||
+      !g_queue_is_empty (&priv->offered_remote_codecs) ||
+      !rakia_sip_codec_list_equal (priv->accepted_remote_codecs,
+          remote_codecs))
+    return FALSE;
+
+  local_md = tp_base_media_call_content_get_local_media_description (bmcc,
+      tp_base_channel_get_target_handle (TP_BASE_CHANNEL (priv->channel)));
+  if (local_md == NULL)
+    return FALSE;
+
+  DEBUG ("remote codecs unchanged, reusing the accepted description");
+
+  set_local_codecs (self, codecs_from_telepathy (local_md));
+
+  return TRUE;
+}
+
+static guint
+next_offer_id (RakiaCallContent *self)
+{
+  guint id = 1;
+
+  while (g_hash_table_lookup (self->priv->offer_mds,
+          GUINT_TO_POINTER (id)) != NULL)
+    id++;
+
+  return id;
 }
 
 static void
@@ -330,14 +497,28 @@ media_remote_codecs_updated_cb (RakiaSipMedia *media, gboolean is_offer,
   TpCallContentMediaDescription *md;
   TpDBusDaemon *bus = tp_base_connection_get_dbus_daemon (
       tp_base_call_content_get_connection (bcc));
+  RakiaCodecCache *cache =
+      rakia_call_channel_get_codec_cache (priv->channel);
+  GPtrArray *cached_answer = NULL;
+  GHashTable *parameters;
   gchar *object_path;
+  guint offer_id;
   guint i, j;
 
   if (remote_codecs == NULL)
     return;
 
+  if (reuse_accepted_remote_codecs (self, remote_codecs))
+    return;
+
+  if (is_offer && cache != NULL)
+    cached_answer = rakia_codec_cache_answer (cache,
+        tp_base_channel_get_target_handle (TP_BASE_CHANNEL (priv->channel)),
+        rakia_sip_media_get_media_type (priv->media), remote_codecs);
+
+  offer_id = next_offer_id (self);
   object_path = g_strdup_printf ("%s/Offer%u",
-      tp_base_call_content_get_object_path (bcc), ++priv->codec_offer_id);
+      tp_base_call_content_get_object_path (bcc), offer_id);
 
   md = tp_call_content_media_description_new (bus, object_path,
       tp_base_channel_get_target_handle (TP_BASE_CHANNEL (priv->channel)),
@@ -345,12 +526,17 @@ media_remote_codecs_updated_cb (RakiaSipMedia *media, gboolean is_offer,
 
   g_free (object_path);
 
+  g_hash_table_insert (priv->offer_mds, GUINT_TO_POINTER (offer_id), md);
+  g_object_weak_ref (G_OBJECT (md), offer_md_finalized, self);
+
+  /* .._append_codec () copies the parameters, so one table serves for
+   * all the codecs, and it needn't copy the strings either */
+  parameters = g_hash_table_new (g_str_hash, g_str_equal);
+
   for (i = 0; i < remote_codecs->len; i++)
     {
       RakiaSipCodec *codec = g_ptr_array_index (remote_codecs, i);
-      GHashTable *parameters = g_hash_table_new (g_str_hash, g_str_equal);
 
-      /* No need to copy the values as .._append_codec() will */
       if (codec->params)
         for (j = 0; j < codec->params->len; j++)
           {
@@ -363,13 +549,30 @@ media_remote_codecs_updated_cb (RakiaSipMedia *media, gboolean is_offer,
           codec->encoding_name, codec->clock_rate, codec->channels, TRUE,
           parameters);
 
-      g_hash_table_unref (parameters);
+      g_hash_table_remove_all (parameters);
     }
 
+  g_hash_table_unref (parameters);
+
+  g_queue_push_tail (&priv->offered_remote_codecs,
+      g_ptr_array_ref (remote_codecs));
+
   tp_base_media_call_content_offer_media_description_async (bmcc,
       md, md_offer_cb, GUINT_TO_POINTER (FALSE));
 
   g_object_unref (md);
+
+  /* The peer offers everything we agreed on last time: answer with that
+   * right away instead of waiting for the streaming implementation.
+   * Its reply still replaces these codecs when it arrives, and only
+   * causes a re-INVITE if the resulting SDP differs. */
+  if (cached_answer != NULL)
+    {
+      DEBUG ("answering remote offer with %u cached codecs",
+          cached_answer->len);
+      priv->answered_from_cache = TRUE;
+      rakia_sip_media_take_local_codecs (priv->media, cached_answer);
+    }
 }
 
 void
@@ -378,11 +581,14 @@ rakia_call_content_add_stream (RakiaCallContent *self)
   RakiaCallContentPrivate *priv = self->priv;
   TpBaseCallContent *bcc = TP_BASE_CALL_CONTENT (self);
   gchar *object_path;
+  guint transport = TP_STREAM_TRANSPORT_TYPE_RAW_UDP;
+
+  g_object_get (priv->channel, "initial-transport", &transport, NULL);
 
   object_path = g_strdup_printf ("%s/Stream",
       tp_base_call_content_get_object_path (bcc));
   priv->stream = rakia_call_stream_new (self, priv->media,
-      object_path, TP_STREAM_TRANSPORT_TYPE_RAW_UDP,
+      object_path, transport,
       tp_base_call_content_get_connection (bcc));
   g_free (object_path);
 
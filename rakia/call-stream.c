@@ -23,7 +23,12 @@
 
 #include "rakia/call-stream.h"
 
+#include <string.h>
+
+#include <telepathy-glib/telepathy-glib-dbus.h>
+
 #include "rakia/sip-media.h"
+#include "rakia/util.h"
 
 #define DEBUG_FLAG RAKIA_DEBUG_MEDIA
 #include "debug.h"
@@ -61,6 +66,8 @@ static void rakia_call_stream_finalize (GObject *object);
 
 static void media_remote_candidates_updated_cb (RakiaSipMedia *media,
     RakiaCallStream *self);
+static void media_ice_restart_requested_cb (RakiaSipMedia *media,
+    RakiaCallStream *self);
 static void receiving_updated_cb (RakiaCallStream *self);
 
 
@@ -86,6 +93,14 @@ struct _RakiaCallStreamPrivate
   TpCallStreamEndpoint *endpoint;
 
   guint last_endpoint_no;
+
+  TpStreamTransportType transport;
+  gboolean initial_candidates_finished;
+  gboolean ice_restarting;      /* the next set replaces the candidates */
+
+  /* owned RakiaSipCandidate *, converted when added and moved to the
+   * media when the initial set is finished */
+  GPtrArray *pending_candidates;
 };
 
 static void
@@ -95,6 +110,9 @@ rakia_call_stream_init (RakiaCallStream *self)
       RAKIA_TYPE_CALL_STREAM, RakiaCallStreamPrivate);
 
   self->priv = priv;
+
+  priv->pending_candidates = g_ptr_array_new_with_free_func (
+      (GDestroyNotify) rakia_sip_candidate_free);
 }
 
 
@@ -195,13 +213,17 @@ rakia_call_stream_constructed (GObject *object)
   gchar *stun_server = NULL;
   guint stun_port = 0;
 
-  g_object_get (self, "channel", &priv->channel, NULL);
+  g_object_get (self, "channel", &priv->channel,
+      "transport", &priv->transport,
+      NULL);
   contact = tp_base_channel_get_target_handle (TP_BASE_CHANNEL (priv->channel));
 
   g_signal_connect_object (priv->media, "remote-candidates-updated",
       G_CALLBACK (media_remote_candidates_updated_cb), self, 0);
   g_signal_connect_object (priv->media, "direction-changed",
       G_CALLBACK (rakia_call_stream_update_direction), self, G_CONNECT_SWAPPED);
+  g_signal_connect_object (priv->media, "ice-restart-requested",
+      G_CALLBACK (media_ice_restart_requested_cb), self, 0);
 
   if (!rakia_sip_media_is_created_locally (priv->media))
     media_remote_candidates_updated_cb (priv->media, self);
@@ -265,6 +287,10 @@ rakia_call_stream_dispose (GObject *object)
 void
 rakia_call_stream_finalize (GObject *object)
 {
+  RakiaCallStream *self = RAKIA_CALL_STREAM (object);
+
+  g_ptr_array_unref (self->priv->pending_candidates);
+
   G_OBJECT_CLASS (rakia_call_stream_parent_class)->finalize (object);
 }
 
@@ -334,14 +360,74 @@ rakia_call_stream_report_receiving_failure (TpBaseMediaCallStream *bmcs,
       current_requested_direction & ~TP_MEDIA_STREAM_DIRECTION_RECEIVE);
 }
 
+static RakiaSipCandidate *
+priv_sip_candidate_from_tp (guint component, const gchar *ip, guint port,
+    GHashTable *info)
+{
+  RakiaSipCandidate *candidate;
+  const gchar *foundation;
+  const gchar *base_ip;
+  guint priority;
+  gboolean valid;
+
+  foundation = tp_asv_get_string (info, "foundation");
+  if (!foundation)
+    foundation = "";
+
+  priority = tp_asv_get_uint32 (info, "priority", &valid);
+  if (!valid)
+    priority = 0;
+
+  /* A scope such as the "%eth0" of a link-local address only means
+   * something on this host, and SDP has no room for it */
+  candidate = rakia_sip_candidate_new_take (component,
+      g_strndup (ip, strcspn (ip, "%")), port, g_strdup (foundation),
+      priority);
+
+  candidate->type = tp_asv_get_uint32 (info, "type", NULL);
+
+  /* The related address goes into the SDP as it is, so one that is not
+   * a numeric address is dropped rather than the whole candidate */
+  base_ip = tp_asv_get_string (info, "base-ip");
+  if (base_ip != NULL && !rakia_ip_address_is_valid (base_ip))
+    {
+      DEBUG ("ignoring the invalid base-ip of candidate %s:%u", ip, port);
+    }
+  else if (base_ip != NULL)
+    {
+      candidate->base_ip = g_strndup (base_ip, strcspn (base_ip, "%"));
+      candidate->base_port = tp_asv_get_uint32 (info, "base-port", NULL);
+    }
+
+  return candidate;
+}
+
+/* Each candidate is converted for the media right after validation, and
+ * moved to it without copying when the initial set is finished, or at
+ * once if it trickles in later with ICE. */
 static GPtrArray *
 rakia_call_stream_add_local_candidates (TpBaseMediaCallStream *stream,
     const GPtrArray *candidates,
     GError **error)
 {
+  RakiaCallStream *self = RAKIA_CALL_STREAM (stream);
+  RakiaCallStreamPrivate *priv = self->priv;
   GPtrArray *accepted_candidates = g_ptr_array_sized_new (candidates->len);
+  GPtrArray *sip_candidates = NULL;
+  gboolean trickled = FALSE;
   guint i;
 
+  if (!priv->initial_candidates_finished)
+    {
+      sip_candidates = priv->pending_candidates;
+    }
+  else if (priv->transport == TP_STREAM_TRANSPORT_TYPE_ICE)
+    {
+      sip_candidates = g_ptr_array_new_full (candidates->len,
+          (GDestroyNotify) rakia_sip_candidate_free);
+      trickled = TRUE;
+    }
+
   for (i = 0; i < candidates->len; i ++)
     {
       GValueArray *candidate = g_ptr_array_index (candidates, i);
@@ -349,11 +435,15 @@ rakia_call_stream_add_local_candidates (TpBaseMediaCallStream *stream,
       const gchar *ip;
       guint port;
       GHashTable *info;
-      GInetAddress *inetaddr;
       gboolean valid;
       TpMediaStreamBaseProto proto;
 
-      tp_value_array_unpack (candidate, 4, &component, &ip, &port, &info);
+      g_assert (candidate->n_values >= 4);
+
+      component = g_value_get_uint (candidate->values + 0);
+      ip = g_value_get_string (candidate->values + 1);
+      port = g_value_get_uint (candidate->values + 2);
+      info = g_value_get_boxed (candidate->values + 3);
 
       if (component != 1 && component != 2)
         continue;
@@ -365,12 +455,18 @@ rakia_call_stream_add_local_candidates (TpBaseMediaCallStream *stream,
       if (valid && proto != TP_MEDIA_STREAM_BASE_PROTO_UDP)
         continue;
 
-      inetaddr = g_inet_address_new_from_string (ip);
-      if (inetaddr == NULL)
+      if (!rakia_ip_address_is_valid (ip))
+        continue;
+
+      if (!rakia_ice_foundation_is_valid (
+              tp_asv_get_string (info, "foundation")))
         continue;
-      g_object_unref (inetaddr);
 
       g_ptr_array_add (accepted_candidates, candidate);
+
+      if (sip_candidates != NULL)
+        g_ptr_array_add (sip_candidates,
+            priv_sip_candidate_from_tp (component, ip, port, info));
     }
 
   if (accepted_candidates->len == 0)
@@ -378,9 +474,27 @@ rakia_call_stream_add_local_candidates (TpBaseMediaCallStream *stream,
       g_set_error (error, TP_ERROR, TP_ERROR_INVALID_ARGUMENT,
           "No valid candidate passed");
       g_ptr_array_unref (accepted_candidates);
+      if (trickled)
+        g_ptr_array_unref (sip_candidates);
       return NULL;
     }
 
+  /* With ICE, candidates found after the initial set are sent to
+   * the peer in a re-INVITE, instead of delaying the call setup */
+  if (trickled)
+    {
+      DEBUG ("%u trickled local candidates", sip_candidates->len);
+
+      /* The media takes ownership of the candidates */
+      g_ptr_array_set_free_func (sip_candidates, NULL);
+      for (i = 0; i < sip_candidates->len; i++)
+        rakia_sip_media_take_local_candidate (priv->media,
+            g_ptr_array_index (sip_candidates, i));
+      g_ptr_array_unref (sip_candidates);
+
+      rakia_sip_media_local_updated (priv->media);
+    }
+
   return accepted_candidates;
 }
 
@@ -390,34 +504,41 @@ rakia_call_stream_finish_initial_candidates (TpBaseMediaCallStream *stream,
 {
   RakiaCallStream *self = RAKIA_CALL_STREAM (stream);
   RakiaCallStreamPrivate *priv = self->priv;
-  GPtrArray *candidates = tp_base_media_call_stream_get_local_candidates (
-      stream);
+  GPtrArray *candidates = priv->pending_candidates;
   guint i;
 
-  for (i = 0; i < candidates->len; i++)
+  /* The candidates found before the restart are kept until a usable
+   * set replaces them */
+  if (priv->ice_restarting)
     {
-      GValueArray *candidate = g_ptr_array_index (candidates, i);
-      guint component;
-      gchar *ip;
-      guint port;
-      GHashTable *info;
-      const gchar *foundation;
-      guint priority;
-      gboolean valid;
-
-      tp_value_array_unpack (candidate, 4, &component, &ip, &port, &info);
-
-      foundation = tp_asv_get_string (info, "foundation");
-      if (!foundation)
-        foundation = "";
+      for (i = 0; i < candidates->len; i++)
+        if (((RakiaSipCandidate *)
+                g_ptr_array_index (candidates, i))->component == 1)
+          break;
+
+      if (i == candidates->len)
+        {
+          g_set_error (error, TP_ERROR, TP_ERROR_NOT_AVAILABLE,
+              "You need to set a candidate on component 1 first.");
+          return FALSE;
+        }
+
+      rakia_sip_media_reset_local_candidates (priv->media);
+    }
 
-      priority = tp_asv_get_uint32 (info, "priority", &valid);
-      if (!valid)
-        priority = 0;
+  if (priv->transport == TP_STREAM_TRANSPORT_TYPE_ICE)
+    rakia_sip_media_set_local_credentials (priv->media,
+        tp_base_media_call_stream_get_username (stream),
+        tp_base_media_call_stream_get_password (stream));
 
-      rakia_sip_media_take_local_candidate (priv->media,
-          rakia_sip_candidate_new (component, ip, port, foundation, priority));
-    }
+  /* The media takes ownership of the candidates */
+  g_ptr_array_set_free_func (candidates, NULL);
+  for (i = 0; i < candidates->len; i++)
+    rakia_sip_media_take_local_candidate (priv->media,
+        g_ptr_array_index (candidates, i));
+  g_ptr_array_set_size (candidates, 0);
+  g_ptr_array_set_free_func (candidates,
+      (GDestroyNotify) rakia_sip_candidate_free);
 
   if (!rakia_sip_media_local_candidates_prepared (priv->media))
     {
@@ -426,6 +547,20 @@ rakia_call_stream_finish_initial_candidates (TpBaseMediaCallStream *stream,
       return FALSE;
     }
 
+  priv->initial_candidates_finished = TRUE;
+
+  if (priv->ice_restarting)
+    {
+      DEBUG ("ICE restarted, offering the new local candidates");
+
+      priv->ice_restarting = FALSE;
+      rakia_sip_media_end_ice_restart (priv->media);
+
+      /* Offered in a re-INVITE, even if the session has given up
+       * waiting for them */
+      rakia_sip_media_local_updated (priv->media);
+    }
+
   return TRUE;
 }
 
@@ -513,6 +648,21 @@ rakia_call_stream_set_sending (TpBaseMediaCallStream *stream,
   return TRUE;
 }
 
+static void
+media_ice_restart_requested_cb (RakiaSipMedia *media, RakiaCallStream *self)
+{
+  RakiaCallStreamPrivate *priv = self->priv;
+
+  DEBUG ("asking the streaming implementation to restart ICE");
+
+  /* Candidates are held back until the new set is finished */
+  priv->ice_restarting = TRUE;
+  priv->initial_candidates_finished = FALSE;
+  g_ptr_array_set_size (priv->pending_candidates, 0);
+
+  tp_svc_call1_stream_interface_media_emit_ice_restart_requested (self);
+}
+
 static void
 media_remote_candidates_updated_cb (RakiaSipMedia *media, RakiaCallStream *self)
 {
@@ -520,6 +670,7 @@ media_remote_candidates_updated_cb (RakiaSipMedia *media, RakiaCallStream *self)
   TpBaseCallStream *bcs = TP_BASE_CALL_STREAM (self);
   TpBaseMediaCallStream *bmcs = TP_BASE_MEDIA_CALL_STREAM (self);
   GPtrArray *candidates = rakia_sip_media_get_remote_candidates (media);
+  GPtrArray *ice_candidates = NULL;
   TpDBusDaemon *bus = tp_base_connection_get_dbus_daemon (
       tp_base_call_stream_get_connection (bcs));
   gchar *object_path;
@@ -534,13 +685,40 @@ media_remote_candidates_updated_cb (RakiaSipMedia *media, RakiaCallStream *self)
   if (candidates == NULL)
     return;
 
+  /* Use the full candidate list if both sides do ICE */
+  if (priv->transport == TP_STREAM_TRANSPORT_TYPE_ICE)
+    {
+      ice_candidates = rakia_sip_media_get_remote_ice_candidates (media);
+
+      /* A peer without ICE only has the address of its c= line; send it
+       * media there, and stop offering ICE to it (RFC 5245, 5.1) */
+      if (ice_candidates == NULL)
+        {
+          DEBUG ("the remote media has no ICE, falling back to raw UDP");
+          priv->transport = TP_STREAM_TRANSPORT_TYPE_RAW_UDP;
+          rakia_sip_media_set_local_credentials (media, NULL, NULL);
+        }
+    }
+  if (ice_candidates != NULL)
+    candidates = ice_candidates;
+
   object_path = g_strdup_printf ("%s/Endpoint%u",
       tp_base_call_stream_get_object_path (bcs),
       ++priv->last_endpoint_no);
   priv->endpoint = tp_call_stream_endpoint_new (bus, object_path,
-      TP_STREAM_TRANSPORT_TYPE_RAW_UDP, FALSE);
+      priv->transport, FALSE);
   g_free (object_path);
 
+  if (ice_candidates != NULL)
+    {
+      const gchar *ufrag;
+      const gchar *pwd;
+
+      rakia_sip_media_get_remote_credentials (media, &ufrag, &pwd);
+      tp_call_stream_endpoint_set_remote_credentials (priv->endpoint,
+          ufrag, pwd);
+    }
+
   for (i = 0; i < candidates->len; i++)
     {
       RakiaSipCandidate *candidate = g_ptr_array_index (candidates, i);
@@ -549,6 +727,16 @@ media_remote_candidates_updated_cb (RakiaSipMedia *media, RakiaCallStream *self)
           "protocol", G_TYPE_UINT, TP_MEDIA_STREAM_BASE_PROTO_UDP,
           NULL);
 
+      if (candidate->foundation != NULL)
+        tp_asv_set_string (info, "foundation", candidate->foundation);
+      if (candidate->type != TP_CALL_STREAM_CANDIDATE_TYPE_NONE)
+        tp_asv_set_uint32 (info, "type", candidate->type);
+      if (candidate->base_ip != NULL)
+        {
+          tp_asv_set_string (info, "base-ip", candidate->base_ip);
+          tp_asv_set_uint32 (info, "base-port", candidate->base_port);
+        }
+
       tp_call_stream_endpoint_add_new_candidate (priv->endpoint,
           candidate->component, candidate->ip, candidate->port, info);
       g_hash_table_unref (info);
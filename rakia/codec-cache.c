@@ -0,0 +1,304 @@
+/*
+ * codec-cache.c - Per-peer cache of the last agreed codec set
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This work is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This work is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this work; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "config.h"
+
+#include "rakia/codec-cache.h"
+
+#define DEBUG_FLAG RAKIA_DEBUG_MEDIA
+#include "rakia/debug.h"
+
+/* Upper bound on the number of remembered (peer, media type) pairs;
+ * when reached, an arbitrary entry is evicted */
+#define RAKIA_CODEC_CACHE_MAX_ENTRIES 256
+
+struct _RakiaCodecCache
+{
+  gint ref_count;
+
+  /* "handle:media-type" -> GPtrArray of owned (RakiaSipCodec *) */
+  GHashTable *entries;
+};
+
+static gchar *
+priv_make_key (TpHandle peer, TpMediaStreamType media_type)
+{
+  return g_strdup_printf ("%u:%u", peer, (guint) media_type);
+}
+
+static RakiaSipCodec *
+priv_codec_copy (const RakiaSipCodec *codec, guint id)
+{
+  RakiaSipCodec *copy;
+  guint i;
+
+  copy = rakia_sip_codec_new (id, codec->encoding_name, codec->clock_rate,
+      codec->channels);
+
+  if (codec->params != NULL)
+    for (i = 0; i < codec->params->len; i++)
+      {
+        RakiaSipCodecParam *param = g_ptr_array_index (codec->params, i);
+
+        rakia_sip_codec_add_param (copy, param->name, param->value);
+      }
+
+  return copy;
+}
+
+/* Codecs are the same for the purposes of the cache if the encoding,
+ * clock rate and channel count match; payload types are dynamic and
+ * differ between calls. An absent channel count means a single channel. */
+static gboolean
+priv_codec_matches (const RakiaSipCodec *a, const RakiaSipCodec *b)
+{
+  return g_ascii_strcasecmp (a->encoding_name, b->encoding_name) == 0 &&
+      a->clock_rate == b->clock_rate &&
+      MAX (a->channels, 1) == MAX (b->channels, 1);
+}
+
+static const RakiaSipCodec *
+priv_find_codec (const GPtrArray *codecs, const RakiaSipCodec *codec)
+{
+  guint i;
+
+  for (i = 0; i < codecs->len; i++)
+    {
+      const RakiaSipCodec *candidate = g_ptr_array_index (codecs, i);
+
+      if (priv_codec_matches (candidate, codec))
+        return candidate;
+    }
+
+  return NULL;
+}
+
+RakiaCodecCache *
+rakia_codec_cache_new (void)
+{
+  RakiaCodecCache *cache = g_slice_new (RakiaCodecCache);
+
+  cache->ref_count = 1;
+  cache->entries = g_hash_table_new_full (g_str_hash, g_str_equal,
+      g_free, (GDestroyNotify) g_ptr_array_unref);
+
+  return cache;
+}
+
+RakiaCodecCache *
+rakia_codec_cache_ref (RakiaCodecCache *cache)
+{
+  g_return_val_if_fail (cache != NULL, NULL);
+
+  g_atomic_int_inc (&cache->ref_count);
+
+  return cache;
+}
+
+void
+rakia_codec_cache_unref (RakiaCodecCache *cache)
+{
+  g_return_if_fail (cache != NULL);
+
+  if (g_atomic_int_dec_and_test (&cache->ref_count))
+    {
+      g_hash_table_unref (cache->entries);
+      g_slice_free (RakiaCodecCache, cache);
+    }
+}
+
+/**
+ * rakia_codec_cache_store:
+ *
+ * Remembers @codecs as the set last agreed with @peer for @media_type,
+ * replacing any previous entry. An empty set forgets the peer.
+ */
+void
+rakia_codec_cache_store (RakiaCodecCache *cache,
+    TpHandle peer,
+    TpMediaStreamType media_type,
+    const GPtrArray *codecs)
+{
+  GPtrArray *copy;
+  guint i;
+
+  g_return_if_fail (cache != NULL);
+
+  if (codecs == NULL || codecs->len == 0)
+    {
+      gchar *key = priv_make_key (peer, media_type);
+
+      g_hash_table_remove (cache->entries, key);
+      g_free (key);
+      return;
+    }
+
+  if (g_hash_table_size (cache->entries) >= RAKIA_CODEC_CACHE_MAX_ENTRIES)
+    {
+      GHashTableIter iter;
+
+      g_hash_table_iter_init (&iter, cache->entries);
+      if (g_hash_table_iter_next (&iter, NULL, NULL))
+        g_hash_table_iter_remove (&iter);
+    }
+
+  copy = rakia_sip_codec_list_new (codecs->len);
+
+  for (i = 0; i < codecs->len; i++)
+    {
+      const RakiaSipCodec *codec = g_ptr_array_index (codecs, i);
+
+      g_ptr_array_add (copy, priv_codec_copy (codec, codec->id));
+    }
+
+  DEBUG ("remembering %u codecs for peer %u, media type %u",
+      copy->len, peer, media_type);
+
+  g_hash_table_replace (cache->entries, priv_make_key (peer, media_type),
+      copy);
+}
+
+const GPtrArray *
+rakia_codec_cache_lookup (RakiaCodecCache *cache,
+    TpHandle peer,
+    TpMediaStreamType media_type)
+{
+  const GPtrArray *codecs;
+  gchar *key;
+
+  g_return_val_if_fail (cache != NULL, NULL);
+
+  key = priv_make_key (peer, media_type);
+  codecs = g_hash_table_lookup (cache->entries, key);
+  g_free (key);
+
+  return codecs;
+}
+
+/**
+ * rakia_codec_cache_filter_offer:
+ *
+ * Orders and trims @local_codecs for an initial offer to @peer: the
+ * codecs agreed last time come first, in the agreed order, followed by
+ * telephone-event if it was not agreed. Everything else is dropped.
+ *
+ * Returns: a new array of codecs, or %NULL if nothing is cached for the
+ * peer or none of the cached codecs is available locally, in which case
+ * the full local list should be offered.
+ */
+GPtrArray *
+rakia_codec_cache_filter_offer (RakiaCodecCache *cache,
+    TpHandle peer,
+    TpMediaStreamType media_type,
+    const GPtrArray *local_codecs)
+{
+  const GPtrArray *cached;
+  GPtrArray *filtered;
+  gboolean have_match = FALSE;
+  guint i;
+
+  cached = rakia_codec_cache_lookup (cache, peer, media_type);
+  if (cached == NULL)
+    return NULL;
+
+  filtered = rakia_sip_codec_list_new (cached->len + 1);
+
+  for (i = 0; i < cached->len; i++)
+    {
+      const RakiaSipCodec *local;
+
+      local = priv_find_codec (local_codecs, g_ptr_array_index (cached, i));
+      if (local == NULL)
+        continue;
+
+      g_ptr_array_add (filtered, priv_codec_copy (local, local->id));
+
+      if (g_ascii_strcasecmp (local->encoding_name, "telephone-event") != 0)
+        have_match = TRUE;
+    }
+
+  if (!have_match)
+    {
+      g_ptr_array_unref (filtered);
+      return NULL;
+    }
+
+  for (i = 0; i < local_codecs->len; i++)
+    {
+      const RakiaSipCodec *local = g_ptr_array_index (local_codecs, i);
+
+      if (g_ascii_strcasecmp (local->encoding_name, "telephone-event") == 0
+          && priv_find_codec (filtered, local) == NULL)
+        g_ptr_array_add (filtered, priv_codec_copy (local, local->id));
+    }
+
+  DEBUG ("offering %u of %u local codecs to peer %u",
+      filtered->len, local_codecs->len, peer);
+
+  return filtered;
+}
+
+/**
+ * rakia_codec_cache_answer:
+ *
+ * Checks whether @remote_codecs, offered by @peer, contain every codec
+ * agreed with that peer last time.
+ *
+ * Returns: a new array with the cached codecs as they are in the offer,
+ * with its payload types and fmtp parameters, suitable as the local
+ * codecs for the answer; or %NULL if the offer does not cover the cached
+ * set.
+ */
+GPtrArray *
+rakia_codec_cache_answer (RakiaCodecCache *cache,
+    TpHandle peer,
+    TpMediaStreamType media_type,
+    const GPtrArray *remote_codecs)
+{
+  const GPtrArray *cached;
+  GPtrArray *answer;
+  guint i;
+
+  cached = rakia_codec_cache_lookup (cache, peer, media_type);
+  if (cached == NULL)
+    return NULL;
+
+  answer = rakia_sip_codec_list_new (cached->len);
+
+  for (i = 0; i < cached->len; i++)
+    {
+      const RakiaSipCodec *codec = g_ptr_array_index (cached, i);
+      const RakiaSipCodec *remote;
+
+      remote = priv_find_codec (remote_codecs, codec);
+      if (remote == NULL)
+        {
+          DEBUG ("offer from peer %u lacks cached codec %s/%u",
+              peer, codec->encoding_name, codec->clock_rate);
+          g_ptr_array_unref (answer);
+          return NULL;
+        }
+
+      /* The fmtp parameters are the ones of this offer: the peer may
+       * have changed them since the codec was agreed */
+      g_ptr_array_add (answer, priv_codec_copy (remote, remote->id));
+    }
+
+  return answer;
+}
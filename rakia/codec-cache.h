@@ -0,0 +1,58 @@
+/*
+ * codec-cache.h - Header for the per-peer agreed codec cache
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This work is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This work is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this work; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef __RAKIA_CODEC_CACHE_H__
+#define __RAKIA_CODEC_CACHE_H__
+
+#include <glib.h>
+
+#include <telepathy-glib/telepathy-glib.h>
+
+#include "rakia/sip-media.h"
+
+G_BEGIN_DECLS
+
+typedef struct _RakiaCodecCache RakiaCodecCache;
+
+RakiaCodecCache *rakia_codec_cache_new (void);
+RakiaCodecCache *rakia_codec_cache_ref (RakiaCodecCache *cache);
+void rakia_codec_cache_unref (RakiaCodecCache *cache);
+
+void rakia_codec_cache_store (RakiaCodecCache *cache,
+    TpHandle peer,
+    TpMediaStreamType media_type,
+    const GPtrArray *codecs);
+
+const GPtrArray *rakia_codec_cache_lookup (RakiaCodecCache *cache,
+    TpHandle peer,
+    TpMediaStreamType media_type);
+
+GPtrArray *rakia_codec_cache_filter_offer (RakiaCodecCache *cache,
+    TpHandle peer,
+    TpMediaStreamType media_type,
+    const GPtrArray *local_codecs);
+
+GPtrArray *rakia_codec_cache_answer (RakiaCodecCache *cache,
+    TpHandle peer,
+    TpMediaStreamType media_type,
+    const GPtrArray *remote_codecs);
+
+G_END_DECLS
+
+#endif /* #ifndef __RAKIA_CODEC_CACHE_H__ */
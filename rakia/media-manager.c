@@ -29,10 +29,12 @@
 
 #include "rakia/base-connection.h"
 #include "rakia/call-channel.h"
+#include "rakia/codec-cache.h"
 #include "rakia/handles.h"
 #include "rakia/sip-session.h"
 
 #include <sofia-sip/sip_status.h>
+#include <sofia-sip/sip_tag.h>
 
 
 #define DEBUG_FLAG RAKIA_DEBUG_CONNECTION
@@ -45,6 +47,14 @@ static void rakia_media_manager_close_all (RakiaMediaManager *fac);
 
 static RakiaSipSession * new_session (RakiaMediaManager *fac, nua_handle_t *nh,
     TpHandle handle);
+static void priv_stop_lag_probe (RakiaMediaManager *fac);
+
+/* Interval of the main loop lag probe, in milliseconds */
+#define RAKIA_LAG_PROBE_INTERVAL 100
+
+/* Retry-After values in 503 responses to shed INVITEs, in seconds */
+#define RAKIA_RATE_RETRY_AFTER "1"
+#define RAKIA_LAG_RETRY_AFTER "5"
 
 G_DEFINE_TYPE_WITH_CODE (RakiaMediaManager, rakia_media_manager,
     G_TYPE_OBJECT,
@@ -56,6 +66,9 @@ enum
   PROP_CONNECTION = 1,
   PROP_STUN_SERVER,
   PROP_STUN_PORT,
+  PROP_CALLS_ADMITTED,
+  PROP_CALLS_SHED,
+  PROP_MAIN_LOOP_LAG,
   LAST_PROPERTY
 };
 
@@ -65,6 +78,9 @@ struct _RakiaMediaManagerPrivate
   TpBaseConnection *conn;
   /* array of referenced (RakiaCallChannel *) */
   GPtrArray *channels;
+  /* TpHandle => GPtrArray of borrowed (RakiaCallChannel *), the open
+   * channels with that peer, in creation order */
+  GHashTable *channels_by_peer;
   /* for unique channel object paths, currently always increments */
   guint channel_index;
 
@@ -74,6 +90,24 @@ struct _RakiaMediaManagerPrivate
   gchar *stun_server;
   guint16 stun_port;
 
+  /* codecs last agreed with each peer, shared with the channels */
+  RakiaCodecCache *codec_cache;
+
+  /* admission control for incoming calls */
+  guint pending_invites;     /* sessions waiting to become channels */
+  gint64 rate_window_start;  /* monotonic time, usec */
+  guint rate_window_count;
+  guint lag_probe_id;
+  gint64 lag_probe_due;      /* when the probe should fire, usec */
+  guint main_loop_lag;       /* smoothed lag, msec */
+  guint calls_admitted;
+  guint calls_shed;
+
+  /* call setup latency, aggregated when channels close */
+  guint setup_histograms[NUM_RAKIA_SIP_SESSION_MILESTONES]
+      [RAKIA_SETUP_HISTOGRAM_BUCKETS];
+  guint calls_measured;
+
   gboolean dispose_has_run;
 };
 
@@ -97,7 +131,10 @@ rakia_media_manager_init (RakiaMediaManager *fac)
 
   priv->conn = NULL;
   priv->channels = g_ptr_array_new_with_free_func (close_channel_and_unref);
+  priv->channels_by_peer = g_hash_table_new_full (NULL, NULL, NULL,
+      (GDestroyNotify) g_ptr_array_unref);
   priv->channel_index = 0;
+  priv->codec_cache = rakia_codec_cache_new ();
   priv->dispose_has_run = FALSE;
 }
 
@@ -115,6 +152,8 @@ rakia_media_manager_dispose (GObject *object)
   rakia_media_manager_close_all (fac);
   g_assert (priv->channels == NULL);
 
+  priv_stop_lag_probe (fac);
+
   if (G_OBJECT_CLASS (rakia_media_manager_parent_class)->dispose)
     G_OBJECT_CLASS (rakia_media_manager_parent_class)->dispose (object);
 }
@@ -126,6 +165,8 @@ rakia_media_manager_finalize (GObject *object)
   RakiaMediaManagerPrivate *priv = RAKIA_MEDIA_MANAGER_GET_PRIVATE (fac);
 
   g_free (priv->stun_server);
+  rakia_codec_cache_unref (priv->codec_cache);
+  g_hash_table_unref (priv->channels_by_peer);
 }
 
 static void
@@ -147,6 +188,15 @@ rakia_media_manager_get_property (GObject *object,
     case PROP_STUN_PORT:
       g_value_set_uint (value, priv->stun_port);
       break;
+    case PROP_CALLS_ADMITTED:
+      g_value_set_uint (value, priv->calls_admitted);
+      break;
+    case PROP_CALLS_SHED:
+      g_value_set_uint (value, priv->calls_shed);
+      break;
+    case PROP_MAIN_LOOP_LAG:
+      g_value_set_uint (value, priv->main_loop_lag);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
       break;
@@ -212,6 +262,26 @@ rakia_media_manager_class_init (RakiaMediaManagerClass *klass)
       RAKIA_DEFAULT_STUN_PORT,
       G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS);
   g_object_class_install_property (object_class, PROP_STUN_PORT, param_spec);
+
+  param_spec = g_param_spec_uint ("calls-admitted", "Calls admitted",
+      "Number of incoming INVITEs that passed admission control",
+      0, G_MAXUINT, 0,
+      G_PARAM_READABLE | G_PARAM_STATIC_STRINGS);
+  g_object_class_install_property (object_class, PROP_CALLS_ADMITTED,
+      param_spec);
+
+  param_spec = g_param_spec_uint ("calls-shed", "Calls shed",
+      "Number of incoming INVITEs refused by admission control",
+      0, G_MAXUINT, 0,
+      G_PARAM_READABLE | G_PARAM_STATIC_STRINGS);
+  g_object_class_install_property (object_class, PROP_CALLS_SHED, param_spec);
+
+  param_spec = g_param_spec_uint ("main-loop-lag", "Main loop lag",
+      "Smoothed main loop dispatch lag in milliseconds, if monitored",
+      0, G_MAXUINT, 0,
+      G_PARAM_READABLE | G_PARAM_STATIC_STRINGS);
+  g_object_class_install_property (object_class, PROP_MAIN_LOOP_LAG,
+      param_spec);
 }
 
 static void
@@ -230,6 +300,8 @@ rakia_media_manager_close_all (RakiaMediaManager *fac)
     {
       GPtrArray *channels;
 
+      g_hash_table_remove_all (priv->channels_by_peer);
+
       channels = priv->channels;
       priv->channels = NULL;
 
@@ -237,6 +309,98 @@ rakia_media_manager_close_all (RakiaMediaManager *fac)
     }
 }
 
+static void
+priv_index_channel (RakiaMediaManager *fac, RakiaCallChannel *chan)
+{
+  RakiaMediaManagerPrivate *priv = RAKIA_MEDIA_MANAGER_GET_PRIVATE (fac);
+  TpHandle peer = tp_base_channel_get_target_handle (TP_BASE_CHANNEL (chan));
+  GPtrArray *peer_channels;
+
+  if (peer == 0)
+    return;
+
+  peer_channels = g_hash_table_lookup (priv->channels_by_peer,
+      GUINT_TO_POINTER (peer));
+
+  if (peer_channels == NULL)
+    {
+      peer_channels = g_ptr_array_new ();
+      g_hash_table_insert (priv->channels_by_peer, GUINT_TO_POINTER (peer),
+          peer_channels);
+    }
+
+  g_ptr_array_add (peer_channels, chan);
+}
+
+static void
+priv_unindex_channel (RakiaMediaManager *fac, RakiaCallChannel *chan)
+{
+  RakiaMediaManagerPrivate *priv = RAKIA_MEDIA_MANAGER_GET_PRIVATE (fac);
+  TpHandle peer = tp_base_channel_get_target_handle (TP_BASE_CHANNEL (chan));
+  GPtrArray *peer_channels;
+
+  peer_channels = g_hash_table_lookup (priv->channels_by_peer,
+      GUINT_TO_POINTER (peer));
+
+  if (peer_channels == NULL)
+    return;
+
+  /* Not remove_fast, to keep the oldest channel first */
+  g_ptr_array_remove (peer_channels, chan);
+
+  if (peer_channels->len == 0)
+    g_hash_table_remove (priv->channels_by_peer, GUINT_TO_POINTER (peer));
+}
+
+/*
+ * priv_get_peer_channels:
+ *
+ * Returns: the open call channels with @peer, oldest first,
+ * or %NULL if there are none
+ */
+static GPtrArray *
+priv_get_peer_channels (RakiaMediaManager *fac, TpHandle peer)
+{
+  RakiaMediaManagerPrivate *priv = RAKIA_MEDIA_MANAGER_GET_PRIVATE (fac);
+
+  return g_hash_table_lookup (priv->channels_by_peer,
+      GUINT_TO_POINTER (peer));
+}
+
+static guint
+priv_setup_histogram_bucket (gint64 usec)
+{
+  guint64 msec = usec / 1000;
+
+  if (msec == 0)
+    return 0;
+
+  return MIN (g_bit_storage (msec), RAKIA_SETUP_HISTOGRAM_BUCKETS - 1);
+}
+
+static void
+priv_record_setup_timeline (RakiaMediaManager *fac, RakiaCallChannel *chan)
+{
+  RakiaMediaManagerPrivate *priv = RAKIA_MEDIA_MANAGER_GET_PRIVATE (fac);
+  RakiaSipSession *session = NULL;
+  guint i;
+
+  g_object_get (chan, "sip-session", &session, NULL);
+  if (session == NULL)
+    return;
+
+  for (i = 0; i < NUM_RAKIA_SIP_SESSION_MILESTONES; i++)
+    {
+      gint64 usec = rakia_sip_session_get_milestone (session, i);
+
+      if (usec >= 0)
+        priv->setup_histograms[i][priv_setup_histogram_bucket (usec)]++;
+    }
+
+  priv->calls_measured++;
+  g_object_unref (session);
+}
+
 /**
  * media_channel_closed_cb:
  * Signal callback for when a media channel is closed. Removes the references
@@ -251,8 +415,11 @@ call_channel_closed_cb (RakiaCallChannel *chan, gpointer user_data)
   tp_channel_manager_emit_channel_closed_for_object (fac,
       TP_EXPORTABLE_CHANNEL (chan));
 
+  priv_record_setup_timeline (fac, chan);
+
   if (priv->channels)
     {
+      priv_unindex_channel (fac, chan);
       g_ptr_array_remove_fast (priv->channels, chan);
     }
 }
@@ -275,6 +442,7 @@ new_call_channel (RakiaMediaManager *fac,
   gboolean initial_audio = FALSE;
   gboolean initial_video = FALSE;
   gboolean immutable_streams = FALSE;
+  gboolean ice = FALSE;
   const gchar *dtmf_initial_tones = NULL;
   const gchar *initial_audio_name = NULL;
   const gchar *initial_video_name = NULL;
@@ -303,6 +471,7 @@ new_call_channel (RakiaMediaManager *fac,
 
   g_object_get (priv->conn,
       "immutable-streams", &immutable_streams,
+      "ice", &ice,
       NULL);
 
   chan = g_object_new (RAKIA_TYPE_CALL_CHANNEL,
@@ -314,13 +483,16 @@ new_call_channel (RakiaMediaManager *fac,
                        "initial-video", initial_video,
                        "initial-audio-name", initial_audio_name,
                        "initial-video-name", initial_video_name,
-                       "initial-transport", TP_STREAM_TRANSPORT_TYPE_RAW_UDP,
+                       "initial-transport", ice ?
+                       TP_STREAM_TRANSPORT_TYPE_ICE :
+                       TP_STREAM_TRANSPORT_TYPE_RAW_UDP,
                        "mutable-contents", !immutable_streams,
                        "initial-tones", dtmf_initial_tones,
                        "sip-session", session,
                        "stun-server", priv->stun_server ? priv->stun_server :
                        "",
                        "stun-port", priv->stun_port,
+                       "codec-cache", priv->codec_cache,
                        "requested", (initiator == self_handle),
                        NULL);
 
@@ -330,6 +502,7 @@ new_call_channel (RakiaMediaManager *fac,
   g_signal_connect (chan, "closed", G_CALLBACK (call_channel_closed_cb), fac);
 
   g_ptr_array_add (priv->channels, chan);
+  priv_index_channel (fac, chan);
 
   tp_base_channel_register (TP_BASE_CHANNEL (chan));
 
@@ -346,9 +519,13 @@ new_session (RakiaMediaManager *fac,
   RakiaSipSession *session;
   gboolean outgoing = (nh == NULL);
   gboolean immutable_streams = FALSE;
+  gboolean fast_start = FALSE;
+  gboolean rtcp_mux = FALSE;
 
   g_object_get (priv->conn,
       "immutable-streams", &immutable_streams,
+      "fast-start", &fast_start,
+      "rtcp-mux", &rtcp_mux,
       NULL);
 
   if (outgoing)
@@ -358,7 +535,7 @@ new_session (RakiaMediaManager *fac,
     }
 
   session = rakia_sip_session_new (nh, RAKIA_BASE_CONNECTION (priv->conn),
-      !outgoing, immutable_streams);
+      !outgoing, immutable_streams, fast_start, rtcp_mux);
 
   if (outgoing)
     {
@@ -374,14 +551,44 @@ struct InviteData {
   TpHandle handle;
 };
 
+static void incoming_call_cb (RakiaSipSession *session,
+    struct InviteData *idata);
+
+static void
+priv_invite_data_done (RakiaSipSession *session, struct InviteData *idata)
+{
+  RakiaMediaManagerPrivate *priv =
+      RAKIA_MEDIA_MANAGER_GET_PRIVATE (idata->fac);
+
+  g_signal_handlers_disconnect_matched (session, G_SIGNAL_MATCH_DATA,
+      0, 0, NULL, NULL, idata);
+
+  g_assert (priv->pending_invites > 0);
+  priv->pending_invites--;
+}
+
+static void
+incoming_call_ended_cb (RakiaSipSession *session,
+    gboolean self_actor,
+    guint status,
+    const gchar *message,
+    struct InviteData *idata)
+{
+  DEBUG ("incoming session ended before the call was set up");
+
+  priv_invite_data_done (session, idata);
+
+  g_object_unref (session);
+  g_slice_free (struct InviteData, idata);
+}
+
 static void
 incoming_call_cb (RakiaSipSession *session,
     struct InviteData *idata)
 {
   RakiaCallChannel *channel;
 
-  g_signal_handlers_disconnect_by_func (session,
-      G_CALLBACK (incoming_call_cb), idata);
+  priv_invite_data_done (session, idata);
 
   channel = new_call_channel (idata->fac, idata->handle, idata->handle, NULL,
       session);
@@ -394,6 +601,125 @@ incoming_call_cb (RakiaSipSession *session,
 }
 
 
+static gboolean
+priv_lag_probe_cb (gpointer user_data)
+{
+  RakiaMediaManager *fac = RAKIA_MEDIA_MANAGER (user_data);
+  RakiaMediaManagerPrivate *priv = RAKIA_MEDIA_MANAGER_GET_PRIVATE (fac);
+  gint64 now = g_get_monotonic_time ();
+  guint sample = 0;
+
+  if (now > priv->lag_probe_due)
+    sample = (now - priv->lag_probe_due) / 1000;
+
+  /* Smooth out one-off hiccups, but react within a few probes */
+  priv->main_loop_lag = (priv->main_loop_lag * 3 + sample) / 4;
+
+  priv->lag_probe_due = now + RAKIA_LAG_PROBE_INTERVAL * 1000;
+
+  return TRUE;
+}
+
+static void
+priv_start_lag_probe (RakiaMediaManager *fac)
+{
+  RakiaMediaManagerPrivate *priv = RAKIA_MEDIA_MANAGER_GET_PRIVATE (fac);
+
+  if (priv->lag_probe_id != 0)
+    return;
+
+  priv->main_loop_lag = 0;
+  priv->lag_probe_due = g_get_monotonic_time ()
+      + RAKIA_LAG_PROBE_INTERVAL * 1000;
+  priv->lag_probe_id = g_timeout_add (RAKIA_LAG_PROBE_INTERVAL,
+      priv_lag_probe_cb, fac);
+}
+
+static void
+priv_stop_lag_probe (RakiaMediaManager *fac)
+{
+  RakiaMediaManagerPrivate *priv = RAKIA_MEDIA_MANAGER_GET_PRIVATE (fac);
+
+  if (priv->lag_probe_id != 0)
+    {
+      g_source_remove (priv->lag_probe_id);
+      priv->lag_probe_id = 0;
+    }
+}
+
+/*
+ * priv_admit_invite:
+ *
+ * Applies the admission limits set on the connection to an incoming
+ * INVITE. If the call cannot be taken, responds to it and returns FALSE.
+ */
+static gboolean
+priv_admit_invite (RakiaMediaManager *fac, nua_handle_t *nh)
+{
+  RakiaMediaManagerPrivate *priv = RAKIA_MEDIA_MANAGER_GET_PRIVATE (fac);
+  guint max_calls = 0;
+  guint max_call_rate = 0;
+  guint max_main_loop_lag = 0;
+  gint64 now;
+
+  g_object_get (priv->conn,
+      "max-calls", &max_calls,
+      "max-call-rate", &max_call_rate,
+      "max-main-loop-lag", &max_main_loop_lag,
+      NULL);
+
+  if (max_calls != 0 &&
+      priv->channels->len + priv->pending_invites >= max_calls)
+    {
+      MESSAGE ("refusing incoming call: %u calls in progress",
+          priv->channels->len + priv->pending_invites);
+      nua_respond (nh, SIP_486_BUSY_HERE, TAG_END());
+      goto shed;
+    }
+
+  if (max_main_loop_lag != 0 && priv->main_loop_lag > max_main_loop_lag)
+    {
+      MESSAGE ("refusing incoming call: main loop lags by %u ms",
+          priv->main_loop_lag);
+      nua_respond (nh, SIP_503_SERVICE_UNAVAILABLE,
+          SIPTAG_RETRY_AFTER_STR (RAKIA_LAG_RETRY_AFTER),
+          TAG_END());
+      goto shed;
+    }
+
+  if (max_call_rate != 0)
+    {
+      now = g_get_monotonic_time ();
+
+      if (now - priv->rate_window_start >= G_USEC_PER_SEC)
+        {
+          priv->rate_window_start = now;
+          priv->rate_window_count = 0;
+        }
+
+      if (priv->rate_window_count >= max_call_rate)
+        {
+          MESSAGE ("refusing incoming call: more than %u calls per second",
+              max_call_rate);
+          nua_respond (nh, SIP_503_SERVICE_UNAVAILABLE,
+              SIPTAG_RETRY_AFTER_STR (RAKIA_RATE_RETRY_AFTER),
+              TAG_END());
+          goto shed;
+        }
+
+      priv->rate_window_count++;
+    }
+
+  priv->calls_admitted++;
+  return TRUE;
+
+shed:
+  priv->calls_shed++;
+  DEBUG ("%u incoming calls admitted, %u shed",
+      priv->calls_admitted, priv->calls_shed);
+  return FALSE;
+}
+
 static gboolean
 rakia_nua_i_invite_cb (TpBaseConnection    *conn,
                        const RakiaNuaEvent *ev,
@@ -406,6 +732,11 @@ rakia_nua_i_invite_cb (TpBaseConnection    *conn,
 
   /* figure out a handle for the identity */
 
+  /* Check the limits first, so that an overload costs us as little
+   * as possible */
+  if (!priv_admit_invite (fac, ev->nua_handle))
+    return TRUE;
+
   handle = rakia_handle_by_requestor (conn, ev->sip);
   if (!handle)
     {
@@ -433,8 +764,12 @@ rakia_nua_i_invite_cb (TpBaseConnection    *conn,
   idata->fac = fac;
   idata->handle = handle;
 
+  RAKIA_MEDIA_MANAGER_GET_PRIVATE (fac)->pending_invites++;
+
   g_signal_connect (session, "incoming-call",
       G_CALLBACK (incoming_call_cb), idata);
+  g_signal_connect (session, "ended",
+      G_CALLBACK (incoming_call_ended_cb), idata);
 
   return TRUE;
 }
@@ -446,6 +781,7 @@ connection_status_changed_cb (RakiaBaseConnection *conn,
                               RakiaMediaManager *self)
 {
   RakiaMediaManagerPrivate *priv = RAKIA_MEDIA_MANAGER_GET_PRIVATE (self);
+  guint max_main_loop_lag = 0;
 
   switch (status)
     {
@@ -455,10 +791,15 @@ connection_status_changed_cb (RakiaBaseConnection *conn,
           "nua-event::nua_i_invite",
           G_CALLBACK (rakia_nua_i_invite_cb), self);
 
+      g_object_get (conn, "max-main-loop-lag", &max_main_loop_lag, NULL);
+      if (max_main_loop_lag != 0)
+        priv_start_lag_probe (self);
+
       break;
     case TP_CONNECTION_STATUS_DISCONNECTED:
 
       rakia_media_manager_close_all (self);
+      priv_stop_lag_probe (self);
 
       if (priv->invite_received_id != 0)
         {
@@ -650,20 +991,14 @@ rakia_media_manager_requestotron (TpChannelManager *manager,
 
   if (method == METHOD_ENSURE)
     {
-      guint i;
-      TpHandle peer = 0;
+      GPtrArray *peer_channels = priv_get_peer_channels (self, handle);
 
-      for (i = 0; i < priv->channels->len; i++)
+      if (peer_channels != NULL)
         {
-          channel = g_ptr_array_index (priv->channels, i);
-          g_object_get (channel, "peer", &peer, NULL);
-
-          if (peer == handle)
-            {
-              tp_channel_manager_emit_request_already_satisfied (self,
-                  request_token, TP_EXPORTABLE_CHANNEL (channel));
-              return TRUE;
-            }
+          channel = g_ptr_array_index (peer_channels, 0);
+          tp_channel_manager_emit_request_already_satisfied (self,
+              request_token, TP_EXPORTABLE_CHANNEL (channel));
+          return TRUE;
         }
     }
 
@@ -726,3 +1061,117 @@ channel_manager_iface_init (gpointer g_iface,
   iface->create_channel = rakia_media_manager_create_channel;
   iface->ensure_channel = rakia_media_manager_ensure_channel;
 }
+
+/**
+ * rakia_media_manager_dup_setup_histograms:
+ *
+ * Returns: a new map of the names of the call setup milestones to the
+ * histograms of the time it took to reach them, aggregated over the
+ * channels closed so far; milestones that no call has reached are
+ * omitted. See %RAKIA_SETUP_HISTOGRAM_BUCKETS for the bucket layout.
+ */
+GHashTable *
+rakia_media_manager_dup_setup_histograms (RakiaMediaManager *self)
+{
+  RakiaMediaManagerPrivate *priv = RAKIA_MEDIA_MANAGER_GET_PRIVATE (self);
+  GHashTable *histograms;
+  guint i;
+
+  histograms = g_hash_table_new_full (g_str_hash, g_str_equal, NULL,
+      (GDestroyNotify) g_array_unref);
+
+  for (i = 0; i < NUM_RAKIA_SIP_SESSION_MILESTONES; i++)
+    {
+      GArray *buckets;
+      guint j;
+      guint total = 0;
+
+      for (j = 0; j < RAKIA_SETUP_HISTOGRAM_BUCKETS; j++)
+        total += priv->setup_histograms[i][j];
+
+      if (total == 0)
+        continue;
+
+      buckets = g_array_sized_new (FALSE, FALSE, sizeof (guint),
+          RAKIA_SETUP_HISTOGRAM_BUCKETS);
+      g_array_append_vals (buckets, priv->setup_histograms[i],
+          RAKIA_SETUP_HISTOGRAM_BUCKETS);
+
+      g_hash_table_insert (histograms,
+          (gpointer) rakia_sip_session_milestone_name (i), buckets);
+    }
+
+  return histograms;
+}
+
+guint
+rakia_media_manager_get_calls_measured (RakiaMediaManager *self)
+{
+  return self->priv->calls_measured;
+}
+
+/**
+ * rakia_media_manager_get_memory_usage:
+ * @n_channels: (out): set to the number of call channels
+ *
+ * Returns: the bytes held by the sessions of the call channels
+ */
+gsize
+rakia_media_manager_get_memory_usage (RakiaMediaManager *self,
+                                      guint *n_channels)
+{
+  RakiaMediaManagerPrivate *priv = RAKIA_MEDIA_MANAGER_GET_PRIVATE (self);
+  gsize size = 0;
+  guint i;
+
+  *n_channels = 0;
+
+  if (priv->channels == NULL)
+    return 0;
+
+  for (i = 0; i < priv->channels->len; i++)
+    {
+      RakiaSipSession *session = NULL;
+
+      g_object_get (g_ptr_array_index (priv->channels, i),
+          "sip-session", &session, NULL);
+      if (session == NULL)
+        continue;
+
+      size += rakia_sip_session_get_memory_usage (session);
+      g_object_unref (session);
+    }
+
+  *n_channels = priv->channels->len;
+
+  return size;
+}
+
+/**
+ * rakia_media_manager_reoffer_sessions:
+ *
+ * Has the sessions of all call channels send a re-INVITE, for the remote
+ * parties to learn of the new local addresses after a network change.
+ */
+void
+rakia_media_manager_reoffer_sessions (RakiaMediaManager *self)
+{
+  RakiaMediaManagerPrivate *priv = RAKIA_MEDIA_MANAGER_GET_PRIVATE (self);
+  guint i;
+
+  if (priv->channels == NULL)
+    return;
+
+  for (i = 0; i < priv->channels->len; i++)
+    {
+      RakiaSipSession *session = NULL;
+
+      g_object_get (g_ptr_array_index (priv->channels, i),
+          "sip-session", &session, NULL);
+      if (session == NULL)
+        continue;
+
+      rakia_sip_session_reoffer (session);
+      g_object_unref (session);
+    }
+}
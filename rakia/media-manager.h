@@ -55,6 +55,18 @@ GType rakia_media_manager_get_type(void);
 #define RAKIA_MEDIA_MANAGER_GET_CLASS(obj) \
   (G_TYPE_INSTANCE_GET_CLASS ((obj), RAKIA_TYPE_MEDIA_MANAGER, RakiaMediaManagerClass))
 
+/* Number of buckets in the call setup latency histograms, see the
+ * Connection.Interface.SetupStatistics extension */
+#define RAKIA_SETUP_HISTOGRAM_BUCKETS 16
+
+GHashTable *rakia_media_manager_dup_setup_histograms (RakiaMediaManager *self);
+guint rakia_media_manager_get_calls_measured (RakiaMediaManager *self);
+
+gsize rakia_media_manager_get_memory_usage (RakiaMediaManager *self,
+    guint *n_channels);
+
+void rakia_media_manager_reoffer_sessions (RakiaMediaManager *self);
+
 G_END_DECLS
 
 #endif
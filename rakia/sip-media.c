@@ -38,6 +38,7 @@
 #include "rakia/debug.h"
 #include "rakia/codec-param-formats.h"
 #include "rakia/sip-session.h"
+#include "rakia/util.h"
 
 
 #ifdef ENABLE_DEBUG
@@ -77,6 +78,7 @@ enum
   SIG_REMOTE_CANDIDATES_UPDATED,
   SIG_LOCAL_UPDATED,
   SIG_DIRECTION_CHANGED,
+  SIG_ICE_RESTART_REQUESTED,
   NUM_SIGNALS
 };
 
@@ -114,6 +116,13 @@ struct _RakiaSipMediaPrivate
   GPtrArray *remote_codec_offer;
   GPtrArray *remote_candidates;
 
+  gchar *local_ice_ufrag;               /* set if the transport is ICE */
+  gchar *local_ice_pwd;
+  gboolean ice_restart_pending;         /* new local candidates are awaited */
+  GPtrArray *remote_ice_candidates;     /* a=candidate lines of the remote media */
+  gchar *remote_ice_ufrag;
+  gchar *remote_ice_pwd;
+
   gboolean can_receive;
 };
 
@@ -195,6 +204,16 @@ rakia_sip_media_class_init (RakiaSipMediaClass *klass)
           NULL, NULL,
           g_cclosure_marshal_VOID__VOID,
           G_TYPE_NONE, 0);
+
+
+  signals[SIG_ICE_RESTART_REQUESTED] =
+      g_signal_new ("ice-restart-requested",
+          G_OBJECT_CLASS_TYPE (klass),
+          G_SIGNAL_RUN_LAST,
+          0,
+          NULL, NULL,
+          g_cclosure_marshal_VOID__VOID,
+          G_TYPE_NONE, 0);
 }
 
 
@@ -225,7 +244,13 @@ rakia_sip_media_finalize (GObject *object)
     g_ptr_array_unref (priv->remote_candidates);
   if (priv->remote_codec_offer)
     g_ptr_array_unref (priv->remote_codec_offer);
+  if (priv->remote_ice_candidates)
+    g_ptr_array_unref (priv->remote_ice_candidates);
 
+  g_free (priv->local_ice_ufrag);
+  g_free (priv->local_ice_pwd);
+  g_free (priv->remote_ice_ufrag);
+  g_free (priv->remote_ice_pwd);
   g_free (priv->name);
 
   G_OBJECT_CLASS (rakia_sip_media_parent_class)->finalize (object);
@@ -355,6 +380,100 @@ priv_get_preferred_local_candidates (RakiaSipMedia *media,
 }
 
 
+static const gchar *
+priv_candidate_type_to_str (TpCallStreamCandidateType type)
+{
+  switch (type)
+    {
+    case TP_CALL_STREAM_CANDIDATE_TYPE_SERVER_REFLEXIVE:
+      return "srflx";
+    case TP_CALL_STREAM_CANDIDATE_TYPE_PEER_REFLEXIVE:
+      return "prflx";
+    case TP_CALL_STREAM_CANDIDATE_TYPE_RELAY:
+      return "relay";
+    default:
+      return "host";
+    }
+}
+
+static TpCallStreamCandidateType
+priv_candidate_type_from_str (const gchar *str)
+{
+  if (strcmp (str, "host") == 0)
+    return TP_CALL_STREAM_CANDIDATE_TYPE_HOST;
+  if (strcmp (str, "srflx") == 0)
+    return TP_CALL_STREAM_CANDIDATE_TYPE_SERVER_REFLEXIVE;
+  if (strcmp (str, "prflx") == 0)
+    return TP_CALL_STREAM_CANDIDATE_TYPE_PEER_REFLEXIVE;
+  if (strcmp (str, "relay") == 0)
+    return TP_CALL_STREAM_CANDIDATE_TYPE_RELAY;
+  return TP_CALL_STREAM_CANDIDATE_TYPE_NONE;
+}
+
+/* Adds the ICE credentials and all local candidates as per RFC 5245 */
+static void
+priv_append_ice_attributes (RakiaSipMedia *media, GString *alines,
+    gboolean rtp_only)
+{
+  RakiaSipMediaPrivate *priv = media->priv;
+  guint i;
+
+  g_string_append_printf (alines, "a=ice-ufrag:%s\r\na=ice-pwd:%s\r\n",
+      priv->local_ice_ufrag, priv->local_ice_pwd);
+
+  for (i = 0; i < priv->local_candidates->len; i++)
+    {
+      RakiaSipCandidate *cand = g_ptr_array_index (priv->local_candidates, i);
+
+      if (rtp_only && cand->component != 1)
+        continue;
+
+      g_string_append_printf (alines, "a=candidate:%s %u UDP %u %s %u typ %s",
+          (cand->foundation != NULL && cand->foundation[0] != '\0')
+              ? cand->foundation : "1",
+          cand->component, cand->priority, cand->ip, cand->port,
+          priv_candidate_type_to_str (cand->type));
+
+      if (cand->base_ip != NULL
+          && cand->type != TP_CALL_STREAM_CANDIDATE_TYPE_HOST
+          && cand->type != TP_CALL_STREAM_CANDIDATE_TYPE_NONE)
+        g_string_append_printf (alines, " raddr %s rport %u",
+            cand->base_ip, cand->base_port);
+
+      g_string_append (alines, "\r\n");
+    }
+}
+
+static gboolean
+priv_rtcp_mux_allowed (RakiaSipMedia *media)
+{
+  gboolean rtcp_mux = FALSE;
+
+  g_object_get (media->priv->session, "rtcp-mux", &rtcp_mux, NULL);
+
+  return rtcp_mux;
+}
+
+static gboolean
+priv_sdp_has_rtcp_mux (const sdp_media_t *sdp_media)
+{
+  return sdp_media != NULL
+      && sdp_attribute_find (sdp_media->m_attributes, "rtcp-mux") != NULL;
+}
+
+/*
+ * RTCP is multiplexed on the RTP port (RFC 5761) if we allow it and
+ * the last remote description has a=rtcp-mux, which is either
+ * the remote offer we answer to, or the answer accepting our offer.
+ */
+static gboolean
+priv_is_rtcp_muxed (RakiaSipMedia *media)
+{
+  return priv_sdp_has_rtcp_mux (media->priv->remote_media)
+      && priv_rtcp_mux_allowed (media);
+}
+
+
 static void
 rakia_sip_media_set_direction (RakiaSipMedia *media,
     TpMediaStreamDirection direction)
@@ -439,7 +558,13 @@ rakia_sip_media_generate_sdp (RakiaSipMedia *media, GString *out,
 
   alines = g_string_new (dirline);
 
-  if (rtcp_cand != NULL)
+  /* Offer RTCP multiplexing, but keep the separate RTCP port
+   * for the answerers which don't support it */
+  if (authoritative ? priv_rtcp_mux_allowed (media)
+                    : priv_is_rtcp_muxed (media))
+    g_string_append (alines, "a=rtcp-mux\r\n");
+
+  if (rtcp_cand != NULL && (authoritative || !priv_is_rtcp_muxed (media)))
     {
       /* Add RTCP attribute as per RFC 3605 */
       if (strcmp (rtcp_cand->ip, rtp_cand->ip) != 0)
@@ -459,6 +584,10 @@ rakia_sip_media_generate_sdp (RakiaSipMedia *media, GString *out,
         }
     }
 
+  if (priv->local_ice_ufrag != NULL)
+    priv_append_ice_attributes (media, alines,
+        !authoritative && priv_is_rtcp_muxed (media));
+
   priv_append_rtpmaps (priv->media_type,
       priv->local_codecs,
       out, alines);
@@ -473,14 +602,20 @@ rakia_sip_media_generate_sdp (RakiaSipMedia *media, GString *out,
 }
 
 
+/* Codecs and their parameters are created and thrown away in bulk
+ * whenever a media description changes, so each is a single block with
+ * its strings stored after the structure. */
+
 RakiaSipCodec*
 rakia_sip_codec_new (guint id, const gchar *encoding_name,
     guint clock_rate, guint channels)
 {
-  RakiaSipCodec *codec = g_slice_new (RakiaSipCodec);
+  gsize name_size = strlen (encoding_name) + 1;
+  RakiaSipCodec *codec = g_malloc (sizeof (RakiaSipCodec) + name_size);
 
   codec->id = id;
-  codec->encoding_name = g_strdup (encoding_name);
+  codec->encoding_name = (gchar *) (codec + 1);
+  memcpy (codec->encoding_name, encoding_name, name_size);
   codec->clock_rate = clock_rate;
   codec->channels = channels;
   codec->params = NULL;
@@ -488,51 +623,125 @@ rakia_sip_codec_new (guint id, const gchar *encoding_name,
   return codec;
 }
 
-static void
-rakia_sip_codec_param_free (RakiaSipCodecParam *param)
-{
-  g_free (param->name);
-  g_free (param->value);
-  g_slice_free (RakiaSipCodecParam, param);
-}
-
 void
 rakia_sip_codec_add_param (RakiaSipCodec *codec, const gchar *name,
     const gchar *value)
 {
   RakiaSipCodecParam *param;
+  gsize name_size = strlen (name) + 1;
+  gsize value_size = strlen (value) + 1;
 
   if (codec->params == NULL)
-    codec->params = g_ptr_array_new_with_free_func (
-        (GDestroyNotify) rakia_sip_codec_param_free);
+    codec->params = g_ptr_array_new_with_free_func (g_free);
 
-  param = g_slice_new (RakiaSipCodecParam);
-  param->name = g_strdup (name);
-  param->value = g_strdup (value);
+  param = g_malloc (sizeof (RakiaSipCodecParam) + name_size + value_size);
+  param->name = (gchar *) (param + 1);
+  memcpy (param->name, name, name_size);
+  param->value = param->name + name_size;
+  memcpy (param->value, value, value_size);
   g_ptr_array_add (codec->params, param);
 }
 
 void
 rakia_sip_codec_free (RakiaSipCodec *codec)
 {
-  g_free (codec->encoding_name);
   if (codec->params)
     g_ptr_array_unref (codec->params);
-  g_slice_free (RakiaSipCodec, codec);
+  g_free (codec);
+}
+
+static gboolean
+rakia_sip_codec_equal (const RakiaSipCodec *a, const RakiaSipCodec *b)
+{
+  guint a_params = (a->params != NULL) ? a->params->len : 0;
+  guint b_params = (b->params != NULL) ? b->params->len : 0;
+  guint i;
+
+  if (a->id != b->id ||
+      a->clock_rate != b->clock_rate ||
+      a->channels != b->channels ||
+      a_params != b_params ||
+      strcmp (a->encoding_name, b->encoding_name) != 0)
+    return FALSE;
+
+  for (i = 0; i < a_params; i++)
+    {
+      const RakiaSipCodecParam *a_param = g_ptr_array_index (a->params, i);
+      const RakiaSipCodecParam *b_param = g_ptr_array_index (b->params, i);
+
+      if (strcmp (a_param->name, b_param->name) != 0 ||
+          strcmp (a_param->value, b_param->value) != 0)
+        return FALSE;
+    }
+
+  return TRUE;
+}
+
+/**
+ * rakia_sip_codec_list_equal:
+ *
+ * Returns: %TRUE if @a and @b have the same codecs with the same payload
+ * types and parameters, in the same order
+ */
+gboolean
+rakia_sip_codec_list_equal (const GPtrArray *a, const GPtrArray *b)
+{
+  guint i;
+
+  if (a->len != b->len)
+    return FALSE;
+
+  for (i = 0; i < a->len; i++)
+    if (!rakia_sip_codec_equal (g_ptr_array_index (a, i),
+            g_ptr_array_index (b, i)))
+      return FALSE;
+
+  return TRUE;
+}
+
+/**
+ * rakia_sip_codec_list_new:
+ * @reserved_size: the number of codecs expected in the list
+ *
+ * Returns: a new empty array owning the #RakiaSipCodec<!-- -->s added to it,
+ * with room for @reserved_size of them
+ */
+GPtrArray *
+rakia_sip_codec_list_new (guint reserved_size)
+{
+  return g_ptr_array_new_full (reserved_size,
+      (GDestroyNotify) rakia_sip_codec_free);
 }
 
 
 RakiaSipCandidate*
 rakia_sip_candidate_new (guint component, const gchar *ip, guint port,
     const gchar *foundation, guint priority)
+{
+  return rakia_sip_candidate_new_take (component, g_strdup (ip), port,
+      g_strdup (foundation), priority);
+}
+
+/**
+ * rakia_sip_candidate_new_take:
+ *
+ * Like rakia_sip_candidate_new (), but takes ownership of @ip and
+ * @foundation instead of copying them.
+ */
+RakiaSipCandidate*
+rakia_sip_candidate_new_take (guint component, gchar *ip, guint port,
+    gchar *foundation, guint priority)
 {
   RakiaSipCandidate *candidate = g_slice_new (RakiaSipCandidate);
 
   candidate->component = component;
-  candidate->ip = g_strdup (ip);
+  candidate->ip = ip;
   candidate->port = port;
-  candidate->foundation = g_strdup (foundation);
+  candidate->foundation = foundation;
   candidate->priority = priority;
+  candidate->type = TP_CALL_STREAM_CANDIDATE_TYPE_NONE;
+  candidate->base_ip = NULL;
+  candidate->base_port = 0;
 
   return candidate;
 }
@@ -543,6 +752,7 @@ rakia_sip_candidate_free (RakiaSipCandidate *candidate)
 {
   g_free (candidate->ip);
   g_free (candidate->foundation);
+  g_free (candidate->base_ip);
   g_slice_free (RakiaSipCandidate, candidate);
 }
 
@@ -666,8 +876,7 @@ static void push_remote_codecs (RakiaSipMedia *media)
     }
 
 
-  codecs = g_ptr_array_new_with_free_func (
-      (GDestroyNotify) rakia_sip_codec_free);
+  codecs = rakia_sip_codec_list_new (0);
 
   rtpmap = sdpmedia->m_rtpmaps;
   while (rtpmap)
@@ -701,13 +910,201 @@ static void push_remote_codecs (RakiaSipMedia *media)
 
   priv->remote_codec_offer = codecs;
 
+  /* A handler can answer right away, which releases the offer */
+  MEDIA_DEBUG(media, "emitting %d remote codecs to the handler",
+      codecs->len);
+
   g_signal_emit (media, signals[SIG_REMOTE_CODEC_OFFER_UPDATED], 0,
       priv->codec_intersect_pending);
+}
 
-  MEDIA_DEBUG(media, "emitting %d remote codecs to the handler",
-      codecs->len);
+
+/*
+ * Parses the value of an RFC 5245 a=candidate attribute:
+ * <foundation> <component> <transport> <priority> <address> <port>
+ * typ <type> [raddr <address>] [rport <port>] *(<extension> <value>)
+ *
+ * Returns NULL if the candidate is malformed or not on UDP.
+ */
+static RakiaSipCandidate *
+priv_parse_ice_candidate (const gchar *value)
+{
+  RakiaSipCandidate *candidate = NULL;
+  gchar **tokens;
+  guint64 component;
+  guint64 priority;
+  guint64 port;
+  guint n;
+  guint i;
+
+  tokens = g_strsplit (value, " ", 0);
+  n = g_strv_length (tokens);
+
+  if (n < 8
+      || g_ascii_strcasecmp (tokens[2], "UDP") != 0
+      || strcmp (tokens[6], "typ") != 0
+      || !rakia_ice_foundation_is_valid (tokens[0])
+      || !rakia_ip_address_is_valid (tokens[4])
+      || strchr (tokens[4], '%') != NULL)
+    goto out;
+
+  component = g_ascii_strtoull (tokens[1], NULL, 10);
+  priority = g_ascii_strtoull (tokens[3], NULL, 10);
+  port = g_ascii_strtoull (tokens[5], NULL, 10);
+
+  if (component == 0 || component > 256
+      || priority > G_MAXUINT32
+      || port == 0 || port > 65535)
+    goto out;
+
+  /* The strings are moved from the split vector into the candidate,
+   * which is why it is freed by hand below */
+  candidate = rakia_sip_candidate_new_take (component, tokens[4], port,
+      tokens[0], priority);
+  tokens[4] = NULL;
+  tokens[0] = NULL;
+  candidate->type = priv_candidate_type_from_str (tokens[7]);
+
+  for (i = 8; i + 1 < n; i += 2)
+    {
+      if (strcmp (tokens[i], "raddr") == 0)
+        {
+          /* passed on to the streaming implementation as base-ip */
+          if (!rakia_ip_address_is_valid (tokens[i + 1])
+              || strchr (tokens[i + 1], '%') != NULL)
+            continue;
+
+          g_free (candidate->base_ip);
+          candidate->base_ip = tokens[i + 1];
+          tokens[i + 1] = NULL;
+        }
+      else if (strcmp (tokens[i], "rport") == 0)
+        {
+          candidate->base_port = g_ascii_strtoull (tokens[i + 1], NULL, 10);
+        }
+    }
+
+out:
+  for (i = 0; i < n; i++)
+    g_free (tokens[i]);
+  g_free (tokens);
+  return candidate;
+}
+
+static gchar *
+priv_get_ice_attribute (const sdp_media_t *sdp_media, const char *name)
+{
+  gchar *value;
+
+  value = rakia_sdp_get_string_attribute (sdp_media->m_attributes, name);
+  if (value == NULL && sdp_media->m_session != NULL)
+    value = rakia_sdp_get_string_attribute (
+        sdp_media->m_session->sdp_attributes, name);
+
+  return value;
+}
+
+/* Picks up the ICE credentials and candidates of the remote media.
+ * They are only used if our transport is ICE as well */
+static void
+priv_update_remote_ice (RakiaSipMedia *media)
+{
+  RakiaSipMediaPrivate *priv = RAKIA_SIP_MEDIA_GET_PRIVATE (media);
+  const sdp_media_t *sdp_media = priv->remote_media;
+  const sdp_attribute_t *attr;
+  GPtrArray *candidates;
+  gboolean rtp_only = priv_is_rtcp_muxed (media);
+
+  g_free (priv->remote_ice_ufrag);
+  g_free (priv->remote_ice_pwd);
+  priv->remote_ice_ufrag = priv_get_ice_attribute (sdp_media, "ice-ufrag");
+  priv->remote_ice_pwd = priv_get_ice_attribute (sdp_media, "ice-pwd");
+
+  if (priv->remote_ice_candidates != NULL)
+    {
+      g_ptr_array_unref (priv->remote_ice_candidates);
+      priv->remote_ice_candidates = NULL;
+    }
+
+  if (priv->remote_ice_ufrag == NULL || priv->remote_ice_pwd == NULL)
+    return;
+
+  candidates = g_ptr_array_new_with_free_func (
+      (GDestroyNotify) rakia_sip_candidate_free);
+
+  for (attr = sdp_media->m_attributes; attr != NULL; attr = attr->a_next)
+    {
+      RakiaSipCandidate *candidate;
+
+      if (attr->a_value == NULL
+          || g_ascii_strcasecmp (attr->a_name, "candidate") != 0)
+        continue;
+
+      candidate = priv_parse_ice_candidate (attr->a_value);
+      if (candidate == NULL)
+        {
+          MEDIA_MESSAGE (media, "ignoring candidate \"%s\"", attr->a_value);
+          continue;
+        }
+
+      if (rtp_only && candidate->component != 1)
+        {
+          rakia_sip_candidate_free (candidate);
+          continue;
+        }
+
+      g_ptr_array_add (candidates, candidate);
+    }
+
+  MEDIA_DEBUG (media, "%u remote ICE candidates", candidates->len);
+
+  if (candidates->len == 0)
+    g_ptr_array_unref (candidates);
+  else
+    priv->remote_ice_candidates = candidates;
 }
 
+/* Tells if the ICE credentials or candidates differ between the
+ * two media descriptions */
+static gboolean
+priv_sdp_ice_differs (const sdp_media_t *m1, const sdp_media_t *m2)
+{
+  static const char *const names[] = { "ice-ufrag", "ice-pwd", NULL };
+  const sdp_attribute_t *a1 = m1->m_attributes;
+  const sdp_attribute_t *a2 = m2->m_attributes;
+  guint i;
+
+  for (i = 0; names[i] != NULL; i++)
+    {
+      gchar *v1 = priv_get_ice_attribute (m1, names[i]);
+      gchar *v2 = priv_get_ice_attribute (m2, names[i]);
+      gboolean differ = tp_strdiff (v1, v2);
+
+      g_free (v1);
+      g_free (v2);
+
+      if (differ)
+        return TRUE;
+    }
+
+  /* Compare the candidate lines in order */
+  for (;;)
+    {
+      while (a1 != NULL && g_ascii_strcasecmp (a1->a_name, "candidate") != 0)
+        a1 = a1->a_next;
+      while (a2 != NULL && g_ascii_strcasecmp (a2->a_name, "candidate") != 0)
+        a2 = a2->a_next;
+
+      if (a1 == NULL || a2 == NULL)
+        return a1 != a2;
+
+      if (tp_strdiff (a1->a_value, a2->a_value))
+        return TRUE;
+
+      a1 = a1->a_next;
+      a2 = a2->a_next;
+    }
+}
 
 static void push_remote_candidates (RakiaSipMedia *media)
 {
@@ -747,7 +1144,11 @@ static void push_remote_candidates (RakiaSipMedia *media)
 
   MEDIA_DEBUG (media, "remote RTP address=<%s>, port=<%u>", sdp_conn->c_address, port);
 
-  if (!rakia_sdp_rtcp_bandwidth_throttled (sdp_media->m_bandwidths))
+  if (priv_is_rtcp_muxed (media))
+    {
+      MEDIA_DEBUG (media, "RTCP is multiplexed on the RTP port");
+    }
+  else if (!rakia_sdp_rtcp_bandwidth_throttled (sdp_media->m_bandwidths))
     {
       gboolean session_rtcp_enabled = TRUE;
 
@@ -792,6 +1193,8 @@ static void push_remote_candidates (RakiaSipMedia *media)
     g_ptr_array_unref (priv->remote_candidates);
   priv->remote_candidates = candidates;
 
+  priv_update_remote_ice (media);
+
   g_signal_emit (media, signals[SIG_REMOTE_CANDIDATES_UPDATED], 0);
 }
 
@@ -892,7 +1295,10 @@ rakia_sip_media_set_remote_media (RakiaSipMedia *media,
   if (old_media != NULL)
     {
       /* Check if the transport candidate needs to be changed */
-      if (!sdp_connection_cmp (sdp_media_connections (old_media), sdp_conn))
+      if (!sdp_connection_cmp (sdp_media_connections (old_media), sdp_conn)
+          && priv_sdp_has_rtcp_mux (old_media) ==
+              priv_sdp_has_rtcp_mux (new_media)
+          && !priv_sdp_ice_differs (old_media, new_media))
         transport_changed = FALSE;
 
       /* Check if the codec list needs to be updated */
@@ -972,10 +1378,12 @@ rakia_sip_media_is_ready (RakiaSipMedia *self)
   RakiaSipMediaPrivate *priv = RAKIA_SIP_MEDIA_GET_PRIVATE (self);
 
   MEDIA_DEBUG (self, "is_ready, requested_recv: %d can_recv: %d "
-      "local_cand_prep: %d local_codecs: %p local_inter_pending: %d",
+      "local_cand_prep: %d ice_restart: %d local_codecs: %p "
+      "local_inter_pending: %d",
       priv->requested_direction & TP_MEDIA_STREAM_DIRECTION_RECEIVE,
       priv->can_receive,
       self->priv->local_candidates_prepared,
+      priv->ice_restart_pending,
       self->priv->local_codecs,
       priv->codec_intersect_pending);
 
@@ -985,6 +1393,7 @@ rakia_sip_media_is_ready (RakiaSipMedia *self)
     return FALSE;
 
   return (self->priv->local_candidates_prepared &&
+      !priv->ice_restart_pending &&
       self->priv->local_codecs &&
       !priv->codec_intersect_pending);
 }
@@ -998,6 +1407,9 @@ rakia_sip_media_take_local_codecs (RakiaSipMedia *self, GPtrArray *local_codecs)
     g_ptr_array_unref (priv->local_codecs);
   priv->local_codecs = local_codecs;
 
+  rakia_sip_session_mark_milestone (priv->session,
+      RAKIA_SIP_SESSION_MILESTONE_LOCAL_CODECS);
+
   if (priv->push_remote_codecs_pending)
     {
       priv->push_remote_codecs_pending = FALSE;
@@ -1037,7 +1449,9 @@ void
 rakia_sip_media_take_local_candidate (RakiaSipMedia *self,
     RakiaSipCandidate *candidate)
 {
-  g_return_if_fail (!self->priv->local_candidates_prepared);
+  /* With ICE, candidates can trickle in after the initial set */
+  g_return_if_fail (!self->priv->local_candidates_prepared ||
+      self->priv->local_ice_ufrag != NULL);
 
   if (self->priv->local_candidates == NULL)
     self->priv->local_candidates = g_ptr_array_new_with_free_func (
@@ -1064,6 +1478,9 @@ rakia_sip_media_local_candidates_prepared (RakiaSipMedia *self)
 
   self->priv->local_candidates_prepared = TRUE;
 
+  rakia_sip_session_mark_milestone (self->priv->session,
+      RAKIA_SIP_SESSION_MILESTONE_LOCAL_CANDIDATES);
+
   if (rakia_sip_media_is_ready (self))
     {
       g_signal_emit (self, signals[SIG_LOCAL_NEGOTIATION_COMPLETE], 0,
@@ -1073,6 +1490,64 @@ rakia_sip_media_local_candidates_prepared (RakiaSipMedia *self)
   return TRUE;
 }
 
+/**
+ * rakia_sip_media_restart_ice:
+ * @self: the media
+ *
+ * Asks the streaming implementation for new ICE credentials and a new set
+ * of local candidates, after a change of the local network. The media is
+ * not ready again until the new set is finished, or the restart is ended
+ * with rakia_sip_media_end_ice_restart().
+ *
+ * Returns: %TRUE if the restart is pending, %FALSE if the media does not
+ *  use ICE or has no local candidates yet
+ */
+gboolean
+rakia_sip_media_restart_ice (RakiaSipMedia *self)
+{
+  RakiaSipMediaPrivate *priv = RAKIA_SIP_MEDIA_GET_PRIVATE (self);
+
+  if (priv->local_ice_ufrag == NULL || !priv->local_candidates_prepared)
+    return FALSE;
+
+  if (!priv->ice_restart_pending)
+    {
+      MEDIA_DEBUG (self, "restarting ICE");
+      priv->ice_restart_pending = TRUE;
+      g_signal_emit (self, signals[SIG_ICE_RESTART_REQUESTED], 0);
+    }
+
+  return TRUE;
+}
+
+gboolean
+rakia_sip_media_is_restarting_ice (RakiaSipMedia *self)
+{
+  return self->priv->ice_restart_pending;
+}
+
+void
+rakia_sip_media_end_ice_restart (RakiaSipMedia *self)
+{
+  self->priv->ice_restart_pending = FALSE;
+}
+
+/* Drops the local candidates, for the set found after an ICE restart to
+ * replace them */
+void
+rakia_sip_media_reset_local_candidates (RakiaSipMedia *self)
+{
+  RakiaSipMediaPrivate *priv = RAKIA_SIP_MEDIA_GET_PRIVATE (self);
+
+  if (priv->local_candidates != NULL)
+    {
+      g_ptr_array_unref (priv->local_candidates);
+      priv->local_candidates = NULL;
+    }
+
+  priv->local_candidates_prepared = FALSE;
+}
+
 GPtrArray *
 rakia_sip_media_get_remote_codec_offer (RakiaSipMedia *self)
 {
@@ -1089,6 +1564,36 @@ rakia_sip_media_get_remote_candidates (RakiaSipMedia *self)
   return priv->remote_candidates;
 }
 
+void
+rakia_sip_media_set_local_credentials (RakiaSipMedia *self,
+    const gchar *ufrag, const gchar *pwd)
+{
+  RakiaSipMediaPrivate *priv = RAKIA_SIP_MEDIA_GET_PRIVATE (self);
+
+  g_free (priv->local_ice_ufrag);
+  g_free (priv->local_ice_pwd);
+  priv->local_ice_ufrag = g_strdup (ufrag);
+  priv->local_ice_pwd = g_strdup (pwd);
+}
+
+GPtrArray *
+rakia_sip_media_get_remote_ice_candidates (RakiaSipMedia *self)
+{
+  RakiaSipMediaPrivate *priv = RAKIA_SIP_MEDIA_GET_PRIVATE (self);
+
+  return priv->remote_ice_candidates;
+}
+
+void
+rakia_sip_media_get_remote_credentials (RakiaSipMedia *self,
+    const gchar **ufrag, const gchar **pwd)
+{
+  RakiaSipMediaPrivate *priv = RAKIA_SIP_MEDIA_GET_PRIVATE (self);
+
+  *ufrag = priv->remote_ice_ufrag;
+  *pwd = priv->remote_ice_pwd;
+}
+
 gboolean
 rakia_sip_media_is_created_locally (RakiaSipMedia *self)
 {
@@ -65,6 +65,9 @@ typedef struct _RakiaSipCandidate {
   guint port;
   gchar *foundation;
   guint priority;
+  TpCallStreamCandidateType type;  /* ICE candidate type */
+  gchar *base_ip;                  /* ICE related address, or NULL */
+  guint base_port;
 } RakiaSipCandidate;
 
 GType rakia_sip_media_get_type(void);
@@ -128,10 +131,14 @@ RakiaSipCodec* rakia_sip_codec_new (guint id, const gchar *encoding_name,
 void rakia_sip_codec_add_param (RakiaSipCodec *codec, const gchar *name,
     const gchar *value);
 void rakia_sip_codec_free (RakiaSipCodec *codec);
+GPtrArray *rakia_sip_codec_list_new (guint reserved_size);
+gboolean rakia_sip_codec_list_equal (const GPtrArray *a, const GPtrArray *b);
 
 RakiaSipCandidate* rakia_sip_candidate_new (guint component,
     const gchar *ip, guint port,
     const gchar *foundation, guint priority);
+RakiaSipCandidate* rakia_sip_candidate_new_take (guint component,
+    gchar *ip, guint port, gchar *foundation, guint priority);
 void rakia_sip_candidate_free (RakiaSipCandidate *candidate);
 
 void rakia_sip_media_take_local_codecs (RakiaSipMedia *self,
@@ -139,10 +146,20 @@ void rakia_sip_media_take_local_codecs (RakiaSipMedia *self,
 void rakia_sip_media_take_local_candidate (RakiaSipMedia *self,
     RakiaSipCandidate *candidate);
 gboolean rakia_sip_media_local_candidates_prepared (RakiaSipMedia *self);
+gboolean rakia_sip_media_restart_ice (RakiaSipMedia *self);
+gboolean rakia_sip_media_is_restarting_ice (RakiaSipMedia *self);
+void rakia_sip_media_end_ice_restart (RakiaSipMedia *self);
+void rakia_sip_media_reset_local_candidates (RakiaSipMedia *self);
 
 GPtrArray *rakia_sip_media_get_remote_codec_offer (RakiaSipMedia *self);
 GPtrArray *rakia_sip_media_get_remote_candidates (RakiaSipMedia *self);
 
+void rakia_sip_media_set_local_credentials (RakiaSipMedia *self,
+    const gchar *ufrag, const gchar *pwd);
+GPtrArray *rakia_sip_media_get_remote_ice_candidates (RakiaSipMedia *self);
+void rakia_sip_media_get_remote_credentials (RakiaSipMedia *self,
+    const gchar **ufrag, const gchar **pwd);
+
 const gchar *rakia_sip_media_get_name (RakiaSipMedia *media);
 
 RakiaSipSession *rakia_sip_media_get_session (RakiaSipMedia *media);
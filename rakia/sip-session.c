@@ -39,6 +39,7 @@
 #include "rakia/base-connection.h"
 #include "rakia/event-target.h"
 #include "rakia/sip-media.h"
+#include "rakia/util.h"
 
 
 /* The timeout for outstanding re-INVITE transactions in seconds.
@@ -46,6 +47,10 @@
  * described in RFC 3261 Section 13.3.1.1 */
 #define RAKIA_REINVITE_TIMEOUT 180
 
+/* How long an offer made after a change of the local network waits for
+ * the new local candidates of an ICE restart, in seconds */
+#define RAKIA_ICE_RESTART_TIMEOUT 5
+
 static void event_target_init (gpointer, gpointer);
 
 G_DEFINE_TYPE_WITH_CODE(RakiaSipSession,
@@ -99,6 +104,20 @@ static const char *const session_states[NUM_RAKIA_SIP_SESSION_STATES] =
 
 #endif /* ENABLE_DEBUG */
 
+/* Names of the call setup milestones as exported over D-Bus */
+static const char *const session_milestones[NUM_RAKIA_SIP_SESSION_MILESTONES] =
+{
+    "invite-received",
+    "incoming-call",
+    "local-codecs",
+    "local-candidates",
+    "invite-sent",
+    "ringing",
+    "answer-sent",
+    "ack",
+    "active"
+};
+
 
 /* properties */
 enum
@@ -106,6 +125,7 @@ enum
   PROP_REMOTE_PTIME = 1,
   PROP_REMOTE_MAX_PTIME,
   PROP_RTCP_ENABLED,
+  PROP_RTCP_MUX,
   PROP_HOLD_STATE,
   PROP_REMOTE_HELD,
   LAST_PROPERTY
@@ -137,6 +157,8 @@ struct _RakiaSipSessionPrivate
   RakiaSipSessionState state;           /* session state */
 
   gboolean immutable_streams;            /* immutable streams */
+  gboolean fast_start;                   /* offer before all medias are ready */
+  guint fast_start_count;                /* number of medias in a partial initial offer */
 
   GPtrArray *medias;
 
@@ -150,6 +172,7 @@ struct _RakiaSipSessionPrivate
   gchar *remote_max_ptime;                /* see gobj. prop. 'remote-max-ptime' */
   guint remote_media_count;              /* number of m= last seen in a remote offer */
   gboolean rtcp_enabled;                  /* see gobj. prop. 'rtcp-enabled' */
+  gboolean rtcp_mux;                      /* see gobj. prop. 'rtcp-mux' */
   gchar *local_sdp;                       /* local session as SDP string */
   su_home_t *home;                        /* Sofia memory home for remote SDP session structure */
   su_home_t *backup_home;                 /* Sofia memory home for previous generation remote SDP session*/
@@ -159,8 +182,16 @@ struct _RakiaSipSessionPrivate
   gboolean accepted;                      /*< session has been locally accepted for use */
 
   gboolean pending_offer;                 /*< local media have been changed, but a re-INVITE is pending */
+  gboolean pending_reoffer;               /*< the next re-INVITE goes out even with the SDP unchanged */
+  gboolean pending_ice_restart;           /*< ICE is restarted once the session is active */
+  guint ice_restart_timer_id;
   guint glare_timer_id;
   gboolean remote_held;
+
+  gint64 invite_time;                     /* monotonic time the INVITE was sent */
+  gboolean invite_answered;               /* any response to the INVITE came */
+  gint64 created_time;                    /* monotonic time of creation, usec */
+  gint64 milestones[NUM_RAKIA_SIP_SESSION_MILESTONES]; /* 0 if not reached */
 };
 
 
@@ -178,6 +209,8 @@ static void priv_session_invite (RakiaSipSession *session, gboolean reinvite);
 static gboolean priv_update_remote_media (RakiaSipSession *self,
     gboolean authoritative);
 static void priv_request_response_step (RakiaSipSession *session);
+static gboolean priv_has_all_media_ready (RakiaSipSession *self);
+static void priv_restart_ice (RakiaSipSession *self);
 
 static void
 event_target_init(gpointer g_iface, gpointer iface_data)
@@ -201,6 +234,7 @@ rakia_sip_session_init (RakiaSipSession *self)
 
   priv->state = RAKIA_SIP_SESSION_STATE_CREATED;
   priv->rtcp_enabled = TRUE;
+  priv->created_time = g_get_monotonic_time ();
 
   /* allocate any data required by the object here */
   priv->medias = g_ptr_array_new_with_free_func (null_safe_unref);
@@ -225,6 +259,9 @@ static void rakia_sip_session_get_property (GObject    *object,
     case PROP_RTCP_ENABLED:
       g_value_set_boolean (value, priv->rtcp_enabled);
       break;
+    case PROP_RTCP_MUX:
+      g_value_set_boolean (value, priv->rtcp_mux);
+      break;
     case PROP_HOLD_STATE:
       g_value_set_uint (value, priv->hold_state);
       break;
@@ -269,6 +306,12 @@ rakia_sip_session_class_init (RakiaSipSessionClass *klass)
       G_PARAM_READABLE | G_PARAM_STATIC_STRINGS);
   g_object_class_install_property (object_class, PROP_RTCP_ENABLED, param_spec);
 
+  param_spec = g_param_spec_boolean ("rtcp-mux", "RTCP multiplexing",
+      "Can RTCP be multiplexed with RTP on a single port (RFC 5761)",
+      FALSE,
+      G_PARAM_READABLE | G_PARAM_STATIC_STRINGS);
+  g_object_class_install_property (object_class, PROP_RTCP_MUX, param_spec);
+
 
   param_spec = g_param_spec_uint ("hold-state", "Local Hold State",
       "Is the call held or not",
@@ -388,6 +431,12 @@ rakia_sip_session_dispose (GObject *object)
       self->priv->glare_timer_id = 0;
     }
 
+  if (self->priv->ice_restart_timer_id)
+    {
+      g_source_remove (self->priv->ice_restart_timer_id);
+      self->priv->ice_restart_timer_id = 0;
+    }
+
   tp_clear_object (&self->priv->conn);
 
   if (self->priv->remote_sdp != NULL)
@@ -468,9 +517,21 @@ rakia_sip_session_change_state (RakiaSipSession *self,
        * about unhandled states */
     }
 
+  /* Any medias left out of a fast start offer are only pending now */
+  if (new_state == RAKIA_SIP_SESSION_STATE_ACTIVE)
+    {
+      priv->fast_start_count = 0;
+      rakia_sip_session_mark_milestone (self,
+          RAKIA_SIP_SESSION_MILESTONE_ACTIVE);
+    }
+
   g_signal_emit (self, signals[SIG_STATE_CHANGED], 0, old_state, new_state);
 
-  if (new_state == RAKIA_SIP_SESSION_STATE_ACTIVE && priv->pending_offer)
+  if (new_state == RAKIA_SIP_SESSION_STATE_ACTIVE && priv->pending_ice_restart)
+    priv_restart_ice (self);
+
+  if (new_state == RAKIA_SIP_SESSION_STATE_ACTIVE && priv->pending_offer
+      && priv_has_all_media_ready (self))
     priv_session_invite (self, TRUE);
 }
 
@@ -660,6 +721,8 @@ rakia_sip_session_handle_incoming_call (RakiaSipSession *self,
   rakia_sip_session_receive_invite (self);
 
   /* Tell the factory to emit NewChannel(s) */
+  rakia_sip_session_mark_milestone (self,
+      RAKIA_SIP_SESSION_MILESTONE_INCOMING_CALL);
   g_signal_emit (self, signals[SIG_INCOMING_CALL], 0);
 }
 
@@ -803,13 +866,15 @@ priv_media_local_negotiation_complete_cb (RakiaSipMedia *media,
 }
 
 static gboolean
-priv_has_all_media_ready (RakiaSipSession *self)
+priv_has_leading_media_ready (RakiaSipSession *self, guint len)
 {
   guint i;
 
-  for (i = 0; i < self->priv->medias->len; i++)
+  g_assert (len <= self->priv->medias->len);
+
+  for (i = 0; i < len; i++)
     {
-      RakiaSipMedia *media = g_ptr_array_index (self->priv->medias, i);;;;
+      RakiaSipMedia *media = g_ptr_array_index (self->priv->medias, i);
 
       if (media == NULL)
         continue;
@@ -820,6 +885,37 @@ priv_has_all_media_ready (RakiaSipSession *self)
   return TRUE;
 }
 
+static gboolean
+priv_has_all_media_ready (RakiaSipSession *self)
+{
+  return priv_has_leading_media_ready (self, self->priv->medias->len);
+}
+
+/**
+ * Returns the number of leading medias that are ready to be offered,
+ * or 0 if there is no audio media among them.
+ */
+static guint
+priv_count_fast_start_media (RakiaSipSession *self)
+{
+  gboolean has_audio = FALSE;
+  guint i;
+
+  for (i = 0; i < self->priv->medias->len; i++)
+    {
+      RakiaSipMedia *media = g_ptr_array_index (self->priv->medias, i);
+
+      if (media == NULL)
+        continue;
+      if (!rakia_sip_media_is_ready (media))
+        break;
+      if (rakia_sip_media_get_media_type (media) == TP_MEDIA_STREAM_TYPE_AUDIO)
+        has_audio = TRUE;
+    }
+
+  return has_audio ? i : 0;
+}
+
 void
 rakia_sip_session_media_changed (RakiaSipSession *self)
 {
@@ -871,6 +967,111 @@ rakia_sip_session_media_changed (RakiaSipSession *self)
     }
 }
 
+static gboolean
+priv_ice_restart_timeout_cb (gpointer data)
+{
+  RakiaSipSession *self = RAKIA_SIP_SESSION (data);
+  RakiaSipSessionPrivate *priv = RAKIA_SIP_SESSION_GET_PRIVATE (self);
+  gboolean timed_out = FALSE;
+  guint i;
+
+  priv->ice_restart_timer_id = 0;
+
+  for (i = 0; i < priv->medias->len; i++)
+    {
+      RakiaSipMedia *media = g_ptr_array_index (priv->medias, i);
+
+      if (media != NULL && rakia_sip_media_is_restarting_ice (media))
+        {
+          SESSION_MESSAGE (self, "no new candidates for media %u after an "
+              "ICE restart, offering the current ones", i);
+          rakia_sip_media_end_ice_restart (media);
+          timed_out = TRUE;
+        }
+    }
+
+  if (timed_out)
+    priv_request_response_step (self);
+
+  return FALSE;
+}
+
+/* Asks the streaming implementation for new local candidates on the
+ * medias using ICE. Until they are all in, or RAKIA_ICE_RESTART_TIMEOUT
+ * has passed, the medias are not ready and no offer goes out */
+static void
+priv_restart_ice (RakiaSipSession *self)
+{
+  RakiaSipSessionPrivate *priv = RAKIA_SIP_SESSION_GET_PRIVATE (self);
+  gboolean restarting = FALSE;
+  guint i;
+
+  priv->pending_ice_restart = FALSE;
+
+  for (i = 0; i < priv->medias->len; i++)
+    {
+      RakiaSipMedia *media = g_ptr_array_index (priv->medias, i);
+
+      if (media != NULL && rakia_sip_media_restart_ice (media))
+        restarting = TRUE;
+    }
+
+  if (restarting && priv->ice_restart_timer_id == 0)
+    priv->ice_restart_timer_id = g_timeout_add_seconds (
+        RAKIA_ICE_RESTART_TIMEOUT, priv_ice_restart_timeout_cb, self);
+}
+
+/**
+ * rakia_sip_session_reoffer:
+ * @self: the session
+ *
+ * Sends a re-INVITE, as soon as the state of the session allows, even if
+ * the local media are unchanged: after a change of the local network, it
+ * gives the remote party the new Contact address. The medias using ICE
+ * restart it first, and the re-INVITE waits for their new credentials and
+ * local candidates.
+ */
+void
+rakia_sip_session_reoffer (RakiaSipSession *self)
+{
+  RakiaSipSessionPrivate *priv = RAKIA_SIP_SESSION_GET_PRIVATE (self);
+
+  switch (priv->state)
+    {
+    case RAKIA_SIP_SESSION_STATE_CREATED:
+    case RAKIA_SIP_SESSION_STATE_INVITE_RECEIVED:
+      /* The initial offer or answer is yet to be sent, and will have the
+       * current addresses */
+      return;
+    case RAKIA_SIP_SESSION_STATE_ENDED:
+      return;
+    default:
+      break;
+    }
+
+  SESSION_DEBUG (self, "re-offering the session");
+
+  priv->pending_reoffer = TRUE;
+
+  switch (priv->state)
+    {
+    case RAKIA_SIP_SESSION_STATE_ACTIVE:
+    case RAKIA_SIP_SESSION_STATE_REINVITE_PENDING:
+      priv_restart_ice (self);
+      break;
+    default:
+      /* ICE is restarted in our own offer, once the offer-answer round
+       * under way is over */
+      priv->pending_ice_restart = TRUE;
+      break;
+    }
+
+  /* The answer to a remote offer is followed by an offer of our own */
+  if (priv->state == RAKIA_SIP_SESSION_STATE_REINVITE_RECEIVED)
+    priv->pending_offer = TRUE;
+  else
+    rakia_sip_session_media_changed (self);
+}
 
 static RakiaSipMedia *
 rakia_sip_session_add_media_internal (RakiaSipSession *self,
@@ -1122,16 +1323,21 @@ priv_session_generate_sdp (RakiaSipSession *session,
   guint len;
   guint i;
 
-  g_return_val_if_fail (priv_has_all_media_ready (session), NULL);
-
-  user_sdp = g_string_new ("v=0\r\n");
-
   len = priv->medias->len;
   if (!authoritative && len > priv->remote_media_count)
     {
       len = priv->remote_media_count;
       SESSION_DEBUG (session, "clamped response to %u medias seen in the offer", len);
     }
+  if (priv->fast_start_count != 0 && len > priv->fast_start_count)
+    {
+      len = priv->fast_start_count;
+      SESSION_DEBUG (session, "clamped fast start offer to %u ready medias", len);
+    }
+
+  g_return_val_if_fail (priv_has_leading_media_ready (session, len), NULL);
+
+  user_sdp = g_string_new ("v=0\r\n");
 
   for (i = 0; i < len; i++)
     {
@@ -1150,6 +1356,7 @@ priv_session_invite (RakiaSipSession *session, gboolean reinvite)
 {
   RakiaSipSessionPrivate *priv = RAKIA_SIP_SESSION_GET_PRIVATE (session);
   GString *user_sdp;
+  gchar *authorization = NULL;
 
   DEBUG("enter");
 
@@ -1161,6 +1368,7 @@ priv_session_invite (RakiaSipSession *session, gboolean reinvite)
 
   if (!reinvite
       || priv->state == RAKIA_SIP_SESSION_STATE_REINVITE_PENDING
+      || priv->pending_reoffer
       || tp_strdiff (priv->local_sdp, user_sdp->str))
     {
       g_free (priv->local_sdp);
@@ -1170,6 +1378,11 @@ priv_session_invite (RakiaSipSession *session, gboolean reinvite)
        * offer is sent, so we must set the streams to playing */
       g_signal_emit (session, signals[SIG_START_RECEIVING], 0);
 
+      /* Within the dialog, Sofia-SIP has the credentials if any */
+      if (!reinvite)
+        authorization = rakia_base_connection_dup_authorization (priv->conn,
+            priv->nua_op, "INVITE");
+
       nua_invite (priv->nua_op,
                   SOATAG_USER_SDP_STR(priv->local_sdp),
                   SOATAG_RTP_SORT(SOA_RTP_SORT_REMOTE),
@@ -1178,8 +1391,22 @@ priv_session_invite (RakiaSipSession *session, gboolean reinvite)
                   NUTAG_AUTOANSWER(0),
                   TAG_IF(reinvite,
                          NUTAG_INVITE_TIMER (RAKIA_REINVITE_TIMEOUT)),
+                  TAG_IF(authorization != NULL,
+                         SIPTAG_HEADER_STR(authorization)),
                   TAG_END());
       priv->pending_offer = FALSE;
+      if (reinvite)
+        priv->pending_reoffer = FALSE;
+
+      g_free (authorization);
+
+      if (!reinvite)
+        {
+          priv->invite_time = g_get_monotonic_time ();
+          priv->invite_answered = FALSE;
+          rakia_sip_session_mark_milestone (session,
+              RAKIA_SIP_SESSION_MILESTONE_INVITE_SENT);
+        }
 
       rakia_sip_session_change_state (
                 session,
@@ -1223,6 +1450,9 @@ priv_session_respond (RakiaSipSession *session)
                NUTAG_AUTOANSWER(0),
                TAG_END());
 
+  rakia_sip_session_mark_milestone (session,
+      RAKIA_SIP_SESSION_MILESTONE_ANSWER_SENT);
+
   if (priv->saved_event[0])
     nua_destroy_event (priv->saved_event);
 
@@ -1249,6 +1479,49 @@ priv_is_codec_intersect_pending (RakiaSipSession *session)
 }
 
 
+/**
+ * In the fast start mode, sends the initial INVITE as soon as the leading
+ * medias including an audio one are prepared, and activates the session
+ * when the answer to them has been negotiated. The medias left out
+ * are offered in a re-INVITE once they are ready too.
+ *
+ * Returns TRUE if any action was taken.
+ */
+static gboolean
+priv_fast_start_step (RakiaSipSession *session)
+{
+  RakiaSipSessionPrivate *priv = RAKIA_SIP_SESSION_GET_PRIVATE (session);
+  guint count;
+
+  if (!priv->fast_start || priv->incoming)
+    return FALSE;
+
+  switch (priv->state)
+    {
+    case RAKIA_SIP_SESSION_STATE_CREATED:
+      count = priv_count_fast_start_media (session);
+      if (count == 0)
+        return FALSE;
+      SESSION_DEBUG (session, "fast start with %u of %u medias",
+          count, priv->medias->len);
+      priv->fast_start_count = count;
+      priv_session_invite (session, FALSE);
+      priv->pending_offer = TRUE;
+      return TRUE;
+    case RAKIA_SIP_SESSION_STATE_RESPONSE_RECEIVED:
+      if (priv->fast_start_count == 0
+          || !priv_has_leading_media_ready (session, priv->fast_start_count))
+        return FALSE;
+      if (priv->accepted
+          && !priv_is_codec_intersect_pending (session))
+        rakia_sip_session_change_state (session,
+                                        RAKIA_SIP_SESSION_STATE_ACTIVE);
+      return TRUE;
+    default:
+      return FALSE;
+    }
+}
+
 /**
  * Sends requests and responses with an outbound offer/answer
  * if all streams of the session are prepared.
@@ -1265,7 +1538,8 @@ priv_request_response_step (RakiaSipSession *session)
 
   if (!priv_has_all_media_ready (session))
     {
-      SESSION_DEBUG (session, "there are local streams not ready, postponed");
+      if (!priv_fast_start_step (session))
+        SESSION_DEBUG (session, "there are local streams not ready, postponed");
       return;
     }
 
@@ -1356,6 +1630,7 @@ rakia_sip_session_set_remote_media (RakiaSipSession *self,
 
   /* Store the session description structure */
   priv->home = su_home_create ();
+  rakia_su_home_track_usage (priv->home);
   priv->remote_sdp = sdp_session_dup (priv->home, sdp);
   g_return_val_if_fail (priv->remote_sdp != NULL, FALSE);
 
@@ -1433,6 +1708,57 @@ rakia_sip_session_resolve_glare (RakiaSipSession *self)
 
 
 
+static gboolean
+priv_nua_r_invite_cb (RakiaSipSession *self,
+                      const RakiaNuaEvent *ev,
+                      tagi_t tags[],
+                      gpointer foo)
+{
+  RakiaSipSessionPrivate *priv = RAKIA_SIP_SESSION_GET_PRIVATE (self);
+
+  /* A provisional response, 100 Trying at least, shows the proxy is up;
+   * the outcome of the call is for nua_i_state */
+  if (ev->status < 200)
+    priv->invite_answered = TRUE;
+
+  return FALSE;
+}
+
+/* Sends the initial INVITE again through the next server of the proxy,
+ * if the one it went through looks down: it gave no response before
+ * the transaction failed with 408 or 503 */
+static gboolean
+priv_fail_over_proxy (RakiaSipSession *self,
+                      const RakiaNuaEvent *ev)
+{
+  RakiaSipSessionPrivate *priv = RAKIA_SIP_SESSION_GET_PRIVATE (self);
+  nua_handle_t *nh;
+
+  if (priv->state != RAKIA_SIP_SESSION_STATE_INVITE_SENT
+      || priv->invite_answered
+      || (ev->status != 408 && ev->status != 503))
+    return FALSE;
+
+  nh = rakia_base_connection_fail_over_proxy (priv->conn, priv->nua_op,
+      priv->invite_time, ev->sip);
+  if (nh == NULL)
+    return FALSE;
+
+  SESSION_DEBUG (self, "INVITE failed with %03d, sending it again through "
+      "the next proxy server", ev->status);
+
+  rakia_event_target_detach (priv->nua_op);
+  nua_handle_destroy (priv->nua_op);
+
+  /* The reference of the new handle is ours */
+  priv->nua_op = nh;
+  rakia_event_target_attach (priv->nua_op, (GObject *) self);
+
+  priv_session_invite (self, FALSE);
+
+  return TRUE;
+}
+
 static gboolean
 priv_nua_i_state_cb (RakiaSipSession *self,
                      const RakiaNuaEvent  *ev,
@@ -1482,6 +1808,8 @@ priv_nua_i_state_cb (RakiaSipSession *self,
       switch (status)
         {
           case 180:
+            rakia_sip_session_mark_milestone (self,
+                RAKIA_SIP_SESSION_MILESTONE_RINGING);
             g_signal_emit (self, signals[SIG_RINGING], 0);
             break;
           case 182:
@@ -1504,6 +1832,10 @@ priv_nua_i_state_cb (RakiaSipSession *self,
 
       if (status < 300)
         {
+          /* The dialog is confirmed: the ACK has been either received
+           * or sent automatically by the stack */
+          rakia_sip_session_mark_milestone (self,
+              RAKIA_SIP_SESSION_MILESTONE_ACK);
           rakia_sip_session_accept (self);
         }
       else if (status == 491)
@@ -1522,6 +1854,9 @@ priv_nua_i_state_cb (RakiaSipSession *self,
       if (priv->state == RAKIA_SIP_SESSION_STATE_ENDED)
         break;
 
+      if (priv_fail_over_proxy (self, ev))
+        break;
+
       if (status >= 300)
         {
           rakia_sip_session_peer_error (self, status, ev->text);
@@ -1565,13 +1900,18 @@ rakia_sip_session_attach_to_nua_handle (RakiaSipSession *self,
                     "nua-event::nua_i_state",
                     G_CALLBACK (priv_nua_i_state_cb),
                     NULL);
+  g_signal_connect (self,
+                    "nua-event::nua_r_invite",
+                    G_CALLBACK (priv_nua_r_invite_cb),
+                    NULL);
 
 }
 
 
 RakiaSipSession *
 rakia_sip_session_new (nua_handle_t *nh, RakiaBaseConnection *conn,
-    gboolean incoming, gboolean immutable_streams)
+    gboolean incoming, gboolean immutable_streams, gboolean fast_start,
+    gboolean rtcp_mux)
 {
   RakiaSipSession *self = g_object_new (RAKIA_TYPE_SIP_SESSION, NULL);
 
@@ -1579,12 +1919,73 @@ rakia_sip_session_new (nua_handle_t *nh, RakiaBaseConnection *conn,
   self->priv->nua_op = nh;
   self->priv->conn = g_object_ref (conn);
   self->priv->immutable_streams = immutable_streams;
+  self->priv->fast_start = fast_start;
+  self->priv->rtcp_mux = rtcp_mux;
   nua_handle_ref (self->priv->nua_op);
   rakia_sip_session_attach_to_nua_handle (self, nh, conn);
 
+  /* An incoming session is created as soon as the INVITE arrives */
+  if (incoming)
+    rakia_sip_session_mark_milestone (self,
+        RAKIA_SIP_SESSION_MILESTONE_INVITE_RECEIVED);
+
   return self;
 }
 
+/**
+ * rakia_sip_session_mark_milestone:
+ *
+ * Records the current time for a call setup milestone, if it has not
+ * been reached before; later occurrences, e.g. in re-INVITEs or
+ * additional medias, are not recorded.
+ */
+void
+rakia_sip_session_mark_milestone (RakiaSipSession *self,
+    RakiaSipSessionMilestone milestone)
+{
+  RakiaSipSessionPrivate *priv = RAKIA_SIP_SESSION_GET_PRIVATE (self);
+  gint64 now;
+
+  g_return_if_fail (milestone < NUM_RAKIA_SIP_SESSION_MILESTONES);
+
+  if (priv->milestones[milestone] != 0)
+    return;
+
+  now = g_get_monotonic_time ();
+  priv->milestones[milestone] = now;
+
+  SESSION_DEBUG (self, "reached %s after %" G_GINT64_FORMAT " usec",
+      session_milestones[milestone], now - priv->created_time);
+}
+
+/**
+ * rakia_sip_session_get_milestone:
+ *
+ * Returns: the time in microseconds from the creation of the session
+ * until @milestone was reached, or -1 if it has not been reached.
+ */
+gint64
+rakia_sip_session_get_milestone (RakiaSipSession *self,
+    RakiaSipSessionMilestone milestone)
+{
+  RakiaSipSessionPrivate *priv = RAKIA_SIP_SESSION_GET_PRIVATE (self);
+
+  g_return_val_if_fail (milestone < NUM_RAKIA_SIP_SESSION_MILESTONES, -1);
+
+  if (priv->milestones[milestone] == 0)
+    return -1;
+
+  return priv->milestones[milestone] - priv->created_time;
+}
+
+const gchar *
+rakia_sip_session_milestone_name (RakiaSipSessionMilestone milestone)
+{
+  g_return_val_if_fail (milestone < NUM_RAKIA_SIP_SESSION_MILESTONES, NULL);
+
+  return session_milestones[milestone];
+}
+
 
 /**
  * Converts a sofia-sip media type enum to Telepathy media type.
@@ -1824,3 +2225,18 @@ rakia_sip_session_get_medias (RakiaSipSession *self)
 {
   return self->priv->medias;
 }
+
+/**
+ * rakia_sip_session_get_memory_usage:
+ *
+ * Returns: the bytes held for the remote session description, and for
+ *  the previous one while medias still refer to it
+ */
+gsize
+rakia_sip_session_get_memory_usage (RakiaSipSession *self)
+{
+  RakiaSipSessionPrivate *priv = RAKIA_SIP_SESSION_GET_PRIVATE (self);
+
+  return rakia_su_home_get_usage (priv->home)
+      + rakia_su_home_get_usage (priv->backup_home);
+}
@@ -43,6 +43,22 @@ typedef enum {
     NUM_RAKIA_SIP_SESSION_STATES
 } RakiaSipSessionState;
 
+/* Call setup milestones, in the order they usually happen; see
+ * rakia_sip_session_get_milestone() */
+typedef enum {
+    RAKIA_SIP_SESSION_MILESTONE_INVITE_RECEIVED = 0,
+    RAKIA_SIP_SESSION_MILESTONE_INCOMING_CALL,
+    RAKIA_SIP_SESSION_MILESTONE_LOCAL_CODECS,
+    RAKIA_SIP_SESSION_MILESTONE_LOCAL_CANDIDATES,
+    RAKIA_SIP_SESSION_MILESTONE_INVITE_SENT,
+    RAKIA_SIP_SESSION_MILESTONE_RINGING,
+    RAKIA_SIP_SESSION_MILESTONE_ANSWER_SENT,
+    RAKIA_SIP_SESSION_MILESTONE_ACK,
+    RAKIA_SIP_SESSION_MILESTONE_ACTIVE,
+
+    NUM_RAKIA_SIP_SESSION_MILESTONES
+} RakiaSipSessionMilestone;
+
 
 /* RakiaSipSession is defined in sip-media.h */
 /* typedef struct _RakiaSipSession RakiaSipSession; */
@@ -87,7 +103,8 @@ gchar * rakia_sdp_get_string_attribute (const sdp_attribute_t *attrs,
 
 RakiaSipSession *
 rakia_sip_session_new (nua_handle_t *nh, RakiaBaseConnection *conn,
-    gboolean incoming, gboolean immutable_streams);
+    gboolean incoming, gboolean immutable_streams, gboolean fast_start,
+    gboolean rtcp_mux);
 
 void rakia_sip_session_terminate (RakiaSipSession *session, guint status,
     const gchar *reason);
@@ -109,6 +126,7 @@ void rakia_sip_session_queued (RakiaSipSession *self);
 void rakia_sip_session_accept (RakiaSipSession *self);
 
 void rakia_sip_session_media_changed (RakiaSipSession *self);
+void rakia_sip_session_reoffer (RakiaSipSession *self);
 
 GPtrArray *rakia_sip_session_get_medias (RakiaSipSession *self);
 
@@ -121,6 +139,15 @@ gboolean rakia_sip_session_pending_offer (RakiaSipSession *self);
 void rakia_sip_session_change_state (RakiaSipSession *session,
     RakiaSipSessionState new_state);
 
+/* Call setup timeline */
+
+void rakia_sip_session_mark_milestone (RakiaSipSession *self,
+    RakiaSipSessionMilestone milestone);
+gint64 rakia_sip_session_get_milestone (RakiaSipSession *self,
+    RakiaSipSessionMilestone milestone);
+const gchar *rakia_sip_session_milestone_name (
+    RakiaSipSessionMilestone milestone);
+
 /* Obsolete */
 
 void rakia_sip_session_respond (RakiaSipSession *self,    gint status,
@@ -139,6 +166,8 @@ void rakia_sip_session_set_hold_requested (RakiaSipSession *session,
 
 gboolean rakia_sip_session_is_held (RakiaSipSession *session);
 
+gsize rakia_sip_session_get_memory_usage (RakiaSipSession *self);
+
 G_END_DECLS
 
 #endif /* #ifndef __RAKIA_SIP_SESSION_H__*/
@@ -22,7 +22,8 @@
 #define _RAKIA_SOFIA_DECLS_H_
 
 /* note: As one Sofia-SIP NUA instance is created per SIP connection,
- *       RakiaConnection is used as the context pointer.
+ *       RakiaConnection is used as the context pointer. A NUA instance
+ *       shared by connections has its own context pointer instead.
  *       See {top}/docs/design.txt for further information.
  *
  *       Each NUA handle managed by Telepathy-Rakia is bound to an object
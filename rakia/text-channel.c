@@ -91,6 +91,8 @@ struct _RakiaTextPendingMessage
   nua_handle_t *nh;
   gchar *token;
   TpMessageSendingFlags flags;
+  gchar *text;          /* to send again through another proxy server */
+  gint64 sent_time;
 };
 
 typedef struct _RakiaTextChannelPrivate RakiaTextChannelPrivate;
@@ -118,6 +120,7 @@ rakia_text_pending_free (RakiaTextPendingMessage *msg)
     nua_handle_unref (msg->nh);
 
   g_free (msg->token);
+  g_free (msg->text);
 
   g_slice_free (RakiaTextPendingMessage, msg);
 }
@@ -136,6 +139,30 @@ static void rakia_text_channel_send_message (GObject *object,
     TpMessage *message,
     TpMessageSendingFlags flags);
 
+static void
+priv_send_message (RakiaTextChannel *self,
+                   RakiaTextPendingMessage *msg)
+{
+  TpBaseConnection *conn = tp_base_channel_get_connection (
+      TP_BASE_CHANNEL (self));
+  gchar *authorization;
+
+  rakia_event_target_attach (msg->nh, (GObject *) self);
+
+  authorization = rakia_base_connection_dup_authorization (
+      RAKIA_BASE_CONNECTION (conn), msg->nh, "MESSAGE");
+
+  nua_message (msg->nh,
+      SIPTAG_CONTENT_TYPE_STR("text/plain"),
+      SIPTAG_PAYLOAD_STR(msg->text),
+      TAG_IF(authorization != NULL, SIPTAG_HEADER_STR(authorization)),
+      TAG_END());
+
+  msg->sent_time = g_get_monotonic_time ();
+
+  g_free (authorization);
+}
+
 static void
 rakia_text_channel_constructed (GObject *obj)
 {
@@ -436,17 +463,13 @@ rakia_text_channel_send_message (GObject *object,
       goto fail;
     }
 
-  rakia_event_target_attach (msg_nh, (GObject *) self);
-
-  nua_message(msg_nh,
-	      SIPTAG_CONTENT_TYPE_STR("text/plain"),
-	      SIPTAG_PAYLOAD_STR(text),
-	      TAG_END());
-
   msg = _rakia_text_pending_new0 ();
   msg->nh = msg_nh;
   msg->token = g_strdup_printf ("%u", priv->sent_id++);
   msg->flags = flags;
+  msg->text = g_strdup (text);
+
+  priv_send_message (self, msg);
 
   tp_message_mixin_sent (object, message, flags, msg->token, NULL);
   g_queue_push_tail (priv->sending_messages, msg);
@@ -552,6 +575,30 @@ rakia_text_channel_nua_r_message_cb (RakiaTextChannel *self,
 
   g_assert (msg != NULL);
 
+  /* Timed out, unreachable or overloaded: another server of the proxy
+   * may do better. Sofia-SIP reports transport errors as 503 too */
+  if (ev->status == 408 || ev->status == 503)
+    {
+      TpBaseConnection *conn = tp_base_channel_get_connection (
+          TP_BASE_CHANNEL (self));
+      nua_handle_t *nh;
+
+      nh = rakia_base_connection_fail_over_proxy (
+          RAKIA_BASE_CONNECTION (conn), msg->nh, msg->sent_time, ev->sip);
+      if (nh != NULL)
+        {
+          DEBUG ("MESSAGE failed with %03d, sending it again through the "
+              "next proxy server", ev->status);
+
+          rakia_event_target_detach (msg->nh);
+          nua_handle_destroy (msg->nh);
+          msg->nh = nh;
+
+          priv_send_message (self, msg);
+          return TRUE;
+        }
+    }
+
   /* FIXME: generate a delivery report */
   if (ev->status >= 200 && ev->status < 300)
     {
@@ -669,3 +716,29 @@ destroyable_iface_init (gpointer g_iface,
   IMPLEMENT(destroy);
 #undef IMPLEMENT
 }
+
+/**
+ * rakia_text_channel_get_memory_usage:
+ *
+ * Returns: the bytes held for outgoing messages awaiting a response
+ */
+gsize
+rakia_text_channel_get_memory_usage (RakiaTextChannel *self)
+{
+  RakiaTextChannelPrivate *priv = RAKIA_TEXT_CHANNEL_GET_PRIVATE (self);
+  gsize size = 0;
+  GList *l;
+
+  for (l = priv->sending_messages->head; l != NULL; l = l->next)
+    {
+      RakiaTextPendingMessage *msg = l->data;
+
+      size += sizeof (RakiaTextPendingMessage) + sizeof (GList);
+      if (msg->token != NULL)
+        size += strlen (msg->token) + 1;
+      if (msg->text != NULL)
+        size += strlen (msg->text) + 1;
+    }
+
+  return size;
+}
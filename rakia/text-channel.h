@@ -65,6 +65,8 @@ void rakia_text_channel_receive (RakiaTextChannel  *obj,
                                  const char        *text,
                                  gsize              len);
 
+gsize rakia_text_channel_get_memory_usage (RakiaTextChannel *self);
+
 G_END_DECLS
 
 #endif /* #ifndef __RAKIA_TEXT_CHANNEL_H__*/
@@ -628,3 +628,32 @@ channel_manager_iface_init (gpointer g_iface, gpointer iface_data)
   iface->request_channel = rakia_text_manager_request_channel;
   iface->ensure_channel = rakia_text_manager_ensure_channel;
 }
+
+/**
+ * rakia_text_manager_get_memory_usage:
+ * @n_channels: (out): set to the number of text channels
+ *
+ * Returns: the bytes held by the text channels for pending messages
+ */
+gsize
+rakia_text_manager_get_memory_usage (RakiaTextManager *self,
+                                     guint *n_channels)
+{
+  RakiaTextManagerPrivate *priv = RAKIA_TEXT_MANAGER_GET_PRIVATE (self);
+  GHashTableIter iter;
+  gpointer chan;
+  gsize size = 0;
+
+  *n_channels = 0;
+
+  if (priv->channels == NULL)
+    return 0;
+
+  g_hash_table_iter_init (&iter, priv->channels);
+  while (g_hash_table_iter_next (&iter, NULL, &chan))
+    size += rakia_text_channel_get_memory_usage (chan);
+
+  *n_channels = g_hash_table_size (priv->channels);
+
+  return size;
+}
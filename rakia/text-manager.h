@@ -52,6 +52,9 @@ GType rakia_text_manager_get_type(void);
 #define RAKIA_TEXT_MANAGER_GET_CLASS(obj) \
   (G_TYPE_INSTANCE_GET_CLASS ((obj), RAKIA_TYPE_TEXT_MANAGER, RakiaTextManagerClass))
 
+gsize rakia_text_manager_get_memory_usage (RakiaTextManager *self,
+    guint *n_channels);
+
 G_END_DECLS
 
 #endif
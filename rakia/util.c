@@ -24,12 +24,96 @@
 
 #include <string.h>
 
+#include <arpa/inet.h>
+#include <net/if.h>
+
+#include <sofia-sip/su_alloc_stat.h>
+
 gchar const *
 rakia_version_string (void)
 {
   return "Telepathy-Rakia/" PACKAGE_VERSION;
 }
 
+/* An interface name or index, as in the "%eth0" of "fe80::1%eth0" */
+static gboolean
+priv_ip_scope_is_valid (const gchar *scope)
+{
+  guint i;
+
+  for (i = 0; scope[i] != '\0'; i++)
+    {
+      if (i == IF_NAMESIZE - 1)
+        return FALSE;
+      if (!g_ascii_isalnum (scope[i])
+          && scope[i] != '-' && scope[i] != '_' && scope[i] != '.')
+        return FALSE;
+    }
+
+  return i > 0;
+}
+
+/**
+ * rakia_ip_address_is_valid:
+ * @address: a string
+ *
+ * Returns: %TRUE if @address is a numeric IPv4 address, or a numeric
+ * IPv6 address with an optional "%scope" suffix naming an interface, as
+ * in "fe80::1%eth0"; it does so without creating a #GInetAddress for it
+ */
+gboolean
+rakia_ip_address_is_valid (const gchar *address)
+{
+  guchar buf[sizeof (struct in6_addr)];
+  gchar host[INET6_ADDRSTRLEN];
+  const gchar *scope;
+
+  if (address == NULL)
+    return FALSE;
+
+  scope = strchr (address, '%');
+  if (scope == NULL)
+    return inet_pton (AF_INET, address, buf) == 1 ||
+        inet_pton (AF_INET6, address, buf) == 1;
+
+  /* inet_pton () refuses the scope, and only IPv6 has one */
+  if ((gsize) (scope - address) >= sizeof (host)
+      || !priv_ip_scope_is_valid (scope + 1))
+    return FALSE;
+
+  memcpy (host, address, scope - address);
+  host[scope - address] = '\0';
+
+  return inet_pton (AF_INET6, host, buf) == 1;
+}
+
+/**
+ * rakia_ice_foundation_is_valid:
+ * @foundation: a string, or %NULL
+ *
+ * Returns: %TRUE if @foundation is %NULL, empty, or up to 32 characters
+ * of the ice-char set of RFC 5245 (letters, digits, '+' and '/')
+ */
+gboolean
+rakia_ice_foundation_is_valid (const gchar *foundation)
+{
+  guint i;
+
+  if (foundation == NULL)
+    return TRUE;
+
+  for (i = 0; foundation[i] != '\0'; i++)
+    {
+      if (i == 32)
+        return FALSE;
+      if (!g_ascii_isalnum (foundation[i])
+          && foundation[i] != '+' && foundation[i] != '/')
+        return FALSE;
+    }
+
+  return TRUE;
+}
+
 static const guchar escape_table[256] =
   { 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 1, 1, 0, 1, 1,
       /* Control characters except LF and CR.
@@ -159,3 +243,40 @@ rakia_unquote_string (const gchar *src, gssize len)
 
   return res;
 }
+
+/**
+ * rakia_su_home_track_usage:
+ * @home: a Sofia memory home, best before anything is allocated from it
+ *
+ * Starts counting the memory allocated from @home, for
+ * rakia_su_home_get_usage ().
+ */
+void
+rakia_su_home_track_usage (su_home_t *home)
+{
+  su_home_init_stats (home);
+}
+
+/**
+ * rakia_su_home_get_usage:
+ * @home: a Sofia memory home, or %NULL
+ *
+ * Returns: the number of bytes allocated from @home and not freed yet
+ *  since rakia_su_home_track_usage () was called on it
+ */
+gsize
+rakia_su_home_get_usage (su_home_t *home)
+{
+  su_home_stat_t stats[1];
+
+  if (home == NULL)
+    return 0;
+
+  memset (stats, 0, sizeof stats);
+  su_home_get_stats (home, 1, stats, sizeof stats);
+
+  if (stats->hs_allocs.hsa_bytes < stats->hs_frees.hsf_bytes)
+    return 0;
+
+  return stats->hs_allocs.hsa_bytes - stats->hs_frees.hsf_bytes;
+}
@@ -23,6 +23,8 @@
 
 #include <glib.h>
 
+#include <sofia-sip/su_alloc.h>
+
 G_BEGIN_DECLS
 
 gchar * rakia_quote_string (const gchar *src);
@@ -33,6 +35,12 @@ void rakia_string_append_quoted (GString *buf, const gchar *text);
 
 gchar const *rakia_version_string (void);
 
+gboolean rakia_ip_address_is_valid (const gchar *address);
+gboolean rakia_ice_foundation_is_valid (const gchar *foundation);
+
+void rakia_su_home_track_usage (su_home_t *home);
+gsize rakia_su_home_get_usage (su_home_t *home);
+
 G_END_DECLS
 
 #endif /* !RAKIA_UTIL_H_ */
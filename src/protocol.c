@@ -50,11 +50,19 @@ G_DEFINE_TYPE (RakiaProtocol,
 
 enum {
     PROP_SOFIA_ROOT = 1,
+    PROP_SHARED_STACK,
+    PROP_RESOLVER,
+    PROP_REGISTRATION_SCHEDULER,
+    PROP_NETWORK_MONITOR,
 };
 
 struct _RakiaProtocolPrivate
 {
   su_root_t *sofia_root;
+  RakiaSharedStack *shared_stack;
+  RakiaResolver *resolver;
+  RakiaRegistrationScheduler *registration_scheduler;
+  RakiaNetworkMonitor *network_monitor;
 };
 
 /* Used in the otherwise-unused offset field of the TpCMParamSpec. The first
@@ -116,6 +124,11 @@ static TpCMParamSpec rakia_params[] = {
     { "keepalive-interval", DBUS_TYPE_UINT32_AS_STRING, G_TYPE_UINT,
       0, NULL, PARAM_EASY },
 
+    /* Probe how long the NAT keeps the binding to lengthen the interval */
+    { "discover-keepalive-interval", DBUS_TYPE_BOOLEAN_AS_STRING,
+      G_TYPE_BOOLEAN, TP_CONN_MGR_PARAM_FLAG_HAS_DEFAULT,
+      GUINT_TO_POINTER(FALSE), PARAM_EASY },
+
     /* Use SRV DNS lookup to discover STUN server for media NAT traversal
      * (defaults to true unless stun-server is set) */
     { "discover-stun", DBUS_TYPE_BOOLEAN_AS_STRING, G_TYPE_BOOLEAN,
@@ -136,6 +149,32 @@ static TpCMParamSpec rakia_params[] = {
       TP_CONN_MGR_PARAM_FLAG_HAS_DEFAULT, GUINT_TO_POINTER(FALSE),
       PARAM_EASY },
 
+    /* If the initial offer may go out before all contents are ready */
+    { "fast-start", DBUS_TYPE_BOOLEAN_AS_STRING, G_TYPE_BOOLEAN,
+      TP_CONN_MGR_PARAM_FLAG_HAS_DEFAULT, GUINT_TO_POINTER(FALSE),
+      PARAM_EASY },
+
+    /* If the media streams use ICE (RFC 5245) for NAT traversal */
+    { "ice", DBUS_TYPE_BOOLEAN_AS_STRING, G_TYPE_BOOLEAN,
+      TP_CONN_MGR_PARAM_FLAG_HAS_DEFAULT, GUINT_TO_POINTER(FALSE),
+      PARAM_EASY },
+
+    /* If RTP and RTCP can share a single port (RFC 5761) */
+    { "rtcp-mux", DBUS_TYPE_BOOLEAN_AS_STRING, G_TYPE_BOOLEAN,
+      TP_CONN_MGR_PARAM_FLAG_HAS_DEFAULT, GUINT_TO_POINTER(FALSE),
+      PARAM_EASY },
+
+    /* Admission control for incoming calls; 0 means no limit */
+    { "max-calls", DBUS_TYPE_UINT32_AS_STRING, G_TYPE_UINT,
+      TP_CONN_MGR_PARAM_FLAG_HAS_DEFAULT, GUINT_TO_POINTER(0),
+      PARAM_EASY },
+    { "max-call-rate", DBUS_TYPE_UINT32_AS_STRING, G_TYPE_UINT,
+      TP_CONN_MGR_PARAM_FLAG_HAS_DEFAULT, GUINT_TO_POINTER(0),
+      PARAM_EASY },
+    { "max-main-loop-lag", DBUS_TYPE_UINT32_AS_STRING, G_TYPE_UINT,
+      TP_CONN_MGR_PARAM_FLAG_HAS_DEFAULT, GUINT_TO_POINTER(0),
+      PARAM_EASY },
+
     /* Local IP address to use, workaround purposes only */
     { "local-ip-address", DBUS_TYPE_STRING_AS_STRING, G_TYPE_STRING,
       0, NULL, PARAM_EASY },
@@ -155,6 +194,12 @@ static TpCMParamSpec rakia_params[] = {
       TP_CONN_MGR_PARAM_FLAG_HAS_DEFAULT, GUINT_TO_POINTER(FALSE),
       PARAM_EASY },
 
+    /* If true, the connection uses the SIP stack shared by the connections
+     * of the manager, unless its other settings need one of its own */
+    { "share-stack", DBUS_TYPE_BOOLEAN_AS_STRING, G_TYPE_BOOLEAN,
+      TP_CONN_MGR_PARAM_FLAG_HAS_DEFAULT, GUINT_TO_POINTER(FALSE),
+      PARAM_EASY },
+
     { NULL }
 };
 
@@ -296,6 +341,11 @@ new_connection (TpBaseProtocol *protocol,
   conn = g_object_new (RAKIA_TYPE_CONNECTION,
                        "protocol", PROTOCOL_NAME,
                        "sofia-root", self->priv->sofia_root,
+                       "shared-stack", self->priv->shared_stack,
+                       "resolver", self->priv->resolver,
+                       "registration-scheduler",
+                           self->priv->registration_scheduler,
+                       "network-monitor", self->priv->network_monitor,
                        "address", account,
                        NULL);
 
@@ -494,6 +544,22 @@ rakia_protocol_get_property (GObject *object,
         g_value_set_pointer (value, self->priv->sofia_root);
         break;
 
+      case PROP_SHARED_STACK:
+        g_value_set_pointer (value, self->priv->shared_stack);
+        break;
+
+      case PROP_RESOLVER:
+        g_value_set_pointer (value, self->priv->resolver);
+        break;
+
+      case PROP_REGISTRATION_SCHEDULER:
+        g_value_set_pointer (value, self->priv->registration_scheduler);
+        break;
+
+      case PROP_NETWORK_MONITOR:
+        g_value_set_object (value, self->priv->network_monitor);
+        break;
+
       default:
         G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
         break;
@@ -514,6 +580,22 @@ rakia_protocol_set_property (GObject *object,
         self->priv->sofia_root = g_value_get_pointer (value);
         break;
 
+      case PROP_SHARED_STACK:
+        self->priv->shared_stack = g_value_get_pointer (value);
+        break;
+
+      case PROP_RESOLVER:
+        self->priv->resolver = g_value_get_pointer (value);
+        break;
+
+      case PROP_REGISTRATION_SCHEDULER:
+        self->priv->registration_scheduler = g_value_get_pointer (value);
+        break;
+
+      case PROP_NETWORK_MONITOR:
+        self->priv->network_monitor = g_value_get_object (value);
+        break;
+
       default:
         G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
         break;
@@ -545,13 +627,47 @@ rakia_protocol_class_init (RakiaProtocolClass *klass)
       G_PARAM_CONSTRUCT_ONLY | G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS);
   g_object_class_install_property (object_class, PROP_SOFIA_ROOT,
       param_spec);
+
+  param_spec = g_param_spec_pointer ("shared-stack", "Shared stack",
+      "the Sofia-SIP stack shared by connections, or NULL",
+      G_PARAM_CONSTRUCT_ONLY | G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS);
+  g_object_class_install_property (object_class, PROP_SHARED_STACK,
+      param_spec);
+
+  param_spec = g_param_spec_pointer ("resolver", "DNS resolver",
+      "the DNS resolver shared by connections",
+      G_PARAM_CONSTRUCT_ONLY | G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS);
+  g_object_class_install_property (object_class, PROP_RESOLVER,
+      param_spec);
+
+  param_spec = g_param_spec_pointer ("registration-scheduler",
+      "Registration scheduler",
+      "the scheduler staggering the registrations of connections",
+      G_PARAM_CONSTRUCT_ONLY | G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS);
+  g_object_class_install_property (object_class, PROP_REGISTRATION_SCHEDULER,
+      param_spec);
+
+  param_spec = g_param_spec_object ("network-monitor", "Network monitor",
+      "the detector of changes of the local network",
+      RAKIA_TYPE_NETWORK_MONITOR,
+      G_PARAM_CONSTRUCT_ONLY | G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS);
+  g_object_class_install_property (object_class, PROP_NETWORK_MONITOR,
+      param_spec);
 }
 
 TpBaseProtocol *
-rakia_protocol_new (su_root_t *sofia_root)
+rakia_protocol_new (su_root_t *sofia_root,
+    RakiaSharedStack *shared_stack,
+    RakiaResolver *resolver,
+    RakiaRegistrationScheduler *registration_scheduler,
+    RakiaNetworkMonitor *network_monitor)
 {
   return g_object_new (RAKIA_TYPE_PROTOCOL,
       "name", PROTOCOL_NAME,
       "sofia-root", sofia_root,
+      "shared-stack", shared_stack,
+      "resolver", resolver,
+      "registration-scheduler", registration_scheduler,
+      "network-monitor", network_monitor,
       NULL);
 }
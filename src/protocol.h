@@ -26,6 +26,11 @@
 #include <rakia/sofia-decls.h>
 #include <sofia-sip/su_glib.h>
 
+#include "sip-shared-stack.h"
+#include "sip-resolver.h"
+#include "sip-registration-scheduler.h"
+#include "sip-network-monitor.h"
+
 G_BEGIN_DECLS
 
 typedef struct _RakiaProtocol RakiaProtocol;
@@ -68,7 +73,10 @@ GType rakia_protocol_get_type (void);
 gchar *rakia_protocol_normalize_contact (const gchar *id,
     GError **error);
 
-TpBaseProtocol *rakia_protocol_new (su_root_t *sofia_root);
+TpBaseProtocol *rakia_protocol_new (su_root_t *sofia_root,
+    RakiaSharedStack *shared_stack, RakiaResolver *resolver,
+    RakiaRegistrationScheduler *registration_scheduler,
+    RakiaNetworkMonitor *network_monitor);
 
 G_END_DECLS
 
@@ -0,0 +1,492 @@
+/*
+ * sip-auth-cache.c - Digest challenges kept for pre-emptive authentication
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This work is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This work is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this work; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/*
+ * Sofia-SIP answers a challenge on the handle that got it, and adds the
+ * credentials to the later requests on that handle. Every MESSAGE and
+ * every call has a handle of its own, though, so each of them would be
+ * challenged again. The connection keeps the last Digest challenge of
+ * each realm here instead, with the credentials it was answered with,
+ * and new handles send their first request with an Authorization or
+ * Proxy-Authorization header computed from it (RFC 2617), counting the
+ * uses of the nonce.
+ *
+ * A challenge is only answered for the server that sent it: the
+ * credentials of a proxy go to the requests routed through that proxy,
+ * and the ones of a domain to the requests for that domain, never to
+ * another one that happens to use the same realm.
+ *
+ * Only the challenges to MESSAGE are kept: its handle sends the request
+ * once more with the answer, and is then done with. The handles of calls
+ * and registrations go on using the nonce for BYE, re-INVITE, UPDATE or
+ * the next REGISTER, counting it themselves, and one nonce count would
+ * then be sent twice; a nonce one of them is given is dropped from here.
+ *
+ * When the server no longer accepts the nonce, it challenges the request
+ * as before, with stale=true; Sofia-SIP replaces the header with its
+ * answer to the challenge, which is kept here in turn.
+ */
+
+#include "config.h"
+
+#include <string.h>
+
+#include <telepathy-glib/util.h>
+
+#include <rakia/util.h>
+
+#include "sip-auth-cache.h"
+
+#include <sofia-sip/msg_header.h>
+
+#define DEBUG_FLAG RAKIA_DEBUG_CONNECTION
+#include "rakia/debug.h"
+
+struct _RakiaAuthCache
+{
+  /* "server realm" => Challenge */
+  GHashTable *challenges;
+};
+
+typedef struct {
+    gboolean proxy;
+    /* host:port of the proxy or domain the challenge came from */
+    gchar *server;
+    gchar *realm;
+    gchar *nonce;
+    gchar *opaque;
+    gchar *algorithm;
+    gboolean qop_auth;
+    guint32 nc;
+    gchar *user;
+    gchar *password;
+} Challenge;
+
+static void
+challenge_free (gpointer data)
+{
+  Challenge *challenge = data;
+
+  g_free (challenge->server);
+  g_free (challenge->realm);
+  g_free (challenge->nonce);
+  g_free (challenge->opaque);
+  g_free (challenge->algorithm);
+  g_free (challenge->user);
+  g_free (challenge->password);
+  g_slice_free (Challenge, challenge);
+}
+
+RakiaAuthCache *
+rakia_auth_cache_new (void)
+{
+  RakiaAuthCache *self = g_slice_new0 (RakiaAuthCache);
+
+  self->challenges = g_hash_table_new_full (g_str_hash, g_str_equal,
+      g_free, challenge_free);
+
+  return self;
+}
+
+void
+rakia_auth_cache_free (RakiaAuthCache *self)
+{
+  g_hash_table_unref (self->challenges);
+  g_slice_free (RakiaAuthCache, self);
+}
+
+static gchar *
+priv_dup_value (const gchar *value)
+{
+  gsize len;
+
+  if (value == NULL)
+    return NULL;
+
+  len = strlen (value);
+  if (len >= 2 && value[0] == '"' && value[len - 1] == '"')
+    return rakia_unquote_string (value, len);
+
+  return g_strdup (value);
+}
+
+static gchar *
+priv_dup_param (msg_auth_t const *au,
+                const gchar *name)
+{
+  return priv_dup_value (msg_header_find_param ((msg_common_t *) au, name));
+}
+
+static gboolean
+priv_qop_has_auth (const gchar *qop)
+{
+  gchar **tokens = g_strsplit (qop, ",", 0);
+  gboolean found = FALSE;
+  guint i;
+
+  for (i = 0; tokens[i] != NULL; i++)
+    if (!g_ascii_strcasecmp (g_strstrip (tokens[i]), "auth"))
+      found = TRUE;
+
+  g_strfreev (tokens);
+  return found;
+}
+
+/* The host and port of @url, as the servers of challenges are compared */
+static gchar *
+priv_dup_server (const url_t *url)
+{
+  gchar *server;
+  gchar *lower;
+
+  if (url == NULL || url->url_host == NULL)
+    return NULL;
+
+  server = g_strdup_printf ("%s:%s", url->url_host, url_port (url));
+  lower = g_ascii_strdown (server, -1);
+  g_free (server);
+
+  return lower;
+}
+
+static void
+priv_store (RakiaAuthCache *self,
+            msg_auth_t const *au,
+            gboolean proxy,
+            const gchar *server)
+{
+  Challenge *challenge;
+  Challenge *old;
+  gchar *key;
+  gchar *qop;
+
+  for (; au != NULL; au = au->au_next)
+    {
+      if (au->au_scheme == NULL || g_ascii_strcasecmp (au->au_scheme, "Digest"))
+        continue;
+
+      challenge = g_slice_new0 (Challenge);
+      challenge->proxy = proxy;
+      challenge->server = g_strdup (server);
+      challenge->realm = priv_dup_param (au, "realm=");
+      challenge->nonce = priv_dup_param (au, "nonce=");
+      challenge->opaque = priv_dup_param (au, "opaque=");
+      challenge->algorithm = priv_dup_param (au, "algorithm=");
+      qop = priv_dup_param (au, "qop=");
+
+      /* MD5-sess and auth-int take more than the request line; leave
+       * them to the challenge path */
+      if (challenge->realm == NULL || challenge->nonce == NULL
+          || (challenge->algorithm != NULL
+              && g_ascii_strcasecmp (challenge->algorithm, "MD5"))
+          || (qop != NULL && !priv_qop_has_auth (qop)))
+        {
+          g_free (qop);
+          challenge_free (challenge);
+          continue;
+        }
+
+      challenge->qop_auth = (qop != NULL);
+      g_free (qop);
+
+      /* Sofia-SIP answers the challenge with the first count */
+      challenge->nc = 1;
+
+      key = g_strdup_printf ("%s %s", server, challenge->realm);
+
+      /* The credentials stay good with a new nonce */
+      old = g_hash_table_lookup (self->challenges, key);
+      if (old != NULL)
+        {
+          challenge->user = g_strdup (old->user);
+          challenge->password = g_strdup (old->password);
+        }
+
+      DEBUG("keeping the challenge of realm %s from %s", challenge->realm,
+          server);
+
+      g_hash_table_replace (self->challenges, key, challenge);
+    }
+}
+
+static gboolean
+priv_has_nonce (gpointer key,
+                gpointer value,
+                gpointer user_data)
+{
+  Challenge *challenge = value;
+  msg_auth_t const *au = user_data;
+  gboolean found = FALSE;
+  gchar *nonce;
+
+  for (; au != NULL && !found; au = au->au_next)
+    {
+      nonce = priv_dup_param (au, "nonce=");
+      found = !tp_strdiff (nonce, challenge->nonce);
+      g_free (nonce);
+    }
+
+  if (found)
+    DEBUG("a handle of the stack uses the nonce of realm %s now",
+        challenge->realm);
+
+  return found;
+}
+
+/**
+ * rakia_auth_cache_store_challenge:
+ * @self: the cache
+ * @sip: a 401 or 407 response
+ * @proxy: the outbound proxy the request went through, or %NULL
+ * @uri: the Request-URI of the request
+ *
+ * Keeps the Digest challenges of @sip to MESSAGE, replacing the ones of
+ * the same server and realm: a 407 comes from @proxy if there is one,
+ * and from the host of @uri otherwise, and a 401 from the host of @uri.
+ *
+ * The challenges to other methods are not kept, and the ones kept with
+ * their nonces are dropped: Sofia-SIP goes on using them on the handle
+ * of @sip, and two users of one nonce would send the same nonce counts.
+ */
+void
+rakia_auth_cache_store_challenge (RakiaAuthCache *self,
+                                  const sip_t *sip,
+                                  const url_t *proxy,
+                                  const url_t *uri)
+{
+  gchar *domain;
+  gchar *hop;
+
+  if (sip->sip_cseq == NULL || sip->sip_cseq->cs_method != sip_method_message)
+    {
+      g_hash_table_foreach_remove (self->challenges, priv_has_nonce,
+          (gpointer) sip->sip_www_authenticate);
+      g_hash_table_foreach_remove (self->challenges, priv_has_nonce,
+          (gpointer) sip->sip_proxy_authenticate);
+      return;
+    }
+
+  domain = priv_dup_server (uri);
+  hop = (proxy != NULL) ? priv_dup_server (proxy) : g_strdup (domain);
+
+  if (domain != NULL)
+    priv_store (self, (msg_auth_t const *) sip->sip_www_authenticate, FALSE,
+        domain);
+  if (hop != NULL)
+    priv_store (self, (msg_auth_t const *) sip->sip_proxy_authenticate, TRUE,
+        hop);
+
+  g_free (hop);
+  g_free (domain);
+}
+
+/**
+ * rakia_auth_cache_set_credentials:
+ * @self: the cache
+ * @realm: the realm of a challenge, quoted or not
+ * @user: the user name the challenge is answered with
+ * @password: the password the challenge is answered with
+ */
+void
+rakia_auth_cache_set_credentials (RakiaAuthCache *self,
+                                  const gchar *realm,
+                                  const gchar *user,
+                                  const gchar *password)
+{
+  gchar *unquoted = priv_dup_value (realm);
+  GHashTableIter iter;
+  gpointer value;
+
+  /* Every server using the realm asks for the same credentials */
+  g_hash_table_iter_init (&iter, self->challenges);
+  while (g_hash_table_iter_next (&iter, NULL, &value))
+    {
+      Challenge *challenge = value;
+
+      if (tp_strdiff (challenge->realm, unquoted))
+        continue;
+
+      g_free (challenge->user);
+      challenge->user = g_strdup (user);
+      g_free (challenge->password);
+      challenge->password = g_strdup (password);
+    }
+
+  g_free (unquoted);
+}
+
+static gchar *
+priv_md5 (const gchar *first, ...)
+{
+  GChecksum *checksum = g_checksum_new (G_CHECKSUM_MD5);
+  const gchar *str;
+  gchar *digest;
+  va_list args;
+
+  va_start (args, first);
+  for (str = first; str != NULL; str = va_arg (args, const gchar *))
+    {
+      if (str != first)
+        g_checksum_update (checksum, (const guchar *) ":", 1);
+      g_checksum_update (checksum, (const guchar *) str, -1);
+    }
+  va_end (args);
+
+  digest = g_strdup (g_checksum_get_string (checksum));
+  g_checksum_free (checksum);
+
+  return digest;
+}
+
+static void
+priv_append_authorization (GString *headers,
+                           Challenge *challenge,
+                           const gchar *method,
+                           const gchar *uri)
+{
+  gchar *ha1;
+  gchar *ha2;
+  gchar *response;
+  gchar *quoted;
+  gchar nc[9];
+  gchar cnonce[17];
+
+  ha1 = priv_md5 (challenge->user, challenge->realm, challenge->password,
+      NULL);
+  ha2 = priv_md5 (method, uri, NULL);
+
+  challenge->nc++;
+  g_snprintf (nc, sizeof nc, "%08x", challenge->nc);
+  g_snprintf (cnonce, sizeof cnonce, "%08x%08x", g_random_int (),
+      g_random_int ());
+
+  if (challenge->qop_auth)
+    response = priv_md5 (ha1, challenge->nonce, nc, cnonce, "auth", ha2,
+        NULL);
+  else
+    response = priv_md5 (ha1, challenge->nonce, ha2, NULL);
+
+  if (headers->len > 0)
+    g_string_append (headers, "\r\n");
+
+  g_string_append (headers, challenge->proxy ?
+      "Proxy-Authorization: Digest " : "Authorization: Digest ");
+
+  quoted = rakia_quote_string (challenge->user);
+  g_string_append_printf (headers, "username=%s", quoted);
+  g_free (quoted);
+
+  quoted = rakia_quote_string (challenge->realm);
+  g_string_append_printf (headers, ", realm=%s", quoted);
+  g_free (quoted);
+
+  quoted = rakia_quote_string (challenge->nonce);
+  g_string_append_printf (headers, ", nonce=%s", quoted);
+  g_free (quoted);
+
+  quoted = rakia_quote_string (uri);
+  g_string_append_printf (headers, ", uri=%s, response=\"%s\"", quoted,
+      response);
+  g_free (quoted);
+
+  if (challenge->algorithm != NULL)
+    g_string_append_printf (headers, ", algorithm=%s", challenge->algorithm);
+
+  if (challenge->opaque != NULL)
+    {
+      quoted = rakia_quote_string (challenge->opaque);
+      g_string_append_printf (headers, ", opaque=%s", quoted);
+      g_free (quoted);
+    }
+
+  if (challenge->qop_auth)
+    g_string_append_printf (headers, ", qop=auth, nc=%s, cnonce=\"%s\"",
+        nc, cnonce);
+
+  DEBUG("pre-emptive %s for realm %s, nonce count %u", method,
+      challenge->realm, challenge->nc);
+
+  g_free (response);
+  g_free (ha2);
+  g_free (ha1);
+}
+
+/**
+ * rakia_auth_cache_dup_authorization:
+ * @self: the cache
+ * @method: the method of a request to send
+ * @uri: the Request-URI of the request
+ * @proxy: the outbound proxy the request goes through, or %NULL
+ *
+ * Returns: the Authorization and Proxy-Authorization headers answering
+ *  the challenges kept from the servers the request goes to, for
+ *  #SIPTAG_HEADER_STR, or %NULL if there are none with credentials
+ */
+gchar *
+rakia_auth_cache_dup_authorization (RakiaAuthCache *self,
+                                    const gchar *method,
+                                    const url_t *uri,
+                                    const url_t *proxy)
+{
+  su_home_t temphome[1] = { SU_HOME_INIT(temphome) };
+  GString *headers;
+  GHashTableIter iter;
+  gpointer value;
+  gchar *uri_str;
+  gchar *domain;
+  gchar *hop;
+
+  if (g_hash_table_size (self->challenges) == 0)
+    return NULL;
+
+  uri_str = url_as_string (temphome, uri);
+  if (uri_str == NULL)
+    {
+      su_home_deinit (temphome);
+      return NULL;
+    }
+
+  domain = priv_dup_server (uri);
+  hop = (proxy != NULL) ? priv_dup_server (proxy) : g_strdup (domain);
+  headers = g_string_new (NULL);
+
+  g_hash_table_iter_init (&iter, self->challenges);
+  while (g_hash_table_iter_next (&iter, NULL, &value))
+    {
+      Challenge *challenge = value;
+
+      if (tp_strdiff (challenge->server, challenge->proxy ? hop : domain))
+        continue;
+
+      if (challenge->user != NULL && challenge->password != NULL)
+        priv_append_authorization (headers, challenge, method, uri_str);
+    }
+
+  g_free (hop);
+  g_free (domain);
+  su_home_deinit (temphome);
+
+  if (headers->len == 0)
+    {
+      g_string_free (headers, TRUE);
+      return NULL;
+    }
+
+  return g_string_free (headers, FALSE);
+}
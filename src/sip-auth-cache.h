@@ -0,0 +1,44 @@
+/*
+ * sip-auth-cache.h - Digest challenges kept for pre-emptive authentication
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This work is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This work is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this work; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef __RAKIA_AUTH_CACHE_H__
+#define __RAKIA_AUTH_CACHE_H__
+
+#include <glib.h>
+
+#include <rakia/sofia-decls.h>
+
+G_BEGIN_DECLS
+
+typedef struct _RakiaAuthCache RakiaAuthCache;
+
+RakiaAuthCache *rakia_auth_cache_new (void);
+void rakia_auth_cache_free (RakiaAuthCache *self);
+
+void rakia_auth_cache_store_challenge (RakiaAuthCache *self,
+    const sip_t *sip, const url_t *proxy, const url_t *uri);
+void rakia_auth_cache_set_credentials (RakiaAuthCache *self,
+    const gchar *realm, const gchar *user, const gchar *password);
+
+gchar *rakia_auth_cache_dup_authorization (RakiaAuthCache *self,
+    const gchar *method, const url_t *uri, const url_t *proxy);
+
+G_END_DECLS
+
+#endif /* __RAKIA_AUTH_CACHE_H__ */
@@ -0,0 +1,456 @@
+/*
+ * sip-binding-probe.c - Probes of a NAT binding of a socket of its own
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This work is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This work is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this work; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/*
+ * Measuring how long a NAT keeps a binding without traffic takes a
+ * binding that nothing else uses: the keepalives of the SIP socket would
+ * refresh it between the probes. A probe has a UDP socket of its own,
+ * kept for all its requests, and sends an OPTIONS request from it to the
+ * proxy or registrar, which tells in the Via of its response the address
+ * and port the request came from. The request is retransmitted as
+ * RFC 3261 does for non-INVITE transactions over UDP.
+ */
+
+#include "config.h"
+
+#include <string.h>
+#include <sys/socket.h>
+
+#include <gio/gio.h>
+
+#include <telepathy-glib/util.h>
+
+#include <rakia/util.h>
+
+#include "sip-binding-probe.h"
+
+#include <sofia-sip/msg.h>
+#include <sofia-sip/sip_parser.h>
+
+#define DEBUG_FLAG RAKIA_DEBUG_CONNECTION
+#include "rakia/debug.h"
+
+struct _RakiaBindingProbe
+{
+  RakiaResolver *resolver;
+  gchar *host;
+  guint port;
+  gint family;
+  gchar *request_uri;
+  gchar *from_uri;
+  gchar *call_id;
+  gchar *tag;
+  guint32 cseq;
+
+  /* The address of the server once resolved, and our socket to it */
+  GSocketAddress *address;
+  gboolean resolving;
+  GSocket *socket;
+  GSource *source;
+
+  /* The probe under way */
+  RakiaBindingProbeCallback callback;
+  gpointer user_data;
+  gchar *branch;
+  gchar *request;
+  guint start_id;
+  guint retransmit_delay;
+  guint retransmit_id;
+  guint timeout_id;
+};
+
+static gchar *
+priv_random_token (const gchar *prefix)
+{
+  return g_strdup_printf ("%s%08x%08x", prefix, g_random_int (),
+      g_random_int ());
+}
+
+/**
+ * rakia_binding_probe_new:
+ * @resolver: the resolver to look up @host with
+ * @host: the host name or address of the server to send the probes to
+ * @port: the port of the server
+ * @family: AF_INET6 to look up @host as IPv6, AF_INET otherwise
+ * @request_uri: the Request-URI of the probes
+ * @from_uri: the address of record to send the probes from
+ *
+ * Returns: a new probe, which opens its socket with the first request
+ */
+RakiaBindingProbe *
+rakia_binding_probe_new (RakiaResolver *resolver,
+                         const gchar *host,
+                         guint port,
+                         gint family,
+                         const gchar *request_uri,
+                         const gchar *from_uri)
+{
+  RakiaBindingProbe *self = g_slice_new0 (RakiaBindingProbe);
+  gsize len = strlen (host);
+
+  self->resolver = rakia_resolver_ref (resolver);
+
+  /* Without the brackets of an IPv6 reference */
+  if (len > 2 && host[0] == '[' && host[len - 1] == ']')
+    self->host = g_strndup (host + 1, len - 2);
+  else
+    self->host = g_strdup (host);
+
+  self->port = port;
+  self->family = family;
+  self->request_uri = g_strdup (request_uri);
+  self->from_uri = g_strdup (from_uri);
+  self->call_id = priv_random_token ("");
+  self->tag = priv_random_token ("");
+
+  return self;
+}
+
+static void
+priv_stop (RakiaBindingProbe *self)
+{
+  if (self->start_id != 0)
+    {
+      g_source_remove (self->start_id);
+      self->start_id = 0;
+    }
+
+  if (self->retransmit_id != 0)
+    {
+      g_source_remove (self->retransmit_id);
+      self->retransmit_id = 0;
+    }
+
+  if (self->timeout_id != 0)
+    {
+      g_source_remove (self->timeout_id);
+      self->timeout_id = 0;
+    }
+
+  g_free (self->branch);
+  self->branch = NULL;
+  g_free (self->request);
+  self->request = NULL;
+
+  self->callback = NULL;
+  self->user_data = NULL;
+}
+
+void
+rakia_binding_probe_free (RakiaBindingProbe *self)
+{
+  priv_stop (self);
+
+  rakia_resolver_cancel (self->resolver, self);
+  rakia_resolver_unref (self->resolver);
+
+  if (self->source != NULL)
+    {
+      g_source_destroy (self->source);
+      g_source_unref (self->source);
+    }
+
+  if (self->socket != NULL)
+    g_object_unref (self->socket);
+
+  if (self->address != NULL)
+    g_object_unref (self->address);
+
+  g_free (self->host);
+  g_free (self->request_uri);
+  g_free (self->from_uri);
+  g_free (self->call_id);
+  g_free (self->tag);
+  g_slice_free (RakiaBindingProbe, self);
+}
+
+/* Calls back for the probe under way; the callback may free @self */
+static void
+priv_finish (RakiaBindingProbe *self,
+             const gchar *binding)
+{
+  RakiaBindingProbeCallback callback = self->callback;
+  gpointer user_data = self->user_data;
+
+  priv_stop (self);
+
+  callback (binding, user_data);
+}
+
+static gchar *
+priv_dup_binding (const sip_t *sip)
+{
+  sip_via_t const *via = sip->sip_via;
+
+  return g_strdup_printf ("%s:%s",
+      (via->v_received != NULL) ? via->v_received : via->v_host,
+      (via->v_rport != NULL) ? via->v_rport : "");
+}
+
+static gboolean
+priv_socket_cb (GSocket *socket,
+                GIOCondition condition,
+                gpointer data)
+{
+  RakiaBindingProbe *self = data;
+  GError *error = NULL;
+  gchar buffer[4096];
+  gssize len;
+  msg_t *msg;
+  sip_t const *sip;
+  gchar *binding = NULL;
+
+  len = g_socket_receive (socket, buffer, sizeof buffer, NULL, &error);
+  if (len < 0)
+    {
+      /* Such as an ICMP error to an earlier transmission */
+      DEBUG("receiving on the probe socket failed: %s", error->message);
+      g_error_free (error);
+      return TRUE;
+    }
+
+  if (self->callback == NULL)
+    return TRUE;
+
+  msg = msg_make (sip_default_mclass (), 0, buffer, len);
+  sip = (msg != NULL) ? sip_object (msg) : NULL;
+
+  if (sip != NULL && sip->sip_status != NULL && sip->sip_via != NULL
+      && sip->sip_status->st_status >= 200
+      && !tp_strdiff (sip->sip_via->v_branch, self->branch))
+    binding = priv_dup_binding (sip);
+
+  if (msg != NULL)
+    msg_destroy (msg);
+
+  if (binding == NULL)
+    return TRUE;
+
+  DEBUG("the probe socket is seen as %s", binding);
+
+  priv_finish (self, binding);
+  g_free (binding);
+
+  return TRUE;
+}
+
+static gboolean
+priv_retransmit_cb (gpointer data)
+{
+  RakiaBindingProbe *self = data;
+  GError *error = NULL;
+
+  if (g_socket_send (self->socket, self->request, strlen (self->request),
+          NULL, &error) < 0)
+    {
+      DEBUG("sending the probe failed: %s", error->message);
+      g_error_free (error);
+    }
+
+  self->retransmit_delay *= 2;
+  self->retransmit_id = g_timeout_add (self->retransmit_delay,
+      priv_retransmit_cb, self);
+
+  return FALSE;
+}
+
+static gboolean
+priv_open_socket (RakiaBindingProbe *self)
+{
+  GError *error = NULL;
+
+  self->socket = g_socket_new (
+      g_socket_address_get_family (self->address), G_SOCKET_TYPE_DATAGRAM,
+      G_SOCKET_PROTOCOL_UDP, &error);
+
+  if (self->socket != NULL)
+    {
+      g_socket_set_blocking (self->socket, FALSE);
+
+      if (g_socket_connect (self->socket, self->address, NULL, &error))
+        {
+          self->source = g_socket_create_source (self->socket, G_IO_IN,
+              NULL);
+          g_source_set_callback (self->source, (GSourceFunc) priv_socket_cb,
+              self, NULL);
+          g_source_attach (self->source, NULL);
+          return TRUE;
+        }
+
+      g_object_unref (self->socket);
+      self->socket = NULL;
+    }
+
+  WARNING ("cannot open a socket to probe %s:%u from: %s", self->host,
+      self->port, error->message);
+  g_error_free (error);
+
+  return FALSE;
+}
+
+static void
+priv_transmit (RakiaBindingProbe *self)
+{
+  GSocketAddress *local;
+  GInetAddress *local_address;
+  gchar *local_host;
+
+  if (self->socket == NULL && !priv_open_socket (self))
+    {
+      priv_finish (self, NULL);
+      return;
+    }
+
+  local = g_socket_get_local_address (self->socket, NULL);
+  g_return_if_fail (local != NULL);
+  local_address = g_inet_socket_address_get_address (
+      G_INET_SOCKET_ADDRESS (local));
+  local_host = g_inet_address_to_string (local_address);
+
+  self->request = g_strdup_printf (
+      "OPTIONS %s SIP/2.0\r\n"
+      "Via: SIP/2.0/UDP %s%s%s:%u;branch=%s;rport\r\n"
+      "Max-Forwards: 70\r\n"
+      "From: <%s>;tag=%s\r\n"
+      "To: <%s>\r\n"
+      "Call-ID: %s\r\n"
+      "CSeq: %u OPTIONS\r\n"
+      "Content-Length: 0\r\n"
+      "\r\n",
+      self->request_uri,
+      (g_inet_address_get_family (local_address) == G_SOCKET_FAMILY_IPV6)
+      ? "[" : "",
+      local_host,
+      (g_inet_address_get_family (local_address) == G_SOCKET_FAMILY_IPV6)
+      ? "]" : "",
+      g_inet_socket_address_get_port (G_INET_SOCKET_ADDRESS (local)),
+      self->branch,
+      self->from_uri, self->tag,
+      self->from_uri,
+      self->call_id,
+      ++self->cseq);
+
+  g_free (local_host);
+  g_object_unref (local);
+
+  self->retransmit_delay = RAKIA_BINDING_PROBE_RETRANSMIT / 2;
+  priv_retransmit_cb (self);
+}
+
+static void
+priv_set_address (RakiaBindingProbe *self,
+                  const gchar *host)
+{
+  GInetAddress *address = g_inet_address_new_from_string (host);
+
+  if (address == NULL)
+    return;
+
+  self->address = g_inet_socket_address_new (address, self->port);
+  g_object_unref (address);
+}
+
+static void
+priv_lookup_cb (const GArray *records,
+                gpointer user_data)
+{
+  RakiaBindingProbe *self = user_data;
+
+  self->resolving = FALSE;
+
+  if (records->len > 0)
+    priv_set_address (self,
+        g_array_index (records, RakiaResolverRecord, 0).target);
+
+  if (self->callback == NULL)
+    return;
+
+  if (self->address == NULL)
+    {
+      DEBUG("cannot resolve %s to probe it", self->host);
+      priv_finish (self, NULL);
+      return;
+    }
+
+  priv_transmit (self);
+}
+
+static gboolean
+priv_timeout_cb (gpointer data)
+{
+  RakiaBindingProbe *self = data;
+
+  self->timeout_id = 0;
+
+  DEBUG("no response to the probe of %s:%u", self->host, self->port);
+  priv_finish (self, NULL);
+
+  return FALSE;
+}
+
+static gboolean
+priv_start_cb (gpointer data)
+{
+  RakiaBindingProbe *self = data;
+
+  self->start_id = 0;
+
+  if (self->address == NULL && rakia_ip_address_is_valid (self->host))
+    priv_set_address (self, self->host);
+
+  if (self->address != NULL)
+    priv_transmit (self);
+  else if (!self->resolving)
+    {
+      self->resolving = TRUE;
+      rakia_resolver_lookup (self->resolver,
+          (self->family == AF_INET6) ? sres_type_aaaa : sres_type_a,
+          self->host, priv_lookup_cb, self);
+    }
+
+  return FALSE;
+}
+
+/**
+ * rakia_binding_probe_send:
+ * @self: the probe
+ * @callback: called with the binding the server sees, not before this
+ *  returns
+ * @user_data: data for @callback
+ *
+ * Sends a probe, retransmitted until there is a response or
+ * RAKIA_BINDING_PROBE_TIMEOUT seconds have gone by.
+ */
+void
+rakia_binding_probe_send (RakiaBindingProbe *self,
+                          RakiaBindingProbeCallback callback,
+                          gpointer user_data)
+{
+  g_return_if_fail (self->callback == NULL);
+
+  self->callback = callback;
+  self->user_data = user_data;
+  self->branch = priv_random_token ("z9hG4bK");
+  self->timeout_id = g_timeout_add_seconds (RAKIA_BINDING_PROBE_TIMEOUT,
+      priv_timeout_cb, self);
+
+  /* Answers from the cache, and failures to open the socket, come right
+   * away; wait with them for the caller to be done */
+  self->start_id = g_idle_add (priv_start_cb, self);
+}
@@ -0,0 +1,58 @@
+/*
+ * sip-binding-probe.h - Probes of a NAT binding of a socket of its own
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This work is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This work is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this work; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef __RAKIA_BINDING_PROBE_H__
+#define __RAKIA_BINDING_PROBE_H__
+
+#include <glib.h>
+
+#include "sip-resolver.h"
+
+G_BEGIN_DECLS
+
+/* Milliseconds before the first retransmission of a probe, doubled for
+ * each of the next ones, as T1 of RFC 3261 */
+#define RAKIA_BINDING_PROBE_RETRANSMIT 500
+
+/* Seconds after which a probe without a response is given up on */
+#define RAKIA_BINDING_PROBE_TIMEOUT 4
+
+typedef struct _RakiaBindingProbe RakiaBindingProbe;
+
+/**
+ * RakiaBindingProbeCallback:
+ * @binding: the public address and port of the socket of the probe, as
+ *  "received:rport" from the Via of the response, or %NULL without a
+ *  response
+ * @user_data: the data given to rakia_binding_probe_send ()
+ */
+typedef void (* RakiaBindingProbeCallback) (const gchar *binding,
+    gpointer user_data);
+
+RakiaBindingProbe *rakia_binding_probe_new (RakiaResolver *resolver,
+    const gchar *host, guint port, gint family, const gchar *request_uri,
+    const gchar *from_uri);
+void rakia_binding_probe_free (RakiaBindingProbe *self);
+
+void rakia_binding_probe_send (RakiaBindingProbe *self,
+    RakiaBindingProbeCallback callback, gpointer user_data);
+
+G_END_DECLS
+
+#endif /* __RAKIA_BINDING_PROBE_H__ */
@@ -23,16 +23,21 @@
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <sys/socket.h>
 
 #include <telepathy-glib/telepathy-glib.h>
 
+#include <rakia/event-target.h>
 #include <rakia/util.h>
 #include <rakia/handles.h>
 
 #include "sip-connection-helpers.h"
+#include "sip-binding-probe.h"
+#include "sip-heartbeat-slot.h"
 
 #include <sofia-sip/sip.h>
 #include <sofia-sip/sip_header.h>
+#include <sofia-sip/su_tagarg.h>
 #include <sofia-sip/tport_tag.h>
 
 #include "sip-connection-private.h"
@@ -53,6 +58,10 @@
  * REGISTER is special because it may tie resources on the server side */
 #define RAKIA_CONNECTION_MINIMUM_KEEPALIVE_INTERVAL_REGISTER 50
 
+/* Discovery of the keepalive interval doubles the idle time it probes
+ * the NAT binding with up to this, in seconds */
+#define RAKIA_CONNECTION_MAXIMUM_KEEPALIVE_PROBE 1800
+
 static sip_to_t *
 priv_sip_to_url_make (RakiaConnection *conn,
                       su_home_t *home,
@@ -113,57 +122,330 @@ rakia_conn_create_register_handle (RakiaConnection *conn,
 
   to = priv_sip_to_url_make (conn, temphome, contact);
 
+  /* On a shared stack, the From of REGISTER can't come from the stack
+   * default */
   if (to)
-      result = nua_handle (priv->sofia_nua, NULL, SIPTAG_TO(to), TAG_END());
+      result = nua_handle (priv->sofia_nua, NULL,
+                           SIPTAG_TO(to),
+                           TAG_IF(priv->stack_line != 0, SIPTAG_FROM(to)),
+                           TAG_NEXT(priv->handle_params));
 
   su_home_deinit (temphome);
 
   return result;
 }
 
+static nua_handle_t *
+priv_create_request_handle (RakiaConnection *conn,
+                            su_home_t *home,
+                            const sip_to_t *to)
+{
+  RakiaConnectionPrivate *priv = RAKIA_CONNECTION_GET_PRIVATE (conn);
+  sip_from_t *from;
+
+  g_assert (priv->sofia_home != NULL);
+  g_assert (priv->sofia_nua != NULL);
+
+  from = priv_sip_from_url_make (conn, home);
+
+  if (to == NULL || from == NULL)
+    return NULL;
+
+  return nua_handle (priv->sofia_nua, NULL,
+                     NUTAG_URL(to->a_url),
+                     SIPTAG_TO(to),
+                     SIPTAG_FROM(from),
+                     TAG_NEXT(priv->handle_params));
+}
+
 nua_handle_t *
 rakia_conn_create_request_handle (RakiaConnection *conn,
                                   TpHandle contact)
 {
-  RakiaConnectionPrivate *priv = RAKIA_CONNECTION_GET_PRIVATE (conn);
+  nua_handle_t *result;
+  su_home_t temphome[1] = { SU_HOME_INIT(temphome) };
+
+  result = priv_create_request_handle (conn, temphome,
+      priv_sip_to_url_make (conn, temphome, contact));
+
+  su_home_deinit (temphome);
+
+  return result;
+}
+
+/**
+ * rakia_conn_create_request_handle_like:
+ * @conn: the connection
+ * @nh: a handle made by rakia_conn_create_request_handle ()
+ *
+ * Returns: a new handle to the same destination as @nh, without the
+ *  dialog state @nh may have picked up
+ */
+nua_handle_t *
+rakia_conn_create_request_handle_like (RakiaConnection *conn,
+                                       nua_handle_t *nh)
+{
   nua_handle_t *result = NULL;
   su_home_t temphome[1] = { SU_HOME_INIT(temphome) };
-  sip_from_t *from;
+  const sip_to_t *remote;
   sip_to_t *to;
 
-  g_assert (priv->sofia_home != NULL);
-  g_assert (priv->sofia_nua != NULL);
-
-  to = priv_sip_to_url_make (conn, temphome, contact);
-  from = priv_sip_from_url_make (conn, temphome);
+  remote = nua_handle_remote (nh);
+  if (remote == NULL)
+    return NULL;
 
-  if (to != NULL && from != NULL)
-    result = nua_handle (priv->sofia_nua, NULL,
-                         NUTAG_URL(to->a_url),
-                         SIPTAG_TO(to),
-                         SIPTAG_FROM(from),
-                         TAG_END());
+  /* Without the tag of the failed attempt */
+  to = sip_to_create (temphome, (const url_string_t *) remote->a_url);
+  if (to != NULL)
+    {
+      to->a_display = remote->a_display;
+      result = priv_create_request_handle (conn, temphome, to);
+    }
 
   su_home_deinit (temphome);
 
   return result;
 }
 
+static gboolean
+priv_tag_is_set (tagi_t const *t)
+{
+  return t->t_tag != NULL && t->t_tag != tag_null && t->t_tag != tag_skip;
+}
+
+/* A stack shared by connections only has per-handle settings to
+ * offer for the account, hence these are stored in the connection
+ * and given to every handle it creates, and the ones the stack
+ * creates for requests coming to the connection */
+static tagi_t *
+priv_merge_handle_params (su_home_t *home,
+                          tagi_t *params,
+                          tagi_t const *update)
+{
+  tagi_t const *t;
+  tagi_t *merged;
+  tagi_t *result;
+  guint n = 0;
+
+  /* Counting is generous, as skipped items are copied over */
+  for (t = params; t != NULL; t = tl_next (t))
+    n++;
+  for (t = update; t != NULL; t = tl_next (t))
+    n++;
+
+  merged = g_new0 (tagi_t, n + 1);
+  n = 0;
+
+  for (t = params; t != NULL; t = tl_next (t))
+    if (priv_tag_is_set (t) && tl_find (update, t->t_tag) == NULL)
+      merged[n++] = *t;
+  for (t = update; t != NULL; t = tl_next (t))
+    if (priv_tag_is_set (t))
+      merged[n++] = *t;
+
+  result = tl_adup (home, TAG_NEXT(merged));
+
+  g_free (merged);
+  su_free (home, params);
+
+  return result;
+}
+
+void
+rakia_conn_set_nua_params (RakiaConnection *conn,
+                           tag_type_t tag,
+                           tag_value_t value,
+                           ...)
+{
+  RakiaConnectionPrivate *priv = RAKIA_CONNECTION_GET_PRIVATE (conn);
+  ta_list ta;
+
+  g_return_if_fail (priv->sofia_nua != NULL);
+
+  ta_start (ta, tag, value);
+
+  if (priv->stack_line == 0)
+    nua_set_params (priv->sofia_nua, ta_tags (ta));
+  else
+    priv->handle_params = priv_merge_handle_params (priv->sofia_home,
+        priv->handle_params, (ta).tl);
+
+  ta_end (ta);
+}
+
+void
+rakia_conn_apply_handle_params (RakiaConnection *conn,
+                                nua_handle_t *nh)
+{
+  RakiaConnectionPrivate *priv = RAKIA_CONNECTION_GET_PRIVATE (conn);
+
+  if (priv->handle_params != NULL)
+    nua_set_hparams (nh, TAG_NEXT(priv->handle_params));
+}
+
+/* Whether the address family to reach the proxy with is raced for, see
+ * rakia_conn_race_proxy_families () */
+static gboolean
+priv_proxy_has_family_race (RakiaConnection *conn)
+{
+  RakiaConnectionPrivate *priv = RAKIA_CONNECTION_GET_PRIVATE (conn);
+  const url_t *proxy = priv->proxy_url;
+
+  /* The binding is not ours to choose */
+  if (priv->local_ip_address != NULL)
+    return FALSE;
+
+  /* Without a port, the proxy is found with SRV lookups by the stack */
+  if (proxy == NULL || proxy->url_host == NULL || proxy->url_port == NULL
+      || proxy->url_host[0] == '['
+      || rakia_ip_address_is_valid (proxy->url_host))
+    return FALSE;
+
+  /* Datagrams do not wait for a connection to time out */
+  return proxy->url_type == url_sips
+      || (priv->transport != NULL
+          && g_ascii_strcasecmp (priv->transport, "tcp") == 0);
+}
+
+/**
+ * rakia_conn_can_share_stack:
+ * @conn: the connection
+ *
+ * Returns: %TRUE if the connection is to use the stack shared by the
+ *  connections of the manager: "share-stack" is set and none of its other
+ *  settings need a stack of its own
+ */
+gboolean
+rakia_conn_can_share_stack (RakiaConnection *conn)
+{
+  RakiaConnectionPrivate *priv = RAKIA_CONNECTION_GET_PRIVATE (conn);
+  const url_t *url = priv->proxy_url != NULL
+      ? priv->proxy_url : priv->account_url;
+
+  if (priv->shared_stack == NULL || !priv->share_stack)
+    return FALSE;
+
+  /* These need a transport of their own. The shared stack binds to
+   * both address families, leaving no family to race for either. */
+  return priv->local_ip_address == NULL
+      && priv->local_port == 0
+      && !priv->ignore_tls_errors
+      && url->url_type == url_sip
+      && !priv_proxy_has_family_race (conn);
+}
+
+/* The SRV service of the proxy, or NULL if it is not looked up */
+static const gchar *
+priv_proxy_srv_service (RakiaConnection *conn)
+{
+  RakiaConnectionPrivate *priv = RAKIA_CONNECTION_GET_PRIVATE (conn);
+  const gchar *transport = priv->transport;
+  char param[8];
+
+  /* Certificates are checked against the host name of the URL, which
+   * has to stay the proxy's own */
+  if (priv->proxy_url->url_type != url_sip)
+    return NULL;
+
+  if (priv->proxy_url->url_params != NULL
+      && url_param (priv->proxy_url->url_params, "transport", param,
+          sizeof param) > 0)
+    transport = param;
+
+  if (transport == NULL
+      || g_ascii_strcasecmp (transport, "auto") == 0
+      || g_ascii_strcasecmp (transport, "udp") == 0)
+    return "_sip._udp";
+
+  if (g_ascii_strcasecmp (transport, "tcp") == 0)
+    return "_sip._tcp";
+
+  return NULL;
+}
+
+/* The proxy URL, for the target in use if the proxy has been resolved
+ * through SRV records */
+static url_t *
+priv_dup_proxy_url (RakiaConnection *conn,
+                    su_home_t *home)
+{
+  RakiaConnectionPrivate *priv = RAKIA_CONNECTION_GET_PRIVATE (conn);
+  const RakiaProxyTarget *target = NULL;
+  url_t *url;
+
+  url = url_hdup (home, priv->proxy_url);
+  if (url == NULL)
+    return NULL;
+
+  if (priv->proxy_targets != NULL)
+    target = rakia_proxy_targets_get_current (priv->proxy_targets);
+
+  if (target == NULL)
+    return url;
+
+  url->url_host = su_strdup (home, target->host);
+  url->url_port = su_sprintf (home, "%u", target->port);
+
+  /* Given a port, the stack would go for UDP */
+  if (!tp_strdiff (priv_proxy_srv_service (conn), "_sip._tcp")
+      && !url_has_param (url, "transport"))
+    url_param_add (home, url, "transport=tcp");
+
+  return url;
+}
+
 void
 rakia_conn_update_proxy_and_transport (RakiaConnection *conn)
 {
   RakiaConnectionPrivate *priv = RAKIA_CONNECTION_GET_PRIVATE (conn);
 
-  if (priv->proxy_url != NULL)
+  if (priv->stack_line != 0)
+    {
+      su_home_t temphome[1] = { SU_HOME_INIT(temphome) };
+      sip_route_t *route = NULL;
+      char *params;
+
+      params = su_sprintf (temphome, "line=%u", priv->stack_line);
+
+      /* The outbound proxy is a stack-wide setting, so make it
+       * the first hop of a loose route */
+      if (priv->proxy_url != NULL)
+        {
+          url_t *route_url;
+          route_url = priv_dup_proxy_url (conn, temphome);
+          g_return_if_fail (route_url != NULL);
+          if (!url_has_param (route_url, "lr"))
+            url_param_add (temphome, route_url, "lr");
+          route = sip_route_create (temphome, route_url, NULL);
+
+          if (priv->transport != NULL
+              && (g_ascii_strcasecmp (priv->transport, "tcp") == 0
+                  || g_ascii_strcasecmp (priv->transport, "udp") == 0))
+            params = su_sprintf (temphome, "transport=%s;%s",
+                priv->transport, params);
+        }
+
+      rakia_conn_set_nua_params (conn,
+                                 TAG_IF(route, NUTAG_INITIAL_ROUTE(route)),
+                                 NUTAG_M_PARAMS(params),
+                                 TAG_NULL());
+
+      su_home_deinit (temphome);
+    }
+  else if (priv->proxy_url != NULL)
     {
       su_home_t temphome[1] = { SU_HOME_INIT(temphome) };
       sip_route_t *route = NULL;
       const char *params = NULL;
+      url_t *proxy_url;
+
+      proxy_url = priv_dup_proxy_url (conn, temphome);
+      g_return_if_fail (proxy_url != NULL);
 
       if (priv->loose_routing)
         {
           url_t *route_url;
-          route_url = url_hdup (temphome, priv->proxy_url);
+          route_url = url_hdup (temphome, proxy_url);
           g_return_if_fail (route_url != NULL);
           if (!url_has_param (route_url, "lr"))
             url_param_add (temphome, route_url, "lr");
@@ -180,12 +462,12 @@ rakia_conn_update_proxy_and_transport (RakiaConnection *conn)
             WARNING ("unrecognized transport parameter value: %s", priv->transport);
         }
 
-      nua_set_params (priv->sofia_nua,
-                      TAG_IF(route, NUTAG_INITIAL_ROUTE(route)),
-                      TAG_IF(!priv->loose_routing,
-                             NUTAG_PROXY(priv->proxy_url)),
-                      TAG_IF(params, NUTAG_M_PARAMS(params)),
-                      TAG_NULL());
+      rakia_conn_set_nua_params (conn,
+                                 TAG_IF(route, NUTAG_INITIAL_ROUTE(route)),
+                                 TAG_IF(!priv->loose_routing,
+                                        NUTAG_PROXY(proxy_url)),
+                                 TAG_IF(params, NUTAG_M_PARAMS(params)),
+                                 TAG_NULL());
 
       su_home_deinit (temphome);
     }
@@ -212,8 +494,10 @@ rakia_conn_get_local_url (RakiaConnection *conn)
       url->url_type = priv->account_url->url_type;
     }
 
+  /* Without an address to bind to, the stack sticks to IPv4 unless IPv6
+   * has won the race to the proxy */
   if (priv->local_ip_address == NULL)
-    url->url_host = "0";
+    url->url_host = (priv->signalling_family == AF_INET6) ? "[::]" : "0";
   else
     url->url_host = priv->local_ip_address;
 
@@ -238,8 +522,9 @@ rakia_conn_get_local_url (RakiaConnection *conn)
 }
 
 static GHashTable*
-priv_nua_get_outbound_options (nua_t* nua)
+priv_nua_get_outbound_options (RakiaConnection *conn)
 {
+  RakiaConnectionPrivate *priv = RAKIA_CONNECTION_GET_PRIVATE (conn);
   const char* outbound = NULL;
   GHashTable* option_table;
   gchar** options;
@@ -252,7 +537,18 @@ priv_nua_get_outbound_options (nua_t* nua)
                                         g_free,
                                         NULL);
 
-  nua_get_params (nua, NUTAG_OUTBOUND_REF(outbound), TAG_END());
+  if (priv->stack_line != 0)
+    {
+      tagi_t const *t = NULL;
+
+      if (priv->handle_params != NULL)
+        t = tl_find (priv->handle_params, nutag_outbound);
+      if (t != NULL)
+        outbound = (const char *) t->t_value;
+    }
+  else
+    nua_get_params (priv->sofia_nua, NUTAG_OUTBOUND_REF(outbound), TAG_END());
+
   if (outbound == NULL)
     return option_table;
 
@@ -306,7 +602,7 @@ priv_nua_outbound_vectorize_walk (gpointer key,
 }
 
 static void
-priv_nua_set_outbound_options (nua_t* nua, GHashTable* option_table)
+priv_nua_set_outbound_options (RakiaConnection *conn, GHashTable* option_table)
 {
   gchar* outbound;
   gchar** options;
@@ -329,7 +625,7 @@ priv_nua_set_outbound_options (nua_t* nua, GHashTable* option_table)
 
   /* deliver the option string to the stack */
   DEBUG ("setting outbound options %s", outbound);
-  nua_set_params (nua, NUTAG_OUTBOUND(outbound), TAG_NULL());
+  rakia_conn_set_nua_params (conn, NUTAG_OUTBOUND(outbound), TAG_NULL());
 
   g_free (outbound);
 }
@@ -342,7 +638,7 @@ rakia_conn_update_nua_outbound (RakiaConnection *conn)
 
   g_return_if_fail (priv->sofia_nua != NULL);
 
-  option_table = priv_nua_get_outbound_options (priv->sofia_nua);
+  option_table = priv_nua_get_outbound_options (conn);
 
   /* Purge existing occurrences of the affected options */
   g_hash_table_remove (option_table, "options-keepalive");
@@ -379,7 +675,7 @@ rakia_conn_update_nua_outbound (RakiaConnection *conn)
 
   /* Hand options back to the NUA */
 
-  priv_nua_set_outbound_options (priv->sofia_nua, option_table);
+  priv_nua_set_outbound_options (conn, option_table);
 
   g_hash_table_unref (option_table);
 }
@@ -422,10 +718,12 @@ rakia_conn_update_nua_keepalive_interval (RakiaConnection *conn)
 
   DEBUG("setting keepalive interval to %ld msec", keepalive_interval);
 
-  nua_set_params (priv->sofia_nua,
-                  NUTAG_KEEPALIVE(keepalive_interval),
-                  TPTAG_KEEPALIVE(keepalive_interval),
-                  TAG_NULL());
+  /* The transport keepalive is stack-wide and left alone when shared */
+  rakia_conn_set_nua_params (conn,
+                             NUTAG_KEEPALIVE(keepalive_interval),
+                             TAG_IF(priv->stack_line == 0,
+                                    TPTAG_KEEPALIVE(keepalive_interval)),
+                             TAG_NULL());
 }
 
 void
@@ -446,195 +744,512 @@ rakia_conn_update_nua_contact_features (RakiaConnection *conn)
       ? priv->keepalive_interval
       : RAKIA_CONNECTION_DEFAULT_KEEPALIVE_INTERVAL;
   contact_features = g_strdup_printf ("expires=%u", timeout);
-  nua_set_params(priv->sofia_nua,
-		 NUTAG_M_FEATURES(contact_features),
-		 TAG_NULL());
+  rakia_conn_set_nua_params (conn,
+                             NUTAG_M_FEATURES(contact_features),
+                             TAG_NULL());
   g_free (contact_features);
 }
 
+guint
+rakia_conn_get_keepalive_interval (RakiaConnection *conn)
+{
+  RakiaConnectionPrivate *priv = RAKIA_CONNECTION_GET_PRIVATE (conn);
+
+  if (priv->keepalive_mechanism == RAKIA_CONNECTION_KEEPALIVE_NONE)
+    return 0;
+
+  return priv->keepalive_interval_specified
+      ? priv->keepalive_interval
+      : RAKIA_CONNECTION_DEFAULT_KEEPALIVE_INTERVAL;
+}
+
+static gboolean
+priv_proxy_timeout_cb (gpointer data)
+{
+  RakiaConnection *conn = RAKIA_CONNECTION (data);
+  RakiaConnectionPrivate *priv = RAKIA_CONNECTION_GET_PRIVATE (conn);
+
+  priv->proxy_timeout_id = 0;
+
+  DEBUG("no response to REGISTER within %u seconds",
+      RAKIA_PROXY_TARGET_TIMEOUT);
+
+  /* With no target left, the transaction goes on until it times out */
+  rakia_conn_fail_over_proxy (conn, NULL);
+
+  return FALSE;
+}
+
+void
+rakia_conn_register (RakiaConnection *conn)
+{
+  RakiaConnectionPrivate *priv = RAKIA_CONNECTION_GET_PRIVATE (conn);
+  gchar *expires;
+
+  g_return_if_fail (priv->register_op != NULL);
+
+  /* The stack refreshes the registration at a random point of the time
+   * granted; a different time asked for by each account spreads the
+   * refreshes further in case the registrar grants it as it is */
+  expires = g_strdup_printf ("%u",
+      rakia_registration_jitter_expires (priv->register_expires));
+
+  DEBUG("registering for %s seconds", expires);
+
+  nua_register (priv->register_op,
+      TAG_IF(priv->register_expires != 0, SIPTAG_EXPIRES_STR(expires)),
+      TAG_NULL());
+  priv->register_time = g_get_monotonic_time ();
+
+  g_free (expires);
+
+  /* The refreshes sent by the stack are not timed, a 408 to them has
+   * to do */
+  if (priv->proxy_targets != NULL)
+    {
+      if (priv->proxy_timeout_id != 0)
+        g_source_remove (priv->proxy_timeout_id);
+
+      priv->proxy_timeout_id = g_timeout_add_seconds (
+          RAKIA_PROXY_TARGET_TIMEOUT, priv_proxy_timeout_cb, conn);
+    }
+}
+
+/**
+ * rakia_conn_next_proxy_target:
+ * @conn: the connection
+ * @sent_time: the monotonic time the failed request was sent at
+ * @sip: the response the request failed with, or %NULL if it got none
+ *
+ * Blacklists the proxy target in use and goes on to the next one, unless
+ * the request was sent before the last such change: it then went through
+ * a target already given up on, and the current one is left alone.
+ *
+ * Returns: %TRUE if the request can be sent again through another
+ *  target, %FALSE if the proxy is not resolved through SRV records or
+ *  has no target left
+ */
+gboolean
+rakia_conn_next_proxy_target (RakiaConnection *conn,
+                              gint64 sent_time,
+                              const sip_t *sip)
+{
+  RakiaConnectionPrivate *priv = RAKIA_CONNECTION_GET_PRIVATE (conn);
+  guint blacklist_time = RAKIA_PROXY_TARGET_BLACKLIST_TIME;
+
+  if (priv->proxy_targets == NULL)
+    return FALSE;
+
+  if (sent_time < priv->proxy_failover_time)
+    {
+      DEBUG("the request went through a proxy target given up on already");
+      return TRUE;
+    }
+
+  if (sip != NULL && sip->sip_retry_after != NULL
+      && sip->sip_retry_after->af_delta > 0)
+    blacklist_time = sip->sip_retry_after->af_delta;
+
+  rakia_proxy_targets_fail (priv->proxy_targets, blacklist_time);
+
+  if (rakia_proxy_targets_next (priv->proxy_targets) == NULL)
+    return FALSE;
+
+  priv->proxy_failover_time = g_get_monotonic_time ();
+
+  rakia_conn_update_proxy_and_transport (conn);
+
+  return TRUE;
+}
+
+/**
+ * rakia_conn_fail_over_proxy:
+ * @conn: the connection
+ * @sip: the response to REGISTER the proxy target failed with, or %NULL
+ *  if it did not answer in time
+ *
+ * Registers again through the next proxy target, see
+ * rakia_conn_next_proxy_target (), dropping the REGISTER transaction
+ * under way.
+ *
+ * Returns: %TRUE if the connection went on to another target, %FALSE if
+ *  the proxy is not resolved through SRV records or has no target left
+ */
+gboolean
+rakia_conn_fail_over_proxy (RakiaConnection *conn,
+                            const sip_t *sip)
+{
+  RakiaConnectionPrivate *priv = RAKIA_CONNECTION_GET_PRIVATE (conn);
+  nua_handle_t *register_op;
+
+  if (priv->register_op == NULL)
+    return FALSE;
+
+  if (!rakia_conn_next_proxy_target (conn, priv->register_time, sip))
+    return FALSE;
+
+  register_op = rakia_conn_create_register_handle (conn,
+      tp_base_connection_get_self_handle ((TpBaseConnection *) conn));
+  if (register_op == NULL)
+    return FALSE;
+
+  rakia_event_target_detach (priv->register_op);
+  nua_handle_destroy (priv->register_op);
+
+  priv->register_op = register_op;
+  rakia_event_target_attach (priv->register_op, (GObject *) conn);
+
+  rakia_conn_register (conn);
+
+  return TRUE;
+}
+
+/*
+ * Discovery of the keepalive interval
+ *
+ * The interval the keepalives need is the time a NAT keeps a binding
+ * without traffic, which is usually much longer than the default. To
+ * find it out while the keepalives of the stack go on as configured,
+ * OPTIONS requests are sent to the proxy or registrar from a socket of
+ * their own (see src/sip-binding-probe.c), with ever longer idle times
+ * between them. As long as the Via of the responses has the same
+ * received and rport parameters as the first one, the binding survived;
+ * once they change, it had expired, and the keepalive interval is set
+ * to four fifths of the longest idle time it survived.
+ *
+ * Only the UDP bindings are probed, their lifetime being much shorter
+ * than the one of TCP connections through the same NAT. Lost responses
+ * make the binding look shorter-lived than it is, and the margin covers
+ * some of the rest.
+ */
+
+static RakiaResolver *priv_get_resolver (RakiaConnection *conn);
+static void priv_keepalive_probe_send (RakiaConnection *conn);
+
+static gboolean
+priv_keepalive_probe_timeout (gpointer data)
+{
+  RakiaConnection *conn = RAKIA_CONNECTION (data);
+  RakiaConnectionPrivate *priv = RAKIA_CONNECTION_GET_PRIVATE (conn);
+
+  priv->keepalive_probe_id = 0;
+
+  priv_keepalive_probe_send (conn);
+
+  return FALSE;
+}
+
 static void
-rakia_conn_set_stun_server_address (RakiaConnection *conn, const gchar *address)
+priv_keepalive_discovery_finish (RakiaConnection *conn,
+                                 guint interval)
 {
   RakiaConnectionPrivate *priv = RAKIA_CONNECTION_GET_PRIVATE (conn);
-  g_return_if_fail (priv->media_manager != NULL);
-  g_object_set (priv->media_manager,
-                "stun-server", address,
-                "stun-port", priv->stun_port,
-                NULL);
+
+  rakia_conn_stop_keepalive_discovery (conn);
+
+  priv->keepalive_interval = interval;
+  priv->keepalive_interval_specified = TRUE;
+  rakia_conn_update_nua_keepalive_interval (conn);
 }
 
 static void
-priv_stun_resolver_cb (sres_context_t *ctx, sres_query_t *query, sres_record_t **answers)
+priv_keepalive_discovery_settle (RakiaConnection *conn)
 {
-  RakiaConnection *conn = RAKIA_CONNECTION (ctx);
   RakiaConnectionPrivate *priv = RAKIA_CONNECTION_GET_PRIVATE (conn);
-  sres_a_record_t *ans = NULL;
+  guint interval;
 
-  if (NULL != answers)
-    {
-      int i;
-      GPtrArray *items = g_ptr_array_sized_new (1);
+  interval = priv->binding_lifetime - priv->binding_lifetime / 5;
+  if (interval < RAKIA_CONNECTION_MINIMUM_KEEPALIVE_INTERVAL)
+    interval = RAKIA_CONNECTION_MINIMUM_KEEPALIVE_INTERVAL;
+
+  MESSAGE ("the NAT binding lasts at least %u seconds idle, "
+      "using a keepalive interval of %u seconds", priv->binding_lifetime,
+      interval);
 
-      for (i = 0; NULL != answers[i]; i++)
+  priv_keepalive_discovery_finish (conn, interval);
+}
+
+static void
+priv_keepalive_probe_cb (const gchar *binding,
+                         gpointer user_data)
+{
+  RakiaConnection *conn = RAKIA_CONNECTION (user_data);
+  RakiaConnectionPrivate *priv = RAKIA_CONNECTION_GET_PRIVATE (conn);
+
+  if (binding == NULL)
+    {
+      if (priv->keepalive_probe_binding == NULL)
         {
-          if ((0 == answers[i]->sr_record->r_status)
-              && (sres_type_a == answers[i]->sr_record->r_type))
-            {
-              g_ptr_array_add (items, answers[i]->sr_a);
-            }
+          WARNING ("cannot probe the NAT binding, "
+              "keeping the keepalive interval");
+          rakia_conn_stop_keepalive_discovery (conn);
         }
-
-      if (items->len > 0)
+      else
         {
-          ans = g_ptr_array_index (items, g_random_int_range (0, items->len));
+          priv_keepalive_discovery_settle (conn);
         }
 
-      g_ptr_array_unref (items);
+      return;
+    }
+
+  if (priv->keepalive_probe_binding == NULL)
+    {
+      DEBUG("NAT binding is %s", binding);
+      priv->keepalive_probe_binding = g_strdup (binding);
     }
+  else if (!tp_strdiff (binding, priv->keepalive_probe_binding))
+    {
+      priv->binding_lifetime = priv->keepalive_probe_interval;
+
+      if (priv->keepalive_probe_interval
+          >= RAKIA_CONNECTION_MAXIMUM_KEEPALIVE_PROBE)
+        {
+          priv_keepalive_discovery_settle (conn);
+          return;
+        }
 
-  if (NULL != ans)
-    rakia_conn_set_stun_server_address (conn,
-                                        inet_ntoa (ans->a_addr));
+      priv->keepalive_probe_interval = MIN (
+          priv->keepalive_probe_interval * 2,
+          RAKIA_CONNECTION_MAXIMUM_KEEPALIVE_PROBE);
+    }
   else
-    MESSAGE ("could not resolve STUN server address, ignoring");
+    {
+      DEBUG("NAT binding changed from %s to %s after %u seconds",
+          priv->keepalive_probe_binding, binding,
+          priv->keepalive_probe_interval);
+
+      priv_keepalive_discovery_settle (conn);
+      return;
+    }
 
-  sres_free_answers (priv->sofia_resolver, answers);
+  priv->keepalive_probe_id = g_timeout_add_seconds (
+      priv->keepalive_probe_interval, priv_keepalive_probe_timeout, conn);
+}
+
+static void
+priv_keepalive_probe_send (RakiaConnection *conn)
+{
+  RakiaConnectionPrivate *priv = RAKIA_CONNECTION_GET_PRIVATE (conn);
+
+  DEBUG("probing the NAT binding after %u seconds",
+      (priv->keepalive_probe_binding != NULL)
+      ? priv->keepalive_probe_interval : 0);
+
+  rakia_binding_probe_send (priv->keepalive_probe, priv_keepalive_probe_cb,
+      conn);
 }
 
 void
-rakia_conn_resolv_stun_server (RakiaConnection *conn, const gchar *stun_host)
+rakia_conn_discover_keepalive_interval (RakiaConnection *conn)
 {
   RakiaConnectionPrivate *priv = RAKIA_CONNECTION_GET_PRIVATE (conn);
-  struct in_addr test_addr;
+  su_home_t temphome[1] = { SU_HOME_INIT(temphome) };
+  const gchar *start = g_getenv ("RAKIA_KEEPALIVE_PROBE_START");
+  url_t *target;
+  url_t *server;
+  gchar *target_str;
+  gchar *from_str;
 
-  if (stun_host == NULL)
+  g_return_if_fail (priv->account_url != NULL);
+  g_return_if_fail (priv->keepalive_probe == NULL);
+
+  switch (priv->keepalive_mechanism)
     {
-      rakia_conn_set_stun_server_address (conn, NULL);
+    case RAKIA_CONNECTION_KEEPALIVE_AUTO:
+    case RAKIA_CONNECTION_KEEPALIVE_OPTIONS:
+      break;
+    default:
+      DEBUG("the keepalive interval is only discovered for OPTIONS "
+          "keepalives");
       return;
     }
 
-  /* FIXME: support IPv6 as well */
-  if (inet_aton (stun_host, &test_addr))
+  if (priv->transport != NULL
+      && g_ascii_strcasecmp (priv->transport, "udp") != 0
+      && g_ascii_strcasecmp (priv->transport, "auto") != 0)
     {
-      rakia_conn_set_stun_server_address (conn, stun_host);
+      DEBUG("the keepalive interval is only discovered over UDP");
       return;
     }
 
-  if (NULL == priv->sofia_resolver)
+  /* The registrar, or the domain of the account, through the proxy
+   * the registrations go through */
+  if (priv->registrar_url != NULL)
+    target = url_hdup (temphome, priv->registrar_url);
+  else
     {
-      su_root_t *root = NULL;
+      target = url_hdup (temphome, priv->account_url);
+      target->url_user = NULL;
+      target->url_password = NULL;
+      target->url_params = NULL;
+      target->url_headers = NULL;
+    }
 
-      g_object_get (conn, "sofia-root", &root, NULL);
+  server = (priv->proxy_url != NULL) ? priv_dup_proxy_url (conn, temphome)
+      : target;
+
+  target_str = url_as_string (temphome, target);
+  from_str = url_as_string (temphome, priv->account_url);
+
+  priv->keepalive_probe = rakia_binding_probe_new (priv_get_resolver (conn),
+      server->url_host, (guint) atoi (url_port (server)),
+      priv->signalling_family, target_str, from_str);
+
+  su_home_deinit (temphome);
 
-      priv->sofia_resolver = sres_resolver_create (root, NULL, TAG_END());
+  /* Start from the interval known to work, or from the one given for
+   * testing; the keepalives of the stack go on meanwhile */
+  priv->keepalive_probe_interval = rakia_conn_get_keepalive_interval (conn);
+  if (start != NULL)
+    {
+      gchar *end;
+      guint64 value = g_ascii_strtoull (start, &end, 10);
+
+      if (g_ascii_isdigit (*start) && *end == '\0' && value > 0
+          && value <= RAKIA_CONNECTION_MAXIMUM_KEEPALIVE_PROBE)
+        priv->keepalive_probe_interval = value;
+      else
+        WARNING ("ignoring invalid RAKIA_KEEPALIVE_PROBE_START value '%s'",
+            start);
+    }
+  priv->binding_lifetime = 0;
 
-      g_return_if_fail (priv->sofia_resolver != NULL);
+  priv_keepalive_probe_send (conn);
+}
+
+void
+rakia_conn_stop_keepalive_discovery (RakiaConnection *conn)
+{
+  RakiaConnectionPrivate *priv = RAKIA_CONNECTION_GET_PRIVATE (conn);
+
+  if (priv->keepalive_probe_id != 0)
+    {
+      g_source_remove (priv->keepalive_probe_id);
+      priv->keepalive_probe_id = 0;
     }
 
-  DEBUG("creating a new resolver query for STUN host name %s", stun_host);
+  if (priv->keepalive_probe != NULL)
+    {
+      rakia_binding_probe_free (priv->keepalive_probe);
+      priv->keepalive_probe = NULL;
+    }
 
-  sres_query (priv->sofia_resolver,
-              priv_stun_resolver_cb,
-              (sres_context_t *) conn,
-              sres_type_a,
-              stun_host);
+  g_free (priv->keepalive_probe_binding);
+  priv->keepalive_probe_binding = NULL;
 }
 
 static void
-priv_stun_discover_cb (sres_context_t *ctx,
-                       sres_query_t *query,
-                       sres_record_t **answers)
+rakia_conn_set_stun_server_address (RakiaConnection *conn, const gchar *address)
 {
-  RakiaConnection *conn = RAKIA_CONNECTION (ctx);
   RakiaConnectionPrivate *priv = RAKIA_CONNECTION_GET_PRIVATE (conn);
-  sres_srv_record_t *sel = NULL;
-  guint n_sel_items = 0;
-  guint i;
+  g_return_if_fail (priv->media_manager != NULL);
+  g_object_set (priv->media_manager,
+                "stun-server", address,
+                "stun-port", priv->stun_port,
+                NULL);
+}
 
-  if (answers == NULL)
-    return;
+static RakiaResolver *
+priv_get_resolver (RakiaConnection *conn)
+{
+  RakiaConnectionPrivate *priv = RAKIA_CONNECTION_GET_PRIVATE (conn);
 
-  for (i = 0; NULL != answers[i]; i++)
+  if (priv->resolver == NULL)
     {
-      if (answers[i]->sr_record->r_status != 0)
-        continue;
-      if (G_UNLIKELY (answers[i]->sr_record->r_type != sres_type_srv))
-        continue;
+      su_root_t *root = NULL;
 
-      if (sel == NULL
-          || (answers[i]->sr_srv->srv_priority < sel->srv_priority))
-        {
-          sel = answers[i]->sr_srv;
-          n_sel_items = 1;
-        }
-      else if (answers[i]->sr_srv->srv_priority == sel->srv_priority)
-        {
-          n_sel_items++;
-        }
+      g_object_get (conn, "sofia-root", &root, NULL);
+
+      priv->resolver = rakia_resolver_new (root);
     }
 
-  if (n_sel_items > 1)
-    {
-      /* Random selection procedure as recommended in RFC 2782 */
-      GArray *items = g_array_sized_new (FALSE,
-                                         TRUE,
-                                         sizeof (sres_srv_record_t *),
-                                         n_sel_items);
-      int sum = 0;
-      int dice;
-      sres_srv_record_t *rec;
+  return priv->resolver;
+}
 
-      g_assert (sel != NULL);
+/* The media go the way of the signalling */
+static guint16
+priv_stun_first_type (RakiaConnection *conn)
+{
+  RakiaConnectionPrivate *priv = RAKIA_CONNECTION_GET_PRIVATE (conn);
 
-      for (i = 0; NULL != answers[i]; i++)
-        {
-          if (answers[i]->sr_record->r_status != 0)
-            continue;
-          if (G_UNLIKELY (answers[i]->sr_record->r_type != sres_type_srv))
-            continue;
+  return (priv->signalling_family == AF_INET6) ? sres_type_aaaa : sres_type_a;
+}
 
-          rec = answers[i]->sr_srv; 
-          if (rec->srv_priority != sel->srv_priority)
-            continue;
+static void
+priv_stun_resolver_cb (const GArray *records, gpointer user_data)
+{
+  RakiaConnection *conn = RAKIA_CONNECTION (user_data);
+  RakiaConnectionPrivate *priv = RAKIA_CONNECTION_GET_PRIVATE (conn);
 
-          if (rec->srv_weight == 0)
-            g_array_prepend_val (items, rec);
-          else
-            g_array_append_val (items, rec);
-        }
+  if (records->len > 0)
+    {
+      rakia_conn_set_stun_server_address (conn,
+          g_array_index (records, RakiaResolverRecord,
+              g_random_int_range (0, records->len)).target);
+      return;
+    }
 
-      g_assert (n_sel_items == items->len);
+  /* The server may have addresses of the other family only */
+  if (priv->stun_lookup_type == priv_stun_first_type (conn))
+    {
+      priv->stun_lookup_type = (priv->stun_lookup_type == sres_type_a)
+          ? sres_type_aaaa : sres_type_a;
 
-      for (i = 0; i < n_sel_items; i++)
-        {
-          rec = g_array_index (items, sres_srv_record_t *, i);
-          sum = (rec->srv_weight += sum);
-        }
+      DEBUG("no %s records for STUN host name %s, trying %s",
+          priv->stun_lookup_type == sres_type_a ? "AAAA" : "A",
+          priv->stun_lookup,
+          priv->stun_lookup_type == sres_type_a ? "A" : "AAAA");
 
-      dice = g_random_int_range (0, sum + 1);
+      rakia_resolver_lookup (priv_get_resolver (conn), priv->stun_lookup_type,
+          priv->stun_lookup, priv_stun_resolver_cb, conn);
+      return;
+    }
 
-      for (i = 0; i < n_sel_items; i++)
-        {
-          rec = g_array_index (items, sres_srv_record_t *, i);
-          if (rec->srv_weight >= dice)
-            {
-              sel = rec;
-              break;
-            }
-        }
+  MESSAGE ("could not resolve STUN server address, ignoring");
+}
 
-      g_array_unref (items);
+void
+rakia_conn_resolv_stun_server (RakiaConnection *conn, const gchar *stun_host)
+{
+  RakiaConnectionPrivate *priv = RAKIA_CONNECTION_GET_PRIVATE (conn);
+
+  if (stun_host == NULL)
+    {
+      rakia_conn_set_stun_server_address (conn, NULL);
+      return;
     }
 
-  if (sel != NULL)
+  if (rakia_ip_address_is_valid (stun_host))
     {
-      DEBUG ("discovery got STUN server %s:%u",
-             sel->srv_target, sel->srv_port);
-      priv->stun_port = sel->srv_port;
-      rakia_conn_resolv_stun_server (conn, sel->srv_target);
+      rakia_conn_set_stun_server_address (conn, stun_host);
+      return;
     }
 
-  sres_free_answers (priv->sofia_resolver, answers);
+  DEBUG("looking up STUN host name %s", stun_host);
+
+  g_free (priv->stun_lookup);
+  priv->stun_lookup = g_strdup (stun_host);
+  priv->stun_lookup_type = priv_stun_first_type (conn);
+
+  rakia_resolver_lookup (priv_get_resolver (conn), priv->stun_lookup_type,
+      priv->stun_lookup, priv_stun_resolver_cb, conn);
+}
+
+static void
+priv_stun_discover_cb (const GArray *records, gpointer user_data)
+{
+  RakiaConnection *conn = RAKIA_CONNECTION (user_data);
+  RakiaConnectionPrivate *priv = RAKIA_CONNECTION_GET_PRIVATE (conn);
+  const RakiaResolverRecord *sel;
+
+  sel = rakia_resolver_select_srv (records);
+
+  if (sel != NULL)
+    {
+      DEBUG ("discovery got STUN server %s:%u", sel->target, sel->port);
+      priv->stun_port = sel->port;
+      rakia_conn_resolv_stun_server (conn, sel->target);
+    }
 }
 
 void
@@ -643,7 +1258,6 @@ rakia_conn_discover_stun_server (RakiaConnection *conn)
   RakiaConnectionPrivate *priv = RAKIA_CONNECTION_GET_PRIVATE (conn);
   const char *url_host;
   char *srv_domain;
-  struct in_addr test_addr;
 
   g_return_if_fail (priv->account_url != NULL);
 
@@ -655,34 +1269,132 @@ rakia_conn_discover_stun_server (RakiaConnection *conn)
       return;
     }
 
-  /* FIXME: support IPv6 as well */
-  if (inet_aton (url_host, &test_addr))
+  if (url_host[0] == '[' || rakia_ip_address_is_valid (url_host))
     {
       DEBUG("AOR URI has IP address, not making STUN SRV lookup");
       return;
     }
 
-  if (NULL == priv->sofia_resolver)
-    {
-      su_root_t *root = NULL;
+  DEBUG("looking up STUN SRV records for domain %s", url_host);
 
-      g_object_get (conn, "sofia-root", &root, NULL);
+  srv_domain = g_strdup_printf ("_stun._udp.%s", url_host);
+
+  rakia_resolver_lookup (priv_get_resolver (conn), sres_type_srv, srv_domain,
+      priv_stun_discover_cb, conn);
+
+  g_free (srv_domain);
+}
+
+/**
+ * rakia_conn_race_proxy_families:
+ * @conn: the connection, with its own stack to create
+ * @callback: called with the family to bind the stack to
+ *
+ * Picks the address family for the stack of the connection to reach a
+ * stream proxy with, racing connections over both if it's not known
+ * already, see src/sip-happy-eyeballs.c.
+ *
+ * Returns: %TRUE if @callback is to be called once the race is over,
+ *  %FALSE if the family has been set right away
+ */
+gboolean
+rakia_conn_race_proxy_families (RakiaConnection *conn,
+                                RakiaHappyEyeballsCallback callback)
+{
+  RakiaConnectionPrivate *priv = RAKIA_CONNECTION_GET_PRIVATE (conn);
+  const url_t *proxy = priv->proxy_url;
+  guint port;
 
-      priv->sofia_resolver = sres_resolver_create (root, NULL, TAG_END());
-      g_return_if_fail (priv->sofia_resolver != NULL);
+  priv->signalling_family = AF_UNSPEC;
+
+  if (!priv_proxy_has_family_race (conn))
+    return FALSE;
+
+  port = atoi (proxy->url_port);
+
+  priv->signalling_family = rakia_resolver_get_preferred_family (
+      priv_get_resolver (conn), proxy->url_host, port);
+  if (priv->signalling_family != AF_UNSPEC)
+    {
+      DEBUG("going for IPv%c to %s:%u as last time",
+          priv->signalling_family == AF_INET6 ? '6' : '4',
+          proxy->url_host, port);
+      return FALSE;
     }
 
-  DEBUG("creating a new STUN SRV query for domain %s", url_host);
+  priv->happy_eyeballs = rakia_happy_eyeballs_start (priv_get_resolver (conn),
+      proxy->url_host, port, callback, conn);
 
-  srv_domain = g_strdup_printf ("_stun._udp.%s", url_host);
+  return TRUE;
+}
+
+/**
+ * rakia_conn_lookup_proxy_targets:
+ * @conn: the connection
+ * @callback: called with the answer to the SRV query for the proxy, to
+ *  be given to rakia_conn_set_proxy_targets ()
+ *
+ * Returns: %TRUE if the proxy is looked up, %FALSE if it is left to the
+ *  stack to resolve
+ */
+gboolean
+rakia_conn_lookup_proxy_targets (RakiaConnection *conn,
+                                 RakiaResolverCallback callback)
+{
+  RakiaConnectionPrivate *priv = RAKIA_CONNECTION_GET_PRIVATE (conn);
+  const url_t *proxy = priv->proxy_url;
+  const gchar *service;
+  gchar *srv_domain;
+
+  /* With a port or an address, there is nothing to look up */
+  if (proxy == NULL || proxy->url_host == NULL || proxy->url_port != NULL
+      || proxy->url_host[0] == '['
+      || rakia_ip_address_is_valid (proxy->url_host))
+    return FALSE;
 
-  sres_query (priv->sofia_resolver,
-              priv_stun_discover_cb,
-              (sres_context_t *) conn,
-              sres_type_srv,
-              srv_domain);
+  service = priv_proxy_srv_service (conn);
+  if (service == NULL)
+    return FALSE;
+
+  srv_domain = g_strdup_printf ("%s.%s", service, proxy->url_host);
+
+  DEBUG("looking up proxy SRV records %s", srv_domain);
+
+  rakia_resolver_lookup (priv_get_resolver (conn), sres_type_srv, srv_domain,
+      callback, conn);
 
   g_free (srv_domain);
+
+  return TRUE;
+}
+
+/**
+ * rakia_conn_set_proxy_targets:
+ * @conn: the connection
+ * @records: the answer to the SRV query for the proxy
+ *
+ * Sets the targets of @records to go through in turn, starting with the
+ * first one; without targets, the stack resolves the proxy itself.
+ */
+void
+rakia_conn_set_proxy_targets (RakiaConnection *conn,
+                              const GArray *records)
+{
+  RakiaConnectionPrivate *priv = RAKIA_CONNECTION_GET_PRIVATE (conn);
+
+  if (priv->proxy_targets != NULL)
+    rakia_proxy_targets_free (priv->proxy_targets);
+
+  priv->proxy_targets = rakia_proxy_targets_new (priv_get_resolver (conn),
+      records);
+
+  if (priv->proxy_targets == NULL)
+    {
+      DEBUG("no proxy SRV records, leaving the proxy to the stack");
+      return;
+    }
+
+  rakia_proxy_targets_next (priv->proxy_targets);
 }
 
 gchar *
@@ -698,19 +1410,19 @@ rakia_handle_normalize (TpHandleRepoIface *repo,
       error);
 }
 
-#ifdef HAVE_LIBIPHB
-
+/* The global wakeup slots of libiphb, in seconds, which the fallback
+ * below uses as well, so that all processes wake up together */
 static gushort
 recommended_intervals[] = {
-    IPHB_GS_WAIT_10_HOURS,
-    IPHB_GS_WAIT_2_HOURS,
-    IPHB_GS_WAIT_1_HOUR,
-    IPHB_GS_WAIT_30_MINS,
-    IPHB_GS_WAIT_10_MINS * 2, /* It aligns with the 1 hour slot. */
-    IPHB_GS_WAIT_10_MINS,
-    IPHB_GS_WAIT_5_MINS,
-    IPHB_GS_WAIT_2_5_MINS,
-    IPHB_GS_WAIT_30_SEC};
+    10 * 60 * 60, /* IPHB_GS_WAIT_10_HOURS */
+    2 * 60 * 60,  /* IPHB_GS_WAIT_2_HOURS */
+    60 * 60,      /* IPHB_GS_WAIT_1_HOUR */
+    30 * 60,      /* IPHB_GS_WAIT_30_MINS */
+    20 * 60,      /* It aligns with the 1 hour slot. */
+    10 * 60,      /* IPHB_GS_WAIT_10_MINS */
+    5 * 60,       /* IPHB_GS_WAIT_5_MINS */
+    150,          /* IPHB_GS_WAIT_2_5_MINS */
+    30};          /* IPHB_GS_WAIT_30_SEC */
 
 static gushort
 get_system_sync_interval (guint max_interval)
@@ -726,6 +1438,57 @@ get_system_sync_interval (guint max_interval)
   return (gushort) MIN (max_interval, G_MAXUSHORT);
 }
 
+/* Without the IP heartbeat service, a source of our own wakes the main
+ * loop on wall-clock slots when the deferrable timers of the connections
+ * are due, see src/sip-heartbeat-slot.c */
+static guint heartbeat_slot_users = 0;
+static GSource *heartbeat_slot_source = NULL;
+
+static void
+heartbeat_slot_join (RakiaConnection *self)
+{
+  RakiaConnectionPrivate *priv = RAKIA_CONNECTION_GET_PRIVATE (self);
+  /* A slot longer than the deferral limit would leave the timers to fire
+   * on their own at that limit */
+  guint slot = get_system_sync_interval (RAKIA_DEFER_TIMEOUT);
+  su_root_t *root = NULL;
+
+  g_assert (!priv->heartbeat_slot);
+
+  DEBUG("using wakeup slots of %u seconds", slot);
+
+  priv->heartbeat_slot = TRUE;
+
+  if (heartbeat_slot_users++ > 0)
+    return;
+
+  /* The connections all run on the root of the connection manager */
+  g_object_get (self, "sofia-root", &root, NULL);
+
+  heartbeat_slot_source = rakia_heartbeat_slot_source_new (root, slot);
+  g_source_attach (heartbeat_slot_source, NULL);
+}
+
+static void
+heartbeat_slot_leave (RakiaConnection *self)
+{
+  RakiaConnectionPrivate *priv = RAKIA_CONNECTION_GET_PRIVATE (self);
+
+  if (!priv->heartbeat_slot)
+    return;
+
+  priv->heartbeat_slot = FALSE;
+
+  if (--heartbeat_slot_users == 0)
+    {
+      g_source_destroy (heartbeat_slot_source);
+      g_source_unref (heartbeat_slot_source);
+      heartbeat_slot_source = NULL;
+    }
+}
+
+#ifdef HAVE_LIBIPHB
+
 static void
 heartbeat_schedule_wait (RakiaConnection *self)
 {
@@ -790,6 +1553,7 @@ rakia_conn_heartbeat_init (RakiaConnection *self)
   if (priv->heartbeat == NULL)
     {
       WARNING ("opening IP heartbeat failed: %s", strerror (errno));
+      heartbeat_slot_join (self);
       return;
     }
 
@@ -812,6 +1576,8 @@ rakia_conn_heartbeat_init (RakiaConnection *self)
 
   heartbeat_schedule_wait (self);
 
+#else
+  heartbeat_slot_join (self);
 #endif /* HAVE_LIBIPHB */
 }
 
@@ -821,7 +1587,11 @@ rakia_conn_heartbeat_shutdown (RakiaConnection *self)
 #ifdef HAVE_LIBIPHB
   RakiaConnectionPrivate *priv = RAKIA_CONNECTION_GET_PRIVATE (self);
   su_root_t *root = NULL;
+#endif
+
+  heartbeat_slot_leave (self);
 
+#ifdef HAVE_LIBIPHB
   if (priv->heartbeat_wait_id == 0)
     return;
 
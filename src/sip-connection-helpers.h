@@ -24,6 +24,8 @@
 #include <glib.h>
 
 #include "sip-connection.h"
+#include "sip-happy-eyeballs.h"
+#include "sip-resolver.h"
 #include <rakia/sofia-decls.h>
 
 G_BEGIN_DECLS
@@ -36,12 +38,18 @@ nua_handle_t *rakia_conn_create_register_handle (RakiaConnection *conn,
     TpHandle contact);
 nua_handle_t *rakia_conn_create_request_handle (RakiaConnection *conn,
     TpHandle contact);
+nua_handle_t *rakia_conn_create_request_handle_like (RakiaConnection *conn,
+    nua_handle_t *nh);
 
 /***********************************************************************
  * Functions for managing NUA outbound/keepalive parameters and STUN settings
  ***********************************************************************/
 
 const url_t * rakia_conn_get_local_url (RakiaConnection *conn);
+void rakia_conn_set_nua_params (RakiaConnection *conn, tag_type_t tag,
+    tag_value_t value, ...);
+void rakia_conn_apply_handle_params (RakiaConnection *conn, nua_handle_t *nh);
+gboolean rakia_conn_can_share_stack (RakiaConnection *conn);
 void rakia_conn_update_proxy_and_transport (RakiaConnection *conn);
 void rakia_conn_update_nua_outbound (RakiaConnection *conn);
 void rakia_conn_update_nua_keepalive_interval (RakiaConnection *conn);
@@ -49,6 +57,26 @@ void rakia_conn_update_nua_contact_features (RakiaConnection *conn);
 void rakia_conn_update_stun_server (RakiaConnection *conn);
 void rakia_conn_resolv_stun_server (RakiaConnection *conn, const gchar *stun_host);
 void rakia_conn_discover_stun_server (RakiaConnection *conn);
+gboolean rakia_conn_race_proxy_families (RakiaConnection *conn,
+    RakiaHappyEyeballsCallback callback);
+gboolean rakia_conn_lookup_proxy_targets (RakiaConnection *conn,
+    RakiaResolverCallback callback);
+void rakia_conn_set_proxy_targets (RakiaConnection *conn,
+    const GArray *records);
+gboolean rakia_conn_next_proxy_target (RakiaConnection *conn,
+    gint64 sent_time, const sip_t *sip);
+
+guint rakia_conn_get_keepalive_interval (RakiaConnection *conn);
+void rakia_conn_discover_keepalive_interval (RakiaConnection *conn);
+void rakia_conn_stop_keepalive_discovery (RakiaConnection *conn);
+
+/***********************************************************************
+ * Registration
+ ***********************************************************************/
+
+void rakia_conn_register (RakiaConnection *conn);
+gboolean rakia_conn_fail_over_proxy (RakiaConnection *conn,
+    const sip_t *sip);
 
 /***********************************************************************
  * Heartbeat management for keepalives
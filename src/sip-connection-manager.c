@@ -49,6 +49,10 @@ G_DEFINE_TYPE(RakiaConnectionManager, rakia_connection_manager,
 struct _RakiaConnectionManagerPrivate
 {
   su_root_t *sofia_root;
+  RakiaSharedStack *shared_stack;
+  RakiaResolver *resolver;
+  RakiaRegistrationScheduler *registration_scheduler;
+  RakiaNetworkMonitor *network_monitor;
   TpDebugSender *debug_sender;
 };
 
@@ -60,6 +64,9 @@ rakia_connection_manager_init (RakiaConnectionManager *obj)
   RakiaConnectionManagerPrivate *priv = G_TYPE_INSTANCE_GET_PRIVATE (obj,
         RAKIA_TYPE_CONNECTION_MANAGER, RakiaConnectionManagerPrivate);
   GSource *source;
+  gchar *dns_cache_file;
+  const gchar *ramp;
+  guint ramp_window;
 
   obj->priv = priv;
 
@@ -73,9 +80,47 @@ rakia_connection_manager_init (RakiaConnectionManager *obj)
   source = su_glib_root_gsource(priv->sofia_root);
   g_source_attach(source, NULL);
 
-#ifdef HAVE_LIBIPHB
+  /* Deferrable timers wait for the heartbeat wakeups, see
+   * rakia_conn_heartbeat_init () */
   su_root_set_max_defer (priv->sofia_root, RAKIA_DEFER_TIMEOUT * 1000L);
-#endif
+
+  priv->resolver = rakia_resolver_new (priv->sofia_root);
+
+  /* Answers saved by the previous run let the first connections use the
+   * STUN server without waiting for the DNS */
+  dns_cache_file = g_strdup (g_getenv ("RAKIA_DNS_CACHE_FILE"));
+  if (dns_cache_file == NULL)
+    dns_cache_file = g_build_filename (g_get_user_cache_dir (),
+        "telepathy-rakia", "dns-cache", NULL);
+  if (*dns_cache_file != '\0')
+    rakia_resolver_set_cache_file (priv->resolver, dns_cache_file);
+  g_free (dns_cache_file);
+
+  /* Spread the registrations of accounts connecting all at once, see
+   * src/sip-registration-scheduler.c */
+  ramp_window = RAKIA_REGISTRATION_DEFAULT_RAMP;
+  ramp = g_getenv ("RAKIA_REGISTER_RAMP");
+  if (ramp != NULL)
+    {
+      gchar *end;
+      guint64 value = g_ascii_strtoull (ramp, &end, 10);
+
+      if (!g_ascii_isdigit (*ramp) || *end != '\0'
+          || value > G_MAXINT / 1000)
+        WARNING ("ignoring invalid RAKIA_REGISTER_RAMP value '%s'", ramp);
+      else
+        ramp_window = value;
+    }
+  priv->registration_scheduler = rakia_registration_scheduler_new (
+      ramp_window);
+
+  /* The connections register again when the network changes, see
+   * src/sip-network-monitor.c */
+  priv->network_monitor = rakia_network_monitor_new ();
+
+  /* One NUA instance for the connections with the share-stack parameter
+   * set, created when the first one connects; see docs/design.txt */
+  priv->shared_stack = rakia_shared_stack_new (priv->sofia_root);
 }
 
 static void
@@ -90,7 +135,9 @@ rakia_connection_manager_constructed (GObject *object)
   if (constructed != NULL)
     constructed (object);
 
-  protocol = rakia_protocol_new (self->priv->sofia_root);
+  protocol = rakia_protocol_new (self->priv->sofia_root,
+      self->priv->shared_stack, self->priv->resolver,
+      self->priv->registration_scheduler, self->priv->network_monitor);
   tp_base_connection_manager_add_protocol (base, protocol);
   g_object_unref (protocol);
 }
@@ -119,6 +166,18 @@ rakia_connection_manager_finalize (GObject *object)
   RakiaConnectionManagerPrivate *priv = RAKIA_CONNECTION_MANAGER_GET_PRIVATE (self);
   GSource *source;
 
+  /* The shared stack must be done with its shutdown for it to be
+   * destroyed below, before the root it runs in */
+  rakia_shared_stack_wait_shutdown (priv->shared_stack);
+  rakia_shared_stack_unref (priv->shared_stack);
+
+  rakia_resolver_unref (priv->resolver);
+  rakia_registration_scheduler_unref (priv->registration_scheduler);
+  g_object_unref (priv->network_monitor);
+
+  /* The stacks of the last connections may be waiting to be destroyed */
+  rakia_base_connection_sofia_flush ();
+
   source = su_glib_root_gsource(priv->sofia_root);
   g_source_destroy(source);
   su_root_destroy(priv->sofia_root);
@@ -24,8 +24,16 @@
 #include "config.h"
 
 #include <rakia/media-manager.h>
+#include <rakia/text-manager.h>
 #include <rakia/sofia-decls.h>
-#include <sofia-sip/sresolv.h>
+#include "sip-shared-stack.h"
+#include "sip-resolver.h"
+#include "sip-auth-cache.h"
+#include "sip-registration-scheduler.h"
+#include "sip-network-monitor.h"
+#include "sip-happy-eyeballs.h"
+#include "sip-proxy-targets.h"
+#include "sip-binding-probe.h"
 
 #include <telepathy-glib/telepathy-glib.h>
 
@@ -37,21 +45,41 @@ struct _RakiaConnectionPrivate
 {
   nua_t  *sofia_nua;
   su_home_t *sofia_home;
+  RakiaSharedStack *shared_stack;
+  guint stack_line;           /* line on shared_stack, 0 if not on it */
+  tagi_t *handle_params;      /* account settings for each handle when
+                                 on the shared stack */
   nua_handle_t *register_op;
-  sres_resolver_t *sofia_resolver;
+  RakiaRegistrationScheduler *registration_scheduler;
+  guint register_id;          /* initial REGISTER delayed by the scheduler */
+  guint register_expires;     /* expiry asked for */
+  RakiaNetworkMonitor *network_monitor;
+  gulong network_changed_id;
+  RakiaResolver *resolver;
   const url_t *account_url;
   url_t *proxy_url;
   url_t *registrar_url;
+  RakiaHappyEyeballs *happy_eyeballs; /* racing the families to the proxy */
+  gint signalling_family;     /* AF_INET6 if the stack is bound to IPv6 */
+  RakiaProxyTargets *proxy_targets; /* if the proxy has SRV records */
+  guint proxy_timeout_id;     /* waiting for a response to REGISTER */
+  gint64 proxy_failover_time; /* when the last target was given up on */
+  gint64 register_time;       /* when the last REGISTER was sent */
+  guint start_stack_id;       /* once the proxy has been looked up */
 
 #ifdef HAVE_LIBIPHB
   iphb_t    heartbeat;
   su_wait_t heartbeat_wait[1];
   int       heartbeat_wait_id;
 #endif
+  gboolean heartbeat_slot;    /* on the wakeup slots of the fallback */
 
   gchar *registrar_realm;
+  RakiaAuthCache *auth_cache;
 
   RakiaMediaManager *media_manager;
+  RakiaTextManager *text_manager;
+  guint memory_log_id;
   TpSimplePasswordManager *password_manager;
 
   gchar *address;
@@ -61,8 +89,16 @@ struct _RakiaConnectionPrivate
   gchar *transport;
   RakiaConnectionKeepaliveMechanism keepalive_mechanism;
   guint keepalive_interval;
+  gboolean discover_keepalive_interval;
+  RakiaBindingProbe *keepalive_probe; /* while discovering the interval */
+  guint keepalive_probe_id;
+  guint keepalive_probe_interval;    /* idle time being probed, in s */
+  gchar *keepalive_probe_binding;    /* received:rport of the last probe */
+  guint binding_lifetime;            /* longest idle time survived, in s */
   gboolean discover_stun;
   gchar *stun_host;
+  gchar *stun_lookup;         /* STUN host name being looked up */
+  guint16 stun_lookup_type;
   guint stun_port;
   gchar *local_ip_address;
   guint local_port;
@@ -71,7 +107,14 @@ struct _RakiaConnectionPrivate
   gboolean loose_routing;
   gboolean discover_binding;
   gboolean immutable_streams;
+  gboolean fast_start;
+  gboolean rtcp_mux;
+  gboolean ice;
+  guint max_calls;
+  guint max_call_rate;
+  guint max_main_loop_lag;
   gboolean ignore_tls_errors;
+  gboolean share_stack;
 
   gboolean keepalive_interval_specified;
 
@@ -80,6 +123,9 @@ struct _RakiaConnectionPrivate
 
 /* #define RAKIA_PROTOCOL_STRING               "sip" */
 
+#define RAKIA_CONNECTION_ALLOW_METHODS \
+    "INVITE, ACK, BYE, CANCEL, OPTIONS, PRACK, MESSAGE, UPDATE"
+
 #define RAKIA_CONNECTION_GET_PRIVATE(o)     (G_TYPE_INSTANCE_GET_PRIVATE ((o), RAKIA_TYPE_CONNECTION, RakiaConnectionPrivate))
 
 #endif /*__RAKIA_CONNECTION_PRIVATE_H__*/
@@ -31,6 +31,8 @@
 
 #include <telepathy-glib/telepathy-glib-dbus.h>
 
+#include "extensions/extensions.h"
+
 #include <rakia/event-target.h>
 #include <rakia/handles.h>
 #include <rakia/connection-aliasing.h>
@@ -57,6 +59,18 @@ G_DEFINE_TYPE_WITH_CODE (RakiaConnection, rakia_connection,
     G_IMPLEMENT_INTERFACE (TP_TYPE_SVC_CONNECTION_INTERFACE_ALIASING,
         rakia_connection_aliasing_svc_iface_init);
     G_IMPLEMENT_INTERFACE (RAKIA_TYPE_CONNECTION_ALIASING, NULL);
+    G_IMPLEMENT_INTERFACE (RAKIA_TYPE_SVC_CONNECTION_INTERFACE_SETUP_STATISTICS,
+        NULL);
+    G_IMPLEMENT_INTERFACE (RAKIA_TYPE_SVC_CONNECTION_INTERFACE_MEMORY_USAGE,
+        NULL);
+    G_IMPLEMENT_INTERFACE (
+        RAKIA_TYPE_SVC_CONNECTION_INTERFACE_REGISTRATION_LOAD, NULL);
+    G_IMPLEMENT_INTERFACE (RAKIA_TYPE_SVC_CONNECTION_INTERFACE_KEEPALIVE,
+        NULL);
+    G_IMPLEMENT_INTERFACE (
+        RAKIA_TYPE_SVC_CONNECTION_INTERFACE_ADMISSION_CONTROL, NULL);
+    G_IMPLEMENT_INTERFACE (
+        RAKIA_TYPE_SVC_CONNECTION_INTERFACE_PROXY_TARGETS, NULL);
 );
 
 
@@ -74,17 +88,29 @@ enum
   PROP_LOOSE_ROUTING,       /**< enable loose routing behavior */
   PROP_KEEPALIVE_MECHANISM, /**< keepalive mechanism as defined by RakiaConnectionKeepaliveMechanism */
   PROP_KEEPALIVE_INTERVAL, /**< keepalive interval in seconds */
+  PROP_DISCOVER_KEEPALIVE_INTERVAL, /**< probe the NAT binding lifetime */
   PROP_DISCOVER_BINDING,   /**< enable discovery of public binding */
   PROP_DISCOVER_STUN,      /**< Discover STUN server name using DNS SRV lookup */
   PROP_STUN_SERVER,        /**< STUN server address (if not set, derived
 			        from public SIP address */
   PROP_STUN_PORT,          /**< STUN port */
   PROP_IMMUTABLE_STREAMS,  /**< If the session content is immutable once set up */
+  PROP_FAST_START,         /**< If the INVITE can be sent once audio is ready */
+  PROP_RTCP_MUX,           /**< If RTCP can be multiplexed with RTP */
+  PROP_ICE,                /**< If the media streams use ICE */
+  PROP_MAX_CALLS,          /**< Max concurrent calls, 0 for no limit */
+  PROP_MAX_CALL_RATE,      /**< Max new incoming calls per second */
+  PROP_MAX_MAIN_LOOP_LAG,  /**< Main loop lag in ms above which calls are shed */
   PROP_LOCAL_IP_ADDRESS,   /**< Local IP address (normally not needed, chosen by stack) */
   PROP_LOCAL_PORT,         /**< Local port for SIP (normally not needed, chosen by stack) */
   PROP_EXTRA_AUTH_USER,	   /**< User name to use for extra authentication challenges */
   PROP_EXTRA_AUTH_PASSWORD,/**< Password to use for extra authentication challenges */
   PROP_IGNORE_TLS_ERRORS,  /**< If true, TLS errors will be ignored */
+  PROP_SHARE_STACK,        /**< If true, use the shared stack if possible */
+  PROP_SHARED_STACK,       /**< Stack shared with other connections, if any */
+  PROP_RESOLVER,           /**< DNS resolver shared with other connections */
+  PROP_REGISTRATION_SCHEDULER, /**< Staggers the registrations of connections */
+  PROP_NETWORK_MONITOR,    /**< Signals changes of the local network */
   PROP_SOFIA_NUA,          /**< Base class accessing nua_t */
   LAST_PROPERTY
 };
@@ -135,9 +161,9 @@ rakia_connection_create_channel_managers (TpBaseConnection *conn)
   RakiaConnectionPrivate *priv = RAKIA_CONNECTION_GET_PRIVATE (self);
   GPtrArray *channel_managers = g_ptr_array_sized_new (2);
 
-  g_ptr_array_add (channel_managers,
-      g_object_new (RAKIA_TYPE_TEXT_MANAGER,
-        "connection", self, NULL));
+  priv->text_manager = g_object_new (RAKIA_TYPE_TEXT_MANAGER,
+        "connection", self, NULL);
+  g_ptr_array_add (channel_managers, priv->text_manager);
 
   priv->media_manager = g_object_new (RAKIA_TYPE_MEDIA_MANAGER,
         "connection", self, NULL);
@@ -156,6 +182,9 @@ rakia_connection_init (RakiaConnection *self)
   RakiaConnectionPrivate *priv = RAKIA_CONNECTION_GET_PRIVATE (self);
 
   priv->sofia_home = su_home_new(sizeof (su_home_t));
+  rakia_su_home_track_usage (priv->sofia_home);
+
+  priv->auth_cache = rakia_auth_cache_new ();
 
   rakia_connection_aliasing_init (self);
 }
@@ -202,9 +231,9 @@ rakia_connection_set_property (GObject      *object,
   case PROP_REGISTRAR: {
     priv->registrar_url = priv_url_from_string_value (priv->sofia_home, value);
     if (priv->sofia_nua)
-      nua_set_params(priv->sofia_nua,
-                     NUTAG_REGISTRAR(priv->registrar_url),
-                     TAG_END());
+      rakia_conn_set_nua_params (self,
+                                 NUTAG_REGISTRAR(priv->registrar_url),
+                                 TAG_END());
     break;
   }
   case PROP_LOOSE_ROUTING: {
@@ -245,6 +274,9 @@ rakia_connection_set_property (GObject      *object,
       }
     break;
   }
+  case PROP_DISCOVER_KEEPALIVE_INTERVAL:
+    priv->discover_keepalive_interval = g_value_get_boolean (value);
+    break;
   case PROP_DISCOVER_BINDING: {
     priv->discover_binding = g_value_get_boolean (value);
     if (priv->sofia_nua)
@@ -266,6 +298,24 @@ rakia_connection_set_property (GObject      *object,
   case PROP_IMMUTABLE_STREAMS:
     priv->immutable_streams = g_value_get_boolean (value);
     break;
+  case PROP_FAST_START:
+    priv->fast_start = g_value_get_boolean (value);
+    break;
+  case PROP_RTCP_MUX:
+    priv->rtcp_mux = g_value_get_boolean (value);
+    break;
+  case PROP_ICE:
+    priv->ice = g_value_get_boolean (value);
+    break;
+  case PROP_MAX_CALLS:
+    priv->max_calls = g_value_get_uint (value);
+    break;
+  case PROP_MAX_CALL_RATE:
+    priv->max_call_rate = g_value_get_uint (value);
+    break;
+  case PROP_MAX_MAIN_LOOP_LAG:
+    priv->max_main_loop_lag = g_value_get_uint (value);
+    break;
   case PROP_LOCAL_IP_ADDRESS: {
     g_free (priv->local_ip_address);
     priv->local_ip_address = g_value_dup_string (value);
@@ -288,6 +338,31 @@ rakia_connection_set_property (GObject      *object,
   case PROP_IGNORE_TLS_ERRORS:
     priv->ignore_tls_errors = g_value_get_boolean (value);
     break;
+  case PROP_SHARE_STACK:
+    priv->share_stack = g_value_get_boolean (value);
+    break;
+  case PROP_SHARED_STACK: {
+    RakiaSharedStack *stack = g_value_get_pointer (value);
+    if (stack != NULL)
+      priv->shared_stack = rakia_shared_stack_ref (stack);
+    break;
+  }
+  case PROP_RESOLVER: {
+    RakiaResolver *resolver = g_value_get_pointer (value);
+    if (resolver != NULL)
+      priv->resolver = rakia_resolver_ref (resolver);
+    break;
+  }
+  case PROP_REGISTRATION_SCHEDULER: {
+    RakiaRegistrationScheduler *scheduler = g_value_get_pointer (value);
+    if (scheduler != NULL)
+      priv->registration_scheduler =
+          rakia_registration_scheduler_ref (scheduler);
+    break;
+  }
+  case PROP_NETWORK_MONITOR:
+    priv->network_monitor = g_value_dup_object (value);
+    break;
   default:
     /* We don't have any other property... */
     G_OBJECT_WARN_INVALID_PROPERTY_ID(object,property_id,pspec);
@@ -347,6 +422,9 @@ rakia_connection_get_property (GObject      *object,
     g_value_set_uint (value, priv->keepalive_interval);
     break;
   }
+  case PROP_DISCOVER_KEEPALIVE_INTERVAL:
+    g_value_set_boolean (value, priv->discover_keepalive_interval);
+    break;
   case PROP_DISCOVER_BINDING: {
     g_value_set_boolean (value, priv->discover_binding);
     break;
@@ -365,6 +443,24 @@ rakia_connection_get_property (GObject      *object,
   case PROP_IMMUTABLE_STREAMS:
     g_value_set_boolean (value, priv->immutable_streams);
     break;
+  case PROP_FAST_START:
+    g_value_set_boolean (value, priv->fast_start);
+    break;
+  case PROP_RTCP_MUX:
+    g_value_set_boolean (value, priv->rtcp_mux);
+    break;
+  case PROP_ICE:
+    g_value_set_boolean (value, priv->ice);
+    break;
+  case PROP_MAX_CALLS:
+    g_value_set_uint (value, priv->max_calls);
+    break;
+  case PROP_MAX_CALL_RATE:
+    g_value_set_uint (value, priv->max_call_rate);
+    break;
+  case PROP_MAX_MAIN_LOOP_LAG:
+    g_value_set_uint (value, priv->max_main_loop_lag);
+    break;
   case PROP_LOCAL_IP_ADDRESS: {
     g_value_set_string (value, priv->local_ip_address);
     break;
@@ -376,6 +472,9 @@ rakia_connection_get_property (GObject      *object,
   case PROP_IGNORE_TLS_ERRORS:
     g_value_set_boolean (value, priv->ignore_tls_errors);
     break;
+  case PROP_SHARE_STACK:
+    g_value_set_boolean (value, priv->share_stack);
+    break;
   case PROP_SOFIA_NUA: {
     g_value_set_pointer (value, priv->sofia_nua);
     break;
@@ -410,6 +509,12 @@ static const gchar *interfaces_always_present[] = {
     TP_IFACE_CONNECTION_INTERFACE_REQUESTS,
     TP_IFACE_CONNECTION_INTERFACE_CONTACTS,
     TP_IFACE_CONNECTION_INTERFACE_ALIASING,
+    RAKIA_IFACE_CONNECTION_INTERFACE_SETUP_STATISTICS,
+    RAKIA_IFACE_CONNECTION_INTERFACE_MEMORY_USAGE,
+    RAKIA_IFACE_CONNECTION_INTERFACE_REGISTRATION_LOAD,
+    RAKIA_IFACE_CONNECTION_INTERFACE_KEEPALIVE,
+    RAKIA_IFACE_CONNECTION_INTERFACE_PROXY_TARGETS,
+    RAKIA_IFACE_CONNECTION_INTERFACE_ADMISSION_CONTROL,
     NULL };
 
 const gchar **
@@ -434,10 +539,280 @@ get_interfaces_always_present (TpBaseConnection *base)
   return arr;
 }
 
+static void
+rakia_connection_get_setup_statistics (GObject *object,
+    GQuark iface,
+    GQuark name,
+    GValue *value,
+    gpointer getter_data)
+{
+  RakiaConnectionPrivate *priv = RAKIA_CONNECTION_GET_PRIVATE (object);
+  const gchar *prop = getter_data;
+
+  if (!tp_strdiff (prop, "MilestoneHistograms"))
+    {
+      if (priv->media_manager != NULL)
+        g_value_take_boxed (value,
+            rakia_media_manager_dup_setup_histograms (priv->media_manager));
+      else
+        g_value_take_boxed (value,
+            g_hash_table_new (g_str_hash, g_str_equal));
+    }
+  else if (!tp_strdiff (prop, "CallsMeasured"))
+    {
+      g_value_set_uint (value, (priv->media_manager != NULL)
+          ? rakia_media_manager_get_calls_measured (priv->media_manager)
+          : 0);
+    }
+  else
+    {
+      g_assert_not_reached ();
+    }
+}
+
+typedef struct {
+    gsize connection;
+    gsize sessions;
+    gsize pending_messages;
+    gsize uris;
+    guint call_channels;
+    guint text_channels;
+} RakiaConnectionMemoryUsage;
+
+static gsize
+rakia_connection_memory_usage_total (const RakiaConnectionMemoryUsage *usage)
+{
+  return usage->connection + usage->sessions + usage->pending_messages
+      + usage->uris;
+}
+
+static void
+priv_get_memory_usage (RakiaConnection *self,
+                       RakiaConnectionMemoryUsage *usage)
+{
+  RakiaConnectionPrivate *priv = RAKIA_CONNECTION_GET_PRIVATE (self);
+
+  memset (usage, 0, sizeof (*usage));
+
+  usage->connection = sizeof (RakiaConnectionPrivate)
+      + rakia_su_home_get_usage (priv->sofia_home);
+
+  if (priv->media_manager != NULL)
+    usage->sessions = rakia_media_manager_get_memory_usage (
+        priv->media_manager, &usage->call_channels);
+
+  if (priv->text_manager != NULL)
+    usage->pending_messages = rakia_text_manager_get_memory_usage (
+        priv->text_manager, &usage->text_channels);
+
+  usage->uris = rakia_base_connection_get_uri_cache_usage (
+      RAKIA_BASE_CONNECTION (self));
+}
+
+static void
+rakia_connection_get_memory_usage (GObject *object,
+    GQuark iface,
+    GQuark name,
+    GValue *value,
+    gpointer getter_data)
+{
+  const gchar *prop = getter_data;
+  RakiaConnectionMemoryUsage usage;
+
+  priv_get_memory_usage (RAKIA_CONNECTION (object), &usage);
+
+  if (!tp_strdiff (prop, "MemoryUsage"))
+    {
+      GHashTable *table = g_hash_table_new (g_str_hash, g_str_equal);
+
+      g_hash_table_insert (table, "connection",
+          GUINT_TO_POINTER (usage.connection));
+      g_hash_table_insert (table, "sessions",
+          GUINT_TO_POINTER (usage.sessions));
+      g_hash_table_insert (table, "pending-messages",
+          GUINT_TO_POINTER (usage.pending_messages));
+      g_hash_table_insert (table, "uris",
+          GUINT_TO_POINTER (usage.uris));
+      g_hash_table_insert (table, "total",
+          GUINT_TO_POINTER (rakia_connection_memory_usage_total (&usage)));
+
+      g_value_take_boxed (value, table);
+    }
+  else if (!tp_strdiff (prop, "CallChannels"))
+    {
+      g_value_set_uint (value, usage.call_channels);
+    }
+  else if (!tp_strdiff (prop, "TextChannels"))
+    {
+      g_value_set_uint (value, usage.text_channels);
+    }
+  else
+    {
+      g_assert_not_reached ();
+    }
+}
+
+static void
+rakia_connection_get_registration_load (GObject *object,
+    GQuark iface,
+    GQuark name,
+    GValue *value,
+    gpointer getter_data)
+{
+  RakiaConnectionPrivate *priv = RAKIA_CONNECTION_GET_PRIVATE (object);
+  RakiaRegistrationScheduler *scheduler = priv->registration_scheduler;
+  const gchar *prop = getter_data;
+
+  if (!tp_strdiff (prop, "RegistrationHistogram"))
+    {
+      if (scheduler != NULL)
+        g_value_take_boxed (value,
+            rakia_registration_scheduler_dup_histogram (scheduler));
+      else
+        g_value_take_boxed (value,
+            g_array_new (FALSE, FALSE, sizeof (guint)));
+    }
+  else if (!tp_strdiff (prop, "HistogramBucketLength"))
+    {
+      g_value_set_uint (value, RAKIA_REGISTRATION_HISTOGRAM_BUCKET_LENGTH);
+    }
+  else if (!tp_strdiff (prop, "PendingRegistrations"))
+    {
+      g_value_set_uint (value, (scheduler != NULL)
+          ? rakia_registration_scheduler_get_pending (scheduler)
+          : 0);
+    }
+  else if (!tp_strdiff (prop, "RampWindow"))
+    {
+      g_value_set_uint (value, (scheduler != NULL)
+          ? rakia_registration_scheduler_get_ramp_window (scheduler)
+          : 0);
+    }
+  else
+    {
+      g_assert_not_reached ();
+    }
+}
+
+static void
+rakia_connection_get_keepalive (GObject *object,
+    GQuark iface,
+    GQuark name,
+    GValue *value,
+    gpointer getter_data)
+{
+  RakiaConnection *self = RAKIA_CONNECTION (object);
+  RakiaConnectionPrivate *priv = RAKIA_CONNECTION_GET_PRIVATE (self);
+  const gchar *prop = getter_data;
+
+  if (!tp_strdiff (prop, "KeepaliveInterval"))
+    {
+      g_value_set_uint (value, rakia_conn_get_keepalive_interval (self));
+    }
+  else if (!tp_strdiff (prop, "BindingLifetime"))
+    {
+      g_value_set_uint (value, priv->binding_lifetime);
+    }
+  else if (!tp_strdiff (prop, "DiscoveringKeepaliveInterval"))
+    {
+      g_value_set_boolean (value, priv->keepalive_probe != NULL);
+    }
+  else
+    {
+      g_assert_not_reached ();
+    }
+}
+
+/* The counters are properties of the media manager, named in
+ * admission_control_props */
+static void
+rakia_connection_get_admission_control (GObject *object,
+    GQuark iface,
+    GQuark name,
+    GValue *value,
+    gpointer getter_data)
+{
+  RakiaConnectionPrivate *priv = RAKIA_CONNECTION_GET_PRIVATE (object);
+  const gchar *prop = getter_data;
+
+  if (priv->media_manager != NULL)
+    g_object_get_property (G_OBJECT (priv->media_manager), prop, value);
+  else
+    g_value_set_uint (value, 0);
+}
+
+static void
+rakia_connection_get_proxy_targets (GObject *object,
+    GQuark iface,
+    GQuark name,
+    GValue *value,
+    gpointer getter_data)
+{
+  RakiaConnectionPrivate *priv = RAKIA_CONNECTION_GET_PRIVATE (object);
+  const gchar *prop = getter_data;
+  GPtrArray *list;
+  const GArray *targets;
+  guint i;
+
+  g_assert (!tp_strdiff (prop, "ProxyTargets"));
+
+  list = g_ptr_array_new ();
+
+  if (priv->proxy_targets != NULL)
+    {
+      targets = rakia_proxy_targets_get_targets (priv->proxy_targets);
+
+      for (i = 0; i < targets->len; i++)
+        {
+          const RakiaProxyTarget *target =
+              &g_array_index (targets, RakiaProxyTarget, i);
+
+          g_ptr_array_add (list, tp_value_array_build (7,
+                  G_TYPE_STRING, target->host,
+                  G_TYPE_UINT, (guint) target->port,
+                  G_TYPE_UINT, (guint) target->priority,
+                  G_TYPE_UINT, (guint) target->weight,
+                  G_TYPE_UINT, (guint) target->state,
+                  G_TYPE_UINT, target->failures,
+                  G_TYPE_UINT, rakia_proxy_targets_get_blacklist_time (
+                      priv->proxy_targets, target),
+                  G_TYPE_INVALID));
+        }
+    }
+
+  g_value_take_boxed (value, list);
+}
+
+/* Seconds between the memory usage lines in the debug log */
+#define RAKIA_CONNECTION_MEMORY_LOG_INTERVAL 60
+
+static gboolean
+priv_log_memory_usage (gpointer data)
+{
+  RakiaConnection *self = RAKIA_CONNECTION (data);
+  RakiaConnectionMemoryUsage usage;
+
+  priv_get_memory_usage (self, &usage);
+
+  DEBUG("connection %p memory: %" G_GSIZE_FORMAT " bytes total, "
+      "connection %" G_GSIZE_FORMAT ", sessions %" G_GSIZE_FORMAT
+      ", pending messages %" G_GSIZE_FORMAT ", uris %" G_GSIZE_FORMAT
+      "; %u call channels, %u text channels", self,
+      rakia_connection_memory_usage_total (&usage), usage.connection,
+      usage.sessions, usage.pending_messages, usage.uris,
+      usage.call_channels, usage.text_channels);
+
+  return TRUE;
+}
+
 static nua_handle_t *rakia_connection_create_nua_handle (RakiaBaseConnection *,
     TpHandle);
 static void rakia_connection_add_auth_handler (RakiaBaseConnection *,
     RakiaEventTarget *);
+static gchar *rakia_connection_dup_authorization (RakiaBaseConnection *,
+    nua_handle_t *, const gchar *);
+static nua_handle_t *rakia_connection_fail_over_proxy (
+    RakiaBaseConnection *, nua_handle_t *, gint64, const sip_t *);
 
 static void
 rakia_connection_class_init (RakiaConnectionClass *klass)
@@ -446,10 +821,47 @@ rakia_connection_class_init (RakiaConnectionClass *klass)
   TpBaseConnectionClass *base_class = TP_BASE_CONNECTION_CLASS (klass);
   RakiaBaseConnectionClass *sip_class = RAKIA_BASE_CONNECTION_CLASS (klass);
   GParamSpec *param_spec;
+  static TpDBusPropertiesMixinPropImpl setup_statistics_props[] = {
+      { "MilestoneHistograms", "MilestoneHistograms", NULL },
+      { "CallsMeasured", "CallsMeasured", NULL },
+      { NULL }
+  };
+  static TpDBusPropertiesMixinPropImpl memory_usage_props[] = {
+      { "MemoryUsage", "MemoryUsage", NULL },
+      { "CallChannels", "CallChannels", NULL },
+      { "TextChannels", "TextChannels", NULL },
+      { NULL }
+  };
+  static TpDBusPropertiesMixinPropImpl registration_load_props[] = {
+      { "RegistrationHistogram", "RegistrationHistogram", NULL },
+      { "HistogramBucketLength", "HistogramBucketLength", NULL },
+      { "PendingRegistrations", "PendingRegistrations", NULL },
+      { "RampWindow", "RampWindow", NULL },
+      { NULL }
+  };
+  static TpDBusPropertiesMixinPropImpl keepalive_props[] = {
+      { "KeepaliveInterval", "KeepaliveInterval", NULL },
+      { "BindingLifetime", "BindingLifetime", NULL },
+      { "DiscoveringKeepaliveInterval", "DiscoveringKeepaliveInterval",
+        NULL },
+      { NULL }
+  };
+  static TpDBusPropertiesMixinPropImpl proxy_targets_props[] = {
+      { "ProxyTargets", "ProxyTargets", NULL },
+      { NULL }
+  };
+  static TpDBusPropertiesMixinPropImpl admission_control_props[] = {
+      { "CallsAdmitted", "calls-admitted", NULL },
+      { "CallsShed", "calls-shed", NULL },
+      { "MainLoopLag", "main-loop-lag", NULL },
+      { NULL }
+  };
 
   /* Implement pure-virtual methods */
   sip_class->create_handle = rakia_connection_create_nua_handle;
   sip_class->add_auth_handler = rakia_connection_add_auth_handler;
+  sip_class->dup_authorization = rakia_connection_dup_authorization;
+  sip_class->fail_over_proxy = rakia_connection_fail_over_proxy;
 
   base_class->create_handle_repos = rakia_create_handle_repos;
   base_class->get_unique_connection_name = rakia_connection_unique_name;
@@ -532,6 +944,14 @@ rakia_connection_class_init (RakiaConnectionClass *klass)
       G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS);
   INST_PROP(PROP_KEEPALIVE_INTERVAL);
 
+  param_spec = g_param_spec_boolean ("discover-keepalive-interval",
+      "Discover keepalive interval",
+      "Probe how long the NAT binding lasts idle, and set the keepalive "
+      "interval from it",
+      FALSE, /*default value*/
+      G_PARAM_CONSTRUCT | G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS);
+  INST_PROP(PROP_DISCOVER_KEEPALIVE_INTERVAL);
+
   param_spec = g_param_spec_boolean ("discover-binding",
       "Discover public contact",
       "Enable discovery of public IP address beyond NAT",
@@ -565,6 +985,48 @@ rakia_connection_class_init (RakiaConnectionClass *klass)
       G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS);
   INST_PROP(PROP_IMMUTABLE_STREAMS);
 
+  param_spec = g_param_spec_boolean ("fast-start", "Fast call start",
+      "Set if the initial INVITE should be sent as soon as the audio"
+      " stream is ready, adding the other streams in a re-INVITE",
+      FALSE,
+      G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS);
+  INST_PROP(PROP_FAST_START);
+
+  param_spec = g_param_spec_boolean ("rtcp-mux", "RTCP multiplexing",
+      "Set if RTCP multiplexing on the RTP port should be offered and"
+      " accepted; the streaming implementation must support it",
+      FALSE,
+      G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS);
+  INST_PROP(PROP_RTCP_MUX);
+
+  param_spec = g_param_spec_boolean ("ice", "ICE",
+      "Set if the media streams should use ICE, signalling all the"
+      " candidates and the ICE credentials in SDP",
+      FALSE,
+      G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS);
+  INST_PROP(PROP_ICE);
+
+  param_spec = g_param_spec_uint ("max-calls", "Maximum calls",
+      "Incoming calls are refused with 486 while this many calls are"
+      " in progress (0 = no limit)",
+      0, G_MAXUINT32, 0,
+      G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS);
+  INST_PROP(PROP_MAX_CALLS);
+
+  param_spec = g_param_spec_uint ("max-call-rate", "Maximum call rate",
+      "Incoming calls beyond this many per second are refused with 503"
+      " (0 = no limit)",
+      0, G_MAXUINT32, 0,
+      G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS);
+  INST_PROP(PROP_MAX_CALL_RATE);
+
+  param_spec = g_param_spec_uint ("max-main-loop-lag", "Maximum main loop lag",
+      "Incoming calls are refused with 503 while the main loop runs"
+      " late by more than this many milliseconds (0 = not checked)",
+      0, G_MAXUINT32, 0,
+      G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS);
+  INST_PROP(PROP_MAX_MAIN_LOOP_LAG);
+
   param_spec = g_param_spec_string ("local-ip-address", "Local IP address",
       "Local IP address to use",
       NULL,
@@ -596,10 +1058,72 @@ rakia_connection_class_init (RakiaConnectionClass *klass)
       G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS);
   INST_PROP(PROP_IGNORE_TLS_ERRORS);
 
+  param_spec = g_param_spec_boolean ("share-stack", "Share the SIP stack",
+      "If true, the connection uses the SIP stack of the shared-stack "
+      "property, unless its other settings need a stack of its own",
+      FALSE,
+      G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS);
+  INST_PROP(PROP_SHARE_STACK);
+
+  param_spec = g_param_spec_pointer ("shared-stack", "Shared stack",
+      "Sofia-SIP stack to use if the connection's settings allow",
+      G_PARAM_CONSTRUCT_ONLY | G_PARAM_WRITABLE | G_PARAM_STATIC_STRINGS);
+  INST_PROP(PROP_SHARED_STACK);
+
+  param_spec = g_param_spec_pointer ("resolver", "DNS resolver",
+      "DNS resolver shared with other connections; if not set, the "
+      "connection has one of its own",
+      G_PARAM_CONSTRUCT_ONLY | G_PARAM_WRITABLE | G_PARAM_STATIC_STRINGS);
+  INST_PROP(PROP_RESOLVER);
+
+  param_spec = g_param_spec_pointer ("registration-scheduler",
+      "Registration scheduler",
+      "Scheduler staggering the registrations of the connections; if not "
+      "set, the connection registers right away",
+      G_PARAM_CONSTRUCT_ONLY | G_PARAM_WRITABLE | G_PARAM_STATIC_STRINGS);
+  INST_PROP(PROP_REGISTRATION_SCHEDULER);
+
+  param_spec = g_param_spec_object ("network-monitor", "Network monitor",
+      "Detector of changes of the local network; if not set, the "
+      "connection only catches up with them on its refreshes",
+      RAKIA_TYPE_NETWORK_MONITOR,
+      G_PARAM_CONSTRUCT_ONLY | G_PARAM_WRITABLE | G_PARAM_STATIC_STRINGS);
+  INST_PROP(PROP_NETWORK_MONITOR);
+
 #undef INST_PROP
 
   tp_dbus_properties_mixin_class_init (object_class,
       G_STRUCT_OFFSET (RakiaConnectionClass, properties_class));
+
+  tp_dbus_properties_mixin_implement_interface (object_class,
+      RAKIA_IFACE_QUARK_CONNECTION_INTERFACE_SETUP_STATISTICS,
+      rakia_connection_get_setup_statistics, NULL,
+      setup_statistics_props);
+
+  tp_dbus_properties_mixin_implement_interface (object_class,
+      RAKIA_IFACE_QUARK_CONNECTION_INTERFACE_MEMORY_USAGE,
+      rakia_connection_get_memory_usage, NULL,
+      memory_usage_props);
+
+  tp_dbus_properties_mixin_implement_interface (object_class,
+      RAKIA_IFACE_QUARK_CONNECTION_INTERFACE_REGISTRATION_LOAD,
+      rakia_connection_get_registration_load, NULL,
+      registration_load_props);
+
+  tp_dbus_properties_mixin_implement_interface (object_class,
+      RAKIA_IFACE_QUARK_CONNECTION_INTERFACE_KEEPALIVE,
+      rakia_connection_get_keepalive, NULL,
+      keepalive_props);
+
+  tp_dbus_properties_mixin_implement_interface (object_class,
+      RAKIA_IFACE_QUARK_CONNECTION_INTERFACE_PROXY_TARGETS,
+      rakia_connection_get_proxy_targets, NULL,
+      proxy_targets_props);
+
+  tp_dbus_properties_mixin_implement_interface (object_class,
+      RAKIA_IFACE_QUARK_CONNECTION_INTERFACE_ADMISSION_CONTROL,
+      rakia_connection_get_admission_control, NULL,
+      admission_control_props);
 }
 
 typedef struct {
@@ -660,6 +1184,7 @@ priv_handle_auth (RakiaConnection* self,
   RakiaConnectionPrivate *priv = RAKIA_CONNECTION_GET_PRIVATE (self);
   sip_www_authenticate_t const *wa;
   sip_proxy_authenticate_t const *pa;
+  sip_to_t const *to;
   const char *method = NULL;
   const char *realm = NULL;
   const char *user =  NULL;
@@ -697,6 +1222,12 @@ priv_handle_auth (RakiaConnection* self,
       return FALSE;
     }
 
+  /* Keep the challenge for the requests on other handles; the handle
+   * was created with its Request-URI in To */
+  to = nua_handle_remote (nh);
+  rakia_auth_cache_store_challenge (priv->auth_cache, sip, priv->proxy_url,
+      (to != NULL) ? to->a_url : NULL);
+
   /* step: determine which set of credentials to use */
   if (home_realm)
     {
@@ -816,6 +1347,7 @@ priv_handle_auth_continue (RakiaConnection* self,
     const gchar *user,
     const gchar *password)
 {
+  RakiaConnectionPrivate *priv = RAKIA_CONNECTION_GET_PRIVATE (self);
   gchar *auth = NULL;
 
   /* step: if all info is available, create an authorization response */
@@ -837,6 +1369,8 @@ priv_handle_auth_continue (RakiaConnection* self,
   /* step: authenticate */
   nua_authenticate(nh, NUTAG_AUTH(auth), TAG_END());
 
+  rakia_auth_cache_set_credentials (priv->auth_cache, realm, user, password);
+
   g_free (auth);
 }
 
@@ -864,28 +1398,105 @@ rakia_connection_add_auth_handler (RakiaBaseConnection *self,
                            0);
 }
 
+static gchar *
+rakia_connection_dup_authorization (RakiaBaseConnection *base,
+                                    nua_handle_t *nh,
+                                    const gchar *method)
+{
+  RakiaConnectionPrivate *priv = RAKIA_CONNECTION_GET_PRIVATE (base);
+  sip_to_t const *to = nua_handle_remote (nh);
+
+  /* The handle was created with its Request-URI in To */
+  if (to == NULL)
+    return NULL;
+
+  return rakia_auth_cache_dup_authorization (priv->auth_cache, method,
+      to->a_url, priv->proxy_url);
+}
+
 static nua_handle_t *
 rakia_connection_create_nua_handle (RakiaBaseConnection *base, TpHandle handle)
 {
   return rakia_conn_create_request_handle (RAKIA_CONNECTION (base), handle);
 }
 
+static nua_handle_t *
+rakia_connection_fail_over_proxy (RakiaBaseConnection *base,
+                                  nua_handle_t *nh,
+                                  gint64 sent_time,
+                                  const sip_t *sip)
+{
+  RakiaConnection *self = RAKIA_CONNECTION (base);
+
+  if (!rakia_conn_next_proxy_target (self, sent_time, sip))
+    return NULL;
+
+  return rakia_conn_create_request_handle_like (self, nh);
+}
+
+static void
+priv_network_changed_cb (RakiaNetworkMonitor *monitor,
+                         RakiaConnection *self)
+{
+  RakiaConnectionPrivate *priv = RAKIA_CONNECTION_GET_PRIVATE (self);
+
+  if (priv->register_op == NULL)
+    return;
+
+  DEBUG("the network has changed, registering again");
+
+  /* The Contact follows the new address when the registrar reports it in
+   * the Via of the response, see the "natify" outbound option */
+  rakia_conn_register (self);
+
+  /* Another network, another NAT */
+  if (priv->discover_keepalive_interval)
+    {
+      rakia_conn_stop_keepalive_discovery (self);
+      rakia_conn_discover_keepalive_interval (self);
+    }
+
+  if (priv->media_manager != NULL)
+    rakia_media_manager_reoffer_sessions (priv->media_manager);
+}
+
 static gboolean
 rakia_connection_nua_r_register_cb (RakiaConnection     *self,
                                     const RakiaNuaEvent *ev,
                                     tagi_t               tags[],
                                     gpointer             foo)
 {
+  RakiaConnectionPrivate *priv = RAKIA_CONNECTION_GET_PRIVATE (self);
   TpBaseConnection *base = (TpBaseConnection *) self;
   TpConnectionStatus conn_status = TP_CONNECTION_STATUS_DISCONNECTED;
   TpConnectionStatusReason reason = 0;
 
+  /* The proxy target is alive */
+  if (priv->proxy_timeout_id != 0)
+    {
+      g_source_remove (priv->proxy_timeout_id);
+      priv->proxy_timeout_id = 0;
+    }
+
   if (ev->status < 200)
     return TRUE;
 
+  if (priv->registration_scheduler != NULL)
+    rakia_registration_scheduler_note_response (priv->registration_scheduler);
+
   if (priv_handle_auth (self, ev->status, ev->nua_handle, ev->sip, TRUE))
     return TRUE;
 
+  /* Timed out, unreachable or overloaded: the next target may do better.
+   * Sofia-SIP reports transport errors as 503 too */
+  if ((ev->status == 408 || ev->status == 503)
+      && rakia_conn_fail_over_proxy (self, ev->sip))
+    {
+      DEBUG("REGISTER failed with %03d, going on to the next proxy target",
+          ev->status);
+      return TRUE;
+    }
+
   switch (ev->status)
     {
     case 401:
@@ -905,6 +1516,9 @@ rakia_connection_nua_r_register_cb (RakiaConnection     *self,
         }
       else /* if (ev->status == 200) */
         {
+          if (priv->proxy_targets != NULL)
+            rakia_proxy_targets_succeed (priv->proxy_targets);
+
           if (tp_base_connection_get_status (base) != TP_CONNECTION_STATUS_CONNECTING)
             return TRUE;
 
@@ -913,6 +1527,14 @@ rakia_connection_nua_r_register_cb (RakiaConnection     *self,
           reason = TP_CONNECTION_STATUS_REASON_REQUESTED;
 
           rakia_conn_heartbeat_init (self);
+
+          if (priv->discover_keepalive_interval)
+            rakia_conn_discover_keepalive_interval (self);
+
+          if (priv->network_monitor != NULL)
+            priv->network_changed_id = g_signal_connect (
+                priv->network_monitor, "changed",
+                G_CALLBACK (priv_network_changed_cb), self);
         }
     }
 
@@ -936,7 +1558,21 @@ rakia_connection_shut_down (TpBaseConnection *base)
 
   rakia_conn_heartbeat_shutdown (self);
 
-  if (priv->sofia_nua != NULL)
+  if (priv->memory_log_id != 0)
+    {
+      g_source_remove (priv->memory_log_id);
+      priv->memory_log_id = 0;
+    }
+
+  if (priv->stack_line != 0)
+    {
+      /* Pending transactions go on in the shared stack, and the handles
+       * are retired with their event targets */
+      rakia_shared_stack_remove_connection (priv->shared_stack,
+          priv->stack_line);
+      priv->stack_line = 0;
+    }
+  else if (priv->sofia_nua != NULL)
     nua_shutdown (priv->sofia_nua);
 
   priv->sofia_nua = NULL;
@@ -968,6 +1604,7 @@ rakia_connection_dispose (GObject *object)
   /* the base class owns channel factories/managers,
    * here we just nullify the references */
   priv->media_manager = NULL;
+  priv->text_manager = NULL;
 
   if (G_OBJECT_CLASS (rakia_connection_parent_class)->dispose)
     G_OBJECT_CLASS (rakia_connection_parent_class)->dispose (object);
@@ -983,13 +1620,26 @@ rakia_connection_finalize (GObject *obj)
 
   DEBUG("enter");
 
-  if (NULL != priv->sofia_resolver)
+  if (priv->proxy_targets != NULL)
+    rakia_proxy_targets_free (priv->proxy_targets);
+
+  if (NULL != priv->resolver)
     {
-      DEBUG("destroying sofia resolver");
-      sres_resolver_destroy (priv->sofia_resolver);
-      priv->sofia_resolver = NULL;
+      /* The queries go on for the other connections */
+      rakia_resolver_cancel (priv->resolver, self);
+      rakia_resolver_unref (priv->resolver);
+      priv->resolver = NULL;
     }
 
+  if (priv->shared_stack != NULL)
+    rakia_shared_stack_unref (priv->shared_stack);
+
+  if (priv->registration_scheduler != NULL)
+    rakia_registration_scheduler_unref (priv->registration_scheduler);
+
+  if (priv->network_monitor != NULL)
+    g_object_unref (priv->network_monitor);
+
   su_home_unref (priv->sofia_home);
 
   g_free (priv->address);
@@ -998,83 +1648,95 @@ rakia_connection_finalize (GObject *obj)
   g_free (priv->alias);
   g_free (priv->transport);
   g_free (priv->stun_host);
+  g_free (priv->stun_lookup);
   g_free (priv->local_ip_address);
   g_free (priv->extra_auth_user);
   g_free (priv->extra_auth_password);
 
   g_free (priv->registrar_realm);
+  rakia_auth_cache_free (priv->auth_cache);
 
   tp_contacts_mixin_finalize (obj);
 
   G_OBJECT_CLASS (rakia_connection_parent_class)->finalize (obj);
 }
 
+/* Registration expiry asked for; with REGISTER keepalives, the expires
+ * parameter of the contact takes precedence */
+#define RAKIA_CONNECTION_REGISTER_EXPIRES 3600
+
 static gboolean
-rakia_connection_start_connecting (TpBaseConnection *base,
-                                   GError **error)
+priv_start_register (gpointer data)
 {
-  RakiaConnection *self = RAKIA_CONNECTION (base);
-  RakiaBaseConnection *rbase = RAKIA_BASE_CONNECTION (self);
+  RakiaConnection *self = RAKIA_CONNECTION (data);
+  RakiaConnectionPrivate *priv = RAKIA_CONNECTION_GET_PRIVATE (self);
+
+  priv->register_id = 0;
+  priv->register_expires = RAKIA_CONNECTION_REGISTER_EXPIRES;
+
+  rakia_conn_register (self);
+
+  return FALSE;
+}
+
+/* Creates the stack, or joins the shared one, and starts registering */
+static gboolean
+priv_start_stack (RakiaConnection *self,
+                  GError **error)
+{
+  TpBaseConnection *base = (TpBaseConnection *) self;
   RakiaConnectionPrivate *priv = RAKIA_CONNECTION_GET_PRIVATE (self);
   TpHandleRepoIface *contact_repo;
+  TpHandle self_handle = tp_base_connection_get_self_handle (base);
   const gchar *sip_address;
   const url_t *local_url;
   su_root_t *root = NULL;
-  TpHandle self_handle;
-
-  g_assert (tp_base_connection_get_status (base) ==
-      TP_CONNECTION_STATUS_DISCONNECTED);
 
-  /* the construct parameters will be non-empty */
   g_object_get (self, "sofia-root", &root, NULL);
-  g_assert (root != NULL);
-  g_return_val_if_fail (priv->address != NULL, FALSE);
 
   contact_repo = tp_base_connection_get_handles (base, TP_HANDLE_TYPE_CONTACT);
-  self_handle = tp_handle_ensure (contact_repo, priv->address,
-      NULL, error);
-  if (self_handle == 0)
+  sip_address = tp_handle_inspect (contact_repo, self_handle);
+
+  /* step: join the shared stack, or create a stack instance */
+  if (rakia_conn_can_share_stack (self))
     {
-      return FALSE;
+      priv->sofia_nua = rakia_shared_stack_add_connection (
+          priv->shared_stack, self, &priv->stack_line);
+      if (priv->sofia_nua != NULL)
+        rakia_conn_set_nua_params (self,
+            NUTAG_M_USERNAME(priv->account_url->url_user),
+            TAG_NULL());
     }
-
-  tp_base_connection_set_self_handle (base, self_handle);
-
-  sip_address = tp_handle_inspect(contact_repo, self_handle);
-
-  DEBUG("self_handle = %d, sip_address = %s", self_handle, sip_address);
-
-  priv->account_url = rakia_base_connection_handle_to_uri (rbase,
-      tp_base_connection_get_self_handle (base));
-  if (priv->account_url == NULL)
+  else
     {
-      g_set_error (error, TP_ERROR, TP_ERROR_NOT_AVAILABLE,
-          "Failed to create the account URI");
-      return FALSE;
+      if (priv->share_stack)
+        MESSAGE ("share-stack is set, but a local address or port, TLS, "
+            "ignore-tls-errors or a TCP proxy given by name and port need "
+            "a SIP stack of its own");
+
+      local_url = rakia_conn_get_local_url (self);
+
+      priv->sofia_nua = nua_create (root,
+          rakia_base_connection_sofia_callback,
+          RAKIA_BASE_CONNECTION (self),
+          SOATAG_AF(SOA_AF_IP4_IP6),
+          SIPTAG_FROM_STR(sip_address),
+          NUTAG_URL(local_url),
+          /* TAG_IF(local_url && local_url->url_type == url_sips,
+                 NUTAG_SIPS_URL(local_url)), */
+          NUTAG_M_USERNAME(priv->account_url->url_user),
+          NUTAG_USER_AGENT(rakia_version_string ()),
+          NUTAG_ENABLEMESSAGE(1),
+          NUTAG_ENABLEINVITE(1),
+          NUTAG_AUTOALERT(0),
+          NUTAG_AUTOANSWER(0),
+          NUTAG_APPL_METHOD("MESSAGE"),
+          SIPTAG_ALLOW_STR(RAKIA_CONNECTION_ALLOW_METHODS),
+          TAG_IF(!priv->ignore_tls_errors,
+                 TPTAG_TLS_VERIFY_POLICY(TPTLS_VERIFY_ALL)),
+          TAG_NULL());
     }
 
-  local_url = rakia_conn_get_local_url (self);
-
-  /* step: create stack instance */
-  priv->sofia_nua = nua_create (root,
-      rakia_base_connection_sofia_callback,
-      RAKIA_BASE_CONNECTION (self),
-      SOATAG_AF(SOA_AF_IP4_IP6),
-      SIPTAG_FROM_STR(sip_address),
-      NUTAG_URL(local_url),
-      /* TAG_IF(local_url && local_url->url_type == url_sips,
-             NUTAG_SIPS_URL(local_url)), */
-      NUTAG_M_USERNAME(priv->account_url->url_user),
-      NUTAG_USER_AGENT(rakia_version_string ()),
-      NUTAG_ENABLEMESSAGE(1),
-      NUTAG_ENABLEINVITE(1),
-      NUTAG_AUTOALERT(0),
-      NUTAG_AUTOANSWER(0),
-      NUTAG_APPL_METHOD("MESSAGE"),
-      SIPTAG_ALLOW_STR("INVITE, ACK, BYE, CANCEL, OPTIONS, PRACK, MESSAGE, UPDATE"),
-      TAG_IF(!priv->ignore_tls_errors,
-             TPTAG_TLS_VERIFY_POLICY(TPTLS_VERIFY_ALL)),
-      TAG_NULL());
   if (priv->sofia_nua == NULL)
     {
       g_set_error (error, TP_ERROR, TP_ERROR_NOT_AVAILABLE,
@@ -1093,11 +1755,14 @@ rakia_connection_start_connecting (TpBaseConnection *base,
   else if (priv->stun_host != NULL)
     rakia_conn_resolv_stun_server (self, priv->stun_host);
 
-  DEBUG("initialized a Sofia-SIP NUA at address %p", priv->sofia_nua);
+  if (priv->stack_line == 0)
+    {
+      DEBUG("initialized a Sofia-SIP NUA at address %p", priv->sofia_nua);
 
-  /* for debugging purposes, request a dump of stack configuration
-   * at registration time */
-  nua_get_params (priv->sofia_nua, TAG_ANY(), TAG_NULL());
+      /* for debugging purposes, request a dump of stack configuration
+       * at registration time */
+      nua_get_params (priv->sofia_nua, TAG_ANY(), TAG_NULL());
+    }
 
   g_signal_connect (self,
                     "nua-event::nua_r_register",
@@ -1114,11 +1779,128 @@ rakia_connection_start_connecting (TpBaseConnection *base,
 
   rakia_event_target_attach (priv->register_op, (GObject *) self);
 
-  nua_register (priv->register_op, TAG_NULL());
+  if (priv->registration_scheduler != NULL)
+    priv->register_id = rakia_registration_scheduler_add (
+        priv->registration_scheduler, priv_start_register, self);
+  else
+    priv_start_register (self);
+
+  priv->memory_log_id = g_timeout_add_seconds (
+      RAKIA_CONNECTION_MEMORY_LOG_INTERVAL, priv_log_memory_usage, self);
 
   return TRUE;
 }
 
+/* Starts the stack once start_connecting has returned */
+static void
+priv_start_stack_later (RakiaConnection *self)
+{
+  GError *error = NULL;
+
+  if (!priv_start_stack (self, &error))
+    {
+      DEBUG("%s", error->message);
+      g_error_free (error);
+      tp_base_connection_change_status ((TpBaseConnection *) self,
+          TP_CONNECTION_STATUS_DISCONNECTED,
+          TP_CONNECTION_STATUS_REASON_NETWORK_ERROR);
+    }
+}
+
+static void
+priv_happy_eyeballs_cb (gint family,
+                        gpointer user_data)
+{
+  RakiaConnection *self = RAKIA_CONNECTION (user_data);
+  RakiaConnectionPrivate *priv = RAKIA_CONNECTION_GET_PRIVATE (self);
+
+  priv->happy_eyeballs = NULL;
+  priv->signalling_family = family;
+
+  priv_start_stack_later (self);
+}
+
+static gboolean
+priv_start_stack_cb (gpointer data)
+{
+  RakiaConnection *self = RAKIA_CONNECTION (data);
+  RakiaConnectionPrivate *priv = RAKIA_CONNECTION_GET_PRIVATE (self);
+
+  priv->start_stack_id = 0;
+
+  priv_start_stack_later (self);
+
+  return FALSE;
+}
+
+static void
+priv_proxy_targets_cb (const GArray *records,
+                       gpointer user_data)
+{
+  RakiaConnection *self = RAKIA_CONNECTION (user_data);
+  RakiaConnectionPrivate *priv = RAKIA_CONNECTION_GET_PRIVATE (self);
+
+  rakia_conn_set_proxy_targets (self, records);
+
+  /* Answers from the cache come before start_connecting returns */
+  priv->start_stack_id = g_idle_add (priv_start_stack_cb, self);
+}
+
+static gboolean
+rakia_connection_start_connecting (TpBaseConnection *base,
+                                   GError **error)
+{
+  RakiaConnection *self = RAKIA_CONNECTION (base);
+  RakiaBaseConnection *rbase = RAKIA_BASE_CONNECTION (self);
+  RakiaConnectionPrivate *priv = RAKIA_CONNECTION_GET_PRIVATE (self);
+  TpHandleRepoIface *contact_repo;
+  const gchar *sip_address;
+  su_root_t *root = NULL;
+  TpHandle self_handle;
+
+  g_assert (tp_base_connection_get_status (base) ==
+      TP_CONNECTION_STATUS_DISCONNECTED);
+
+  /* the construct parameters will be non-empty */
+  g_object_get (self, "sofia-root", &root, NULL);
+  g_assert (root != NULL);
+  g_return_val_if_fail (priv->address != NULL, FALSE);
+
+  contact_repo = tp_base_connection_get_handles (base, TP_HANDLE_TYPE_CONTACT);
+  self_handle = tp_handle_ensure (contact_repo, priv->address,
+      NULL, error);
+  if (self_handle == 0)
+    {
+      return FALSE;
+    }
+
+  tp_base_connection_set_self_handle (base, self_handle);
+
+  sip_address = tp_handle_inspect(contact_repo, self_handle);
+
+  DEBUG("self_handle = %d, sip_address = %s", self_handle, sip_address);
+
+  priv->account_url = rakia_base_connection_handle_to_uri (rbase,
+      tp_base_connection_get_self_handle (base));
+  if (priv->account_url == NULL)
+    {
+      g_set_error (error, TP_ERROR, TP_ERROR_NOT_AVAILABLE,
+          "Failed to create the account URI");
+      return FALSE;
+    }
+
+  /* The stack of the connection waits for the race of the address
+   * families to the proxy, if any */
+  if (rakia_conn_race_proxy_families (self, priv_happy_eyeballs_cb))
+    return TRUE;
+
+  /* or for the SRV lookup of the proxy, if any */
+  if (rakia_conn_lookup_proxy_targets (self, priv_proxy_targets_cb))
+    return TRUE;
+
+  return priv_start_stack (self, error);
+}
+
 
 /**
  * rakia_connection_disconnected
@@ -1135,6 +1917,44 @@ rakia_connection_disconnected (TpBaseConnection *base)
 
   DEBUG("enter");
 
+  if (priv->happy_eyeballs != NULL)
+    {
+      rakia_happy_eyeballs_cancel (priv->happy_eyeballs);
+      priv->happy_eyeballs = NULL;
+    }
+
+  /* The SRV lookup of the proxy, if under way, along with the others */
+  if (priv->resolver != NULL)
+    rakia_resolver_cancel (priv->resolver, obj);
+
+  if (priv->start_stack_id != 0)
+    {
+      g_source_remove (priv->start_stack_id);
+      priv->start_stack_id = 0;
+    }
+
+  if (priv->proxy_timeout_id != 0)
+    {
+      g_source_remove (priv->proxy_timeout_id);
+      priv->proxy_timeout_id = 0;
+    }
+
+  if (priv->register_id != 0)
+    {
+      rakia_registration_scheduler_cancel (priv->registration_scheduler,
+          priv->register_id);
+      priv->register_id = 0;
+    }
+
+  rakia_conn_stop_keepalive_discovery (obj);
+
+  if (priv->network_changed_id != 0)
+    {
+      g_signal_handler_disconnect (priv->network_monitor,
+          priv->network_changed_id);
+      priv->network_changed_id = 0;
+    }
+
   /* Dispose of the register use */
   if (priv->register_op != NULL)
     {
@@ -0,0 +1,439 @@
+/*
+ * sip-happy-eyeballs.c - Racing IPv6 and IPv4 connections to a proxy
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This work is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This work is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this work; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/*
+ * On a network where IPv6 is routed but broken somewhere along the way,
+ * a stream connection to a dual-stack proxy stalls on IPv6 until the TCP
+ * connection times out, which takes minutes. Sofia-SIP tries the addresses
+ * of a name one by one, so the connection decides on the family the stack
+ * uses for the proxy beforehand, as RFC 8305 does it: the AAAA and A
+ * records are looked up together, and connections are attempted to the
+ * addresses alternating between the families, IPv6 first, a new attempt
+ * starting every RAKIA_HAPPY_EYEBALLS_ATTEMPT_DELAY ms or as soon as the
+ * previous one fails. The family of the first one to connect wins, and
+ * the connections are closed again, the winning one too: the transports
+ * of Sofia-SIP open their own sockets and cannot be given one, so only
+ * the family is picked here.
+ */
+
+#include "config.h"
+
+#include <sys/socket.h>
+
+#include <gio/gio.h>
+
+#include "sip-happy-eyeballs.h"
+
+#define DEBUG_FLAG RAKIA_DEBUG_CONNECTION
+#include "rakia/debug.h"
+
+struct _RakiaHappyEyeballs
+{
+  RakiaResolver *resolver;
+  gchar *host;
+  guint port;
+  RakiaHappyEyeballsCallback callback;
+  gpointer user_data;
+
+  gboolean a_done;
+  gboolean aaaa_done;
+  /* Addresses not attempted yet, as strings, for each family */
+  GQueue ipv6;
+  GQueue ipv4;
+  gint next_family;
+  /* Still in rakia_happy_eyeballs_start () */
+  gboolean starting;
+  gboolean started;
+  /* Attempts under way */
+  GList *attempts;
+
+  guint idle_id;
+  guint resolution_delay_id;
+  guint attempt_delay_id;
+  guint timeout_id;
+};
+
+typedef struct {
+    RakiaHappyEyeballs *race;
+    GSocket *socket;
+    GSource *source;
+    gint family;
+} Attempt;
+
+static void priv_attempt_next (RakiaHappyEyeballs *self);
+
+static void
+priv_attempt_free (Attempt *attempt)
+{
+  g_source_destroy (attempt->source);
+  g_source_unref (attempt->source);
+  g_object_unref (attempt->socket);
+  g_slice_free (Attempt, attempt);
+}
+
+static void
+priv_free (RakiaHappyEyeballs *self)
+{
+  rakia_resolver_cancel (self->resolver, self);
+  rakia_resolver_unref (self->resolver);
+
+  if (self->idle_id != 0)
+    g_source_remove (self->idle_id);
+  if (self->resolution_delay_id != 0)
+    g_source_remove (self->resolution_delay_id);
+  if (self->attempt_delay_id != 0)
+    g_source_remove (self->attempt_delay_id);
+  if (self->timeout_id != 0)
+    g_source_remove (self->timeout_id);
+
+  g_list_foreach (self->attempts, (GFunc) priv_attempt_free, NULL);
+  g_list_free (self->attempts);
+
+  g_queue_foreach (&self->ipv6, (GFunc) g_free, NULL);
+  g_queue_clear (&self->ipv6);
+  g_queue_foreach (&self->ipv4, (GFunc) g_free, NULL);
+  g_queue_clear (&self->ipv4);
+
+  g_free (self->host);
+  g_slice_free (RakiaHappyEyeballs, self);
+}
+
+static void
+priv_finish (RakiaHappyEyeballs *self,
+             gint family)
+{
+  RakiaHappyEyeballsCallback callback = self->callback;
+  gpointer user_data = self->user_data;
+
+  if (family != AF_UNSPEC)
+    rakia_resolver_set_preferred_family (self->resolver, self->host,
+        self->port, family);
+  else
+    DEBUG("could not connect to %s:%u over either family", self->host,
+        self->port);
+
+  priv_free (self);
+
+  callback (family, user_data);
+}
+
+static gboolean
+priv_attempt_cb (GSocket *socket,
+                 GIOCondition condition,
+                 gpointer data)
+{
+  Attempt *attempt = data;
+  RakiaHappyEyeballs *self = attempt->race;
+  GError *error = NULL;
+
+  if (g_socket_check_connect_result (socket, &error))
+    {
+      DEBUG("connected to %s:%u over IPv%c first", self->host, self->port,
+          attempt->family == AF_INET6 ? '6' : '4');
+      priv_finish (self, attempt->family);
+      return FALSE;
+    }
+
+  DEBUG("connection attempt to %s:%u failed: %s", self->host, self->port,
+      error->message);
+  g_error_free (error);
+
+  self->attempts = g_list_remove (self->attempts, attempt);
+  priv_attempt_free (attempt);
+
+  /* No need to wait for the next one */
+  priv_attempt_next (self);
+
+  return FALSE;
+}
+
+static gboolean
+priv_attempt_delay_cb (gpointer data)
+{
+  RakiaHappyEyeballs *self = data;
+
+  self->attempt_delay_id = 0;
+  priv_attempt_next (self);
+
+  return FALSE;
+}
+
+static gchar *
+priv_pop_address (RakiaHappyEyeballs *self,
+                  gint *family)
+{
+  GQueue *first = (self->next_family == AF_INET6) ? &self->ipv6 : &self->ipv4;
+  GQueue *second = (first == &self->ipv6) ? &self->ipv4 : &self->ipv6;
+  GQueue *queue = g_queue_is_empty (first) ? second : first;
+
+  if (g_queue_is_empty (queue))
+    return NULL;
+
+  *family = (queue == &self->ipv6) ? AF_INET6 : AF_INET;
+  self->next_family = (*family == AF_INET6) ? AF_INET : AF_INET6;
+
+  return g_queue_pop_head (queue);
+}
+
+static void
+priv_attempt_next (RakiaHappyEyeballs *self)
+{
+  GInetAddress *inet_address = NULL;
+  GSocketAddress *address;
+  GSocket *socket;
+  GError *error = NULL;
+  Attempt *attempt;
+  gchar *str;
+  gint family = AF_UNSPEC;
+
+  if (self->attempt_delay_id != 0)
+    {
+      g_source_remove (self->attempt_delay_id);
+      self->attempt_delay_id = 0;
+    }
+
+  while ((str = priv_pop_address (self, &family)) != NULL)
+    {
+      inet_address = g_inet_address_new_from_string (str);
+      g_free (str);
+      if (inet_address != NULL)
+        break;
+    }
+
+  if (inet_address == NULL)
+    {
+      /* Out of addresses: it's up to the attempts under way, and the
+       * answer still to come if any */
+      if (self->attempts == NULL && self->a_done && self->aaaa_done)
+        priv_finish (self, AF_UNSPEC);
+      return;
+    }
+
+  address = g_inet_socket_address_new (inet_address, self->port);
+  g_object_unref (inet_address);
+
+  socket = g_socket_new ((GSocketFamily) family, G_SOCKET_TYPE_STREAM,
+      G_SOCKET_PROTOCOL_TCP, &error);
+  if (socket != NULL)
+    {
+      g_socket_set_blocking (socket, FALSE);
+
+      if (g_socket_connect (socket, address, NULL, &error))
+        {
+          g_object_unref (socket);
+          g_object_unref (address);
+          priv_finish (self, family);
+          return;
+        }
+
+      if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_PENDING))
+        {
+          g_clear_error (&error);
+
+          attempt = g_slice_new (Attempt);
+          attempt->race = self;
+          attempt->socket = socket;
+          attempt->family = family;
+          attempt->source = g_socket_create_source (socket, G_IO_OUT, NULL);
+          g_source_set_callback (attempt->source,
+              (GSourceFunc) priv_attempt_cb, attempt, NULL);
+          g_source_attach (attempt->source, NULL);
+
+          self->attempts = g_list_prepend (self->attempts, attempt);
+
+          self->attempt_delay_id = g_timeout_add (
+              RAKIA_HAPPY_EYEBALLS_ATTEMPT_DELAY, priv_attempt_delay_cb,
+              self);
+
+          g_object_unref (address);
+          return;
+        }
+
+      g_object_unref (socket);
+    }
+
+  /* Failed right away, such as with no route for the family */
+  DEBUG("connection attempt to %s:%u failed: %s", self->host, self->port,
+      error->message);
+  g_error_free (error);
+  g_object_unref (address);
+
+  priv_attempt_next (self);
+}
+
+static void
+priv_start_attempts (RakiaHappyEyeballs *self)
+{
+  if (self->resolution_delay_id != 0)
+    {
+      g_source_remove (self->resolution_delay_id);
+      self->resolution_delay_id = 0;
+    }
+
+  if (self->started)
+    return;
+
+  self->started = TRUE;
+  priv_attempt_next (self);
+}
+
+static gboolean
+priv_resolution_delay_cb (gpointer data)
+{
+  RakiaHappyEyeballs *self = data;
+
+  self->resolution_delay_id = 0;
+  priv_start_attempts (self);
+
+  return FALSE;
+}
+
+static void
+priv_add_addresses (GQueue *queue,
+                    const GArray *records)
+{
+  guint i;
+
+  for (i = 0; i < records->len; i++)
+    g_queue_push_tail (queue, g_strdup (
+        g_array_index (records, RakiaResolverRecord, i).target));
+}
+
+/* Starts the attempts when there are enough answers to, or goes on with
+ * them if they have all failed before the last answer came */
+static void
+priv_answer_in (RakiaHappyEyeballs *self)
+{
+  if (self->starting)
+    return;
+
+  if (self->started)
+    {
+      if (self->attempts == NULL)
+        priv_attempt_next (self);
+    }
+  else if (self->aaaa_done
+      && (self->a_done || !g_queue_is_empty (&self->ipv6)))
+    priv_start_attempts (self);
+  else if (!self->aaaa_done && !g_queue_is_empty (&self->ipv4)
+      && self->resolution_delay_id == 0)
+    self->resolution_delay_id = g_timeout_add (
+        RAKIA_HAPPY_EYEBALLS_RESOLUTION_DELAY, priv_resolution_delay_cb,
+        self);
+}
+
+static void
+priv_aaaa_cb (const GArray *records,
+              gpointer user_data)
+{
+  RakiaHappyEyeballs *self = user_data;
+
+  self->aaaa_done = TRUE;
+  priv_add_addresses (&self->ipv6, records);
+  priv_answer_in (self);
+}
+
+static void
+priv_a_cb (const GArray *records,
+           gpointer user_data)
+{
+  RakiaHappyEyeballs *self = user_data;
+
+  self->a_done = TRUE;
+  priv_add_addresses (&self->ipv4, records);
+  priv_answer_in (self);
+}
+
+static gboolean
+priv_idle_cb (gpointer data)
+{
+  RakiaHappyEyeballs *self = data;
+
+  self->idle_id = 0;
+  priv_answer_in (self);
+
+  return FALSE;
+}
+
+static gboolean
+priv_timeout_cb (gpointer data)
+{
+  RakiaHappyEyeballs *self = data;
+
+  self->timeout_id = 0;
+  priv_finish (self, AF_UNSPEC);
+
+  return FALSE;
+}
+
+/**
+ * rakia_happy_eyeballs_start:
+ * @resolver: the resolver to look up @host with
+ * @host: the host name of the proxy
+ * @port: the port of the proxy
+ * @callback: called with the family winning the race, never before this
+ *  returns
+ * @user_data: data for @callback
+ *
+ * Returns: the race, which is freed after @callback has been called,
+ *  or by rakia_happy_eyeballs_cancel () before that
+ */
+RakiaHappyEyeballs *
+rakia_happy_eyeballs_start (RakiaResolver *resolver,
+                            const gchar *host,
+                            guint port,
+                            RakiaHappyEyeballsCallback callback,
+                            gpointer user_data)
+{
+  RakiaHappyEyeballs *self = g_slice_new0 (RakiaHappyEyeballs);
+
+  self->resolver = rakia_resolver_ref (resolver);
+  self->host = g_strdup (host);
+  self->port = port;
+  self->callback = callback;
+  self->user_data = user_data;
+  self->next_family = AF_INET6;
+  g_queue_init (&self->ipv6);
+  g_queue_init (&self->ipv4);
+
+  DEBUG("racing IPv6 and IPv4 connections to %s:%u", host, port);
+
+  /* Answers from the cache come right away; wait with the attempts for
+   * the caller to have the race in hand */
+  self->starting = TRUE;
+
+  rakia_resolver_lookup (resolver, sres_type_aaaa, host, priv_aaaa_cb, self);
+  rakia_resolver_lookup (resolver, sres_type_a, host, priv_a_cb, self);
+
+  self->starting = FALSE;
+
+  self->timeout_id = g_timeout_add_seconds (RAKIA_HAPPY_EYEBALLS_TIMEOUT,
+      priv_timeout_cb, self);
+
+  if (self->aaaa_done || self->a_done)
+    self->idle_id = g_idle_add (priv_idle_cb, self);
+
+  return self;
+}
+
+void
+rakia_happy_eyeballs_cancel (RakiaHappyEyeballs *self)
+{
+  priv_free (self);
+}
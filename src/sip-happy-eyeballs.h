@@ -0,0 +1,55 @@
+/*
+ * sip-happy-eyeballs.h - Racing IPv6 and IPv4 connections to a proxy
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This work is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This work is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this work; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef __RAKIA_HAPPY_EYEBALLS_H__
+#define __RAKIA_HAPPY_EYEBALLS_H__
+
+#include <glib.h>
+
+#include "sip-resolver.h"
+
+G_BEGIN_DECLS
+
+/* Milliseconds to wait for the AAAA answer once the A answer is in, and
+ * between the starts of connection attempts, as RFC 8305 recommends */
+#define RAKIA_HAPPY_EYEBALLS_RESOLUTION_DELAY 50
+#define RAKIA_HAPPY_EYEBALLS_ATTEMPT_DELAY 250
+
+/* Seconds after which the race is given up on */
+#define RAKIA_HAPPY_EYEBALLS_TIMEOUT 10
+
+typedef struct _RakiaHappyEyeballs RakiaHappyEyeballs;
+
+/**
+ * RakiaHappyEyeballsCallback:
+ * @family: AF_INET6 or AF_INET, the family of the first address
+ *  connected to, or AF_UNSPEC if none could be
+ * @user_data: the data given to rakia_happy_eyeballs_start ()
+ */
+typedef void (* RakiaHappyEyeballsCallback) (gint family,
+    gpointer user_data);
+
+RakiaHappyEyeballs *rakia_happy_eyeballs_start (RakiaResolver *resolver,
+    const gchar *host, guint port, RakiaHappyEyeballsCallback callback,
+    gpointer user_data);
+void rakia_happy_eyeballs_cancel (RakiaHappyEyeballs *self);
+
+G_END_DECLS
+
+#endif /* __RAKIA_HAPPY_EYEBALLS_H__ */
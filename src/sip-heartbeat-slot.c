@@ -0,0 +1,167 @@
+/*
+ * sip-heartbeat-slot.c - Wakeups for the deferrable timers on wall-clock
+ *  slots
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This work is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This work is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this work; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/*
+ * Without the IP heartbeat service, this source wakes the main loop at
+ * the start of a slot of wall-clock time. The deferrable Sofia-SIP timers
+ * of all connections (keepalives, registration and session refreshes)
+ * wait for a wakeup, up to the maximum deferral of the root, so they fire
+ * together on the slot following their due time instead of each waking
+ * the CPU on its own.
+ *
+ * The source only wakes the loop at the slot after the first deferrable
+ * timer is due, and not at all while none is pending. Like the Sofia-SIP
+ * source, it looks at the timers again every time the main loop is about
+ * to sleep, so the timers set meanwhile are taken into account.
+ */
+
+#include "config.h"
+
+#include "sip-heartbeat-slot.h"
+
+#include <sofia-sip/su_wait.h>
+
+#define DEBUG_FLAG RAKIA_DEBUG_CONNECTION
+#include "rakia/debug.h"
+
+typedef struct {
+    GSource source;
+    su_root_t *root;
+    guint slot;
+    /* real time of the wakeup, or 0 without deferrable timers */
+    gint64 wakeup;
+    /* real time of the last wakeup dispatched */
+    gint64 last_wakeup;
+} RakiaHeartbeatSlotSource;
+
+/**
+ * rakia_heartbeat_slot_get_wakeup:
+ * @root: a Sofia-SIP root
+ * @slot: the length of the wall-clock slots, in seconds
+ *
+ * Returns: the real time, in microseconds, of the start of the first slot
+ *  at which a deferrable timer of @root is due, or 0 if it has none
+ */
+gint64
+rakia_heartbeat_slot_get_wakeup (su_root_t *root,
+                                 guint slot)
+{
+  su_duration_t due;
+  gint64 slot_us = (gint64) slot * G_USEC_PER_SEC;
+  gint64 at;
+
+  due = su_timer_next_expires (su_task_deferrable (su_root_task (root)),
+      su_now ());
+  if (due == SU_DURATION_MAX)
+    return 0;
+
+  at = g_get_real_time () + (gint64) MAX (due, 0) * 1000;
+
+  /* A timer due right on a boundary fires on that slot */
+  return (at + slot_us - 1) / slot_us * slot_us;
+}
+
+static gboolean
+heartbeat_slot_prepare (GSource *source,
+                        gint *timeout)
+{
+  RakiaHeartbeatSlotSource *self = (RakiaHeartbeatSlotSource *) source;
+  gint64 now;
+
+  self->wakeup = rakia_heartbeat_slot_get_wakeup (self->root, self->slot);
+
+  if (self->wakeup == 0)
+    {
+      *timeout = -1;
+      return FALSE;
+    }
+
+  /* Not twice on one slot, should a timer be left over */
+  if (self->wakeup <= self->last_wakeup)
+    self->wakeup = self->last_wakeup + (gint64) self->slot * G_USEC_PER_SEC;
+
+  now = g_get_real_time ();
+  if (now >= self->wakeup)
+    return TRUE;
+
+  *timeout = (self->wakeup - now + 999) / 1000;
+  return FALSE;
+}
+
+static gboolean
+heartbeat_slot_check (GSource *source)
+{
+  RakiaHeartbeatSlotSource *self = (RakiaHeartbeatSlotSource *) source;
+
+  return self->wakeup != 0 && g_get_real_time () >= self->wakeup;
+}
+
+static gboolean
+heartbeat_slot_dispatch (GSource *source,
+                         GSourceFunc callback,
+                         gpointer user_data)
+{
+  RakiaHeartbeatSlotSource *self = (RakiaHeartbeatSlotSource *) source;
+
+  DEBUG("tick for the deferrable timers");
+
+  self->last_wakeup = self->wakeup;
+
+  /* The timers themselves are run by the Sofia-SIP source */
+  if (callback != NULL)
+    callback (user_data);
+
+  return TRUE;
+}
+
+static GSourceFuncs heartbeat_slot_funcs = {
+    heartbeat_slot_prepare,
+    heartbeat_slot_check,
+    heartbeat_slot_dispatch,
+    NULL
+};
+
+/**
+ * rakia_heartbeat_slot_source_new:
+ * @root: the Sofia-SIP root whose deferrable timers are to be woken for
+ * @slot: the length of the wall-clock slots, in seconds
+ *
+ * Returns: a new source waking the main loop at the start of the slot
+ *  following the due time of each deferrable timer of @root, to be
+ *  attached to the main context of @root; a callback, if set, is called
+ *  on each wakeup
+ */
+GSource *
+rakia_heartbeat_slot_source_new (su_root_t *root,
+                                 guint slot)
+{
+  GSource *source;
+  RakiaHeartbeatSlotSource *self;
+
+  g_return_val_if_fail (slot > 0, NULL);
+
+  source = g_source_new (&heartbeat_slot_funcs,
+      sizeof (RakiaHeartbeatSlotSource));
+  self = (RakiaHeartbeatSlotSource *) source;
+  self->root = root;
+  self->slot = slot;
+
+  return source;
+}
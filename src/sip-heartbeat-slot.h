@@ -0,0 +1,36 @@
+/*
+ * sip-heartbeat-slot.h - Wakeups for the deferrable timers on wall-clock
+ *  slots
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This work is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This work is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this work; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef __RAKIA_HEARTBEAT_SLOT_H__
+#define __RAKIA_HEARTBEAT_SLOT_H__
+
+#include <glib.h>
+
+#include <rakia/sofia-decls.h>
+
+G_BEGIN_DECLS
+
+GSource *rakia_heartbeat_slot_source_new (su_root_t *root, guint slot);
+
+gint64 rakia_heartbeat_slot_get_wakeup (su_root_t *root, guint slot);
+
+G_END_DECLS
+
+#endif /* __RAKIA_HEARTBEAT_SLOT_H__ */
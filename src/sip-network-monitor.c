@@ -0,0 +1,268 @@
+/*
+ * sip-network-monitor.c - Detection of changes of the local network
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This work is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This work is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this work; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/*
+ * When the device moves to another network, the registration and the
+ * media of the calls keep going to addresses that are gone, until the
+ * registration is refreshed, which can be an hour later. The connection
+ * manager listens to the routing netlink of the kernel for the changes
+ * that matter: global addresses coming or going, and the default route
+ * being replaced. Several of them come in together when an interface is
+ * brought up, so the "changed" signal is emitted once they have settled
+ * for RAKIA_NETWORK_MONITOR_SETTLE_TIME.
+ *
+ * Where there is no rtnetlink, the monitor never signals anything, and
+ * the registrations catch up with the network on their refreshes.
+ */
+
+#include "config.h"
+
+#include "sip-network-monitor.h"
+
+#ifdef HAVE_LINUX_RTNETLINK_H
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#endif
+
+#define DEBUG_FLAG RAKIA_DEBUG_CONNECTION
+#include "rakia/debug.h"
+
+G_DEFINE_TYPE (RakiaNetworkMonitor, rakia_network_monitor, G_TYPE_OBJECT)
+
+enum
+{
+  SIG_CHANGED,
+  N_SIGNALS
+};
+
+static guint signals[N_SIGNALS];
+
+struct _RakiaNetworkMonitorPrivate
+{
+  GIOChannel *channel;
+  guint watch_id;
+  guint settle_id;
+};
+
+static void
+rakia_network_monitor_init (RakiaNetworkMonitor *self)
+{
+  self->priv = G_TYPE_INSTANCE_GET_PRIVATE (self, RAKIA_TYPE_NETWORK_MONITOR,
+      RakiaNetworkMonitorPrivate);
+}
+
+static gboolean
+priv_settled (gpointer data)
+{
+  RakiaNetworkMonitor *self = data;
+
+  self->priv->settle_id = 0;
+
+  DEBUG("the local network has changed");
+
+  g_signal_emit (self, signals[SIG_CHANGED], 0);
+
+  return FALSE;
+}
+
+static void
+priv_note_change (RakiaNetworkMonitor *self)
+{
+  if (self->priv->settle_id != 0)
+    g_source_remove (self->priv->settle_id);
+
+  self->priv->settle_id = g_timeout_add (RAKIA_NETWORK_MONITOR_SETTLE_TIME,
+      priv_settled, self);
+}
+
+#ifdef HAVE_LINUX_RTNETLINK_H
+
+static gboolean
+priv_message_is_change (const struct nlmsghdr *nh)
+{
+  switch (nh->nlmsg_type)
+    {
+    case RTM_NEWADDR:
+    case RTM_DELADDR:
+      {
+        const struct ifaddrmsg *ifa = NLMSG_DATA (nh);
+
+        /* Host and link scope addresses are never in our contacts; an
+         * address still checked for duplicates comes again when it
+         * is usable */
+        return ifa->ifa_scope == RT_SCOPE_UNIVERSE
+            && !(ifa->ifa_flags & IFA_F_TENTATIVE);
+      }
+    case RTM_NEWROUTE:
+    case RTM_DELROUTE:
+      {
+        const struct rtmsg *rtm = NLMSG_DATA (nh);
+
+        return rtm->rtm_table == RT_TABLE_MAIN && rtm->rtm_dst_len == 0;
+      }
+    default:
+      return FALSE;
+    }
+}
+
+static gboolean
+priv_netlink_cb (GIOChannel *channel,
+                 GIOCondition condition,
+                 gpointer data)
+{
+  RakiaNetworkMonitor *self = data;
+  int fd = g_io_channel_unix_get_fd (channel);
+  gchar buf[8192];
+  gboolean changed = FALSE;
+  ssize_t len;
+
+  while ((len = recv (fd, buf, sizeof buf, 0)) != 0)
+    {
+      struct nlmsghdr *nh;
+
+      if (len < 0)
+        {
+          if (errno == EINTR)
+            continue;
+
+          /* Messages have been dropped, any of them could be a change */
+          if (errno == ENOBUFS)
+            changed = TRUE;
+
+          break;
+        }
+
+      for (nh = (struct nlmsghdr *) buf; NLMSG_OK (nh, (size_t) len);
+           nh = NLMSG_NEXT (nh, len))
+        {
+          if (priv_message_is_change (nh))
+            changed = TRUE;
+        }
+    }
+
+  if (changed)
+    priv_note_change (self);
+
+  return TRUE;
+}
+
+static void
+priv_open_netlink (RakiaNetworkMonitor *self)
+{
+  struct sockaddr_nl addr;
+  int fd;
+
+  fd = socket (AF_NETLINK, SOCK_RAW | SOCK_NONBLOCK | SOCK_CLOEXEC,
+      NETLINK_ROUTE);
+  if (fd < 0)
+    {
+      WARNING ("cannot open a routing netlink socket: %s",
+          g_strerror (errno));
+      return;
+    }
+
+  memset (&addr, 0, sizeof addr);
+  addr.nl_family = AF_NETLINK;
+  addr.nl_groups = RTMGRP_IPV4_IFADDR | RTMGRP_IPV6_IFADDR
+      | RTMGRP_IPV4_ROUTE | RTMGRP_IPV6_ROUTE;
+
+  if (bind (fd, (struct sockaddr *) &addr, sizeof addr) < 0)
+    {
+      WARNING ("cannot listen to the routing netlink: %s",
+          g_strerror (errno));
+      close (fd);
+      return;
+    }
+
+  self->priv->channel = g_io_channel_unix_new (fd);
+  g_io_channel_set_close_on_unref (self->priv->channel, TRUE);
+  self->priv->watch_id = g_io_add_watch (self->priv->channel, G_IO_IN,
+      priv_netlink_cb, self);
+}
+
+#endif /* HAVE_LINUX_RTNETLINK_H */
+
+static void
+rakia_network_monitor_constructed (GObject *object)
+{
+  void (*constructed) (GObject *) =
+      G_OBJECT_CLASS (rakia_network_monitor_parent_class)->constructed;
+
+  if (constructed != NULL)
+    constructed (object);
+
+#ifdef HAVE_LINUX_RTNETLINK_H
+  priv_open_netlink (RAKIA_NETWORK_MONITOR (object));
+#else
+  DEBUG("changes of the local network are not detected on this system");
+#endif
+}
+
+static void
+rakia_network_monitor_finalize (GObject *object)
+{
+  RakiaNetworkMonitorPrivate *priv = RAKIA_NETWORK_MONITOR (object)->priv;
+
+  if (priv->settle_id != 0)
+    g_source_remove (priv->settle_id);
+
+  if (priv->watch_id != 0)
+    g_source_remove (priv->watch_id);
+
+  if (priv->channel != NULL)
+    g_io_channel_unref (priv->channel);
+
+  G_OBJECT_CLASS (rakia_network_monitor_parent_class)->finalize (object);
+}
+
+static void
+rakia_network_monitor_class_init (RakiaNetworkMonitorClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  g_type_class_add_private (klass, sizeof (RakiaNetworkMonitorPrivate));
+
+  object_class->constructed = rakia_network_monitor_constructed;
+  object_class->finalize = rakia_network_monitor_finalize;
+
+  /**
+   * RakiaNetworkMonitor::changed:
+   *
+   * Emitted when the local addresses or the default route have changed,
+   * and stayed so for RAKIA_NETWORK_MONITOR_SETTLE_TIME.
+   */
+  signals[SIG_CHANGED] =
+      g_signal_new ("changed",
+          G_OBJECT_CLASS_TYPE (klass),
+          G_SIGNAL_RUN_LAST,
+          0,
+          NULL, NULL,
+          g_cclosure_marshal_VOID__VOID,
+          G_TYPE_NONE, 0);
+}
+
+RakiaNetworkMonitor *
+rakia_network_monitor_new (void)
+{
+  return g_object_new (RAKIA_TYPE_NETWORK_MONITOR, NULL);
+}
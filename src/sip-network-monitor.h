@@ -0,0 +1,65 @@
+/*
+ * sip-network-monitor.h - Detection of changes of the local network
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This work is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This work is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this work; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef __RAKIA_NETWORK_MONITOR_H__
+#define __RAKIA_NETWORK_MONITOR_H__
+
+#include <glib-object.h>
+
+G_BEGIN_DECLS
+
+/* Milliseconds the network has to stay unchanged before the change is
+ * signalled, as bringing an interface up takes a few updates */
+#define RAKIA_NETWORK_MONITOR_SETTLE_TIME 1000
+
+typedef struct _RakiaNetworkMonitor RakiaNetworkMonitor;
+typedef struct _RakiaNetworkMonitorClass RakiaNetworkMonitorClass;
+typedef struct _RakiaNetworkMonitorPrivate RakiaNetworkMonitorPrivate;
+
+struct _RakiaNetworkMonitorClass {
+  GObjectClass parent_class;
+};
+
+struct _RakiaNetworkMonitor {
+  GObject parent;
+
+  RakiaNetworkMonitorPrivate *priv;
+};
+
+GType rakia_network_monitor_get_type (void);
+
+/* TYPE MACROS */
+#define RAKIA_TYPE_NETWORK_MONITOR \
+  (rakia_network_monitor_get_type ())
+#define RAKIA_NETWORK_MONITOR(obj) \
+  (G_TYPE_CHECK_INSTANCE_CAST((obj), RAKIA_TYPE_NETWORK_MONITOR, RakiaNetworkMonitor))
+#define RAKIA_NETWORK_MONITOR_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_CAST((klass), RAKIA_TYPE_NETWORK_MONITOR, RakiaNetworkMonitorClass))
+#define RAKIA_IS_NETWORK_MONITOR(obj) \
+  (G_TYPE_CHECK_INSTANCE_TYPE((obj), RAKIA_TYPE_NETWORK_MONITOR))
+#define RAKIA_IS_NETWORK_MONITOR_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_TYPE((klass), RAKIA_TYPE_NETWORK_MONITOR))
+#define RAKIA_NETWORK_MONITOR_GET_CLASS(obj) \
+  (G_TYPE_INSTANCE_GET_CLASS ((obj), RAKIA_TYPE_NETWORK_MONITOR, RakiaNetworkMonitorClass))
+
+RakiaNetworkMonitor *rakia_network_monitor_new (void);
+
+G_END_DECLS
+
+#endif /* __RAKIA_NETWORK_MONITOR_H__ */
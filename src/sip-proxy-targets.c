@@ -0,0 +1,259 @@
+/*
+ * sip-proxy-targets.c - The servers an outbound proxy resolves to
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This work is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This work is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this work; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/*
+ * Given a proxy without a port, Sofia-SIP goes through its SRV targets
+ * itself, but only moves on from one once its transaction has timed out,
+ * 32 seconds later, and starts from the first one again for the next
+ * request. The connection looks up the SRV records instead, and sets
+ * the targets as the proxy one at a time, in the order of RFC 2782,
+ * going on to the next one as soon as the current one fails.
+ *
+ * A failed target is blacklisted in the resolver shared by the
+ * connections, and skipped by all of them until the blacklisting
+ * expires; the targets blacklisted by other connections are still tried,
+ * after all the others, before giving up.
+ */
+
+#include "config.h"
+
+#include <string.h>
+
+#include "sip-proxy-targets.h"
+
+#define DEBUG_FLAG RAKIA_DEBUG_CONNECTION
+#include "rakia/debug.h"
+
+struct _RakiaProxyTargets
+{
+  RakiaResolver *resolver;
+  /* RakiaProxyTarget, in the order they are tried in */
+  GArray *targets;
+  /* index of the target in use, or -1 */
+  gint current;
+};
+
+/**
+ * rakia_proxy_targets_new:
+ * @resolver: the resolver to blacklist the failed targets in
+ * @records: the answer to a SRV query for the proxy
+ *
+ * Returns: the targets of @records, ordered as RFC 2782 says with none
+ *  in use yet, or %NULL if @records has none
+ */
+RakiaProxyTargets *
+rakia_proxy_targets_new (RakiaResolver *resolver,
+                         const GArray *records)
+{
+  RakiaProxyTargets *self;
+  GArray *remaining;
+  const RakiaResolverRecord *sel;
+  guint i;
+
+  remaining = g_array_sized_new (FALSE, FALSE, sizeof (RakiaResolverRecord),
+      records->len);
+
+  /* A target of "." means the service is not available there */
+  for (i = 0; i < records->len; i++)
+    {
+      const RakiaResolverRecord *rec =
+          &g_array_index (records, RakiaResolverRecord, i);
+
+      if (rec->target != NULL && rec->target[0] != '\0'
+          && strcmp (rec->target, ".") != 0)
+        g_array_append_val (remaining, *rec);
+    }
+
+  if (remaining->len == 0)
+    {
+      g_array_unref (remaining);
+      return NULL;
+    }
+
+  self = g_slice_new0 (RakiaProxyTargets);
+  self->resolver = rakia_resolver_ref (resolver);
+  self->targets = g_array_sized_new (FALSE, TRUE, sizeof (RakiaProxyTarget),
+      remaining->len);
+  self->current = -1;
+
+  /* Picking the first record out of the remaining ones over and over
+   * gives the order to try them in */
+  while ((sel = rakia_resolver_select_srv (remaining)) != NULL)
+    {
+      RakiaProxyTarget target = { NULL, };
+
+      target.host = g_strdup (sel->target);
+      target.port = sel->port;
+      target.priority = sel->priority;
+      target.weight = sel->weight;
+      target.state = RAKIA_PROXY_TARGET_STATE_UNTRIED;
+      g_array_append_val (self->targets, target);
+
+      g_array_remove_index (remaining,
+          sel - (const RakiaResolverRecord *) remaining->data);
+    }
+
+  g_array_unref (remaining);
+
+  return self;
+}
+
+void
+rakia_proxy_targets_free (RakiaProxyTargets *self)
+{
+  guint i;
+
+  for (i = 0; i < self->targets->len; i++)
+    g_free (g_array_index (self->targets, RakiaProxyTarget, i).host);
+
+  g_array_unref (self->targets);
+  rakia_resolver_unref (self->resolver);
+  g_slice_free (RakiaProxyTargets, self);
+}
+
+/**
+ * rakia_proxy_targets_get_targets:
+ * @self: the targets
+ *
+ * Returns: all the targets, as an array of #RakiaProxyTarget in the
+ *  order they are tried in
+ */
+const GArray *
+rakia_proxy_targets_get_targets (RakiaProxyTargets *self)
+{
+  return self->targets;
+}
+
+/**
+ * rakia_proxy_targets_get_current:
+ * @self: the targets
+ *
+ * Returns: the target in use, or %NULL before the first call to
+ *  rakia_proxy_targets_next ()
+ */
+const RakiaProxyTarget *
+rakia_proxy_targets_get_current (RakiaProxyTargets *self)
+{
+  if (self->current < 0)
+    return NULL;
+
+  return &g_array_index (self->targets, RakiaProxyTarget, self->current);
+}
+
+guint
+rakia_proxy_targets_get_blacklist_time (RakiaProxyTargets *self,
+                                        const RakiaProxyTarget *target)
+{
+  return rakia_resolver_get_blacklist_time (self->resolver, target->host,
+      target->port);
+}
+
+/**
+ * rakia_proxy_targets_next:
+ * @self: the targets
+ *
+ * Goes on to the first target, in order, that is not blacklisted; if
+ * they all are, to the first one that has not failed for this
+ * connection.
+ *
+ * Returns: the target now in use, or %NULL if there is none left to try
+ */
+const RakiaProxyTarget *
+rakia_proxy_targets_next (RakiaProxyTargets *self)
+{
+  RakiaProxyTarget *target;
+  gint next = -1;
+  guint i;
+
+  for (i = 0; i < self->targets->len && next < 0; i++)
+    {
+      target = &g_array_index (self->targets, RakiaProxyTarget, i);
+
+      if ((gint) i != self->current
+          && rakia_proxy_targets_get_blacklist_time (self, target) == 0)
+        next = i;
+    }
+
+  for (i = 0; i < self->targets->len && next < 0; i++)
+    {
+      target = &g_array_index (self->targets, RakiaProxyTarget, i);
+
+      if ((gint) i != self->current
+          && target->state != RAKIA_PROXY_TARGET_STATE_FAILED)
+        next = i;
+    }
+
+  if (next < 0)
+    {
+      DEBUG("no proxy target left to try");
+      return NULL;
+    }
+
+  self->current = next;
+
+  target = &g_array_index (self->targets, RakiaProxyTarget, next);
+  target->state = RAKIA_PROXY_TARGET_STATE_TRYING;
+
+  DEBUG("going through proxy target %s:%u", target->host, target->port);
+
+  return target;
+}
+
+/**
+ * rakia_proxy_targets_succeed:
+ * @self: the targets
+ *
+ * Marks the target in use as the one registered through.
+ */
+void
+rakia_proxy_targets_succeed (RakiaProxyTargets *self)
+{
+  RakiaProxyTarget *target;
+
+  g_return_if_fail (self->current >= 0);
+
+  target = &g_array_index (self->targets, RakiaProxyTarget, self->current);
+  target->state = RAKIA_PROXY_TARGET_STATE_ACTIVE;
+  target->failures = 0;
+}
+
+/**
+ * rakia_proxy_targets_fail:
+ * @self: the targets
+ * @blacklist_time: the number of seconds to blacklist the target in use
+ *  for, for all connections
+ *
+ * Marks the target in use as failed; rakia_proxy_targets_next () is to
+ * be called next.
+ */
+void
+rakia_proxy_targets_fail (RakiaProxyTargets *self,
+                          guint blacklist_time)
+{
+  RakiaProxyTarget *target;
+
+  g_return_if_fail (self->current >= 0);
+
+  target = &g_array_index (self->targets, RakiaProxyTarget, self->current);
+  target->state = RAKIA_PROXY_TARGET_STATE_FAILED;
+  target->failures++;
+
+  rakia_resolver_blacklist (self->resolver, target->host, target->port,
+      blacklist_time);
+}
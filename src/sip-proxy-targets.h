@@ -0,0 +1,65 @@
+/*
+ * sip-proxy-targets.h - The servers an outbound proxy resolves to
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This work is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This work is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this work; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef __RAKIA_PROXY_TARGETS_H__
+#define __RAKIA_PROXY_TARGETS_H__
+
+#include <glib.h>
+
+#include "extensions/extensions.h"
+#include "sip-resolver.h"
+
+G_BEGIN_DECLS
+
+/* Seconds to wait for a response to REGISTER before going on to the
+ * next target, much less than the 32 of Timer F */
+#define RAKIA_PROXY_TARGET_TIMEOUT 4
+
+/* Seconds a failed target is avoided for, unless it says otherwise
+ * with Retry-After */
+#define RAKIA_PROXY_TARGET_BLACKLIST_TIME 300
+
+typedef struct {
+    gchar *host;
+    guint16 port;
+    guint16 priority;
+    guint16 weight;
+    RakiaProxyTargetState state;
+    guint failures;
+} RakiaProxyTarget;
+
+typedef struct _RakiaProxyTargets RakiaProxyTargets;
+
+RakiaProxyTargets *rakia_proxy_targets_new (RakiaResolver *resolver,
+    const GArray *records);
+void rakia_proxy_targets_free (RakiaProxyTargets *self);
+
+const GArray *rakia_proxy_targets_get_targets (RakiaProxyTargets *self);
+const RakiaProxyTarget *rakia_proxy_targets_get_current (
+    RakiaProxyTargets *self);
+guint rakia_proxy_targets_get_blacklist_time (RakiaProxyTargets *self,
+    const RakiaProxyTarget *target);
+
+const RakiaProxyTarget *rakia_proxy_targets_next (RakiaProxyTargets *self);
+void rakia_proxy_targets_succeed (RakiaProxyTargets *self);
+void rakia_proxy_targets_fail (RakiaProxyTargets *self, guint blacklist_time);
+
+G_END_DECLS
+
+#endif /* __RAKIA_PROXY_TARGETS_H__ */
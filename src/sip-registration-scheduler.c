@@ -0,0 +1,308 @@
+/*
+ * sip-registration-scheduler.c - Staggering of registrations between
+ *  connections
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This work is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This work is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this work; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/*
+ * When many accounts are brought online together, after a restart of
+ * the connection manager or of the network, their REGISTER requests would
+ * all hit the registrar at once, and with the same expiry time their
+ * refreshes would keep coming in bursts. The connection manager has one
+ * scheduler for all its connections to prevent that.
+ *
+ * Up to RAKIA_REGISTRATION_BURST initial registrations within the ramp
+ * window go out right away, so a single account is never held back;
+ * the ones past those are each delayed by a random time within the
+ * window. Each connection then asks for an expiry time lowered by a
+ * random amount, and Sofia-SIP refreshes the registration at a random
+ * point of the time granted, so that the refreshes move apart from one
+ * another.
+ *
+ * The final responses to the REGISTER requests of all connections,
+ * refreshes included, are counted in a histogram of the last ten
+ * minutes, for tuning the ramp window against the registrar's load.
+ */
+
+#include "config.h"
+
+#include <string.h>
+
+#include "sip-registration-scheduler.h"
+
+#define DEBUG_FLAG RAKIA_DEBUG_CONNECTION
+#include "rakia/debug.h"
+
+struct _RakiaRegistrationScheduler
+{
+  gint ref_count;
+  guint ramp_window;
+  /* monotonic start times of the registrations within the window,
+   * oldest first, as gint64 pointers */
+  GQueue starts;
+  /* Delayed registrations */
+  GList *delayed;
+  guint counts[RAKIA_REGISTRATION_HISTOGRAM_BUCKETS];
+  /* index since the epoch of the bucket counted into last */
+  gint64 last_bucket;
+};
+
+typedef struct {
+    RakiaRegistrationScheduler *scheduler;
+    guint id;
+    GSourceFunc func;
+    gpointer data;
+} Delayed;
+
+RakiaRegistrationScheduler *
+rakia_registration_scheduler_new (guint ramp_window)
+{
+  RakiaRegistrationScheduler *self = g_slice_new0 (RakiaRegistrationScheduler);
+
+  self->ref_count = 1;
+  self->ramp_window = ramp_window;
+  g_queue_init (&self->starts);
+  self->last_bucket = g_get_monotonic_time ()
+      / (RAKIA_REGISTRATION_HISTOGRAM_BUCKET_LENGTH * G_USEC_PER_SEC);
+
+  return self;
+}
+
+RakiaRegistrationScheduler *
+rakia_registration_scheduler_ref (RakiaRegistrationScheduler *self)
+{
+  g_atomic_int_inc (&self->ref_count);
+  return self;
+}
+
+static void
+priv_start_free (gpointer data,
+                 gpointer user_data)
+{
+  g_slice_free (gint64, data);
+}
+
+void
+rakia_registration_scheduler_unref (RakiaRegistrationScheduler *self)
+{
+  if (!g_atomic_int_dec_and_test (&self->ref_count))
+    return;
+
+  /* The connections cancel their registrations before letting go */
+  g_warn_if_fail (self->delayed == NULL);
+
+  while (self->delayed != NULL)
+    rakia_registration_scheduler_cancel (self,
+        ((Delayed *) self->delayed->data)->id);
+
+  g_queue_foreach (&self->starts, priv_start_free, NULL);
+  g_queue_clear (&self->starts);
+  g_slice_free (RakiaRegistrationScheduler, self);
+}
+
+static void
+priv_forget_old_starts (RakiaRegistrationScheduler *self,
+                        gint64 now)
+{
+  gint64 *start;
+
+  while ((start = g_queue_peek_head (&self->starts)) != NULL
+      && now - *start >= self->ramp_window * G_USEC_PER_SEC)
+    g_slice_free (gint64, g_queue_pop_head (&self->starts));
+}
+
+static gboolean
+priv_delayed_cb (gpointer user_data)
+{
+  Delayed *delayed = user_data;
+  RakiaRegistrationScheduler *self = delayed->scheduler;
+
+  self->delayed = g_list_remove (self->delayed, delayed);
+
+  delayed->func (delayed->data);
+
+  return FALSE;
+}
+
+static void
+priv_delayed_free (gpointer data)
+{
+  g_slice_free (Delayed, data);
+}
+
+/**
+ * rakia_registration_scheduler_add:
+ * @self: the scheduler
+ * @func: the function sending the initial REGISTER
+ * @data: data for @func
+ *
+ * Calls @func right away if there is no burst of registrations under way,
+ * and later on otherwise.
+ *
+ * Returns: an identifier to give to rakia_registration_scheduler_cancel ()
+ *  while @func has not been called, or 0 if it has been already
+ */
+guint
+rakia_registration_scheduler_add (RakiaRegistrationScheduler *self,
+                                  GSourceFunc func,
+                                  gpointer data)
+{
+  gint64 now = g_get_monotonic_time ();
+  gint64 *start;
+  Delayed *delayed;
+  guint delay;
+
+  priv_forget_old_starts (self, now);
+
+  start = g_slice_new (gint64);
+  *start = now;
+  g_queue_push_tail (&self->starts, start);
+
+  if (self->ramp_window == 0
+      || g_queue_get_length (&self->starts) <= RAKIA_REGISTRATION_BURST)
+    {
+      func (data);
+      return 0;
+    }
+
+  delay = g_random_int_range (0, self->ramp_window * 1000);
+
+  DEBUG("%u registrations within %u s, delaying this one by %u ms",
+      g_queue_get_length (&self->starts), self->ramp_window, delay);
+
+  delayed = g_slice_new (Delayed);
+  delayed->scheduler = self;
+  delayed->func = func;
+  delayed->data = data;
+  delayed->id = g_timeout_add_full (G_PRIORITY_DEFAULT, delay,
+      priv_delayed_cb, delayed, priv_delayed_free);
+
+  self->delayed = g_list_prepend (self->delayed, delayed);
+
+  return delayed->id;
+}
+
+void
+rakia_registration_scheduler_cancel (RakiaRegistrationScheduler *self,
+                                     guint id)
+{
+  GList *l;
+
+  for (l = self->delayed; l != NULL; l = l->next)
+    {
+      Delayed *delayed = l->data;
+
+      if (delayed->id == id)
+        {
+          self->delayed = g_list_delete_link (self->delayed, l);
+          g_source_remove (id);
+          return;
+        }
+    }
+}
+
+static void
+priv_advance_histogram (RakiaRegistrationScheduler *self)
+{
+  gint64 bucket = g_get_monotonic_time ()
+      / (RAKIA_REGISTRATION_HISTOGRAM_BUCKET_LENGTH * G_USEC_PER_SEC);
+
+  /* Clear the buckets gone by since the last count */
+  if (bucket - self->last_bucket >= RAKIA_REGISTRATION_HISTOGRAM_BUCKETS)
+    {
+      memset (self->counts, 0, sizeof self->counts);
+      self->last_bucket = bucket;
+      return;
+    }
+
+  while (self->last_bucket < bucket)
+    {
+      self->last_bucket++;
+      self->counts[self->last_bucket % RAKIA_REGISTRATION_HISTOGRAM_BUCKETS]
+          = 0;
+    }
+}
+
+/**
+ * rakia_registration_scheduler_note_response:
+ * @self: the scheduler
+ *
+ * Counts a final response to a REGISTER request in the histogram.
+ */
+void
+rakia_registration_scheduler_note_response (RakiaRegistrationScheduler *self)
+{
+  priv_advance_histogram (self);
+
+  self->counts[self->last_bucket % RAKIA_REGISTRATION_HISTOGRAM_BUCKETS]++;
+}
+
+/**
+ * rakia_registration_scheduler_dup_histogram:
+ * @self: the scheduler
+ *
+ * Returns: the number of final responses to REGISTER requests in each of
+ *  the last RAKIA_REGISTRATION_HISTOGRAM_BUCKETS periods of
+ *  RAKIA_REGISTRATION_HISTOGRAM_BUCKET_LENGTH seconds, the oldest first
+ *  and the current one last, as an array of guint
+ */
+GArray *
+rakia_registration_scheduler_dup_histogram (RakiaRegistrationScheduler *self)
+{
+  GArray *histogram = g_array_sized_new (FALSE, FALSE, sizeof (guint),
+      RAKIA_REGISTRATION_HISTOGRAM_BUCKETS);
+  guint i;
+
+  priv_advance_histogram (self);
+
+  for (i = 1; i <= RAKIA_REGISTRATION_HISTOGRAM_BUCKETS; i++)
+    {
+      guint count = self->counts[(self->last_bucket + i)
+          % RAKIA_REGISTRATION_HISTOGRAM_BUCKETS];
+
+      g_array_append_val (histogram, count);
+    }
+
+  return histogram;
+}
+
+guint
+rakia_registration_scheduler_get_pending (RakiaRegistrationScheduler *self)
+{
+  return g_list_length (self->delayed);
+}
+
+guint
+rakia_registration_scheduler_get_ramp_window (RakiaRegistrationScheduler *self)
+{
+  return self->ramp_window;
+}
+
+/**
+ * rakia_registration_jitter_expires:
+ * @expires: the expiry time of a registration, in seconds
+ *
+ * Returns: the expiry time to ask for, @expires lowered by a random
+ *  amount of up to a tenth of it
+ */
+guint
+rakia_registration_jitter_expires (guint expires)
+{
+  guint jittered = expires - g_random_int_range (0, expires / 10 + 1);
+
+  return MAX (jittered, 1);
+}
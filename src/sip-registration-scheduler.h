@@ -0,0 +1,67 @@
+/*
+ * sip-registration-scheduler.h - Staggering of registrations between
+ *  connections
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This work is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This work is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this work; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef __RAKIA_REGISTRATION_SCHEDULER_H__
+#define __RAKIA_REGISTRATION_SCHEDULER_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* Registrations started within the ramp window without being delayed */
+#define RAKIA_REGISTRATION_BURST 10
+
+/* Seconds over which the registrations past the burst are spread, unless
+ * RAKIA_REGISTER_RAMP says otherwise */
+#define RAKIA_REGISTRATION_DEFAULT_RAMP 10
+
+/* The registration load histogram: buckets of so many seconds, for the
+ * last RAKIA_REGISTRATION_HISTOGRAM_BUCKETS of them */
+#define RAKIA_REGISTRATION_HISTOGRAM_BUCKET_LENGTH 10
+#define RAKIA_REGISTRATION_HISTOGRAM_BUCKETS 60
+
+typedef struct _RakiaRegistrationScheduler RakiaRegistrationScheduler;
+
+RakiaRegistrationScheduler *rakia_registration_scheduler_new (
+    guint ramp_window);
+RakiaRegistrationScheduler *rakia_registration_scheduler_ref (
+    RakiaRegistrationScheduler *self);
+void rakia_registration_scheduler_unref (RakiaRegistrationScheduler *self);
+
+guint rakia_registration_scheduler_add (RakiaRegistrationScheduler *self,
+    GSourceFunc func, gpointer data);
+void rakia_registration_scheduler_cancel (RakiaRegistrationScheduler *self,
+    guint id);
+
+void rakia_registration_scheduler_note_response (
+    RakiaRegistrationScheduler *self);
+
+GArray *rakia_registration_scheduler_dup_histogram (
+    RakiaRegistrationScheduler *self);
+guint rakia_registration_scheduler_get_pending (
+    RakiaRegistrationScheduler *self);
+guint rakia_registration_scheduler_get_ramp_window (
+    RakiaRegistrationScheduler *self);
+
+guint rakia_registration_jitter_expires (guint expires);
+
+G_END_DECLS
+
+#endif /* __RAKIA_REGISTRATION_SCHEDULER_H__ */
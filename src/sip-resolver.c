@@ -0,0 +1,1052 @@
+/*
+ * sip-resolver.c - DNS resolver with an answer cache shared by connections
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This work is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This work is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this work; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/*
+ * The connection manager has one resolver for all its connections, so
+ * that accounts on the same domain look up its SRV and address records
+ * once rather than each on its own when they connect.
+ *
+ * Answers are kept for the smallest TTL of their records, and failures
+ * (no such name, no records of the type, no response) for
+ * RAKIA_RESOLVER_NEGATIVE_TTL. Lookups made while a query for the same
+ * name and type is under way wait for its answer instead of sending
+ * another one. If the query cannot be sent at all, they get an empty
+ * answer, which is not cached.
+ *
+ * With a cache file set, the answers with records are also saved to it,
+ * with their expiry time, and read back in the background when it is set
+ * after a restart; lookups made meanwhile wait for it to be read. Saved
+ * answers are used right away but always queried again,
+ * even before they expire; one expired for less than
+ * RAKIA_RESOLVER_MAX_STALE is still given out while the query is under
+ * way, and kept if the DNS servers do not respond.
+ *
+ * The resolver also remembers, for RAKIA_RESOLVER_FAMILY_TTL, which
+ * address family got through first to a destination, so that the
+ * connections after the first one go for it right away, and which
+ * destinations failed lately, so that they all skip those for a while.
+ */
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <arpa/inet.h>
+
+#include "sip-resolver.h"
+
+#include <gio/gio.h>
+#include <sofia-sip/sresolv.h>
+
+#define DEBUG_FLAG RAKIA_DEBUG_CONNECTION
+#include "rakia/debug.h"
+
+/* Seconds to remember that a name could not be resolved */
+#define RAKIA_RESOLVER_NEGATIVE_TTL 60
+
+/* Upper bound for the TTL of cached answers, in seconds */
+#define RAKIA_RESOLVER_MAX_TTL 86400
+
+/* Seconds past their expiry during which saved answers are used while
+ * they are being queried again */
+#define RAKIA_RESOLVER_MAX_STALE 86400
+
+/* Seconds to wait before saving the cache after a new answer, so that
+ * the answers coming in together are saved at once */
+#define RAKIA_RESOLVER_SAVE_DELAY 5
+
+/* Seconds to remember the address family preferred for a destination */
+#define RAKIA_RESOLVER_FAMILY_TTL 600
+
+struct _RakiaResolver
+{
+  gint ref_count;
+  su_root_t *root;
+  sres_resolver_t *sres;
+  /* "type:domain" => CacheEntry */
+  GHashTable *cache;
+  /* "type:domain" => PendingQuery, for queries under way */
+  GHashTable *pending;
+  RakiaResolverCounters counters;
+  gchar *cache_file;
+  /* DeferredLookup, made while the cache file is being read, or NULL */
+  GArray *deferred;
+  guint save_id;
+  /* for the tests: queries wait for rakia_resolver_answer_query () */
+  gboolean hold_queries;
+  /* "host:port" => FamilyPreference */
+  GHashTable *families;
+  /* "host:port" => monotonic time the destination is blacklisted until,
+   * as a gint64 pointer */
+  GHashTable *blacklist;
+};
+
+typedef struct {
+    GArray *records;
+    gint64 expires;
+    /* read from the cache file, not confirmed by a query yet */
+    gboolean saved;
+} CacheEntry;
+
+typedef struct {
+    gint family;
+    gint64 expires;
+} FamilyPreference;
+
+typedef struct {
+    RakiaResolverCallback callback;
+    gpointer user_data;
+} Waiter;
+
+typedef struct {
+    RakiaResolver *resolver;
+    gchar *key;
+    guint16 type;
+    GArray *waiters;
+} PendingQuery;
+
+typedef struct {
+    guint16 type;
+    gchar *domain;
+    Waiter waiter;
+} DeferredLookup;
+
+static void
+priv_records_free (GArray *records)
+{
+  guint i;
+
+  for (i = 0; i < records->len; i++)
+    g_free (g_array_index (records, RakiaResolverRecord, i).target);
+
+  g_array_unref (records);
+}
+
+static void
+cache_entry_free (gpointer data)
+{
+  CacheEntry *entry = data;
+
+  priv_records_free (entry->records);
+  g_slice_free (CacheEntry, entry);
+}
+
+static void
+pending_query_free (gpointer data)
+{
+  PendingQuery *pending = data;
+
+  g_free (pending->key);
+  g_array_unref (pending->waiters);
+  g_slice_free (PendingQuery, pending);
+}
+
+static void
+family_preference_free (gpointer data)
+{
+  g_slice_free (FamilyPreference, data);
+}
+
+static void
+blacklist_expiry_free (gpointer data)
+{
+  g_slice_free (gint64, data);
+}
+
+RakiaResolver *
+rakia_resolver_new (su_root_t *root)
+{
+  RakiaResolver *self = g_slice_new0 (RakiaResolver);
+
+  self->ref_count = 1;
+  self->root = root;
+  self->cache = g_hash_table_new_full (g_str_hash, g_str_equal,
+      g_free, cache_entry_free);
+  self->pending = g_hash_table_new_full (g_str_hash, g_str_equal,
+      NULL, pending_query_free);
+  self->families = g_hash_table_new_full (g_str_hash, g_str_equal,
+      g_free, family_preference_free);
+  self->blacklist = g_hash_table_new_full (g_str_hash, g_str_equal,
+      g_free, blacklist_expiry_free);
+
+  return self;
+}
+
+/* The cache file is a key file with a group for each answer, named
+ * "type:domain" like the cache keys, with the wall clock time of expiry
+ * and the records as "priority weight port target" strings */
+
+static void
+priv_save_cache (RakiaResolver *self)
+{
+  GKeyFile *keyfile;
+  GHashTableIter iter;
+  gpointer key;
+  gpointer value;
+  gint64 now = g_get_monotonic_time ();
+  gint64 real_now = g_get_real_time ();
+  gchar *dir;
+  gchar *data;
+  gsize len;
+  GError *error = NULL;
+
+  if (self->cache_file == NULL)
+    return;
+
+  keyfile = g_key_file_new ();
+
+  g_hash_table_iter_init (&iter, self->cache);
+  while (g_hash_table_iter_next (&iter, &key, &value))
+    {
+      CacheEntry *entry = value;
+      GPtrArray *strv;
+      guint i;
+
+      if (entry->records->len == 0
+          || entry->expires + RAKIA_RESOLVER_MAX_STALE * G_USEC_PER_SEC
+              <= now)
+        continue;
+
+      strv = g_ptr_array_sized_new (entry->records->len + 1);
+      for (i = 0; i < entry->records->len; i++)
+        {
+          RakiaResolverRecord *rec =
+              &g_array_index (entry->records, RakiaResolverRecord, i);
+
+          g_ptr_array_add (strv, g_strdup_printf ("%u %u %u %s",
+                  rec->priority, rec->weight, rec->port, rec->target));
+        }
+      g_ptr_array_add (strv, NULL);
+
+      g_key_file_set_int64 (keyfile, key, "Expires",
+          (real_now + entry->expires - now) / G_USEC_PER_SEC);
+      g_key_file_set_string_list (keyfile, key, "Records",
+          (const gchar * const *) strv->pdata, entry->records->len);
+
+      g_strfreev ((gchar **) g_ptr_array_free (strv, FALSE));
+    }
+
+  data = g_key_file_to_data (keyfile, &len, NULL);
+  g_key_file_free (keyfile);
+
+  dir = g_path_get_dirname (self->cache_file);
+  g_mkdir_with_parents (dir, 0700);
+  g_free (dir);
+
+  if (g_file_set_contents (self->cache_file, data, len, &error))
+    {
+      DEBUG("saved the DNS cache to %s", self->cache_file);
+    }
+  else
+    {
+      MESSAGE ("could not save the DNS cache: %s", error->message);
+      g_clear_error (&error);
+    }
+
+  g_free (data);
+}
+
+static gboolean
+priv_save_cache_cb (gpointer data)
+{
+  RakiaResolver *self = data;
+
+  self->save_id = 0;
+  priv_save_cache (self);
+
+  return FALSE;
+}
+
+static void
+priv_schedule_save (RakiaResolver *self)
+{
+  if (self->cache_file != NULL && self->save_id == 0)
+    self->save_id = g_timeout_add_seconds (RAKIA_RESOLVER_SAVE_DELAY,
+        priv_save_cache_cb, self);
+}
+
+static gboolean
+priv_parse_record (const gchar *str,
+                   RakiaResolverRecord *record)
+{
+  gchar **fields = g_strsplit (str, " ", 4);
+  gboolean ok = (g_strv_length (fields) == 4 && *fields[3] != '\0');
+
+  if (ok)
+    {
+      record->priority = strtoul (fields[0], NULL, 10);
+      record->weight = strtoul (fields[1], NULL, 10);
+      record->port = strtoul (fields[2], NULL, 10);
+      record->target = g_strdup (fields[3]);
+    }
+
+  g_strfreev (fields);
+  return ok;
+}
+
+static void
+priv_merge_cache (RakiaResolver *self,
+                  GKeyFile *keyfile)
+{
+  gchar **groups;
+  gint64 now = g_get_monotonic_time ();
+  gint64 real_now = g_get_real_time () / G_USEC_PER_SEC;
+  guint n_loaded = 0;
+  guint i;
+
+  groups = g_key_file_get_groups (keyfile, NULL);
+
+  for (i = 0; groups[i] != NULL; i++)
+    {
+      gint64 expires;
+      gchar **strv;
+      CacheEntry *entry;
+      guint j;
+
+      expires = g_key_file_get_int64 (keyfile, groups[i], "Expires", NULL);
+      if (expires + RAKIA_RESOLVER_MAX_STALE <= real_now)
+        continue;
+
+      /* Answers already in the cache are newer */
+      if (g_hash_table_lookup (self->cache, groups[i]) != NULL)
+        continue;
+
+      strv = g_key_file_get_string_list (keyfile, groups[i], "Records",
+          NULL, NULL);
+      if (strv == NULL)
+        continue;
+
+      entry = g_slice_new0 (CacheEntry);
+      entry->records = g_array_new (FALSE, FALSE,
+          sizeof (RakiaResolverRecord));
+      entry->expires = now + (expires - real_now) * G_USEC_PER_SEC;
+      entry->saved = TRUE;
+
+      for (j = 0; strv[j] != NULL; j++)
+        {
+          RakiaResolverRecord record = { 0, };
+
+          if (priv_parse_record (strv[j], &record))
+            g_array_append_val (entry->records, record);
+        }
+
+      g_strfreev (strv);
+
+      if (entry->records->len == 0)
+        {
+          cache_entry_free (entry);
+          continue;
+        }
+
+      g_hash_table_insert (self->cache, g_strdup (groups[i]), entry);
+      n_loaded++;
+    }
+
+  DEBUG("loaded %u answers from %s", n_loaded, self->cache_file);
+
+  g_strfreev (groups);
+}
+
+static void
+priv_cache_loaded_cb (GObject *source,
+                      GAsyncResult *result,
+                      gpointer user_data)
+{
+  RakiaResolver *self = user_data;
+  GArray *deferred = self->deferred;
+  gchar *data = NULL;
+  gsize len;
+  GKeyFile *keyfile;
+  GError *error = NULL;
+  guint i;
+
+  if (g_file_load_contents_finish (G_FILE (source), result, &data, &len,
+          NULL, &error))
+    {
+      keyfile = g_key_file_new ();
+
+      if (g_key_file_load_from_data (keyfile, data, len, G_KEY_FILE_NONE,
+              &error))
+        priv_merge_cache (self, keyfile);
+
+      g_key_file_free (keyfile);
+      g_free (data);
+    }
+
+  if (error != NULL)
+    {
+      DEBUG("no DNS cache loaded from %s: %s", self->cache_file,
+          error->message);
+      g_clear_error (&error);
+    }
+
+  /* Now for the lookups that waited; they may add more */
+  self->deferred = NULL;
+
+  for (i = 0; i < deferred->len; i++)
+    {
+      DeferredLookup *lookup = &g_array_index (deferred, DeferredLookup, i);
+
+      if (lookup->waiter.callback != NULL)
+        rakia_resolver_lookup (self, lookup->type, lookup->domain,
+            lookup->waiter.callback, lookup->waiter.user_data);
+
+      g_free (lookup->domain);
+    }
+
+  g_array_unref (deferred);
+  rakia_resolver_unref (self);
+}
+
+RakiaResolver *
+rakia_resolver_ref (RakiaResolver *self)
+{
+  g_atomic_int_inc (&self->ref_count);
+  return self;
+}
+
+void
+rakia_resolver_unref (RakiaResolver *self)
+{
+  if (!g_atomic_int_dec_and_test (&self->ref_count))
+    return;
+
+  if (self->save_id != 0)
+    {
+      g_source_remove (self->save_id);
+      priv_save_cache (self);
+    }
+
+  DEBUG("resolver %p: %u lookups, %u hits, %u negative hits, "
+      "%u coalesced, %u queries", self, self->counters.lookups,
+      self->counters.hits, self->counters.negative_hits,
+      self->counters.coalesced, self->counters.queries);
+
+  /* Cancels the queries under way */
+  if (self->sres != NULL)
+    sres_resolver_destroy (self->sres);
+
+  g_hash_table_unref (self->pending);
+  g_hash_table_unref (self->cache);
+  g_hash_table_unref (self->families);
+  g_hash_table_unref (self->blacklist);
+  g_free (self->cache_file);
+  g_slice_free (RakiaResolver, self);
+}
+
+static void
+priv_add_record (GArray *records,
+                 sres_record_t *answer,
+                 guint16 type)
+{
+  RakiaResolverRecord record = { 0, };
+  gchar buf[INET6_ADDRSTRLEN];
+
+  switch (type)
+    {
+    case sres_type_a:
+      if (inet_ntop (AF_INET, &answer->sr_a->a_addr, buf, sizeof buf) == NULL)
+        return;
+      record.target = g_strdup (buf);
+      break;
+    case sres_type_aaaa:
+      if (inet_ntop (AF_INET6, &answer->sr_aaaa->aaaa_addr, buf,
+              sizeof buf) == NULL)
+        return;
+      record.target = g_strdup (buf);
+      break;
+    case sres_type_srv:
+      record.priority = answer->sr_srv->srv_priority;
+      record.weight = answer->sr_srv->srv_weight;
+      record.port = answer->sr_srv->srv_port;
+      record.target = g_strdup (answer->sr_srv->srv_target);
+      break;
+    default:
+      g_return_if_reached ();
+    }
+
+  g_array_append_val (records, record);
+}
+
+/* Caches the answer to a query and gives it to the lookups waiting for
+ * it; @records is taken over, and is %NULL if the DNS servers did not
+ * respond */
+static void
+priv_finish_query (PendingQuery *pending,
+                   GArray *records,
+                   guint32 ttl)
+{
+  RakiaResolver *self = pending->resolver;
+  CacheEntry *entry;
+  CacheEntry *old_entry;
+  guint i;
+
+  entry = g_slice_new0 (CacheEntry);
+  entry->records = (records != NULL) ? records
+      : g_array_new (FALSE, FALSE, sizeof (RakiaResolverRecord));
+
+  if (entry->records->len == 0)
+    ttl = RAKIA_RESOLVER_NEGATIVE_TTL;
+
+  /* Keep answers with a TTL of 0 for the callbacks below, at least */
+  ttl = MAX (ttl, 1);
+
+  entry->expires = g_get_monotonic_time () + (gint64) ttl * G_USEC_PER_SEC;
+
+  g_hash_table_steal (self->pending, pending->key);
+
+  old_entry = g_hash_table_lookup (self->cache, pending->key);
+  if (records == NULL && old_entry != NULL && old_entry->records->len > 0)
+    {
+      /* No response: rather than forget the saved answer, keep it until
+       * the next lookup tries again */
+      DEBUG("%s: no response, keeping the saved answer", pending->key);
+      cache_entry_free (entry);
+      entry = old_entry;
+      g_free (pending->key);
+    }
+  else
+    {
+      DEBUG("%s: %u records, cached for %u s", pending->key,
+          entry->records->len, ttl);
+
+      /* The cache takes over the key */
+      g_hash_table_replace (self->cache, pending->key, entry);
+
+      if (entry->records->len > 0)
+        priv_schedule_save (self);
+    }
+
+  pending->key = NULL;
+
+  for (i = 0; i < pending->waiters->len; i++)
+    {
+      Waiter *waiter = &g_array_index (pending->waiters, Waiter, i);
+
+      if (waiter->callback != NULL)
+        waiter->callback (entry->records, waiter->user_data);
+    }
+
+  pending_query_free (pending);
+}
+
+/* Gives the lookups waiting for a query that could not be sent an empty
+ * answer, without caching it: the failure is ours, not the name's */
+static void
+priv_fail_query (PendingQuery *pending)
+{
+  RakiaResolver *self = pending->resolver;
+  GArray *empty = g_array_new (FALSE, FALSE, sizeof (RakiaResolverRecord));
+  guint i;
+
+  g_hash_table_steal (self->pending, pending->key);
+
+  for (i = 0; i < pending->waiters->len; i++)
+    {
+      Waiter *waiter = &g_array_index (pending->waiters, Waiter, i);
+
+      if (waiter->callback != NULL)
+        waiter->callback (empty, waiter->user_data);
+    }
+
+  g_array_unref (empty);
+  pending_query_free (pending);
+}
+
+static void
+priv_resolver_cb (sres_context_t *ctx,
+                  sres_query_t *query,
+                  sres_record_t **answers)
+{
+  PendingQuery *pending = (PendingQuery *) ctx;
+  RakiaResolver *self = pending->resolver;
+  GArray *records = NULL;
+  guint32 ttl = RAKIA_RESOLVER_MAX_TTL;
+  guint i;
+
+  if (answers != NULL)
+    {
+      records = g_array_new (FALSE, FALSE, sizeof (RakiaResolverRecord));
+
+      for (i = 0; answers[i] != NULL; i++)
+        {
+          if (answers[i]->sr_record->r_status != 0
+              || answers[i]->sr_record->r_type != pending->type)
+            continue;
+
+          priv_add_record (records, answers[i], pending->type);
+          ttl = MIN (ttl, answers[i]->sr_record->r_ttl);
+        }
+
+      sres_free_answers (self->sres, answers);
+    }
+
+  priv_finish_query (pending, records, ttl);
+}
+
+static void
+priv_send_query (RakiaResolver *self,
+                 gchar *key,
+                 guint16 type,
+                 const gchar *domain,
+                 const Waiter *waiter)
+{
+  PendingQuery *pending;
+
+  pending = g_slice_new0 (PendingQuery);
+  pending->resolver = self;
+  pending->key = key;
+  pending->type = type;
+  pending->waiters = g_array_new (FALSE, FALSE, sizeof (Waiter));
+  if (waiter != NULL)
+    g_array_append_val (pending->waiters, *waiter);
+
+  g_hash_table_insert (self->pending, key, pending);
+
+  self->counters.queries++;
+
+  if (self->hold_queries)
+    {
+      DEBUG("%s: holding the query", key);
+      return;
+    }
+
+  if (self->sres == NULL)
+    {
+      self->sres = sres_resolver_create (self->root, NULL, TAG_END());
+      if (self->sres == NULL)
+        {
+          MESSAGE ("could not create a DNS resolver");
+          priv_fail_query (pending);
+          return;
+        }
+    }
+
+  DEBUG("%s: sending a query", key);
+
+  if (sres_query (self->sres, priv_resolver_cb, (sres_context_t *) pending,
+          type, domain) == NULL)
+    {
+      MESSAGE ("could not send a DNS query for %s", domain);
+      priv_fail_query (pending);
+    }
+}
+
+/**
+ * rakia_resolver_lookup:
+ * @self: the resolver
+ * @type: sres_type_srv, sres_type_a or sres_type_aaaa
+ * @domain: the name to look up
+ * @callback: called with the answer, possibly before this returns
+ * @user_data: data for @callback, and the key for rakia_resolver_cancel ()
+ */
+void
+rakia_resolver_lookup (RakiaResolver *self,
+                       guint16 type,
+                       const gchar *domain,
+                       RakiaResolverCallback callback,
+                       gpointer user_data)
+{
+  gchar *key;
+  CacheEntry *entry;
+  PendingQuery *pending;
+  Waiter waiter = { callback, user_data };
+  gint64 now = g_get_monotonic_time ();
+
+  g_return_if_fail (type == sres_type_srv || type == sres_type_a
+      || type == sres_type_aaaa);
+
+  if (self->deferred != NULL)
+    {
+      DeferredLookup lookup = { type, g_strdup (domain), waiter };
+
+      DEBUG("%u:%s: waiting for the cache file", type, domain);
+      g_array_append_val (self->deferred, lookup);
+      return;
+    }
+
+  self->counters.lookups++;
+
+  key = g_strdup_printf ("%u:%s", type, domain);
+  pending = g_hash_table_lookup (self->pending, key);
+
+  entry = g_hash_table_lookup (self->cache, key);
+  if (entry != NULL && entry->expires <= now
+      && (!entry->saved
+          || entry->expires + RAKIA_RESOLVER_MAX_STALE * G_USEC_PER_SEC
+              <= now))
+    {
+      g_hash_table_remove (self->cache, key);
+      entry = NULL;
+    }
+
+  if (entry != NULL)
+    {
+      if (entry->records->len > 0)
+        self->counters.hits++;
+      else
+        self->counters.negative_hits++;
+
+      DEBUG("%s: answered from the cache%s", key,
+          entry->saved ? " file" : "");
+
+      /* Saved answers may have changed since, so check them again while
+       * they are in use */
+      if (entry->saved && pending == NULL)
+        priv_send_query (self, g_strdup (key), type, domain, NULL);
+
+      g_free (key);
+      callback (entry->records, user_data);
+      return;
+    }
+
+  if (pending != NULL)
+    {
+      self->counters.coalesced++;
+      DEBUG("%s: waiting for the query under way", key);
+      g_array_append_val (pending->waiters, waiter);
+      g_free (key);
+      return;
+    }
+
+  priv_send_query (self, key, type, domain, &waiter);
+}
+
+/**
+ * rakia_resolver_cancel:
+ * @self: the resolver
+ * @user_data: the data given to rakia_resolver_lookup ()
+ *
+ * Forgets the callbacks of the lookups made with @user_data. The queries
+ * themselves go on, for the cache.
+ */
+void
+rakia_resolver_cancel (RakiaResolver *self,
+                       gpointer user_data)
+{
+  GHashTableIter iter;
+  gpointer value;
+  guint i;
+
+  g_hash_table_iter_init (&iter, self->pending);
+  while (g_hash_table_iter_next (&iter, NULL, &value))
+    {
+      PendingQuery *pending = value;
+
+      for (i = 0; i < pending->waiters->len; i++)
+        {
+          Waiter *waiter = &g_array_index (pending->waiters, Waiter, i);
+
+          if (waiter->user_data == user_data)
+            waiter->callback = NULL;
+        }
+    }
+
+  for (i = 0; self->deferred != NULL && i < self->deferred->len; i++)
+    {
+      DeferredLookup *lookup =
+          &g_array_index (self->deferred, DeferredLookup, i);
+
+      if (lookup->waiter.user_data == user_data)
+        lookup->waiter.callback = NULL;
+    }
+}
+
+/**
+ * rakia_resolver_select_srv:
+ * @records: the answer to a SRV query
+ *
+ * Returns: the record to try first out of the ones with the lowest
+ *  priority value, picked at random by weight as RFC 2782 says,
+ *  or %NULL if @records is empty
+ */
+const RakiaResolverRecord *
+rakia_resolver_select_srv (const GArray *records)
+{
+  const RakiaResolverRecord *sel = NULL;
+  guint sum = 0;
+  guint running = 0;
+  guint dice;
+  guint pass;
+  guint i;
+
+  for (i = 0; i < records->len; i++)
+    {
+      const RakiaResolverRecord *rec =
+          &g_array_index (records, RakiaResolverRecord, i);
+
+      if (sel == NULL || rec->priority < sel->priority)
+        sel = rec;
+    }
+
+  if (sel == NULL)
+    return NULL;
+
+  for (i = 0; i < records->len; i++)
+    {
+      const RakiaResolverRecord *rec =
+          &g_array_index (records, RakiaResolverRecord, i);
+
+      if (rec->priority == sel->priority)
+        sum += rec->weight;
+    }
+
+  dice = g_random_int_range (0, sum + 1);
+
+  /* Records of weight 0 go first, so they are picked when the dice
+   * says 0 */
+  for (pass = 0; pass < 2; pass++)
+    for (i = 0; i < records->len; i++)
+      {
+        const RakiaResolverRecord *rec =
+            &g_array_index (records, RakiaResolverRecord, i);
+
+        if (rec->priority != sel->priority
+            || (rec->weight == 0) != (pass == 0))
+          continue;
+
+        running += rec->weight;
+        if (running >= dice)
+          return rec;
+      }
+
+  return sel;
+}
+
+/**
+ * rakia_resolver_set_cache_file:
+ * @self: the resolver
+ * @path: the file to keep answers in across restarts
+ *
+ * Starts reading the answers saved in @path, without blocking; lookups
+ * made before it has been read wait for it. To be called once, before
+ * the first lookup.
+ */
+void
+rakia_resolver_set_cache_file (RakiaResolver *self,
+                               const gchar *path)
+{
+  GFile *file;
+
+  g_return_if_fail (path != NULL);
+  g_return_if_fail (self->cache_file == NULL);
+
+  self->cache_file = g_strdup (path);
+  self->deferred = g_array_new (FALSE, FALSE, sizeof (DeferredLookup));
+
+  file = g_file_new_for_path (path);
+  g_file_load_contents_async (file, NULL, priv_cache_loaded_cb,
+      rakia_resolver_ref (self));
+  g_object_unref (file);
+}
+
+/**
+ * rakia_resolver_set_preferred_family:
+ * @self: the resolver
+ * @host: the host name of a destination
+ * @port: the port of the destination
+ * @family: AF_INET or AF_INET6, the family of the address that got
+ *  through first, or AF_UNSPEC to forget the preference
+ */
+void
+rakia_resolver_set_preferred_family (RakiaResolver *self,
+                                     const gchar *host,
+                                     guint port,
+                                     gint family)
+{
+  gchar *key = g_strdup_printf ("%s:%u", host, port);
+  FamilyPreference *pref;
+
+  if (family == AF_UNSPEC)
+    {
+      g_hash_table_remove (self->families, key);
+      g_free (key);
+      return;
+    }
+
+  DEBUG("%s: preferring IPv%c", key, family == AF_INET6 ? '6' : '4');
+
+  pref = g_slice_new (FamilyPreference);
+  pref->family = family;
+  pref->expires = g_get_monotonic_time ()
+      + RAKIA_RESOLVER_FAMILY_TTL * G_USEC_PER_SEC;
+
+  g_hash_table_replace (self->families, key, pref);
+}
+
+/**
+ * rakia_resolver_get_preferred_family:
+ * @self: the resolver
+ * @host: the host name of a destination
+ * @port: the port of the destination
+ *
+ * Returns: the family given to rakia_resolver_set_preferred_family () for
+ *  the destination within the last RAKIA_RESOLVER_FAMILY_TTL seconds, or
+ *  AF_UNSPEC
+ */
+gint
+rakia_resolver_get_preferred_family (RakiaResolver *self,
+                                     const gchar *host,
+                                     guint port)
+{
+  gchar *key = g_strdup_printf ("%s:%u", host, port);
+  FamilyPreference *pref = g_hash_table_lookup (self->families, key);
+  gint family = AF_UNSPEC;
+
+  if (pref != NULL && pref->expires <= g_get_monotonic_time ())
+    g_hash_table_remove (self->families, key);
+  else if (pref != NULL)
+    family = pref->family;
+
+  g_free (key);
+  return family;
+}
+
+/**
+ * rakia_resolver_blacklist:
+ * @self: the resolver
+ * @host: the host name of a destination
+ * @port: the port of the destination
+ * @seconds: how long to avoid the destination for, or 0 to stop avoiding it
+ */
+void
+rakia_resolver_blacklist (RakiaResolver *self,
+                          const gchar *host,
+                          guint port,
+                          guint seconds)
+{
+  gchar *key = g_strdup_printf ("%s:%u", host, port);
+  gint64 *until;
+
+  if (seconds == 0)
+    {
+      g_hash_table_remove (self->blacklist, key);
+      g_free (key);
+      return;
+    }
+
+  DEBUG("%s: blacklisted for %u seconds", key, seconds);
+
+  until = g_slice_new (gint64);
+  *until = g_get_monotonic_time () + (gint64) seconds * G_USEC_PER_SEC;
+
+  g_hash_table_replace (self->blacklist, key, until);
+}
+
+/**
+ * rakia_resolver_get_blacklist_time:
+ * @self: the resolver
+ * @host: the host name of a destination
+ * @port: the port of the destination
+ *
+ * Returns: the number of seconds, rounded up, the destination is still
+ *  blacklisted for, or 0 if it is not
+ */
+guint
+rakia_resolver_get_blacklist_time (RakiaResolver *self,
+                                   const gchar *host,
+                                   guint port)
+{
+  gchar *key = g_strdup_printf ("%s:%u", host, port);
+  gint64 *until = g_hash_table_lookup (self->blacklist, key);
+  gint64 now = g_get_monotonic_time ();
+  guint seconds = 0;
+
+  if (until != NULL && *until <= now)
+    g_hash_table_remove (self->blacklist, key);
+  else if (until != NULL)
+    seconds = (*until - now + G_USEC_PER_SEC - 1) / G_USEC_PER_SEC;
+
+  g_free (key);
+  return seconds;
+}
+
+/**
+ * rakia_resolver_get_counters:
+ * @self: the resolver
+ * @counters: filled in with how the lookups made so far were answered
+ */
+void
+rakia_resolver_get_counters (RakiaResolver *self,
+                             RakiaResolverCounters *counters)
+{
+  *counters = self->counters;
+}
+
+/**
+ * rakia_resolver_hold_queries:
+ * @self: the resolver
+ *
+ * For the tests: from now on, the queries are not sent to the DNS
+ * servers, but wait for rakia_resolver_answer_query ().
+ */
+void
+rakia_resolver_hold_queries (RakiaResolver *self)
+{
+  self->hold_queries = TRUE;
+}
+
+/**
+ * rakia_resolver_answer_query:
+ * @self: the resolver, holding its queries
+ * @type: the type of the query
+ * @domain: the name queried
+ * @records: the answer, or %NULL for no response from the DNS servers
+ * @ttl: the smallest TTL of @records
+ *
+ * For the tests: answers a held query as the DNS servers would.
+ *
+ * Returns: %TRUE if the query was under way
+ */
+gboolean
+rakia_resolver_answer_query (RakiaResolver *self,
+                             guint16 type,
+                             const gchar *domain,
+                             const GArray *records,
+                             guint ttl)
+{
+  gchar *key = g_strdup_printf ("%u:%s", type, domain);
+  PendingQuery *pending = g_hash_table_lookup (self->pending, key);
+  GArray *copy = NULL;
+  guint i;
+
+  g_free (key);
+
+  if (pending == NULL)
+    return FALSE;
+
+  if (records != NULL)
+    {
+      copy = g_array_sized_new (FALSE, FALSE, sizeof (RakiaResolverRecord),
+          records->len);
+
+      for (i = 0; i < records->len; i++)
+        {
+          RakiaResolverRecord record =
+              g_array_index (records, RakiaResolverRecord, i);
+
+          record.target = g_strdup (record.target);
+          g_array_append_val (copy, record);
+        }
+    }
+
+  priv_finish_query (pending, copy, ttl);
+
+  return TRUE;
+}
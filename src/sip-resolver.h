@@ -0,0 +1,90 @@
+/*
+ * sip-resolver.h - DNS resolver with an answer cache shared by connections
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This work is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This work is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this work; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef __RAKIA_RESOLVER_H__
+#define __RAKIA_RESOLVER_H__
+
+#include <glib.h>
+
+#include <rakia/sofia-decls.h>
+#include <sofia-sip/sresolv.h>
+
+G_BEGIN_DECLS
+
+typedef struct _RakiaResolver RakiaResolver;
+
+/* An answer record: for SRV queries, target is the host name of the
+ * server, for A and AAAA queries it is the address in text form and the
+ * other fields are 0 */
+typedef struct {
+    guint16 priority;
+    guint16 weight;
+    guint16 port;
+    gchar *target;
+} RakiaResolverRecord;
+
+typedef struct {
+    guint lookups;        /* lookups made */
+    guint hits;           /* answered from the cache with records */
+    guint negative_hits;  /* answered from the cache with no records */
+    guint coalesced;      /* joined a query already under way */
+    guint queries;        /* sent to the DNS servers */
+} RakiaResolverCounters;
+
+/**
+ * RakiaResolverCallback:
+ * @records: the answer records, empty if the name could not be resolved
+ * @user_data: the data given to rakia_resolver_lookup ()
+ */
+typedef void (* RakiaResolverCallback) (const GArray *records,
+    gpointer user_data);
+
+RakiaResolver *rakia_resolver_new (su_root_t *root);
+RakiaResolver *rakia_resolver_ref (RakiaResolver *self);
+void rakia_resolver_unref (RakiaResolver *self);
+
+void rakia_resolver_set_cache_file (RakiaResolver *self, const gchar *path);
+
+void rakia_resolver_lookup (RakiaResolver *self, guint16 type,
+    const gchar *domain, RakiaResolverCallback callback, gpointer user_data);
+void rakia_resolver_cancel (RakiaResolver *self, gpointer user_data);
+
+const RakiaResolverRecord *rakia_resolver_select_srv (const GArray *records);
+
+void rakia_resolver_set_preferred_family (RakiaResolver *self,
+    const gchar *host, guint port, gint family);
+gint rakia_resolver_get_preferred_family (RakiaResolver *self,
+    const gchar *host, guint port);
+
+void rakia_resolver_blacklist (RakiaResolver *self, const gchar *host,
+    guint port, guint seconds);
+guint rakia_resolver_get_blacklist_time (RakiaResolver *self,
+    const gchar *host, guint port);
+
+void rakia_resolver_get_counters (RakiaResolver *self,
+    RakiaResolverCounters *counters);
+
+/* For the tests, see tests/test-resolver.c */
+void rakia_resolver_hold_queries (RakiaResolver *self);
+gboolean rakia_resolver_answer_query (RakiaResolver *self, guint16 type,
+    const gchar *domain, const GArray *records, guint ttl);
+
+G_END_DECLS
+
+#endif /* __RAKIA_RESOLVER_H__ */
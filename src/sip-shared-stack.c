@@ -0,0 +1,329 @@
+/*
+ * sip-shared-stack.c - A Sofia-SIP NUA instance shared by connections
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This work is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This work is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this work; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/*
+ * Every connection with the "share-stack" parameter set that can live
+ * with the stack-wide settings below uses the same NUA instance, and with
+ * it the same sockets, timers and DNS resolver.
+ * The account-specific settings are handle parameters (see
+ * rakia_conn_set_nua_params ()), and each connection is given a line
+ * number which goes into its Contact URI as the "line" parameter.
+ *
+ * Events for handles bound to an event target are delivered as usual.
+ * Unbound handles are the ones the stack creates for incoming requests;
+ * their events go to the connection owning the line in the request URI,
+ * or failing that, the connection whose account the request is addressed
+ * to. Requests nobody claims are rejected with 404.
+ */
+
+#include "config.h"
+
+#include <stdlib.h>
+
+#include <rakia/base-connection.h>
+#include <rakia/util.h>
+
+#include "sip-shared-stack.h"
+#include "sip-connection-helpers.h"
+#include "sip-connection-private.h"
+
+#include <sofia-sip/sip_status.h>
+#include <sofia-sip/tport_tag.h>
+#include <sofia-sip/su_wait.h>
+
+#define DEBUG_FLAG RAKIA_DEBUG_CONNECTION
+#include "rakia/debug.h"
+
+struct _RakiaSharedStack
+{
+  gint ref_count;
+  su_root_t *root;
+  nua_t *nua;
+  /* set from the shutdown of the NUA to its nua_r_shutdown */
+  gboolean shutting_down;
+  /* line number => RakiaConnection, not referenced */
+  GHashTable *connections;
+  guint last_line;
+};
+
+RakiaSharedStack *
+rakia_shared_stack_new (su_root_t *root)
+{
+  RakiaSharedStack *self = g_slice_new0 (RakiaSharedStack);
+
+  self->ref_count = 1;
+  self->root = root;
+  self->connections = g_hash_table_new (g_direct_hash, g_direct_equal);
+
+  return self;
+}
+
+RakiaSharedStack *
+rakia_shared_stack_ref (RakiaSharedStack *self)
+{
+  g_atomic_int_inc (&self->ref_count);
+  return self;
+}
+
+void
+rakia_shared_stack_unref (RakiaSharedStack *self)
+{
+  if (!g_atomic_int_dec_and_test (&self->ref_count))
+    return;
+
+  /* The NUA keeps a reference until it's destroyed */
+  g_assert (self->nua == NULL);
+
+  g_hash_table_unref (self->connections);
+  g_slice_free (RakiaSharedStack, self);
+}
+
+static gboolean
+priv_url_matches_account (const url_t *url, const url_t *account)
+{
+  return url != NULL && account != NULL
+      && g_strcmp0 (url->url_user, account->url_user) == 0
+      && url->url_host != NULL && account->url_host != NULL
+      && g_ascii_strcasecmp (url->url_host, account->url_host) == 0;
+}
+
+static RakiaConnection *
+priv_find_connection (RakiaSharedStack *self,
+                      nua_handle_t *nh,
+                      sip_t const *sip)
+{
+  sip_to_t const *to = NULL;
+  GHashTableIter iter;
+  gpointer value;
+
+  if (sip != NULL && sip->sip_request != NULL)
+    {
+      char line[16];
+
+      if (url_param (sip->sip_request->rq_url->url_params, "line",
+              line, sizeof line) > 0)
+        {
+          value = g_hash_table_lookup (self->connections,
+              GUINT_TO_POINTER (strtoul (line, NULL, 10)));
+          if (value != NULL)
+            return value;
+        }
+
+      to = sip->sip_to;
+    }
+
+  if (to == NULL)
+    to = nua_handle_local (nh);
+
+  if (to == NULL)
+    return NULL;
+
+  g_hash_table_iter_init (&iter, self->connections);
+  while (g_hash_table_iter_next (&iter, NULL, &value))
+    {
+      RakiaConnectionPrivate *priv = RAKIA_CONNECTION_GET_PRIVATE (value);
+
+      if (priv_url_matches_account (to->a_url, priv->account_url))
+        return value;
+    }
+
+  return NULL;
+}
+
+static void
+priv_reject_stray_request (nua_event_t event,
+                           nua_handle_t *nh)
+{
+  switch (event)
+    {
+    case nua_i_invite:
+    case nua_i_message:
+    case nua_i_subscribe:
+    case nua_i_refer:
+    case nua_i_info:
+    case nua_i_notify:
+    case nua_i_publish:
+      DEBUG("no connection for %s on handle %p, rejecting",
+          nua_event_name (event), nh);
+      nua_respond (nh, SIP_404_NOT_FOUND, TAG_END());
+      nua_handle_destroy (nh);
+      break;
+    default:
+      DEBUG("no connection for %s on handle %p, dropped",
+          nua_event_name (event), nh);
+      break;
+    }
+}
+
+static void
+priv_shared_stack_callback (nua_event_t event,
+                            int status,
+                            char const *phrase,
+                            nua_t *nua,
+                            nua_magic_t *magic,
+                            nua_handle_t *nh,
+                            nua_hmagic_t *target,
+                            sip_t const *sip,
+                            tagi_t tags[])
+{
+  RakiaSharedStack *self = (RakiaSharedStack *) magic;
+  RakiaConnection *conn;
+
+  if (event == nua_r_shutdown)
+    {
+      rakia_base_connection_sofia_callback (event, status, phrase, nua,
+          NULL, nh, target, sip, tags);
+
+      /* Drop the reference taken by the NUA once it has shut down; it
+       * sends no more events before it is destroyed */
+      if (status >= 200)
+        {
+          self->shutting_down = FALSE;
+          rakia_shared_stack_unref (self);
+        }
+      return;
+    }
+
+  if (target != NULL)
+    {
+      rakia_base_connection_sofia_callback (event, status, phrase, nua,
+          NULL, nh, target, sip, tags);
+      return;
+    }
+
+  if (nh == NULL)
+    {
+      DEBUG("stack event %s: %03d %s", nua_event_name (event), status, phrase);
+      return;
+    }
+
+  conn = priv_find_connection (self, nh, sip);
+  if (conn == NULL)
+    {
+      priv_reject_stray_request (event, nh);
+      return;
+    }
+
+  /* The handle was created by the stack for an incoming request, so it
+   * has none of the connection's settings yet */
+  if (sip != NULL && sip->sip_request != NULL)
+    rakia_conn_apply_handle_params (conn, nh);
+
+  rakia_base_connection_sofia_callback (event, status, phrase, nua,
+      RAKIA_BASE_CONNECTION (conn), nh, NULL, sip, tags);
+}
+
+/**
+ * rakia_shared_stack_add_connection:
+ * @self: the shared stack
+ * @conn: a connection about to start connecting
+ * @line: set to the line number identifying @conn in the stack
+ *
+ * Returns: the NUA instance for @conn to use, created on demand,
+ * or %NULL if it could not be created
+ */
+nua_t *
+rakia_shared_stack_add_connection (RakiaSharedStack *self,
+                                   RakiaConnection *conn,
+                                   guint *line)
+{
+  if (self->nua == NULL)
+    {
+      self->nua = nua_create (self->root,
+          priv_shared_stack_callback,
+          (nua_magic_t *) self,
+          SOATAG_AF(SOA_AF_IP4_IP6),
+          NUTAG_URL(URL_STRING_MAKE("sip:0:*")),
+          NUTAG_USER_AGENT(rakia_version_string ()),
+          NUTAG_ENABLEMESSAGE(1),
+          NUTAG_ENABLEINVITE(1),
+          NUTAG_AUTOALERT(0),
+          NUTAG_AUTOANSWER(0),
+          NUTAG_APPL_METHOD("MESSAGE"),
+          SIPTAG_ALLOW_STR(RAKIA_CONNECTION_ALLOW_METHODS),
+          TPTAG_TLS_VERIFY_POLICY(TPTLS_VERIFY_ALL),
+          TAG_NULL());
+      if (self->nua == NULL)
+        return NULL;
+
+      rakia_shared_stack_ref (self);
+
+      DEBUG("initialized a shared Sofia-SIP NUA at address %p", self->nua);
+    }
+
+  do
+    self->last_line++;
+  while (self->last_line == 0 || g_hash_table_lookup (self->connections,
+          GUINT_TO_POINTER (self->last_line)) != NULL);
+
+  g_hash_table_insert (self->connections, GUINT_TO_POINTER (self->last_line),
+      conn);
+
+  DEBUG("connection %p is on line %u of %u", conn, self->last_line,
+      g_hash_table_size (self->connections));
+
+  *line = self->last_line;
+  return self->nua;
+}
+
+/**
+ * rakia_shared_stack_remove_connection:
+ * @self: the shared stack
+ * @line: the line number of a connection which is shutting down
+ *
+ * Stops delivering events for unbound handles to the connection on @line.
+ * The NUA instance is shut down with the last connection.
+ */
+void
+rakia_shared_stack_remove_connection (RakiaSharedStack *self,
+                                      guint line)
+{
+  g_hash_table_remove (self->connections, GUINT_TO_POINTER (line));
+
+  if (g_hash_table_size (self->connections) == 0 && self->nua != NULL)
+    {
+      DEBUG("last line closed, shutting down the shared NUA");
+      nua_shutdown (self->nua);
+      self->nua = NULL;
+      self->shutting_down = TRUE;
+    }
+}
+
+/**
+ * rakia_shared_stack_wait_shutdown:
+ * @self: the shared stack, with no connections left
+ *
+ * Runs the Sofia root until the NUA instance has completed its shutdown,
+ * so that it can be destroyed with rakia_base_connection_sofia_flush ()
+ * before the root. Sofia-SIP gives up on the pending transactions after
+ * 30 seconds at most.
+ */
+void
+rakia_shared_stack_wait_shutdown (RakiaSharedStack *self)
+{
+  g_return_if_fail (g_hash_table_size (self->connections) == 0);
+
+  if (!self->shutting_down)
+    return;
+
+  DEBUG("waiting for the shared NUA to shut down");
+
+  while (self->shutting_down)
+    su_root_step (self->root, 100);
+}
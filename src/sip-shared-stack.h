@@ -0,0 +1,45 @@
+/*
+ * sip-shared-stack.h - A Sofia-SIP NUA instance shared by connections
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This work is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This work is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this work; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef __RAKIA_SHARED_STACK_H__
+#define __RAKIA_SHARED_STACK_H__
+
+#include <glib.h>
+
+#include <rakia/sofia-decls.h>
+
+#include "sip-connection.h"
+
+G_BEGIN_DECLS
+
+typedef struct _RakiaSharedStack RakiaSharedStack;
+
+RakiaSharedStack *rakia_shared_stack_new (su_root_t *root);
+RakiaSharedStack *rakia_shared_stack_ref (RakiaSharedStack *self);
+void rakia_shared_stack_unref (RakiaSharedStack *self);
+
+nua_t *rakia_shared_stack_add_connection (RakiaSharedStack *self,
+    RakiaConnection *conn, guint *line);
+void rakia_shared_stack_remove_connection (RakiaSharedStack *self,
+    guint line);
+void rakia_shared_stack_wait_shutdown (RakiaSharedStack *self);
+
+G_END_DECLS
+
+#endif /* __RAKIA_SHARED_STACK_H__ */
@@ -337,7 +337,7 @@ main (void)
   dbus_g_type_specialized_init ();
 
   protocols = g_slist_prepend (protocols,
-    rakia_protocol_new (NULL));
+    rakia_protocol_new (NULL, NULL, NULL, NULL, NULL));
 
   s = mgr_file_contents (TP_CM_BUS_NAME_BASE "sofiasip",
       TP_CM_OBJECT_PATH_BASE "sofiasip",
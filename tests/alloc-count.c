@@ -0,0 +1,145 @@
+/*
+ * alloc-count.c - Heap allocation counter for the benchmarks
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This work is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This work is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this work; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/*
+ * Counts the blocks taken from the heap, by GLib, by Sofia-SIP's su_home
+ * and by everything else in the process.
+ *
+ * With glibc, malloc (), calloc () and realloc () are replaced here and
+ * forward to the C library's own entry points; the benchmark executable
+ * defining them is enough for every library to use them. Elsewhere, a
+ * counting GMemVTable is installed, which only sees GLib's allocations,
+ * and only with a GLib older than 2.46, which ignores g_mem_set_vtable ();
+ * alloc_count_is_available () says whether the figures mean anything.
+ */
+
+#include "config.h"
+
+#include "alloc-count.h"
+
+#include <stdlib.h>
+
+static volatile gint n_allocs = 0;
+
+#ifdef __GLIBC__
+
+extern void *__libc_malloc (size_t size);
+extern void *__libc_calloc (size_t n_members, size_t size);
+extern void *__libc_realloc (void *ptr, size_t size);
+
+void *
+malloc (size_t size)
+{
+  g_atomic_int_inc (&n_allocs);
+  return __libc_malloc (size);
+}
+
+void *
+calloc (size_t n_members, size_t size)
+{
+  g_atomic_int_inc (&n_allocs);
+  return __libc_calloc (n_members, size);
+}
+
+void *
+realloc (void *ptr, size_t size)
+{
+  if (ptr == NULL)
+    g_atomic_int_inc (&n_allocs);
+  return __libc_realloc (ptr, size);
+}
+
+void
+alloc_count_init (void)
+{
+  /* Make GSlice take its blocks from malloc () too */
+  g_setenv ("G_SLICE", "always-malloc", TRUE);
+}
+
+gboolean
+alloc_count_is_available (void)
+{
+  return TRUE;
+}
+
+#else /* !__GLIBC__ */
+
+static gpointer
+counting_malloc (gsize n_bytes)
+{
+  g_atomic_int_inc (&n_allocs);
+  return malloc (n_bytes);
+}
+
+static gpointer
+counting_realloc (gpointer mem, gsize n_bytes)
+{
+  if (mem == NULL)
+    g_atomic_int_inc (&n_allocs);
+  return realloc (mem, n_bytes);
+}
+
+static gpointer
+counting_calloc (gsize n_blocks, gsize n_block_bytes)
+{
+  g_atomic_int_inc (&n_allocs);
+  return calloc (n_blocks, n_block_bytes);
+}
+
+static GMemVTable counting_vtable = {
+    counting_malloc,
+    counting_realloc,
+    free,
+    counting_calloc,
+    NULL,
+    NULL
+};
+
+/* Must be called before anything touches the heap through GLib */
+void
+alloc_count_init (void)
+{
+  g_setenv ("G_SLICE", "always-malloc", TRUE);
+  g_mem_set_vtable (&counting_vtable);
+}
+
+gboolean
+alloc_count_is_available (void)
+{
+  return !g_mem_is_system_malloc ();
+}
+
+#endif /* !__GLIBC__ */
+
+guint
+alloc_count_get (void)
+{
+  return (guint) g_atomic_int_get (&n_allocs);
+}
+
+/* Returns the allocations per operation as a right-aligned column, or
+ * "n/a" if they could not be counted */
+gchar *
+alloc_count_format_per_op (guint allocs, gint ops)
+{
+  if (!alloc_count_is_available ())
+    return g_strdup ("     n/a");
+
+  return g_strdup_printf ("%8.1f", (gdouble) allocs / MAX (ops, 1));
+}
@@ -0,0 +1,34 @@
+/*
+ * alloc-count.h - Heap allocation counter for the benchmarks
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This work is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This work is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this work; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef __RAKIA_TEST_ALLOC_COUNT_H__
+#define __RAKIA_TEST_ALLOC_COUNT_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+void alloc_count_init (void);
+gboolean alloc_count_is_available (void);
+guint alloc_count_get (void);
+gchar *alloc_count_format_per_op (guint allocs, gint ops);
+
+G_END_DECLS
+
+#endif /* #ifndef __RAKIA_TEST_ALLOC_COUNT_H__ */
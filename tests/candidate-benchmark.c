@@ -0,0 +1,252 @@
+/*
+ * candidate-benchmark.c - Benchmark of local candidate handling
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This work is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This work is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this work; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/*
+ * Runs the steps RakiaCallStream takes for the local candidates of a
+ * stream on ICE-sized sets of 20 to 50 candidates in Telepathy's
+ * a(usua{sv}) form: validating the addresses, the way it used to with
+ * GInetAddress and the way it does now, and converting the set into
+ * RakiaSipCandidates handed over to a RakiaSipMedia. Reports operations
+ * (whole candidate sets) per second and heap allocations per operation.
+ *
+ * Usage: candidate-benchmark [-n ITERATIONS]
+ */
+
+#include "config.h"
+
+#include "alloc-count.h"
+
+#include <gio/gio.h>
+#include <telepathy-glib/telepathy-glib.h>
+
+#include <rakia/sip-media.h>
+#include <rakia/sip-session.h>
+#include <rakia/util.h>
+
+typedef void (* BenchmarkFunc) (const GPtrArray *candidates);
+
+static gint iterations = 200;
+
+static RakiaSipSession *session = NULL;
+
+/* A set like a dual-stack host gathers: host, server reflexive and
+ * peer reflexive candidates on a few addresses, for RTP and RTCP */
+static GPtrArray *
+make_candidates (guint n)
+{
+  GPtrArray *candidates = g_ptr_array_new_with_free_func (
+      (GDestroyNotify) g_value_array_free);
+  guint i;
+
+  for (i = 0; i < n; i++)
+    {
+      guint component = 1 + i % 2;
+      TpCallStreamCandidateType type = TP_CALL_STREAM_CANDIDATE_TYPE_HOST
+          + (i / 2) % 3;
+      gchar *ip;
+      gchar *foundation;
+      GHashTable *info;
+
+      if (i % 4 < 2)
+        ip = g_strdup_printf ("192.0.2.%u", 1 + i / 4);
+      else
+        ip = g_strdup_printf ("2001:db8::%x", 1 + i / 4);
+
+      foundation = g_strdup_printf ("%u", 1 + i / 2);
+
+      info = tp_asv_new (
+          "protocol", G_TYPE_UINT, TP_MEDIA_STREAM_BASE_PROTO_UDP,
+          "foundation", G_TYPE_STRING, foundation,
+          "priority", G_TYPE_UINT, 2130706431 - i,
+          "type", G_TYPE_UINT, type,
+          NULL);
+
+      if (type != TP_CALL_STREAM_CANDIDATE_TYPE_HOST)
+        {
+          tp_asv_set_string (info, "base-ip", "10.0.0.1");
+          tp_asv_set_uint32 (info, "base-port", 50000 + i);
+        }
+
+      g_ptr_array_add (candidates, tp_value_array_build (4,
+              G_TYPE_UINT, component,
+              G_TYPE_STRING, ip,
+              G_TYPE_UINT, 40000 + i,
+              TP_HASH_TYPE_STRING_VARIANT_MAP, info,
+              G_TYPE_INVALID));
+
+      g_hash_table_unref (info);
+      g_free (foundation);
+      g_free (ip);
+    }
+
+  return candidates;
+}
+
+static void
+bench_validate_inet_address (const GPtrArray *candidates)
+{
+  guint i;
+
+  for (i = 0; i < candidates->len; i++)
+    {
+      GValueArray *candidate = g_ptr_array_index (candidates, i);
+      GInetAddress *inetaddr = g_inet_address_new_from_string (
+          g_value_get_string (candidate->values + 1));
+
+      g_assert (inetaddr != NULL);
+      g_object_unref (inetaddr);
+    }
+}
+
+static void
+bench_validate_inet_pton (const GPtrArray *candidates)
+{
+  guint i;
+
+  for (i = 0; i < candidates->len; i++)
+    {
+      GValueArray *candidate = g_ptr_array_index (candidates, i);
+
+      g_assert (rakia_ip_address_is_valid (
+          g_value_get_string (candidate->values + 1)));
+    }
+}
+
+/* As RakiaCallStream does from AddCandidates to FinishInitialCandidates */
+static void
+bench_take_candidates (const GPtrArray *candidates)
+{
+  RakiaSipMedia *media;
+  guint i;
+
+  media = rakia_sip_media_new (session, TP_MEDIA_STREAM_TYPE_AUDIO,
+      "benchmark", TP_MEDIA_STREAM_DIRECTION_BIDIRECTIONAL, TRUE, FALSE);
+  rakia_sip_media_set_local_credentials (media, "ufrag", "password");
+
+  for (i = 0; i < candidates->len; i++)
+    {
+      GValueArray *tpcandidate = g_ptr_array_index (candidates, i);
+      GHashTable *info = g_value_get_boxed (tpcandidate->values + 3);
+      RakiaSipCandidate *candidate;
+      const gchar *base_ip;
+
+      if (!rakia_ip_address_is_valid (
+              g_value_get_string (tpcandidate->values + 1)))
+        continue;
+
+      candidate = rakia_sip_candidate_new_take (
+          g_value_get_uint (tpcandidate->values + 0),
+          g_value_dup_string (tpcandidate->values + 1),
+          g_value_get_uint (tpcandidate->values + 2),
+          g_strdup (tp_asv_get_string (info, "foundation")),
+          tp_asv_get_uint32 (info, "priority", NULL));
+      candidate->type = tp_asv_get_uint32 (info, "type", NULL);
+
+      base_ip = tp_asv_get_string (info, "base-ip");
+      if (base_ip != NULL)
+        {
+          candidate->base_ip = g_strdup (base_ip);
+          candidate->base_port = tp_asv_get_uint32 (info, "base-port", NULL);
+        }
+
+      rakia_sip_media_take_local_candidate (media, candidate);
+    }
+
+  g_assert (rakia_sip_media_local_candidates_prepared (media));
+
+  g_object_unref (media);
+}
+
+static void
+run_benchmark (const gchar *stage, BenchmarkFunc func,
+    const GPtrArray *candidates)
+{
+  gint64 start;
+  gint64 elapsed;
+  guint allocs;
+  gchar *per_op;
+  gint n;
+
+  func (candidates);
+
+  allocs = alloc_count_get ();
+  start = g_get_monotonic_time ();
+
+  for (n = 0; n < iterations; n++)
+    func (candidates);
+
+  elapsed = MAX (g_get_monotonic_time () - start, 1);
+  allocs = alloc_count_get () - allocs;
+
+  per_op = alloc_count_format_per_op (allocs, iterations);
+  g_print ("%-22s %2u candidates %12.0f ops/s %s allocs/op\n",
+      stage, candidates->len,
+      (gdouble) iterations * G_USEC_PER_SEC / elapsed, per_op);
+  g_free (per_op);
+}
+
+int
+main (int argc, char **argv)
+{
+  static const guint set_sizes[] = { 20, 35, 50 };
+  GOptionEntry options[] = {
+      { "iterations", 'n', 0, G_OPTION_ARG_INT, &iterations,
+        "Number of iterations for each candidate set", "N" },
+      { NULL }
+  };
+  GOptionContext *context;
+  GError *error = NULL;
+  guint i;
+
+  /* Before anything touches the heap */
+  alloc_count_init ();
+
+  g_type_init ();
+
+  context = g_option_context_new ("- benchmark local candidate handling");
+  g_option_context_add_main_entries (context, options, NULL);
+  if (!g_option_context_parse (context, &argc, &argv, &error))
+    {
+      g_printerr ("%s\n", error->message);
+      return 2;
+    }
+  g_option_context_free (context);
+
+  if (iterations <= 0)
+    iterations = 1;
+
+  session = g_object_new (RAKIA_TYPE_SIP_SESSION, NULL);
+
+  for (i = 0; i < G_N_ELEMENTS (set_sizes); i++)
+    {
+      GPtrArray *candidates = make_candidates (set_sizes[i]);
+
+      run_benchmark ("validate-inet-address", bench_validate_inet_address,
+          candidates);
+      run_benchmark ("validate-inet-pton", bench_validate_inet_pton,
+          candidates);
+      run_benchmark ("take-candidates", bench_take_candidates, candidates);
+
+      g_ptr_array_unref (candidates);
+    }
+
+  g_object_unref (session);
+
+  return 0;
+}
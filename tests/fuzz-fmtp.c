@@ -0,0 +1,170 @@
+/*
+ * fuzz-fmtp.c - Fuzzing entry point for the fmtp parser
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This work is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This work is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this work; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/*
+ * Each input is an encoding name, a space, and the value of an a=fmtp
+ * attribute, e.g. "telephone-event 0-15". The value is parsed with
+ * rakia_codec_param_parse() and the result formatted back with
+ * rakia_codec_param_format().
+ *
+ * Built with -DRAKIA_LIBFUZZER, only LLVMFuzzerTestOneInput() is
+ * provided, for linking with -fsanitize=fuzzer. Otherwise, main()
+ * runs every file given on the command line, as in
+ * "afl-fuzz -i corpus/fmtp -o findings ./fuzz-fmtp @@"; without
+ * arguments it replays the seed corpus, which is what "make check" does.
+ */
+
+#include "config.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#include <glib-object.h>
+
+#include <rakia/codec-param-formats.h>
+
+static const gchar * const video_encodings[] = {
+    "H263-1998", "H263-2000", "H264", "MP4V-ES", "THEORA", "VP8", NULL
+};
+
+static TpMediaStreamType
+guess_media_type (const gchar *encoding_name)
+{
+  guint i;
+
+  for (i = 0; video_encodings[i] != NULL; i++)
+    if (g_ascii_strcasecmp (encoding_name, video_encodings[i]) == 0)
+      return TP_MEDIA_STREAM_TYPE_VIDEO;
+
+  return TP_MEDIA_STREAM_TYPE_AUDIO;
+}
+
+static void
+fuzz_one (const guint8 *data, gsize size)
+{
+  gchar *input;
+  gchar *fmtp;
+  RakiaSipCodec *codec;
+  TpMediaStreamType media_type;
+  GString *out;
+
+  /* The parser works on NUL-terminated strings, so anything past an
+   * embedded NUL is ignored, as it would be coming from sofia-sip */
+  input = g_strndup ((const gchar *) data, size);
+
+  fmtp = strchr (input, ' ');
+  if (fmtp == NULL || fmtp == input)
+    {
+      g_free (input);
+      return;
+    }
+  *fmtp++ = '\0';
+
+  media_type = guess_media_type (input);
+  codec = rakia_sip_codec_new (96, input, 8000, 0);
+
+  rakia_codec_param_parse (media_type, codec, fmtp);
+
+  out = g_string_new (NULL);
+  rakia_codec_param_format (media_type, codec, out);
+
+  g_string_free (out, TRUE);
+  rakia_sip_codec_free (codec);
+  g_free (input);
+}
+
+int LLVMFuzzerTestOneInput (const uint8_t *data, size_t size);
+
+int
+LLVMFuzzerTestOneInput (const uint8_t *data, size_t size)
+{
+  static gboolean initialized = FALSE;
+
+  if (!initialized)
+    {
+      g_type_init ();
+      /* Parse failures are logged, which is expected here */
+      g_log_set_always_fatal (G_LOG_FATAL_MASK | G_LOG_LEVEL_CRITICAL);
+      initialized = TRUE;
+    }
+
+  fuzz_one (data, size);
+  return 0;
+}
+
+#ifndef RAKIA_LIBFUZZER
+
+static int
+run_file (const gchar *path)
+{
+  GError *error = NULL;
+  gchar *contents;
+  gsize length;
+
+  if (!g_file_get_contents (path, &contents, &length, &error))
+    {
+      g_printerr ("%s\n", error->message);
+      g_error_free (error);
+      return 1;
+    }
+
+  LLVMFuzzerTestOneInput ((const uint8_t *) contents, length);
+  g_free (contents);
+  return 0;
+}
+
+int
+main (int argc, char **argv)
+{
+  const gchar *dirname = RAKIA_TEST_CORPUS_DIR "/fmtp";
+  GError *error = NULL;
+  const gchar *name;
+  GDir *dir;
+  int ret = 0;
+  int i;
+
+  if (argc > 1)
+    {
+      for (i = 1; i < argc; i++)
+        ret |= run_file (argv[i]);
+
+      return ret;
+    }
+
+  dir = g_dir_open (dirname, 0, &error);
+  if (dir == NULL)
+    {
+      g_printerr ("%s\n", error->message);
+      g_error_free (error);
+      return 1;
+    }
+
+  while ((name = g_dir_read_name (dir)) != NULL)
+    {
+      gchar *path = g_build_filename (dirname, name, NULL);
+
+      ret |= run_file (path);
+      g_free (path);
+    }
+
+  g_dir_close (dir);
+  return ret;
+}
+
+#endif /* !RAKIA_LIBFUZZER */
@@ -0,0 +1,403 @@
+/*
+ * sdp-benchmark.c - Benchmark of SDP and fmtp processing
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This work is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This work is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this work; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/*
+ * Runs the remote SDP processing and local SDP generation paths of
+ * RakiaSipMedia, and the fmtp parser and formatter, over a corpus of
+ * SDP bodies captured from carriers, PBXes, softphones and WebRTC
+ * gateways. Reports operations per second and heap allocations per
+ * operation for each stage.
+ *
+ * Usage: sdp-benchmark [-n ITERATIONS] [FILE.sdp...]
+ * Without files, the corpus in the source tree is used.
+ */
+
+#include "config.h"
+
+#include "alloc-count.h"
+
+#include <string.h>
+
+#include <glib-object.h>
+
+#include <sofia-sip/sdp.h>
+
+#include <rakia/codec-param-formats.h>
+#include <rakia/sip-media.h>
+#include <rakia/sip-session.h>
+
+typedef struct {
+    gchar *name;
+    gchar *body;
+    sdp_parser_t *parser;
+} CorpusEntry;
+
+typedef void (* BenchmarkFunc) (CorpusEntry *entry);
+
+static gint iterations = 200;
+
+static RakiaSipSession *session = NULL;
+
+static TpMediaStreamType
+media_type_from_sdp (const sdp_media_t *m)
+{
+  switch (m->m_type)
+    {
+    case sdp_media_audio:
+      return TP_MEDIA_STREAM_TYPE_AUDIO;
+    case sdp_media_video:
+      return TP_MEDIA_STREAM_TYPE_VIDEO;
+    default:
+      return G_MAXUINT;
+    }
+}
+
+/* Creates a media for @m as if it came in a remote offer, and
+ * answers it with the offered codecs */
+static RakiaSipMedia *
+media_from_sdp (const sdp_media_t *m, gboolean answer)
+{
+  TpMediaStreamType type = media_type_from_sdp (m);
+  RakiaSipMedia *media;
+  GPtrArray *offer;
+  GPtrArray *codecs;
+  guint i;
+
+  if (type == G_MAXUINT)
+    return NULL;
+
+  media = rakia_sip_media_new (session, type, "benchmark",
+      TP_MEDIA_STREAM_DIRECTION_BIDIRECTIONAL, FALSE, FALSE);
+
+  if (!rakia_sip_media_set_remote_media (media, m, TRUE))
+    {
+      g_object_unref (media);
+      return NULL;
+    }
+
+  if (!answer)
+    return media;
+
+  rakia_sip_media_take_local_candidate (media,
+      rakia_sip_candidate_new (1, "192.0.2.1", 40000, NULL, 0));
+  rakia_sip_media_take_local_candidate (media,
+      rakia_sip_candidate_new (2, "192.0.2.1", 40001, NULL, 0));
+  rakia_sip_media_local_candidates_prepared (media);
+
+  offer = rakia_sip_media_get_remote_codec_offer (media);
+  codecs = rakia_sip_codec_list_new (offer != NULL ? offer->len : 0);
+
+  for (i = 0; offer != NULL && i < offer->len; i++)
+    {
+      RakiaSipCodec *codec = g_ptr_array_index (offer, i);
+      RakiaSipCodec *copy = rakia_sip_codec_new (codec->id,
+          codec->encoding_name, codec->clock_rate, codec->channels);
+      guint j;
+
+      for (j = 0; codec->params != NULL && j < codec->params->len; j++)
+        {
+          RakiaSipCodecParam *param = g_ptr_array_index (codec->params, j);
+
+          rakia_sip_codec_add_param (copy, param->name, param->value);
+        }
+
+      g_ptr_array_add (codecs, copy);
+    }
+
+  rakia_sip_media_take_local_codecs (media, codecs);
+
+  return media;
+}
+
+static void
+bench_sdp_parse (CorpusEntry *entry)
+{
+  sdp_parser_t *parser = sdp_parse (NULL, entry->body, strlen (entry->body),
+      0);
+
+  g_assert (sdp_session (parser) != NULL);
+  sdp_parser_free (parser);
+}
+
+static void
+bench_set_remote_media (CorpusEntry *entry)
+{
+  const sdp_media_t *m;
+
+  for (m = sdp_session (entry->parser)->sdp_media; m != NULL; m = m->m_next)
+    {
+      RakiaSipMedia *media = media_from_sdp (m, FALSE);
+
+      if (media != NULL)
+        g_object_unref (media);
+    }
+}
+
+static GPtrArray *generate_medias = NULL;
+static GString *generate_out = NULL;
+
+static void
+bench_generate_sdp (CorpusEntry *entry)
+{
+  guint i;
+
+  g_string_truncate (generate_out, 0);
+
+  for (i = 0; i < generate_medias->len; i++)
+    rakia_sip_media_generate_sdp (g_ptr_array_index (generate_medias, i),
+        generate_out, FALSE);
+}
+
+static void
+bench_fmtp (CorpusEntry *entry)
+{
+  const sdp_media_t *m;
+  GString *out = g_string_sized_new (128);
+
+  for (m = sdp_session (entry->parser)->sdp_media; m != NULL; m = m->m_next)
+    {
+      TpMediaStreamType type = media_type_from_sdp (m);
+      const sdp_rtpmap_t *rtpmap;
+
+      if (type == G_MAXUINT)
+        continue;
+
+      for (rtpmap = m->m_rtpmaps; rtpmap != NULL; rtpmap = rtpmap->rm_next)
+        {
+          RakiaSipCodec *codec;
+
+          if (rtpmap->rm_fmtp == NULL)
+            continue;
+
+          codec = rakia_sip_codec_new (rtpmap->rm_pt, rtpmap->rm_encoding,
+              rtpmap->rm_rate, 0);
+          rakia_codec_param_parse (type, codec, rtpmap->rm_fmtp);
+          g_string_truncate (out, 0);
+          rakia_codec_param_format (type, codec, out);
+          rakia_sip_codec_free (codec);
+        }
+    }
+
+  g_string_free (out, TRUE);
+}
+
+static void
+run_benchmark (const gchar *stage, BenchmarkFunc func, GPtrArray *corpus)
+{
+  guint i;
+
+  for (i = 0; i < corpus->len; i++)
+    {
+      CorpusEntry *entry = g_ptr_array_index (corpus, i);
+      gint64 start;
+      gint64 elapsed;
+      guint allocs;
+      gchar *per_op;
+      gint n;
+
+      /* Warm up lazily initialised state such as the fmtp regexes */
+      func (entry);
+
+      allocs = alloc_count_get ();
+      start = g_get_monotonic_time ();
+
+      for (n = 0; n < iterations; n++)
+        func (entry);
+
+      elapsed = MAX (g_get_monotonic_time () - start, 1);
+      allocs = alloc_count_get () - allocs;
+
+      per_op = alloc_count_format_per_op (allocs, iterations);
+      g_print ("%-18s %-24s %12.0f ops/s %s allocs/op\n",
+          stage, entry->name,
+          (gdouble) iterations * G_USEC_PER_SEC / elapsed, per_op);
+      g_free (per_op);
+    }
+}
+
+static gboolean
+load_entry (const gchar *path, GPtrArray *corpus)
+{
+  CorpusEntry *entry;
+  GError *error = NULL;
+  gchar *body;
+
+  if (!g_file_get_contents (path, &body, NULL, &error))
+    {
+      g_printerr ("%s\n", error->message);
+      g_error_free (error);
+      return FALSE;
+    }
+
+  entry = g_slice_new0 (CorpusEntry);
+  entry->name = g_path_get_basename (path);
+  entry->body = body;
+  entry->parser = sdp_parse (NULL, body, strlen (body), 0);
+
+  if (sdp_session (entry->parser) == NULL)
+    {
+      g_printerr ("%s: %s\n", path, sdp_parsing_error (entry->parser));
+      sdp_parser_free (entry->parser);
+      g_free (entry->name);
+      g_free (entry->body);
+      g_slice_free (CorpusEntry, entry);
+      return FALSE;
+    }
+
+  g_ptr_array_add (corpus, entry);
+  return TRUE;
+}
+
+static gboolean
+load_corpus_dir (const gchar *dirname, GPtrArray *corpus)
+{
+  GDir *dir;
+  GError *error = NULL;
+  const gchar *name;
+  gboolean ok = TRUE;
+
+  dir = g_dir_open (dirname, 0, &error);
+  if (dir == NULL)
+    {
+      g_printerr ("%s\n", error->message);
+      g_error_free (error);
+      return FALSE;
+    }
+
+  while ((name = g_dir_read_name (dir)) != NULL)
+    {
+      gchar *path;
+
+      if (!g_str_has_suffix (name, ".sdp"))
+        continue;
+
+      path = g_build_filename (dirname, name, NULL);
+      ok = load_entry (path, corpus) && ok;
+      g_free (path);
+    }
+
+  g_dir_close (dir);
+  return ok;
+}
+
+static void
+corpus_entry_free (CorpusEntry *entry)
+{
+  sdp_parser_free (entry->parser);
+  g_free (entry->name);
+  g_free (entry->body);
+  g_slice_free (CorpusEntry, entry);
+}
+
+int
+main (int argc, char **argv)
+{
+  GOptionEntry options[] = {
+      { "iterations", 'n', 0, G_OPTION_ARG_INT, &iterations,
+        "Number of iterations for each corpus entry", "N" },
+      { NULL }
+  };
+  GOptionContext *context;
+  GError *error = NULL;
+  GPtrArray *corpus;
+  gboolean ok = TRUE;
+  guint i;
+
+  /* Before anything touches the heap */
+  alloc_count_init ();
+
+  g_type_init ();
+
+  context = g_option_context_new ("[FILE.sdp...] - benchmark SDP processing");
+  g_option_context_add_main_entries (context, options, NULL);
+  if (!g_option_context_parse (context, &argc, &argv, &error))
+    {
+      g_printerr ("%s\n", error->message);
+      return 2;
+    }
+  g_option_context_free (context);
+
+  if (iterations <= 0)
+    iterations = 1;
+
+  corpus = g_ptr_array_new_with_free_func (
+      (GDestroyNotify) corpus_entry_free);
+
+  if (argc > 1)
+    {
+      for (i = 1; i < (guint) argc; i++)
+        ok = load_entry (argv[i], corpus) && ok;
+    }
+  else
+    {
+      ok = load_corpus_dir (RAKIA_TEST_CORPUS_DIR "/sdp", corpus);
+    }
+
+  if (corpus->len == 0)
+    {
+      g_printerr ("no SDP to process\n");
+      return 1;
+    }
+
+  session = g_object_new (RAKIA_TYPE_SIP_SESSION, NULL);
+
+  run_benchmark ("sdp-parse", bench_sdp_parse, corpus);
+  run_benchmark ("set-remote-media", bench_set_remote_media, corpus);
+  run_benchmark ("fmtp-parse-format", bench_fmtp, corpus);
+
+  generate_out = g_string_sized_new (1024);
+
+  for (i = 0; i < corpus->len; i++)
+    {
+      CorpusEntry *entry = g_ptr_array_index (corpus, i);
+      GPtrArray *one = g_ptr_array_new ();
+      const sdp_media_t *m;
+
+      generate_medias = g_ptr_array_new_with_free_func (g_object_unref);
+
+      for (m = sdp_session (entry->parser)->sdp_media; m != NULL;
+           m = m->m_next)
+        {
+          RakiaSipMedia *media = media_from_sdp (m, TRUE);
+
+          if (media != NULL)
+            g_ptr_array_add (generate_medias, media);
+        }
+
+      if (generate_medias->len == 0)
+        {
+          g_printerr ("%s: no usable media\n", entry->name);
+          ok = FALSE;
+        }
+      else
+        {
+          g_ptr_array_add (one, entry);
+          run_benchmark ("generate-sdp", bench_generate_sdp, one);
+        }
+
+      g_ptr_array_unref (one);
+      g_ptr_array_unref (generate_medias);
+    }
+
+  g_string_free (generate_out, TRUE);
+  g_object_unref (session);
+  g_ptr_array_unref (corpus);
+
+  return ok ? 0 : 1;
+}
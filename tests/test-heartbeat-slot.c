@@ -0,0 +1,198 @@
+/*
+ * test-heartbeat-slot.c - Tests of the wakeups for the deferrable timers
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This work is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This work is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this work; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/*
+ * The tests use one-second slots, and a maximum deferral well past them
+ * so that the timers can only fire on a wakeup of the source.
+ */
+
+#include "config.h"
+
+#include <sofia-sip/su_glib.h>
+#include <sofia-sip/su_wait.h>
+
+#include "sip-heartbeat-slot.h"
+
+#define SLOT 1
+#define MAX_DEFER 10000
+
+typedef struct {
+    su_root_t *root;
+    GSource *sofia_source;
+    GSource *slot_source;
+    GMainLoop *loop;
+    guint ticks;
+    gboolean fired;
+} Fixture;
+
+static gboolean
+tick_cb (gpointer user_data)
+{
+  Fixture *f = user_data;
+
+  f->ticks++;
+
+  return TRUE;
+}
+
+static gboolean
+quit_cb (gpointer user_data)
+{
+  Fixture *f = user_data;
+
+  g_main_loop_quit (f->loop);
+
+  return FALSE;
+}
+
+static void
+timer_cb (su_root_magic_t *magic,
+          su_timer_t *timer,
+          su_timer_arg_t *arg)
+{
+  Fixture *f = (Fixture *) arg;
+
+  f->fired = TRUE;
+  g_main_loop_quit (f->loop);
+}
+
+static void
+run_for (Fixture *f,
+         guint ms)
+{
+  guint id = g_timeout_add (ms, quit_cb, f);
+
+  g_main_loop_run (f->loop);
+  g_source_remove (id);
+}
+
+static void
+setup (Fixture *f,
+       gconstpointer data)
+{
+  f->root = su_glib_root_create (NULL);
+  su_root_threading (f->root, 0);
+  su_root_set_max_defer (f->root, MAX_DEFER);
+
+  f->sofia_source = su_glib_root_gsource (f->root);
+  g_source_attach (f->sofia_source, NULL);
+
+  f->slot_source = rakia_heartbeat_slot_source_new (f->root, SLOT);
+  g_source_set_callback (f->slot_source, tick_cb, f, NULL);
+  g_source_attach (f->slot_source, NULL);
+
+  f->loop = g_main_loop_new (NULL, FALSE);
+}
+
+static void
+teardown (Fixture *f,
+          gconstpointer data)
+{
+  g_main_loop_unref (f->loop);
+
+  g_source_destroy (f->slot_source);
+  g_source_unref (f->slot_source);
+
+  g_source_destroy (f->sofia_source);
+  su_root_destroy (f->root);
+}
+
+static void
+test_idle (Fixture *f,
+           gconstpointer data)
+{
+  g_assert_cmpint (rakia_heartbeat_slot_get_wakeup (f->root, SLOT), ==, 0);
+
+  /* Nothing to wake up for, not even at the slots */
+  run_for (f, 2500);
+  g_assert_cmpuint (f->ticks, ==, 0);
+}
+
+static void
+test_due (Fixture *f,
+          gconstpointer data)
+{
+  su_timer_t *timer;
+  gint64 start;
+  gint64 wakeup;
+
+  timer = su_timer_create (su_root_task (f->root), 0);
+  su_timer_deferrable (timer, TRUE);
+
+  start = g_get_real_time ();
+  su_timer_set_interval (timer, timer_cb, (su_timer_arg_t *) f, 1500);
+
+  /* The start of the slot after the due time */
+  wakeup = rakia_heartbeat_slot_get_wakeup (f->root, SLOT);
+  g_assert_cmpint (wakeup % G_USEC_PER_SEC, ==, 0);
+  g_assert_cmpint (wakeup, >=, start + 1400 * 1000);
+  g_assert_cmpint (wakeup, <=, start + 2600 * 1000);
+
+  /* The timer fires on the wakeup, long before the maximum deferral */
+  run_for (f, 5000);
+  g_assert (f->fired);
+  g_assert_cmpuint (f->ticks, ==, 1);
+  g_assert_cmpint (g_get_real_time (), >=, wakeup);
+
+  /* and the slots after it go by without one */
+  run_for (f, 2500);
+  g_assert_cmpuint (f->ticks, ==, 1);
+  g_assert_cmpint (rakia_heartbeat_slot_get_wakeup (f->root, SLOT), ==, 0);
+
+  su_timer_destroy (timer);
+}
+
+static void
+test_set_later (Fixture *f,
+                gconstpointer data)
+{
+  su_timer_t *timer;
+
+  /* The source sleeps with no timer, and notices the one set while it
+   * does */
+  run_for (f, 500);
+  g_assert_cmpuint (f->ticks, ==, 0);
+
+  timer = su_timer_create (su_root_task (f->root), 0);
+  su_timer_deferrable (timer, TRUE);
+  su_timer_set_interval (timer, timer_cb, (su_timer_arg_t *) f, 500);
+
+  run_for (f, 5000);
+  g_assert (f->fired);
+  g_assert_cmpuint (f->ticks, ==, 1);
+
+  su_timer_destroy (timer);
+}
+
+int
+main (int argc, char **argv)
+{
+  g_type_init ();
+  g_test_init (&argc, &argv, NULL);
+  su_init ();
+
+  g_test_add ("/heartbeat-slot/idle", Fixture, NULL, setup, test_idle,
+      teardown);
+  g_test_add ("/heartbeat-slot/due", Fixture, NULL, setup, test_due,
+      teardown);
+  g_test_add ("/heartbeat-slot/set-later", Fixture, NULL, setup,
+      test_set_later, teardown);
+
+  return g_test_run ();
+}
@@ -0,0 +1,397 @@
+/*
+ * test-resolver.c - Tests of the DNS answer cache shared by connections
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This work is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This work is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this work; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/*
+ * The resolver holds its queries instead of sending them, and the tests
+ * answer them as the DNS servers would, so nothing goes to the network.
+ */
+
+#include "config.h"
+
+#include <unistd.h>
+
+#include <glib/gstdio.h>
+#include <gio/gio.h>
+
+#include "sip-resolver.h"
+
+#define PROXY_SRV "_sip._udp.example.com"
+#define NOWHERE "nowhere.example.com"
+
+/* RAKIA_RESOLVER_MAX_STALE in src/sip-resolver.c */
+#define MAX_STALE 86400
+
+typedef struct {
+    guint calls;
+    guint n_records;
+} Answer;
+
+static void
+answer_cb (const GArray *records,
+           gpointer user_data)
+{
+  Answer *answer = user_data;
+
+  answer->calls++;
+  answer->n_records = records->len;
+}
+
+static GArray *
+make_srv_records (void)
+{
+  GArray *records = g_array_new (FALSE, FALSE, sizeof (RakiaResolverRecord));
+  RakiaResolverRecord one = { 10, 60, 5060, (gchar *) "one.example.com" };
+  RakiaResolverRecord two = { 20, 0, 5060, (gchar *) "two.example.com" };
+
+  g_array_append_val (records, one);
+  g_array_append_val (records, two);
+
+  return records;
+}
+
+static RakiaResolver *
+new_resolver (void)
+{
+  RakiaResolver *resolver = rakia_resolver_new (NULL);
+
+  rakia_resolver_hold_queries (resolver);
+
+  return resolver;
+}
+
+static void
+test_cache_hit (void)
+{
+  RakiaResolver *resolver = new_resolver ();
+  RakiaResolverCounters counters;
+  GArray *records = make_srv_records ();
+  Answer first = { 0, };
+  Answer second = { 0, };
+  Answer third = { 0, };
+
+  rakia_resolver_lookup (resolver, sres_type_srv, PROXY_SRV, answer_cb,
+      &first);
+  g_assert_cmpuint (first.calls, ==, 0);
+
+  /* Joins the query under way */
+  rakia_resolver_lookup (resolver, sres_type_srv, PROXY_SRV, answer_cb,
+      &second);
+  g_assert_cmpuint (second.calls, ==, 0);
+
+  g_assert (rakia_resolver_answer_query (resolver, sres_type_srv, PROXY_SRV,
+          records, 60));
+  g_assert_cmpuint (first.calls, ==, 1);
+  g_assert_cmpuint (first.n_records, ==, 2);
+  g_assert_cmpuint (second.calls, ==, 1);
+  g_assert_cmpuint (second.n_records, ==, 2);
+
+  /* Answered from the cache before the call returns */
+  rakia_resolver_lookup (resolver, sres_type_srv, PROXY_SRV, answer_cb,
+      &third);
+  g_assert_cmpuint (third.calls, ==, 1);
+  g_assert_cmpuint (third.n_records, ==, 2);
+
+  rakia_resolver_get_counters (resolver, &counters);
+  g_assert_cmpuint (counters.lookups, ==, 3);
+  g_assert_cmpuint (counters.coalesced, ==, 1);
+  g_assert_cmpuint (counters.hits, ==, 1);
+  g_assert_cmpuint (counters.negative_hits, ==, 0);
+  g_assert_cmpuint (counters.queries, ==, 1);
+
+  g_array_unref (records);
+  rakia_resolver_unref (resolver);
+}
+
+static void
+test_negative (void)
+{
+  RakiaResolver *resolver = new_resolver ();
+  RakiaResolverCounters counters;
+  GArray *empty = g_array_new (FALSE, FALSE, sizeof (RakiaResolverRecord));
+  Answer answer = { 0, };
+
+  /* No such name */
+  rakia_resolver_lookup (resolver, sres_type_a, NOWHERE, answer_cb, &answer);
+  g_assert (rakia_resolver_answer_query (resolver, sres_type_a, NOWHERE,
+          empty, 3600));
+  g_assert_cmpuint (answer.calls, ==, 1);
+  g_assert_cmpuint (answer.n_records, ==, 0);
+
+  rakia_resolver_lookup (resolver, sres_type_a, NOWHERE, answer_cb, &answer);
+  g_assert_cmpuint (answer.calls, ==, 2);
+  g_assert_cmpuint (answer.n_records, ==, 0);
+
+  /* No response at all is remembered the same way */
+  rakia_resolver_lookup (resolver, sres_type_aaaa, NOWHERE, answer_cb,
+      &answer);
+  g_assert (rakia_resolver_answer_query (resolver, sres_type_aaaa, NOWHERE,
+          NULL, 0));
+  g_assert_cmpuint (answer.calls, ==, 3);
+
+  rakia_resolver_lookup (resolver, sres_type_aaaa, NOWHERE, answer_cb,
+      &answer);
+  g_assert_cmpuint (answer.calls, ==, 4);
+  g_assert_cmpuint (answer.n_records, ==, 0);
+
+  rakia_resolver_get_counters (resolver, &counters);
+  g_assert_cmpuint (counters.hits, ==, 0);
+  g_assert_cmpuint (counters.negative_hits, ==, 2);
+  g_assert_cmpuint (counters.queries, ==, 2);
+
+  g_array_unref (empty);
+  rakia_resolver_unref (resolver);
+}
+
+static void
+test_ttl_expiry (void)
+{
+  RakiaResolver *resolver = new_resolver ();
+  RakiaResolverCounters counters;
+  GArray *records = make_srv_records ();
+  Answer answer = { 0, };
+
+  rakia_resolver_lookup (resolver, sres_type_srv, PROXY_SRV, answer_cb,
+      &answer);
+  g_assert (rakia_resolver_answer_query (resolver, sres_type_srv, PROXY_SRV,
+          records, 1));
+  g_assert_cmpuint (answer.calls, ==, 1);
+
+  rakia_resolver_lookup (resolver, sres_type_srv, PROXY_SRV, answer_cb,
+      &answer);
+  g_assert_cmpuint (answer.calls, ==, 2);
+
+  g_usleep (G_USEC_PER_SEC + G_USEC_PER_SEC / 10);
+
+  /* Gone from the cache, so queried again */
+  rakia_resolver_lookup (resolver, sres_type_srv, PROXY_SRV, answer_cb,
+      &answer);
+  g_assert_cmpuint (answer.calls, ==, 2);
+
+  rakia_resolver_get_counters (resolver, &counters);
+  g_assert_cmpuint (counters.hits, ==, 1);
+  g_assert_cmpuint (counters.queries, ==, 2);
+
+  g_assert (rakia_resolver_answer_query (resolver, sres_type_srv, PROXY_SRV,
+          records, 60));
+  g_assert_cmpuint (answer.calls, ==, 3);
+  g_assert_cmpuint (answer.n_records, ==, 2);
+
+  g_array_unref (records);
+  rakia_resolver_unref (resolver);
+}
+
+static void
+test_cancel (void)
+{
+  RakiaResolver *resolver = new_resolver ();
+  GArray *records = make_srv_records ();
+  Answer cancelled = { 0, };
+  Answer other = { 0, };
+
+  rakia_resolver_lookup (resolver, sres_type_srv, PROXY_SRV, answer_cb,
+      &cancelled);
+  rakia_resolver_lookup (resolver, sres_type_srv, PROXY_SRV, answer_cb,
+      &other);
+  rakia_resolver_cancel (resolver, &cancelled);
+
+  g_assert (rakia_resolver_answer_query (resolver, sres_type_srv, PROXY_SRV,
+          records, 60));
+  g_assert_cmpuint (cancelled.calls, ==, 0);
+  g_assert_cmpuint (other.calls, ==, 1);
+
+  g_array_unref (records);
+  rakia_resolver_unref (resolver);
+}
+
+/* Writes a cache file with the answer for PROXY_SRV expiring @expires
+ * seconds from now, and starts reading it */
+static RakiaResolver *
+new_resolver_with_cache_file (gint64 expires,
+                              gchar **path)
+{
+  RakiaResolver *resolver = new_resolver ();
+  GKeyFile *keyfile = g_key_file_new ();
+  gchar *group = g_strdup_printf ("%u:%s", sres_type_srv, PROXY_SRV);
+  const gchar * const records[] = {
+      "10 60 5060 one.example.com", "20 0 5060 two.example.com", NULL };
+  gchar *data;
+  gsize len;
+  gint fd;
+
+  g_key_file_set_int64 (keyfile, group, "Expires",
+      g_get_real_time () / G_USEC_PER_SEC + expires);
+  g_key_file_set_string_list (keyfile, group, "Records", records, 2);
+  data = g_key_file_to_data (keyfile, &len, NULL);
+
+  fd = g_file_open_tmp ("test-resolver-XXXXXX", path, NULL);
+  g_assert (fd >= 0);
+  close (fd);
+  g_assert (g_file_set_contents (*path, data, len, NULL));
+
+  rakia_resolver_set_cache_file (resolver, *path);
+
+  g_free (data);
+  g_free (group);
+  g_key_file_free (keyfile);
+
+  return resolver;
+}
+
+static void
+wait_for_answer (Answer *answer,
+                 guint calls)
+{
+  while (answer->calls < calls)
+    g_main_context_iteration (NULL, TRUE);
+}
+
+static void
+test_cache_file_load (void)
+{
+  gchar *path;
+  RakiaResolver *resolver = new_resolver_with_cache_file (600, &path);
+  RakiaResolverCounters counters;
+  Answer answer = { 0, };
+
+  /* Waits for the file to be read rather than read it there and then */
+  rakia_resolver_lookup (resolver, sres_type_srv, PROXY_SRV, answer_cb,
+      &answer);
+  g_assert_cmpuint (answer.calls, ==, 0);
+
+  wait_for_answer (&answer, 1);
+  g_assert_cmpuint (answer.n_records, ==, 2);
+
+  /* The saved answer is checked again all the same */
+  rakia_resolver_get_counters (resolver, &counters);
+  g_assert_cmpuint (counters.hits, ==, 1);
+  g_assert_cmpuint (counters.queries, ==, 1);
+
+  rakia_resolver_unref (resolver);
+  g_unlink (path);
+  g_free (path);
+}
+
+static void
+test_cache_file_revalidation (void)
+{
+  gchar *path;
+  RakiaResolver *resolver = new_resolver_with_cache_file (600, &path);
+  RakiaResolverCounters counters;
+  GArray *records = make_srv_records ();
+  Answer answer = { 0, };
+
+  rakia_resolver_lookup (resolver, sres_type_srv, PROXY_SRV, answer_cb,
+      &answer);
+  wait_for_answer (&answer, 1);
+
+  /* Without a response, the saved answer stays and is tried again */
+  g_assert (rakia_resolver_answer_query (resolver, sres_type_srv, PROXY_SRV,
+          NULL, 0));
+
+  rakia_resolver_lookup (resolver, sres_type_srv, PROXY_SRV, answer_cb,
+      &answer);
+  g_assert_cmpuint (answer.calls, ==, 2);
+  g_assert_cmpuint (answer.n_records, ==, 2);
+
+  rakia_resolver_get_counters (resolver, &counters);
+  g_assert_cmpuint (counters.queries, ==, 2);
+
+  /* The response replaces it, and is not checked again */
+  g_array_remove_index (records, 1);
+  g_assert (rakia_resolver_answer_query (resolver, sres_type_srv, PROXY_SRV,
+          records, 60));
+
+  rakia_resolver_lookup (resolver, sres_type_srv, PROXY_SRV, answer_cb,
+      &answer);
+  g_assert_cmpuint (answer.calls, ==, 3);
+  g_assert_cmpuint (answer.n_records, ==, 1);
+
+  rakia_resolver_get_counters (resolver, &counters);
+  g_assert_cmpuint (counters.queries, ==, 2);
+
+  g_array_unref (records);
+  rakia_resolver_unref (resolver);
+  g_unlink (path);
+  g_free (path);
+}
+
+static void
+test_cache_file_stale (void)
+{
+  gchar *path;
+  RakiaResolver *resolver;
+  RakiaResolverCounters counters;
+  Answer answer = { 0, };
+
+  /* Expired a minute ago: still given out while it is checked again */
+  resolver = new_resolver_with_cache_file (-60, &path);
+
+  rakia_resolver_lookup (resolver, sres_type_srv, PROXY_SRV, answer_cb,
+      &answer);
+  wait_for_answer (&answer, 1);
+  g_assert_cmpuint (answer.n_records, ==, 2);
+
+  rakia_resolver_get_counters (resolver, &counters);
+  g_assert_cmpuint (counters.hits, ==, 1);
+  g_assert_cmpuint (counters.queries, ==, 1);
+
+  rakia_resolver_unref (resolver);
+  g_unlink (path);
+  g_free (path);
+
+  /* Expired for too long: not loaded at all */
+  resolver = new_resolver_with_cache_file (-MAX_STALE - 60, &path);
+  answer.calls = 0;
+
+  rakia_resolver_lookup (resolver, sres_type_srv, PROXY_SRV, answer_cb,
+      &answer);
+
+  /* Until the file has been read and the lookup made, queries is 0 */
+  do
+    {
+      g_main_context_iteration (NULL, TRUE);
+      rakia_resolver_get_counters (resolver, &counters);
+    }
+  while (counters.queries == 0);
+
+  g_assert_cmpuint (answer.calls, ==, 0);
+  g_assert_cmpuint (counters.hits, ==, 0);
+
+  rakia_resolver_unref (resolver);
+  g_unlink (path);
+  g_free (path);
+}
+
+int
+main (int argc, char **argv)
+{
+  g_type_init ();
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/resolver/cache-hit", test_cache_hit);
+  g_test_add_func ("/resolver/negative", test_negative);
+  g_test_add_func ("/resolver/ttl-expiry", test_ttl_expiry);
+  g_test_add_func ("/resolver/cancel", test_cancel);
+  g_test_add_func ("/resolver/cache-file/load", test_cache_file_load);
+  g_test_add_func ("/resolver/cache-file/revalidation",
+      test_cache_file_revalidation);
+  g_test_add_func ("/resolver/cache-file/stale", test_cache_file_stale);
+
+  return g_test_run ();
+}
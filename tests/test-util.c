@@ -0,0 +1,97 @@
+/*
+ * test-util.c - Tests of the address and ICE attribute checks
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This work is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This work is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this work; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "config.h"
+
+#include <glib.h>
+
+#include <rakia/util.h>
+
+static void
+test_ip_address_valid (void)
+{
+  g_assert (rakia_ip_address_is_valid ("192.0.2.1"));
+  g_assert (rakia_ip_address_is_valid ("0.0.0.0"));
+  g_assert (rakia_ip_address_is_valid ("2001:db8::1"));
+  g_assert (rakia_ip_address_is_valid ("::ffff:192.0.2.1"));
+  g_assert (rakia_ip_address_is_valid ("::"));
+}
+
+static void
+test_ip_address_scoped (void)
+{
+  g_assert (rakia_ip_address_is_valid ("fe80::1%eth0"));
+  g_assert (rakia_ip_address_is_valid ("fe80::1%2"));
+  g_assert (rakia_ip_address_is_valid ("fe80::1%wlp3s0.100"));
+
+  /* an empty or overlong scope */
+  g_assert (!rakia_ip_address_is_valid ("fe80::1%"));
+  g_assert (!rakia_ip_address_is_valid ("fe80::1%abcdefghijklmnop"));
+  /* only IPv6 has a scope */
+  g_assert (!rakia_ip_address_is_valid ("192.0.2.1%eth0"));
+  /* one scope, of interface name characters */
+  g_assert (!rakia_ip_address_is_valid ("fe80::1%eth0%eth1"));
+  g_assert (!rakia_ip_address_is_valid ("fe80::1%eth0\r\na=x"));
+  g_assert (!rakia_ip_address_is_valid ("fe80::1%eth 0"));
+  g_assert (!rakia_ip_address_is_valid ("%eth0"));
+}
+
+static void
+test_ip_address_invalid (void)
+{
+  g_assert (!rakia_ip_address_is_valid (NULL));
+  g_assert (!rakia_ip_address_is_valid (""));
+  g_assert (!rakia_ip_address_is_valid ("example.com"));
+  g_assert (!rakia_ip_address_is_valid ("192.0.2"));
+  g_assert (!rakia_ip_address_is_valid ("192.0.2.256"));
+  g_assert (!rakia_ip_address_is_valid (" 192.0.2.1"));
+  g_assert (!rakia_ip_address_is_valid ("192.0.2.1\r\n"));
+  g_assert (!rakia_ip_address_is_valid ("2001:db8::1::2"));
+  g_assert (!rakia_ip_address_is_valid ("[2001:db8::1]"));
+}
+
+static void
+test_ice_foundation (void)
+{
+  g_assert (rakia_ice_foundation_is_valid (NULL));
+  g_assert (rakia_ice_foundation_is_valid (""));
+  g_assert (rakia_ice_foundation_is_valid ("1"));
+  g_assert (rakia_ice_foundation_is_valid ("a+b/C9"));
+  g_assert (rakia_ice_foundation_is_valid (
+          "0123456789abcdef0123456789abcdef"));
+
+  g_assert (!rakia_ice_foundation_is_valid (
+          "0123456789abcdef0123456789abcdef0"));
+  g_assert (!rakia_ice_foundation_is_valid ("1 2"));
+  g_assert (!rakia_ice_foundation_is_valid ("1\r\n"));
+  g_assert (!rakia_ice_foundation_is_valid ("1-2"));
+}
+
+int
+main (int argc, char **argv)
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/util/ip-address/valid", test_ip_address_valid);
+  g_test_add_func ("/util/ip-address/scoped", test_ip_address_scoped);
+  g_test_add_func ("/util/ip-address/invalid", test_ip_address_invalid);
+  g_test_add_func ("/util/ice-foundation", test_ice_foundation);
+
+  return g_test_run ();
+}
@@ -0,0 +1,105 @@
+"""
+Memory and sockets per account.
+
+Connects LOAD_ACCOUNTS accounts to the test SIP proxy, each with its own
+connection, and reports how much the connection manager's resident set
+size and number of open sockets grow with every account past the first.
+
+Not part of "make check"; "make -C tests/twisted check-load" runs it. The
+accounts get one SIP stack each, then the "share-stack" parameter is set
+on all of them for comparison. Set RAKIA_LOAD_ACCOUNTS to change the
+number of accounts.
+"""
+
+import os
+
+import dbus
+
+import constants as cs
+from servicetest import make_connection
+from sofiatest import exec_test
+
+LOAD_ACCOUNTS = int(os.environ.get('RAKIA_LOAD_ACCOUNTS', '50'))
+
+# Binding to a given address takes a stack of its own
+PARAMS = {'local-ip-address': None, 'password': None}
+
+def rss_kb(pid):
+    for line in open('/proc/%d/status' % pid):
+        if line.startswith('VmRSS:'):
+            return int(line.split()[1])
+    return 0
+
+def n_sockets(pid):
+    fd_dir = '/proc/%d/fd' % pid
+    n = 0
+    for fd in os.listdir(fd_dir):
+        try:
+            if os.readlink(os.path.join(fd_dir, fd)).startswith('socket:'):
+                n += 1
+        except OSError:
+            pass
+    return n
+
+def wait_for_status(q, conns, status):
+    pending = set([c.object.object_path for c in conns])
+    while pending:
+        e = q.expect('dbus-signal', signal='StatusChanged',
+            predicate=lambda e: e.args[0] == status and e.path in pending)
+        pending.discard(e.path)
+
+def test(q, bus, conn, sip, share_stack):
+    conn.Connect()
+    wait_for_status(q, [conn], cs.CONN_STATUS_CONNECTED)
+
+    dbus_daemon = bus.get_object('org.freedesktop.DBus',
+        '/org/freedesktop/DBus')
+    pid = dbus_daemon.GetConnectionUnixProcessID(conn.bus_name,
+        dbus_interface='org.freedesktop.DBus')
+
+    rss_one = rss_kb(pid)
+    sockets_one = n_sockets(pid)
+
+    conns = [conn]
+    for i in range(1, LOAD_ACCOUNTS):
+        params = {
+            'account': 'load%d@127.0.0.1' % i,
+            'proxy-host': '127.0.0.1',
+            'port': dbus.UInt16(sip.port),
+            'transport': 'udp',
+            'share-stack': share_stack,
+            }
+        conns.append(make_connection(bus, q.append, 'sofiasip', 'sip',
+            params))
+
+    for c in conns[1:]:
+        c.Connect()
+    wait_for_status(q, conns[1:], cs.CONN_STATUS_CONNECTED)
+
+    rss_all = rss_kb(pid)
+    sockets_all = n_sockets(pid)
+    n_more = max(LOAD_ACCOUNTS - 1, 1)
+
+    if share_stack:
+        mode = 'shared stack'
+    else:
+        mode = 'stack per connection'
+
+    print "%d accounts, %s:" % (LOAD_ACCOUNTS, mode)
+    print "RSS: %d kB with one account, %d kB with all, " \
+        "%.1f kB per account" % (rss_one, rss_all,
+            float(rss_all - rss_one) / n_more)
+    print "sockets: %d with one account, %d with all, %.2f per account" % (
+        sockets_one, sockets_all, float(sockets_all - sockets_one) / n_more)
+
+    for c in conns:
+        c.Disconnect()
+    wait_for_status(q, conns, cs.CONN_STATUS_DISCONNECTED)
+
+if __name__ == '__main__':
+    for share_stack in [False, True]:
+        params = dict(PARAMS)
+        params['share-stack'] = share_stack
+        exec_test(lambda q, bus, conn, sip: test(q, bus, conn, sip,
+                share_stack),
+            params=params, timeout=30)
@@ -0,0 +1,102 @@
+"""
+Time to disconnect many accounts at once.
+
+Connects LOAD_ACCOUNTS accounts to the test SIP proxy, each with its own
+connection and so its own SIP stack, disconnects them all together, and
+prints the time elapsed until all of them are disconnected, and until the
+connection manager has destroyed their stacks and closed their sockets.
+
+Not part of "make check"; "make -C tests/twisted check-load" runs it. Set
+RAKIA_LOAD_ACCOUNTS to change the number of accounts.
+"""
+
+import os
+import time
+
+import dbus
+from twisted.internet import reactor
+
+import constants as cs
+from servicetest import make_connection
+from sofiatest import exec_test
+
+LOAD_ACCOUNTS = int(os.environ.get('RAKIA_LOAD_ACCOUNTS', '500'))
+
+PARAMS = {'password': None}
+
+def n_sockets(pid):
+    fd_dir = '/proc/%d/fd' % pid
+    n = 0
+    for fd in os.listdir(fd_dir):
+        try:
+            if os.readlink(os.path.join(fd_dir, fd)).startswith('socket:'):
+                n += 1
+        except OSError:
+            pass
+    return n
+
+def wait_for_status(q, conns, status):
+    pending = set([c.object.object_path for c in conns])
+    while pending:
+        e = q.expect('dbus-signal', signal='StatusChanged',
+            predicate=lambda e: e.args[0] == status and e.path in pending)
+        pending.discard(e.path)
+
+def test(q, bus, conn, sip):
+    dbus_daemon = bus.get_object('org.freedesktop.DBus',
+        '/org/freedesktop/DBus')
+    pid = dbus_daemon.GetConnectionUnixProcessID(conn.bus_name,
+        dbus_interface='org.freedesktop.DBus')
+
+    # The sockets of the connection manager itself
+    sockets_none = n_sockets(pid)
+
+    conns = [conn]
+    for i in range(1, LOAD_ACCOUNTS):
+        params = {
+            'account': 'load%d@127.0.0.1' % i,
+            'proxy-host': '127.0.0.1',
+            'local-ip-address': '127.0.0.1',
+            'port': dbus.UInt16(sip.port),
+            'transport': 'udp',
+            }
+        conns.append(make_connection(bus, q.append, 'sofiasip', 'sip',
+            params))
+
+    for c in conns:
+        c.Connect()
+    wait_for_status(q, conns, cs.CONN_STATUS_CONNECTED)
+
+    sockets_all = n_sockets(pid)
+
+    start = time.time()
+    for c in conns:
+        c.Disconnect(reply_handler=lambda: None, error_handler=lambda e: None)
+    wait_for_status(q, conns, cs.CONN_STATUS_DISCONNECTED)
+    disconnected = time.time() - start
+
+    # The stacks are destroyed once their un-REGISTER transactions are
+    # over, which takes the proxy to answer them; the teardown is done
+    # when the sockets have stopped going for a second
+    sockets = n_sockets(pid)
+    destroyed = time.time() - start
+    while time.time() - start < destroyed + 1:
+        reactor.iterate(0.01)
+        n = n_sockets(pid)
+        if n != sockets:
+            sockets = n
+            destroyed = time.time() - start
+
+    print "%d accounts:" % LOAD_ACCOUNTS
+    print "disconnected in %.2f s, %.2f ms per account" % (
+        disconnected, disconnected * 1000 / LOAD_ACCOUNTS)
+    print "stacks destroyed in %.2f s, %.2f ms per account" % (
+        destroyed, destroyed * 1000 / LOAD_ACCOUNTS)
+    print "sockets: %d with none, %d with all, %d left" % (
+        sockets_none, sockets_all, sockets)
+
+    # Every stack is gone, not only the ones destroyed in the first slices
+    assert sockets <= sockets_none, (sockets_none, sockets)
+
+if __name__ == '__main__':
+    exec_test(test, params=PARAMS, timeout=60)
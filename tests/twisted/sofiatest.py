@@ -36,7 +36,7 @@ class SipProxy(sip.RegisterProxy):
         if message.method == 'REGISTER':
             return sip.RegisterProxy.handle_REGISTER_request(self, message, addr)
         elif message.method == 'OPTIONS' and \
-                'REGISTRATION PROBE' == message.headers.get('subject','')[0]:
+                'REGISTRATION PROBE' == message.headers.get('subject', [''])[0]:
             self.deliverResponse(self.responseFromRequest(200, message))
         else:
             headers = {}
@@ -0,0 +1,94 @@
+"""
+Test the race between IPv6 and IPv4 to a TCP proxy given by host name,
+with an IPv6 address that does not answer: the IPv4 address is attempted
+RAKIA_HAPPY_EYEBALLS_ATTEMPT_DELAY ms later, and wins, rather than after
+the IPv6 connect has timed out. The race only picks the family the stack
+binds to, so the winning connection is closed again without a byte sent.
+
+The name is answered from a DNS cache file given to the connection
+manager; the IPv6 proxy is a listening socket on ::1 with its backlog
+filled up, so that the kernel drops the SYNs of further connects.
+"""
+
+import os
+import socket
+import sys
+import tempfile
+import time
+
+import dbus
+from twisted.internet import reactor
+
+import constants as cs
+from servicetest import EventPattern, EventProtocolFactory
+from sofiatest import exec_test
+
+PROXY = 'rakia-dual.test'
+PORT = 9090 + os.getpid() % 900
+
+def test(q, bus, conn, sip):
+    reactor.listenTCP(PORT, EventProtocolFactory(q), interface='127.0.0.1')
+    q.forbid_events([EventPattern('socket-data')])
+
+    start = time.time()
+    conn.Connect()
+    q.expect('dbus-signal', signal='StatusChanged', args=[1, 1])
+
+    e = q.expect('socket-connected')
+    elapsed = time.time() - start
+    assert elapsed < 2, elapsed
+
+    q.expect('socket-disconnected', protocol=e.protocol)
+
+    # The stack cannot resolve the made up name itself, so the connection
+    # goes no further
+    conn.Disconnect(reply_handler=lambda: None, error_handler=lambda e: None)
+    q.expect('dbus-signal', signal='StatusChanged',
+        predicate=lambda e: e.args[0] == cs.CONN_STATUS_DISCONNECTED)
+    return True
+
+def stall_ipv6():
+    try:
+        listener = socket.socket(socket.AF_INET6, socket.SOCK_STREAM)
+        listener.bind(('::1', PORT))
+    except socket.error:
+        # no IPv6
+        sys.exit(77)
+
+    listener.listen(0)
+
+    fillers = []
+    for i in range(2):
+        s = socket.socket(socket.AF_INET6, socket.SOCK_STREAM)
+        s.setblocking(False)
+        s.connect_ex(('::1', PORT))
+        fillers.append(s)
+
+    return [listener] + fillers
+
+if __name__ == '__main__':
+    sockets = stall_ipv6()
+
+    expires = int(time.time()) + 3600
+    fd, cache_file = tempfile.mkstemp(prefix='rakia-dns-cache-')
+    os.write(fd, '[1:%s]\nExpires=%d\nRecords=0 0 0 127.0.0.1;\n\n'
+        '[28:%s]\nExpires=%d\nRecords=0 0 0 ::1;\n' % (
+            PROXY, expires, PROXY, expires))
+    os.close(fd)
+
+    # The connection manager is started with the next line
+    dbus.Interface(dbus.SessionBus().get_object('org.freedesktop.DBus',
+            '/org/freedesktop/DBus'),
+        'org.freedesktop.DBus').UpdateActivationEnvironment(
+            { 'RAKIA_TEST_DNS_CACHE_FILE': cache_file })
+
+    try:
+        exec_test(test, params={
+            'password': None,
+            'local-ip-address': None,
+            'proxy-host': PROXY,
+            'port': dbus.UInt16(PORT),
+            'transport': 'tcp',
+            }, timeout=10)
+    finally:
+        os.unlink(cache_file)
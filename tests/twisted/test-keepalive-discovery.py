@@ -0,0 +1,109 @@
+"""
+Test the keepalive interval discovery: once registered, the connection
+probes the NAT binding with OPTIONS requests to the registrar from a
+socket of their own, doubling the idle time between them until the
+binding changes, while the keepalives go on with the configured interval.
+"""
+
+import time
+
+import dbus
+import twisted.protocols.sip
+
+import constants as cs
+from servicetest import assertContains, assertEquals
+from sofiatest import exec_test
+
+KEEPALIVE = 'org.freedesktop.Telepathy.Rakia.Connection.Interface.Keepalive'
+
+# The idle time the probes start from, instead of the configured interval
+PROBE_START = 1
+
+def respond(sip, request, rport):
+    """Answers a probe as if it came through a NAT mapping it to rport"""
+    via = twisted.protocols.sip.parseViaHeader(request.headers['via'][0])
+    source = twisted.protocols.sip.URL(host=via.host, port=via.port)
+
+    response = sip.responseFromRequest(200, request)
+    via.received = '192.0.2.1'
+    via.rport = rport
+    response.headers['via'][0] = via.toString()
+
+    sip.sendMessage(source, response)
+
+def test(q, bus, conn, sip):
+    conn.Connect()
+    q.expect('dbus-signal', signal='StatusChanged', args=[1, 1])
+
+    e = q.expect('sip-register')
+    sip_port = twisted.protocols.sip.parseViaHeader(
+        e.headers['via'][0]).port
+
+    q.expect('dbus-signal', signal='StatusChanged', args=[0, 1])
+
+    def is_probe(e):
+        via = twisted.protocols.sip.parseViaHeader(e.headers['via'][0])
+        return via.port != sip_port
+
+    # The first probe only tells the binding
+    e = q.expect('sip-options', predicate=is_probe)
+    assertEquals('sip:127.0.0.1', e.uri)
+    respond(sip, e.sip_message, 5555)
+    last = time.time()
+
+    assertContains(KEEPALIVE, conn.Properties.Get(cs.CONN, 'Interfaces'))
+
+    props = conn.Properties.GetAll(KEEPALIVE)
+    assertEquals(True, props['DiscoveringKeepaliveInterval'])
+    assertEquals(60, props['KeepaliveInterval'])
+    assertEquals(0, props['BindingLifetime'])
+
+    # The binding survives idle times of 1 and 2 seconds: each probe is
+    # only scheduled once the response to the previous one is in
+    for idle, lifetime in [(1, 0), (2, 1), (4, 2)]:
+        e = q.expect('sip-options', predicate=is_probe)
+        now = time.time()
+        assert idle - 0.5 <= now - last <= idle + 1, (idle, now - last)
+        last = now
+
+        props = conn.Properties.GetAll(KEEPALIVE)
+        assertEquals(True, props['DiscoveringKeepaliveInterval'])
+        assertEquals(lifetime, props['BindingLifetime'])
+        # The keepalives of the stack go on as configured meanwhile
+        assertEquals(60, props['KeepaliveInterval'])
+
+        if idle < 4:
+            respond(sip, e.sip_message, 5555)
+
+    # but not 4 seconds: the interval settles on four fifths of the
+    # longest idle time survived, no shorter than the minimum
+    respond(sip, e.sip_message, 6666)
+
+    for i in range(20):
+        props = conn.Properties.GetAll(KEEPALIVE)
+        if not props['DiscoveringKeepaliveInterval']:
+            break
+        time.sleep(0.1)
+
+    assertEquals(False, props['DiscoveringKeepaliveInterval'])
+    assertEquals(2, props['BindingLifetime'])
+    assertEquals(30, props['KeepaliveInterval'])
+
+    conn.Disconnect()
+    q.expect('dbus-signal', signal='StatusChanged', args=[2, 1])
+
+    return True
+
+if __name__ == '__main__':
+    # The connection manager is started with the next line
+    dbus.Interface(dbus.SessionBus().get_object('org.freedesktop.DBus',
+            '/org/freedesktop/DBus'),
+        'org.freedesktop.DBus').UpdateActivationEnvironment(
+            { 'RAKIA_KEEPALIVE_PROBE_START': str(PROBE_START) })
+
+    exec_test(test, params={
+        'password': None,
+        'keepalive-mechanism': 'options',
+        'keepalive-interval': dbus.UInt32(60),
+        'discover-keepalive-interval': True,
+        }, timeout=10)
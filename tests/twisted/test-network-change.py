@@ -0,0 +1,55 @@
+"""
+Test the registration again after a change of the local network: a
+global address is added to a dummy interface. This is only done in the
+network namespace run-test.sh creates for the test, which sets
+RAKIA_TEST_NETNS; the test is skipped anywhere else.
+"""
+
+import os
+import subprocess
+import sys
+
+import constants as cs
+from servicetest import assertEquals
+from sofiatest import exec_test
+
+IFACE = 'rakiatest0'
+
+def ip(*args):
+    with open(os.devnull, 'w') as null:
+        return subprocess.call(('ip',) + args, stdout=null, stderr=null)
+
+def test(q, bus, conn, sip):
+    conn.Connect()
+    q.expect('dbus-signal', signal='StatusChanged', args=[1, 1])
+    e = q.expect('sip-register')
+    q.expect('dbus-signal', signal='StatusChanged', args=[0, 1])
+
+    call_id = e.headers['call-id'][0]
+
+    assertEquals(0, ip('addr', 'add', '192.0.2.1/24', 'dev', IFACE))
+
+    # The change is signalled once the network has settled for a second,
+    # and the registration is refreshed in the same dialog
+    e = q.expect('sip-register')
+    assertEquals(call_id, e.headers['call-id'][0])
+
+    conn.Disconnect()
+    q.expect('dbus-signal', signal='StatusChanged', args=[2, 1])
+    return True
+
+if __name__ == '__main__':
+    if not os.environ.get('RAKIA_TEST_NETNS'):
+        sys.exit(77)
+
+    try:
+        if ip('link', 'add', IFACE, 'type', 'dummy') != 0:
+            sys.exit(77)
+    except OSError:
+        # no ip command
+        sys.exit(77)
+
+    try:
+        exec_test(test, params={"password": None})
+    finally:
+        ip('link', 'del', IFACE)
@@ -0,0 +1,141 @@
+"""
+Test the failover between the SRV targets of a proxy given without a
+port. The records come from a DNS cache file given to the connection
+manager: a server that never answers, tried first, then the one the
+connection registers through, then a spare one. REGISTER goes on to the
+second target once the first has not answered it within four seconds,
+and a MESSAGE the second one turns down with 503 is sent again through
+the third.
+"""
+
+import os
+import socket
+import tempfile
+import time
+
+import dbus
+from twisted.internet import reactor
+from twisted.internet.protocol import DatagramProtocol
+
+import constants as cs
+from servicetest import Event, EventPattern, assertEquals
+from sofiatest import SipProxy, exec_test
+
+PROXY_TARGETS = \
+    'org.freedesktop.Telepathy.Rakia.Connection.Interface.ProxyTargets'
+
+PROXY = 'rakia-srv.test'
+
+STATE_UNTRIED = 0
+STATE_TRYING = 1
+STATE_ACTIVE = 2
+STATE_FAILED = 3
+
+def free_port():
+    s = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    s.bind(('127.0.0.1', 0))
+    port = s.getsockname()[1]
+    s.close()
+    return port
+
+DEAD = free_port()
+LIVE = free_port()
+SPARE = free_port()
+
+class DeadServer(DatagramProtocol):
+    def __init__(self, q):
+        self.q = q
+
+    def datagramReceived(self, data, addr):
+        self.q.append(Event('dead-request', method=data.split(' ', 1)[0]))
+
+def start_proxy(q, name, port):
+    def event_func(e):
+        e.proxy = name
+        q.append(e)
+
+    proxy = SipProxy(host='127.0.0.1', port=port)
+    proxy.event_func = event_func
+    proxy.registrar_handler = lambda message, host, port: True
+    reactor.listenUDP(port, proxy, interface='127.0.0.1')
+    return proxy
+
+def test(q, bus, conn, sip):
+    reactor.listenUDP(DEAD, DeadServer(q), interface='127.0.0.1')
+    live = start_proxy(q, 'live', LIVE)
+    spare = start_proxy(q, 'spare', SPARE)
+
+    conn.Connect()
+    q.expect('dbus-signal', signal='StatusChanged', args=[1, 1])
+
+    q.expect('dead-request', method='REGISTER')
+    start = time.time()
+
+    # well before the 32 seconds of Timer F
+    q.expect('sip-register', proxy='live')
+    elapsed = time.time() - start
+    assert elapsed < 8, elapsed
+
+    q.expect('dbus-signal', signal='StatusChanged', args=[0, 1])
+
+    targets = conn.Properties.Get(PROXY_TARGETS, 'ProxyTargets')
+    assertEquals(3, len(targets))
+    assertEquals(('127.0.0.1', DEAD, 10, 0, STATE_FAILED, 1),
+        tuple(targets[0][:6]))
+    assert targets[0][6] > 0, targets[0]
+    assertEquals(('127.0.0.1', LIVE, 20, 0, STATE_ACTIVE, 0, 0),
+        tuple(targets[1]))
+    assertEquals(('127.0.0.1', SPARE, 30, 0, STATE_UNTRIED, 0, 0),
+        tuple(targets[2]))
+
+    contact = 'sip:user@somewhere.com'
+    handle = conn.get_contact_handle_sync(contact)
+    chan, _ = conn.Requests.CreateChannel({
+        cs.CHANNEL_TYPE: cs.CHANNEL_TYPE_TEXT,
+        cs.TARGET_HANDLE_TYPE: cs.HT_CONTACT,
+        cs.TARGET_HANDLE: handle })
+    text = dbus.Interface(bus.get_object(conn.bus_name, chan),
+        cs.CHANNEL_TYPE_TEXT)
+
+    q.forbid_events([EventPattern('dbus-signal', signal='SendError')])
+
+    text.Send(0, 'Hello')
+
+    e = q.expect('sip-message', proxy='live', body='Hello')
+    live.deliverResponse(live.responseFromRequest(503, e.sip_message))
+
+    e = q.expect('sip-message', proxy='spare', uri=contact, body='Hello')
+    spare.deliverResponse(spare.responseFromRequest(200, e.sip_message))
+
+    targets = conn.Properties.Get(PROXY_TARGETS, 'ProxyTargets')
+    assertEquals(STATE_FAILED, targets[1][4])
+    assertEquals(1, targets[1][5])
+    assertEquals(STATE_TRYING, targets[2][4])
+
+    conn.Disconnect()
+    q.expect('dbus-signal', signal='StatusChanged', args=[2, 1])
+    return True
+
+if __name__ == '__main__':
+    expires = int(time.time()) + 3600
+    fd, cache_file = tempfile.mkstemp(prefix='rakia-dns-cache-')
+    os.write(fd, '[33:_sip._udp.%s]\nExpires=%d\n'
+        'Records=10 0 %d 127.0.0.1;20 0 %d 127.0.0.1;30 0 %d 127.0.0.1;\n' % (
+            PROXY, expires, DEAD, LIVE, SPARE))
+    os.close(fd)
+
+    # The connection manager is started with the next line
+    dbus.Interface(dbus.SessionBus().get_object('org.freedesktop.DBus',
+            '/org/freedesktop/DBus'),
+        'org.freedesktop.DBus').UpdateActivationEnvironment(
+            { 'RAKIA_TEST_DNS_CACHE_FILE': cache_file })
+
+    try:
+        exec_test(test, params={
+            'password': None,
+            'proxy-host': PROXY,
+            # no port, for the proxy to be looked up in SRV records
+            'port': dbus.UInt16(0),
+            }, timeout=10)
+    finally:
+        os.unlink(cache_file)
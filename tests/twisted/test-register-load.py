@@ -0,0 +1,39 @@
+"""
+Test the registration load histogram.
+"""
+
+import constants as cs
+from servicetest import assertContains, assertEquals
+from sofiatest import exec_test
+
+REGISTRATION_LOAD = \
+    'org.freedesktop.Telepathy.Rakia.Connection.Interface.RegistrationLoad'
+
+def test(q, bus, conn, sip):
+    conn.Connect()
+    q.expect('dbus-signal', signal='StatusChanged', args=[1, 1])
+
+    # A single account is not held back
+    q.expect('sip-register')
+
+    q.expect('dbus-signal', signal='StatusChanged', args=[0, 1])
+
+    assertContains(REGISTRATION_LOAD,
+        conn.Properties.Get(cs.CONN, 'Interfaces'))
+
+    props = conn.Properties.GetAll(REGISTRATION_LOAD)
+    assertEquals(10, props['HistogramBucketLength'])
+    assertEquals(0, props['PendingRegistrations'])
+
+    histogram = props['RegistrationHistogram']
+    assertEquals(60, len(histogram))
+    # The response to our REGISTER is in the current bucket, or in the
+    # previous one if a bucket boundary has been crossed since
+    assert sum(histogram[-2:]) >= 1, histogram
+
+    conn.Disconnect()
+    q.expect('dbus-signal', signal='StatusChanged', args=[2, 1])
+    return True
+
+if __name__ == '__main__':
+    exec_test(test, params={"password": None})
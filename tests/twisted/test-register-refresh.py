@@ -0,0 +1,58 @@
+"""
+Test that the expiry time asked for is lowered by up to a tenth, and that
+the registration is refreshed once, by Sofia-SIP, at a random point
+between a quarter and three quarters of the expiry time granted by the
+registrar, not the one asked for.
+"""
+
+import time
+
+from twisted.internet import reactor
+
+from servicetest import Event, EventPattern
+from sofiatest import exec_test
+
+GRANTED = 20
+
+def test(q, bus, conn, sip):
+    def register(message, host, port):
+        q.append(Event('sip-register', uri=str(message.uri),
+            headers=message.headers, sip_message=message,
+            time=time.time()))
+
+        response = sip.responseFromRequest(200, message)
+        response.addHeader('contact', '%s;expires=%u'
+            % (message.headers['contact'][0], GRANTED))
+        response.addHeader('expires', str(GRANTED))
+        sip.deliverResponse(response)
+
+    sip.register = register
+
+    conn.Connect()
+
+    e = q.expect('sip-register')
+    expires = int(e.headers['expires'][0])
+    assert 3240 <= expires <= 3600, expires
+    registered = e.time
+
+    q.expect('dbus-signal', signal='StatusChanged', args=[0, 1])
+
+    e = q.expect('sip-register')
+    delay = e.time - registered
+    assert GRANTED / 4 - 1 <= delay <= 3 * GRANTED / 4 + 1, delay
+    assert int(e.headers['expires'][0]) <= 3600, e.headers['expires']
+
+    # Sofia-SIP would not refresh again before a quarter of the expiry
+    # time, so any other REGISTER in the meantime comes from a second
+    # refresh timer
+    q.forbid_events([EventPattern('sip-register')])
+    reactor.callLater(GRANTED / 4 - 1, q.append, Event('timer'))
+    q.expect('timer')
+    q.unforbid_events([EventPattern('sip-register')])
+
+    conn.Disconnect()
+    q.expect('dbus-signal', signal='StatusChanged', args=[2, 1])
+    return True
+
+if __name__ == '__main__':
+    exec_test(test, timeout=2 * GRANTED)
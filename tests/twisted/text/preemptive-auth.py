@@ -0,0 +1,155 @@
+"""
+Test that once a proxy has challenged a MESSAGE, the next ones carry
+credentials for the challenge with increasing nonce counts, and that the
+credentials for a domain only go to that domain.
+"""
+
+import hashlib
+import re
+
+import dbus
+
+from servicetest import assertEquals
+from sofiatest import exec_test
+import constants as cs
+
+CONTACT = 'sip:user@somewhere.com'
+OTHER_CONTACT = 'sip:user@elsewhere.com'
+DOMAIN_REALM = 'somewhere.com'
+REALM = 'proxy.example.com'
+NONCE = 'dcd98b7102dd2f0e8b11d0f600bfb0c093'
+OPAQUE = '5ccc069c403ebaf9f0171e9517f40e41'
+
+PARAMS = {
+    'extra-auth-user': 'proxyuser',
+    'extra-auth-password': 'proxypwd',
+    }
+
+def md5(*fields):
+    return hashlib.md5(':'.join(fields)).hexdigest()
+
+def parse_digest(value):
+    assert value.startswith('Digest '), value
+    return dict([(k, v1 or v2) for k, v1, v2 in
+                 re.findall(r'(\w+)=(?:"([^"]*)"|([^,\s]*))', value[7:])])
+
+def check_credentials(message, nc):
+    creds = parse_digest(message.headers['proxy-authorization'][0])
+
+    assertEquals('proxyuser', creds['username'])
+    assertEquals(REALM, creds['realm'])
+    assertEquals(NONCE, creds['nonce'])
+    assertEquals(OPAQUE, creds['opaque'])
+    assertEquals('auth', creds['qop'])
+    assertEquals('%08x' % nc, creds['nc'])
+    assertEquals(CONTACT, creds['uri'])
+
+    ha1 = md5('proxyuser', REALM, 'proxypwd')
+    ha2 = md5('MESSAGE', creds['uri'])
+    assertEquals(md5(ha1, NONCE, creds['nc'], creds['cnonce'], 'auth', ha2),
+                 creds['response'])
+
+def text_channel(q, bus, conn, contact):
+    handle = conn.get_contact_handle_sync(contact)
+
+    chan, _ = conn.Requests.CreateChannel(
+            { cs.CHANNEL_TYPE: cs.CHANNEL_TYPE_TEXT,
+                cs.TARGET_HANDLE_TYPE: cs.HT_CONTACT,
+                cs.TARGET_HANDLE: handle })
+
+    return dbus.Interface(bus.get_object(conn.bus_name, chan),
+                          cs.CHANNEL_TYPE_TEXT)
+
+def test(q, bus, conn, sip):
+    conn.Connect()
+    q.expect('dbus-signal', signal='StatusChanged', args=[0, 1])
+
+    iface = text_channel(q, bus, conn, CONTACT)
+
+    iface.Send(0, 'Hello')
+
+    event = q.expect('sip-message', uri=CONTACT, body='Hello')
+    assert 'proxy-authorization' not in event.sip_message.headers
+
+    challenge = sip.responseFromRequest(407, event.sip_message)
+    challenge.addHeader('proxy-authenticate',
+        'Digest realm="%s", nonce="%s", opaque="%s", qop="auth", '
+        'algorithm=MD5' % (REALM, NONCE, OPAQUE))
+    sip.deliverResponse(challenge)
+
+    # Sofia-SIP answers the challenge itself
+    event = q.expect('sip-message', uri=CONTACT, body='Hello')
+    check_credentials(event.sip_message, 1)
+    sip.deliverResponse(sip.responseFromRequest(200, event.sip_message))
+
+    # The next messages come with credentials at once
+    for nc, text in [(2, 'Hello again'), (3, 'And again')]:
+        iface.Send(0, text)
+
+        event = q.expect('sip-message', uri=CONTACT, body=text)
+        check_credentials(event.sip_message, nc)
+        sip.deliverResponse(sip.responseFromRequest(200, event.sip_message))
+
+    # A stale nonce takes the challenge path again
+    iface.Send(0, 'Stale')
+
+    event = q.expect('sip-message', uri=CONTACT, body='Stale')
+    check_credentials(event.sip_message, 4)
+
+    challenge = sip.responseFromRequest(407, event.sip_message)
+    challenge.addHeader('proxy-authenticate',
+        'Digest realm="%s", nonce="%s", opaque="%s", qop="auth", '
+        'algorithm=MD5, stale=true' % (REALM, NONCE + 'new', OPAQUE))
+    sip.deliverResponse(challenge)
+
+    event = q.expect('sip-message', uri=CONTACT, body='Stale')
+    creds = parse_digest(event.sip_message.headers['proxy-authorization'][0])
+    assertEquals(1, len(event.sip_message.headers['proxy-authorization']))
+    assertEquals(NONCE + 'new', creds['nonce'])
+    assertEquals('00000001', creds['nc'])
+    sip.deliverResponse(sip.responseFromRequest(200, event.sip_message))
+
+    iface.Send(0, 'Fresh')
+
+    event = q.expect('sip-message', uri=CONTACT, body='Fresh')
+    creds = parse_digest(event.sip_message.headers['proxy-authorization'][0])
+    assertEquals(NONCE + 'new', creds['nonce'])
+    assertEquals('00000002', creds['nc'])
+    sip.deliverResponse(sip.responseFromRequest(200, event.sip_message))
+
+    # The domain challenges too
+    iface.Send(0, 'Domain')
+
+    event = q.expect('sip-message', uri=CONTACT, body='Domain')
+    assert 'authorization' not in event.sip_message.headers
+
+    challenge = sip.responseFromRequest(401, event.sip_message)
+    challenge.addHeader('www-authenticate',
+        'Digest realm="%s", nonce="%s", algorithm=MD5'
+        % (DOMAIN_REALM, NONCE))
+    sip.deliverResponse(challenge)
+
+    event = q.expect('sip-message', uri=CONTACT, body='Domain')
+    assert 'authorization' in event.sip_message.headers
+    sip.deliverResponse(sip.responseFromRequest(200, event.sip_message))
+
+    iface.Send(0, 'Domain again')
+
+    event = q.expect('sip-message', uri=CONTACT, body='Domain again')
+    creds = parse_digest(event.sip_message.headers['authorization'][0])
+    assertEquals(DOMAIN_REALM, creds['realm'])
+    assert 'proxy-authorization' in event.sip_message.headers
+    sip.deliverResponse(sip.responseFromRequest(200, event.sip_message))
+
+    # Another domain only gets the credentials for the proxy on the way
+    other = text_channel(q, bus, conn, OTHER_CONTACT)
+    other.Send(0, 'Elsewhere')
+
+    event = q.expect('sip-message', uri=OTHER_CONTACT, body='Elsewhere')
+    assert 'authorization' not in event.sip_message.headers
+    creds = parse_digest(event.sip_message.headers['proxy-authorization'][0])
+    assertEquals(REALM, creds['realm'])
+    sip.deliverResponse(sip.responseFromRequest(200, event.sip_message))
+
+if __name__ == '__main__':
+    exec_test(test, params=PARAMS)
@@ -0,0 +1,110 @@
+"""
+Test that incoming calls beyond the configured limits are refused early,
+and that they are counted.
+"""
+
+import dbus
+import os
+import signal
+import time
+import uuid
+
+import calltest
+from servicetest import (
+    EventPattern, assertEquals,
+    )
+from sofiatest import exec_test
+from voip_test import VoipTestContext
+
+ADMISSION_CONTROL = \
+    'org.freedesktop.Telepathy.Rakia.Connection.Interface.AdmissionControl'
+
+class AdmissionControl(calltest.CallTest):
+
+    def during_call(self):
+        # A second call from another peer while the first one is going on
+        call_id = uuid.uuid4().hex
+        self.context.send_message('INVITE',
+            self.context.get_call_sdp(self.medias),
+            content_type='application/sdp',
+            from_='<sip:other@bar.com>;tag=ABC',
+            call_id=call_id)
+
+        # It is refused without a channel ever being announced
+        self.q.forbid_events([
+            EventPattern('dbus-signal', signal='NewChannels')])
+        self.q.expect('sip-response', call_id=call_id, code=486)
+        self.q.unforbid_all()
+
+def connect(q, bus, conn, sip_proxy):
+    conn.Connect()
+    q.expect('dbus-signal', signal='StatusChanged', args=[0, 1])
+
+    return VoipTestContext(q, conn, bus, sip_proxy,
+        'sip:testacc@127.0.0.1', 'foo@bar.com')
+
+def send_invite(context, peer):
+    call_id = uuid.uuid4().hex
+    # A transaction of its own for each call
+    context.via_branch = 'z9hG4bK' + call_id
+    context.send_message('INVITE',
+        context.get_call_sdp([('audio', None)]),
+        content_type='application/sdp',
+        from_='<sip:%s>;tag=%s' % (peer, call_id[:8]),
+        call_id=call_id)
+    return call_id
+
+def test_call_rate(q, bus, conn, sip_proxy):
+    context = connect(q, bus, conn, sip_proxy)
+
+    # The second call in the same second is over max-call-rate
+    send_invite(context, 'one@bar.com')
+    call_id = send_invite(context, 'two@bar.com')
+
+    e = q.expect('sip-response', call_id=call_id, code=503)
+    assertEquals('1', e.headers['retry-after'][0])
+
+    props = conn.Properties.GetAll(ADMISSION_CONTROL)
+    assertEquals(1, props['CallsAdmitted'])
+    assertEquals(1, props['CallsShed'])
+
+def test_main_loop_lag(q, bus, conn, sip_proxy):
+    context = connect(q, bus, conn, sip_proxy)
+
+    props = conn.Properties.GetAll(ADMISSION_CONTROL)
+    assertEquals(0, props['CallsShed'])
+
+    # Hold the connection manager up for half a second, so that it finds
+    # its main loop has been running late once it goes on; the lag takes
+    # a few tenths of a second to fall back under the threshold
+    dbus_daemon = bus.get_object('org.freedesktop.DBus',
+        '/org/freedesktop/DBus')
+    pid = dbus_daemon.GetConnectionUnixProcessID(conn.bus_name,
+        dbus_interface='org.freedesktop.DBus')
+
+    os.kill(pid, signal.SIGSTOP)
+    time.sleep(0.5)
+    os.kill(pid, signal.SIGCONT)
+    time.sleep(0.05)
+
+    call_id = send_invite(context, 'one@bar.com')
+
+    q.forbid_events([
+        EventPattern('dbus-signal', signal='NewChannels')])
+    e = q.expect('sip-response', call_id=call_id, code=503)
+    assertEquals('5', e.headers['retry-after'][0])
+    q.unforbid_all()
+
+    props = conn.Properties.GetAll(ADMISSION_CONTROL)
+    assertEquals(0, props['CallsAdmitted'])
+    assertEquals(1, props['CallsShed'])
+
+if __name__ == '__main__':
+    for incoming in [True, False]:
+        exec_test(lambda q, b, c, s:
+                      calltest.run_call_test(q, b, c, s, incoming=incoming,
+                                             klass=AdmissionControl),
+                  params={'max-calls': dbus.UInt32(1)})
+    exec_test(test_call_rate, params={'max-call-rate': dbus.UInt32(1)})
+    exec_test(test_main_loop_lag,
+              params={'max-main-loop-lag': dbus.UInt32(20)})
@@ -0,0 +1,279 @@
+"""
+Synthetic call load against the test SIP proxy.
+
+Sets up LOAD_CALLS outgoing and LOAD_CALLS incoming calls concurrently,
+each with its own peer, then hangs them all up. Unlike the other voip
+tests, events are not awaited in sequence: every event is dispatched to
+the call it belongs to, and a fake streaming implementation answers
+media description offers, candidate requests and flow state changes as
+soon as they are seen.
+
+Reports the call setup rate, setup latency percentiles and the growth of
+the connection manager's resident set size per active call.
+
+Not part of "make check"; run it with "make -C tests/twisted check-load",
+optionally with RAKIA_LOAD_CALLS set to the number of calls per direction.
+"""
+
+import os
+import time
+import uuid
+
+import dbus
+
+import constants as cs
+from servicetest import TimeoutError, assertEquals
+from sofiatest import exec_test
+from voip_test import VoipTestContext
+
+LOAD_CALLS = int(os.environ.get('RAKIA_LOAD_CALLS', '20'))
+
+class LoadContext(VoipTestContext):
+    """A remote end that can have transactions going on in parallel with
+    those of other remote ends."""
+
+    def send_message(self, message_type, body='', to_=None, from_=None,
+                     **additional_headers):
+        self.via_branch = 'z9hG4bK' + uuid.uuid4().hex
+        return VoipTestContext.send_message(self, message_type, body,
+            to_, from_, **additional_headers)
+
+class LoadCall(object):
+    def __init__(self, driver, index, incoming):
+        self.driver = driver
+        self.incoming = incoming
+        self.peer = 'load%d@bar.com' % index
+        self.context = LoadContext(driver.q, driver.conn, driver.bus,
+            driver.sip_proxy, 'sip:testacc@127.0.0.1', self.peer)
+        self.remote_handle = driver.conn.get_contact_handle_sync(self.peer)
+        self.chan_path = None
+        self.chan = None
+        self.started = None
+        self.setup_time = None
+        self.ended = False
+
+    def start(self):
+        self.started = time.time()
+
+        if self.incoming:
+            self.context.incoming_call()
+            return
+
+        self.chan_path = self.driver.conn.Requests.CreateChannel({
+            cs.CHANNEL_TYPE: cs.CHANNEL_TYPE_CALL,
+            cs.TARGET_HANDLE_TYPE: cs.HT_CONTACT,
+            cs.TARGET_HANDLE: self.remote_handle,
+            cs.CALL_INITIAL_AUDIO: True,
+            })[0]
+        self.driver.calls_by_path[self.chan_path] = self
+        self.channel_announced()
+
+    def channel_announced(self):
+        bus = self.driver.bus
+        bus_name = self.driver.conn.bus_name
+
+        self.chan = bus.get_object(bus_name, self.chan_path)
+        contents = self.chan.Get(cs.CHANNEL_TYPE_CALL, 'Contents',
+            dbus_interface=cs.PROPERTIES_IFACE)
+
+        for content_path in contents:
+            self.driver.fake_engine_new_content(content_path)
+
+        self.chan.Accept(dbus_interface=cs.CHANNEL_TYPE_CALL)
+
+    def set_up(self):
+        self.setup_time = time.time() - self.started
+        self.driver.call_set_up(self)
+
+    def sip_event(self, e):
+        if e.type == 'sip-invite' and not self.incoming:
+            self.context.accept(e.sip_message)
+        elif e.type == 'sip-response' and self.incoming and e.code == 200 \
+                and e.cseq.endswith('INVITE'):
+            self.context.ack(e.sip_message)
+            if self.setup_time is None:
+                self.set_up()
+        elif e.type == 'sip-bye':
+            self.driver.sip_proxy.deliverResponse(
+                self.driver.sip_proxy.responseFromRequest(200, e.sip_message))
+
+    def dbus_event(self, e):
+        if e.signal == 'CallStateChanged':
+            state = e.args[0]
+            if state == cs.CALL_STATE_ACCEPTED and not self.incoming \
+                    and self.setup_time is None:
+                self.set_up()
+            elif state == cs.CALL_STATE_ENDED:
+                self.ended = True
+        else:
+            self.driver.fake_engine_event(e)
+
+    def hangup(self):
+        self.chan.Hangup(cs.CALL_STATE_CHANGE_REASON_USER_REQUESTED, '',
+            'Load test done', dbus_interface=cs.CHANNEL_TYPE_CALL)
+
+class LoadDriver(object):
+    def __init__(self, q, bus, conn, sip_proxy):
+        self.q = q
+        self.bus = bus
+        self.conn = conn
+        self.sip_proxy = sip_proxy
+        self.calls = []
+        self.calls_by_path = {}
+        self.calls_by_peer = {}
+        self.calls_by_call_id = {}
+        self.set_up_count = 0
+
+    def connect(self):
+        self.conn.Connect()
+        self.q.expect('dbus-signal', signal='StatusChanged', args=[0, 1])
+
+        dbus_daemon = self.bus.get_object('org.freedesktop.DBus',
+            '/org/freedesktop/DBus')
+        self.pid = dbus_daemon.GetConnectionUnixProcessID(self.conn.bus_name,
+            dbus_interface='org.freedesktop.DBus')
+
+    def rss_kb(self):
+        for line in open('/proc/%d/status' % self.pid):
+            if line.startswith('VmRSS:'):
+                return int(line.split()[1])
+        return 0
+
+    def call_for_path(self, path):
+        # Contents and streams live below their channel's object path
+        while path and path not in self.calls_by_path:
+            path = path.rpartition('/')[0]
+        return self.calls_by_path.get(path)
+
+    def call_set_up(self, call):
+        self.set_up_count += 1
+
+    # The fake streaming implementation accepts every media description
+    # offer with the remote end's codecs, provides candidates right away
+    # and completes every flow state change it is asked for.
+
+    def fake_engine_new_content(self, content_path):
+        content = self.bus.get_object(self.conn.bus_name, content_path)
+        props = content.GetAll(cs.CALL_CONTENT_IFACE_MEDIA,
+            dbus_interface=cs.PROPERTIES_IFACE)
+        streams = content.Get(cs.CALL_CONTENT, 'Streams',
+            dbus_interface=cs.PROPERTIES_IFACE)
+
+        self.fake_engine_accept_offer(content_path,
+            props['MediaDescriptionOffer'][0])
+
+        for stream_path in streams:
+            stream = self.bus.get_object(self.conn.bus_name, stream_path)
+            call = self.call_for_path(stream_path)
+            stream.AddCandidates(call.context.get_remote_candidates_dbus(),
+                dbus_interface=cs.CALL_STREAM_IFACE_MEDIA)
+            stream.FinishInitialCandidates(
+                dbus_interface=cs.CALL_STREAM_IFACE_MEDIA)
+
+    def fake_engine_accept_offer(self, content_path, md_path):
+        if md_path == '/':
+            return
+
+        call = self.call_for_path(content_path)
+        md = self.bus.get_object(self.conn.bus_name, md_path)
+        md.Accept(call.context.get_audio_md_dbus(call.remote_handle),
+            dbus_interface=cs.CALL_CONTENT_MEDIA_DESCRIPTION)
+
+    def fake_engine_event(self, e):
+        if e.signal == 'NewMediaDescriptionOffer':
+            self.fake_engine_accept_offer(e.path, e.args[0])
+        elif e.signal == 'ContentAdded':
+            self.fake_engine_new_content(e.args[0])
+        elif e.signal in ('ReceivingStateChanged', 'SendingStateChanged') \
+                and e.args[0] == cs.CALL_STREAM_FLOW_STATE_PENDING_START:
+            stream = self.bus.get_object(self.conn.bus_name, e.path)
+            method = 'Complete%sStateChange' % e.signal[:-len('StateChanged')]
+            stream.get_dbus_method(method, cs.CALL_STREAM_IFACE_MEDIA)(
+                cs.CALL_STREAM_FLOW_STATE_STARTED)
+
+    def dispatch(self, e):
+        if e.type.startswith('sip-'):
+            call_id = e.headers['call-id'][0]
+            call = self.calls_by_call_id.get(call_id)
+
+            # Outgoing calls are only known by peer until their INVITE
+            if call is None and e.type == 'sip-invite':
+                call = self.calls_by_peer.get(self.peer_of(e.uri))
+                if call is not None:
+                    self.calls_by_call_id[call_id] = call
+
+            if call is not None:
+                call.sip_event(e)
+        elif e.type == 'dbus-signal':
+            if e.signal == 'NewChannels':
+                for path, props in e.args[0]:
+                    call = self.calls_by_peer.get(props.get(cs.TARGET_ID))
+                    if call is not None and call.incoming:
+                        call.chan_path = path
+                        self.calls_by_path[path] = call
+                        call.channel_announced()
+                return
+
+            call = self.call_for_path(e.path)
+            if call is not None:
+                call.dbus_event(e)
+
+    def peer_of(self, uri):
+        if uri.startswith('sip:'):
+            uri = uri[len('sip:'):]
+        return uri.split(';')[0]
+
+    def run_until(self, done):
+        while not done():
+            try:
+                self.dispatch(self.q.wait())
+            except TimeoutError:
+                raise AssertionError('%d of %d calls set up' %
+                    (self.set_up_count, len(self.calls)))
+
+    def run(self):
+        self.connect()
+        rss_idle = self.rss_kb()
+
+        for i in range(LOAD_CALLS * 2):
+            call = LoadCall(self, i, incoming=(i % 2 == 1))
+            self.calls.append(call)
+            self.calls_by_peer[call.peer] = call
+
+        start = time.time()
+        for call in self.calls:
+            call.start()
+            if call.incoming:
+                self.calls_by_call_id[call.context.call_id] = call
+
+        self.run_until(lambda: self.set_up_count == len(self.calls))
+        elapsed = time.time() - start
+        rss_loaded = self.rss_kb()
+
+        latencies = sorted([c.setup_time * 1000 for c in self.calls])
+        def percentile(p):
+            return latencies[min(len(latencies) - 1,
+                int(len(latencies) * p / 100))]
+
+        print "%d calls (%d outgoing, %d incoming) set up in %.2f s: " \
+            "%.1f calls/s" % (len(self.calls), LOAD_CALLS, LOAD_CALLS,
+                elapsed, len(self.calls) / elapsed)
+        print "setup latency: p50 %.1f ms, p90 %.1f ms, p99 %.1f ms, " \
+            "max %.1f ms" % (percentile(50), percentile(90), percentile(99),
+                latencies[-1])
+        print "RSS: %d kB idle, %d kB loaded, %.1f kB per active call" % (
+            rss_idle, rss_loaded,
+            float(rss_loaded - rss_idle) / len(self.calls))
+
+        for call in self.calls:
+            call.hangup()
+        self.run_until(lambda: all([c.ended for c in self.calls]))
+
+        for call in self.calls:
+            call.chan.Close(dbus_interface=cs.CHANNEL)
+
+        assertEquals(len(self.calls), self.set_up_count)
+
+if __name__ == '__main__':
+    exec_test(lambda q, b, c, s: LoadDriver(q, b, c, s).run(),
+              params={'max-calls': dbus.UInt32(0)}, timeout=30)
@@ -1,4 +1,5 @@
 import dbus
+import time
 
 from sofiatest import exec_test
 
@@ -37,6 +38,7 @@ class CallTest:
         else:
             self.initial_video_content_name = None
         self.contents = []
+        self.transport = cs.CALL_STREAM_TRANSPORT_RAW_UDP
 
         self.medias = []
         if self.initial_audio_content_name:
@@ -94,7 +96,7 @@ class CallTest:
         assertEquals(self.context.get_remote_candidates_dbus(),
                      endpoint_props['RemoteCandidates'])
         assertLength(0, endpoint_props['EndpointState'])
-        assertEquals(cs.CALL_STREAM_TRANSPORT_RAW_UDP,
+        assertEquals(self.transport,
                      endpoint_props['Transport'])
         assertEquals(False, endpoint_props['IsICELite'])
 
@@ -132,7 +134,7 @@ class CallTest:
         else:
             assertEquals(cs.CALL_SENDING_STATE_PENDING_SEND,
                          smedia_props['ReceivingState'])
-        assertEquals(cs.CALL_STREAM_TRANSPORT_RAW_UDP,
+        assertEquals(self.transport,
                      smedia_props['Transport'])
         assertEquals([], smedia_props['LocalCandidates'])
         assertEquals(("",""), smedia_props['LocalCredentials'])
@@ -202,14 +204,20 @@ class CallTest:
         if incoming:
             md = self.bus.get_object (self.conn.bus_name,
                                  cmedia_props['MediaDescriptionOffer'][0])
-            md.Accept(self.context.get_audio_md_dbus(self.remote_handle))
-            o = self.q.expect_many(
-                EventPattern('dbus-signal', signal='MediaDescriptionOfferDone'),
-                EventPattern('dbus-signal', signal='LocalMediaDescriptionChanged'),
-                EventPattern('dbus-signal', signal='RemoteMediaDescriptionsChanged'))
+            self.accept_remote_md(md)
 
         return content                   
 
+    def accept_remote_md(self, md, codecs=None):
+        if codecs is None:
+            md.Accept(self.context.get_audio_md_dbus(self.remote_handle))
+        else:
+            md.Accept(self.context.get_md_dbus(codecs, self.remote_handle))
+        o = self.q.expect_many(
+            EventPattern('dbus-signal', signal='MediaDescriptionOfferDone'),
+            EventPattern('dbus-signal', signal='LocalMediaDescriptionChanged'),
+            EventPattern('dbus-signal', signal='RemoteMediaDescriptionsChanged'))
+
     def check_call_properties(self, call_props):
         if self.incoming:
             assertEquals(cs.CALL_STATE_INITIALISED, call_props['CallState'])
@@ -227,7 +235,7 @@ class CallTest:
                      call_props['InitialVideo'])
         assertEquals(self.initial_video_content_name or "",
                      call_props['InitialVideoName'])
-        assertEquals(cs.CALL_STREAM_TRANSPORT_RAW_UDP,
+        assertEquals(self.transport,
                      call_props['InitialTransport'])
         assertEquals({self.remote_handle: 0}, call_props['CallMembers'])
 
@@ -267,37 +275,47 @@ class CallTest:
             self.add_content(c, True)
 
         if not self.incoming:
-            self.chan.Call1.Accept()
-
-            self.q.expect_many(
-                *self.stream_dbus_signal_event('ReceivingStateChanged',
-                                                   args=[cs.CALL_STREAM_FLOW_STATE_PENDING_START]))
-
-            for c in self.contents:
-                c.stream.Media.CompleteReceivingStateChange(
-                    cs.CALL_STREAM_FLOW_STATE_STARTED)
-
-                mdo = c.Get(cs.CALL_CONTENT_IFACE_MEDIA,
-                            'MediaDescriptionOffer')
-                md = self.bus.get_object (self.conn.bus_name, mdo[0])
-                md.Accept(self.context.get_audio_md_dbus(
-                        self.remote_handle))
-
-                self.q.expect_many(
-                    EventPattern('dbus-signal', signal='MediaDescriptionOfferDone',
-                                 path=c.__dbus_object_path__),
-                    EventPattern('dbus-signal', signal='LocalMediaDescriptionChanged',
-                                 path=c.__dbus_object_path__),
-                    EventPattern('dbus-signal', signal='RemoteMediaDescriptionsChanged',
-                                 path=c.__dbus_object_path__))
-
-                mdo = c.Get(cs.CALL_CONTENT_IFACE_MEDIA,
-                            'MediaDescriptionOffer')
-                assertEquals(('/', {}), mdo)
-
-                self.add_candidates(c.stream)
-                
-            self.invite_event = self.q.expect('sip-invite')
+            self.start_outgoing()
+
+    def start_outgoing(self):
+        self.chan.Call1.Accept()
+
+        self.q.expect_many(
+            *self.stream_dbus_signal_event('ReceivingStateChanged',
+                                           args=[cs.CALL_STREAM_FLOW_STATE_PENDING_START]))
+
+        start = time.time()
+
+        for c in self.contents:
+            self.prepare_outgoing_content(c)
+
+        self.invite_event = self.q.expect('sip-invite')
+        self.q.log('time to first INVITE: %0.3f ms' %
+                   ((time.time() - start) * 1000))
+
+    def prepare_outgoing_content(self, c):
+        c.stream.Media.CompleteReceivingStateChange(
+            cs.CALL_STREAM_FLOW_STATE_STARTED)
+
+        mdo = c.Get(cs.CALL_CONTENT_IFACE_MEDIA,
+                    'MediaDescriptionOffer')
+        md = self.bus.get_object (self.conn.bus_name, mdo[0])
+        md.Accept(self.context.get_audio_md_dbus(
+                self.remote_handle))
+
+        self.q.expect_many(
+            EventPattern('dbus-signal', signal='MediaDescriptionOfferDone',
+                         path=c.__dbus_object_path__),
+            EventPattern('dbus-signal', signal='LocalMediaDescriptionChanged',
+                         path=c.__dbus_object_path__),
+            EventPattern('dbus-signal', signal='RemoteMediaDescriptionsChanged',
+                         path=c.__dbus_object_path__))
+
+        mdo = c.Get(cs.CALL_CONTENT_IFACE_MEDIA,
+                    'MediaDescriptionOffer')
+        assertEquals(('/', {}), mdo)
+
+        self.add_candidates(c.stream)
 
     def content_dbus_signal_event(self, s, **kwparams):
         return map(
@@ -370,6 +388,7 @@ class CallTest:
                             code=200)
 
         self.context.check_call_sdp(acc.sip_message.body, self.medias)
+        self.answer_body = acc.sip_message.body
         self.context.ack(acc.sip_message)
 
     def accept_outgoing(self):
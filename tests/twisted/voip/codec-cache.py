@@ -0,0 +1,125 @@
+"""
+Test that the codecs agreed with a peer are remembered for the next call:
+they are the only ones offered to it, and an offer from it that has all of
+them is answered with them before the streaming implementation replies.
+"""
+
+import calltest
+import constants as cs
+from servicetest import (
+    EventPattern, sync_dbus,
+    assertContains, assertDoesNotContain,
+    )
+from sofiatest import exec_test
+
+GSM = ('GSM', 3, 8000, {})
+PCMA = ('PCMA', 8, 8000, {})
+PCMU = ('PCMU', 0, 8000, {})
+
+class CodecCache(calltest.CallTest):
+
+    def __init__(self, *params, **kwparams):
+        calltest.CallTest.__init__(self, *params, **kwparams)
+        self.second_call = False
+
+    def prepare_outgoing_content(self, c):
+        if self.second_call:
+            # The streaming implementation now supports an extra codec
+            # the peer did not agree on last time
+            self.context.audio_codecs = self.codecs + [('speex', 97, 8000, {})]
+        calltest.CallTest.prepare_outgoing_content(self, c)
+        self.context.audio_codecs = self.codecs
+
+    def accept_outgoing(self):
+        body = self.invite_event.sip_message.body
+        if self.second_call:
+            # Only what was agreed on in the first call is offered
+            assertDoesNotContain('speex', body)
+        for name, codec_id, rate, _misc in self.codecs:
+            assertContains('a=rtpmap:%s %s/%s' % (codec_id, name, rate), body)
+        calltest.CallTest.accept_outgoing(self)
+
+    def run(self):
+        self.connect()
+        self.codecs = self.context.audio_codecs
+
+        for self.second_call in [False, True]:
+            self.contents = []
+            self.initiate()
+            self.accept()
+            self.running_check()
+            self.hangup()
+            self.chan.Close()
+
+class CachedAnswer(calltest.CallTest):
+    """Three incoming calls from the same peer. PCMA alone is agreed in
+    the first one. The second offer has it, and is answered from the
+    cache while the media description is left pending. The third one
+    lacks it, so the answer waits for the streaming implementation."""
+
+    def __init__(self, *params, **kwparams):
+        calltest.CallTest.__init__(self, *params, **kwparams)
+        self.call = 0
+        self.held_md = None
+
+    def accept_remote_md(self, md, codecs=None):
+        if self.call == 0:
+            calltest.CallTest.accept_remote_md(self, md, [PCMA])
+        else:
+            self.held_md = md
+
+    def add_candidates(self, stream):
+        calltest.CallTest.add_candidates(self, stream)
+
+        if self.call == 2:
+            # Nothing usable in the cache: no answer until the streaming
+            # implementation replies
+            forbidden = [EventPattern('sip-response',
+                                      call_id=self.context.call_id, code=200)]
+            self.q.forbid_events(forbidden)
+            sync_dbus(self.bus, self.q, self.conn)
+            self.q.unforbid_events(forbidden)
+
+            calltest.CallTest.accept_remote_md(self, self.held_md,
+                                               self.answer_codecs)
+            self.held_md = None
+
+    def accept_incoming(self):
+        offered = self.context.audio_codecs
+        self.context.audio_codecs = self.answer_codecs
+        calltest.CallTest.accept_incoming(self)
+        self.context.audio_codecs = offered
+
+        if self.call == 1:
+            # The 200 OK went out with the cached codecs, before the
+            # streaming implementation agreed on them; doing so now does
+            # not change the SDP, so it needs no re-INVITE
+            forbidden = [EventPattern('sip-invite')]
+            self.q.forbid_events(forbidden)
+            calltest.CallTest.accept_remote_md(self, self.held_md, [PCMA])
+            self.held_md = None
+            sync_dbus(self.bus, self.q, self.conn)
+            self.q.unforbid_events(forbidden)
+
+    def run(self):
+        self.connect()
+
+        for self.call, offered, self.answer_codecs in [
+                (0, [GSM, PCMA, PCMU], [PCMA]),
+                (1, [GSM, PCMA, PCMU], [PCMA]),
+                (2, [GSM, PCMU], [GSM, PCMU])]:
+            self.context.audio_codecs = offered
+            self.contents = []
+            self.initiate()
+            self.accept()
+            self.running_check()
+            self.hangup()
+            self.chan.Close()
+
+if __name__ == '__main__':
+    exec_test(lambda q, b, c, s:
+                  calltest.run_call_test(q, b, c, s, incoming=False,
+                                         klass=CodecCache))
+    exec_test(lambda q, b, c, s:
+                  calltest.run_call_test(q, b, c, s, incoming=True,
+                                         klass=CachedAnswer))
@@ -0,0 +1,80 @@
+"""
+Benchmark content add/remove churn on a call with many contents.
+
+The remote side grows the call to CONTENTS audio contents with one
+re-INVITE each, then repeatedly removes the oldest content and adds a new
+one. The average time per operation is printed for each phase, so that
+lookups which scale with the number of contents show up.
+"""
+
+import time
+
+import calltest
+import constants as cs
+from servicetest import EventPattern, assertEquals
+from sofiatest import exec_test
+
+CONTENTS = 128
+CHURN_ROUNDS = 32
+
+class ContentChurn(calltest.CallTest):
+
+    def __init__(self, *params, **kwparams):
+        calltest.CallTest.__init__(self, *params, **kwparams)
+        # indices into self.medias of the contents added by the peer,
+        # oldest first
+        self.live = []
+
+    def remote_add(self):
+        self.add_to_medias('audio')
+        self.live.append(len(self.medias) - 1)
+
+        self.context.reinvite(self.medias)
+
+        ca = self.q.expect('dbus-signal', signal='ContentAdded')
+        content = self.add_content(ca.args[0], incoming=True)
+        self.add_candidates(content.stream)
+        content.stream.Media.CompleteReceivingStateChange(
+            cs.CALL_STREAM_FLOW_STATE_STARTED)
+
+        ok = self.q.expect('sip-response', code=200)
+        self.context.ack(ok.sip_message)
+
+    def remote_remove_oldest(self):
+        index = self.live.pop(0)
+        self.medias[index] = (None, None)
+
+        self.context.reinvite(self.medias)
+
+        o = self.q.expect_many(
+            EventPattern('dbus-signal', signal='ContentRemoved'),
+            EventPattern('sip-response', code=200))
+        assertEquals(self.remote_handle, o[0].args[1][0])
+        self.context.ack(o[1].sip_message)
+
+    def during_call(self):
+        start = time.time()
+        for i in range(CONTENTS):
+            self.remote_add()
+        elapsed = time.time() - start
+        print "grow to %d contents: %.2f ms/content" % (
+            CONTENTS, elapsed * 1000 / CONTENTS)
+
+        start = time.time()
+        for i in range(CHURN_ROUNDS):
+            self.remote_remove_oldest()
+            self.remote_add()
+        elapsed = time.time() - start
+        print "churn at %d contents: %.2f ms/round" % (
+            CONTENTS, elapsed * 1000 / CHURN_ROUNDS)
+
+        chan_props = self.chan.Properties.GetAll(cs.CHANNEL_TYPE_CALL)
+        # The initial audio content plus the live ones
+        assertEquals(CONTENTS + 1, len(chan_props['Contents']))
+
+        return calltest.CallTest.during_call(self)
+
+if __name__ == '__main__':
+    exec_test(lambda q, b, c, s:
+                  calltest.run_call_test(q, b, c, s, incoming=False,
+                                         klass=ContentChurn))
@@ -0,0 +1,47 @@
+"""
+Test that EnsureChannel returns the existing call with a peer.
+"""
+
+import calltest
+import constants as cs
+from servicetest import (
+    assertEquals, assertNotEquals,
+    )
+from sofiatest import exec_test
+
+class EnsureChannel(calltest.CallTest):
+
+    def ensure(self, handle):
+        return self.conn.Requests.EnsureChannel({
+                cs.CHANNEL_TYPE: cs.CHANNEL_TYPE_CALL,
+                cs.TARGET_HANDLE_TYPE: cs.HT_CONTACT,
+                cs.TARGET_HANDLE: handle,
+                cs.CALL_INITIAL_AUDIO: True,
+                })
+
+    def during_call(self):
+        yours, path, _props = self.ensure(self.remote_handle)
+        assertEquals(False, yours)
+        assertEquals(self.chan_path, path)
+
+        other_handle = self.conn.get_contact_handle_sync('other@bar.com')
+        yours, other_path, _props = self.ensure(other_handle)
+        assertEquals(True, yours)
+        assertNotEquals(self.chan_path, other_path)
+
+        other_chan = self.bus.get_object(self.conn.bus_name, other_path)
+        other_chan.Close(dbus_interface=cs.CHANNEL)
+        self.q.expect('dbus-signal', signal='Closed', path=other_path)
+
+        # The first call is still the one returned for its peer
+        yours, path, _props = self.ensure(self.remote_handle)
+        assertEquals(False, yours)
+        assertEquals(self.chan_path, path)
+
+if __name__ == '__main__':
+    exec_test(lambda q, b, c, s:
+                  calltest.run_call_test(q, b, c, s, incoming=True,
+                                         klass=EnsureChannel))
+    exec_test(lambda q, b, c, s:
+                  calltest.run_call_test(q, b, c, s, incoming=False,
+                                         klass=EnsureChannel))
@@ -0,0 +1,102 @@
+"""
+Test the fast-start mode: the initial INVITE goes out as soon as the audio
+content is ready, and the lagging video content follows in a re-INVITE.
+"""
+
+import re
+import time
+
+import calltest
+import constants as cs
+from servicetest import (
+    EventPattern,
+    assertEquals, assertLength,
+    )
+from sofiatest import exec_test
+
+class FastStart(calltest.CallTest):
+
+    def __init__(self, *params, **kwparams):
+        calltest.CallTest.__init__(self, *params, **kwparams)
+
+    def get_content(self, media_type):
+        return [c for c in self.contents if c.media_type == media_type][0]
+
+    def start_outgoing(self):
+        self.chan.Call1.Accept()
+
+        self.q.expect_many(
+            *self.stream_dbus_signal_event('ReceivingStateChanged',
+                                           args=[cs.CALL_STREAM_FLOW_STATE_PENDING_START]))
+
+        start = time.time()
+
+        # The video content is left without codecs and candidates for now
+        self.prepare_outgoing_content(
+            self.get_content(cs.MEDIA_STREAM_TYPE_AUDIO))
+
+        self.invite_event = self.q.expect('sip-invite')
+        self.q.log('time to first INVITE with fast start: %0.3f ms' %
+                   ((time.time() - start) * 1000))
+
+        body = self.invite_event.sip_message.body
+        assertLength(1, re.findall('^m=', body, re.MULTILINE))
+        self.context.check_call_sdp(body, [('audio', None)])
+
+    def accept_outgoing(self):
+        audio = self.get_content(cs.MEDIA_STREAM_TYPE_AUDIO)
+        video = self.get_content(cs.MEDIA_STREAM_TYPE_VIDEO)
+
+        self.context.accept(self.invite_event.sip_message)
+
+        ack_cseq = "%s ACK" % self.invite_event.cseq.split()[0]
+        del self.invite_event
+
+        o = self.q.expect_many(
+            EventPattern('sip-ack', cseq=ack_cseq),
+            EventPattern('dbus-signal', signal='NewMediaDescriptionOffer',
+                         path=audio.__dbus_object_path__),
+            EventPattern('dbus-signal', signal='EndpointsChanged',
+                         path=audio.stream.__dbus_object_path__))
+
+        md = self.bus.get_object (self.conn.bus_name, o[1].args[0])
+        md.Accept(self.context.get_audio_md_dbus(self.remote_handle))
+
+        o = self.q.expect('dbus-signal', signal='CallStateChanged')
+        assertEquals(cs.CALL_STATE_ACCEPTED, o.args[0])
+
+        audio.stream.Media.CompleteSendingStateChange(
+            cs.CALL_STREAM_FLOW_STATE_STARTED)
+        self.q.expect('dbus-signal', signal='SendingStateChanged',
+                      args=[cs.CALL_STREAM_FLOW_STATE_STARTED],
+                      path=audio.stream.__dbus_object_path__)
+
+        # Now the video content gets ready and is offered in a re-INVITE
+        self.prepare_outgoing_content(video)
+
+        reinvite_event = self.q.expect('sip-invite')
+        self.context.check_call_sdp(reinvite_event.sip_message.body,
+                                    self.medias)
+        self.context.accept(reinvite_event.sip_message)
+
+        ack_cseq = "%s ACK" % reinvite_event.cseq.split()[0]
+
+        o = self.q.expect_many(
+            EventPattern('sip-ack', cseq=ack_cseq),
+            EventPattern('dbus-signal', signal='NewMediaDescriptionOffer',
+                         path=video.__dbus_object_path__))
+
+        md = self.bus.get_object (self.conn.bus_name, o[1].args[0])
+        md.Accept(self.context.get_audio_md_dbus(self.remote_handle))
+
+        video.stream.Media.CompleteSendingStateChange(
+            cs.CALL_STREAM_FLOW_STATE_STARTED)
+        self.q.expect('dbus-signal', signal='SendingStateChanged',
+                      args=[cs.CALL_STREAM_FLOW_STATE_STARTED],
+                      path=video.stream.__dbus_object_path__)
+
+if __name__ == '__main__':
+    exec_test(lambda q, b, c, s:
+                  calltest.run_call_test(q, b, c, s, incoming=False,
+                                         klass=FastStart, video=True),
+              params={'fast-start': True})
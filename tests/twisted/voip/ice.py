@@ -0,0 +1,210 @@
+"""
+Test ICE candidates and credentials in SDP, in the offer of an outgoing
+call and the answer to an incoming one, and trickled local candidates
+sent in a re-INVITE.
+"""
+
+import calltest
+import constants as cs
+from servicetest import (
+    EventPattern,
+    assertEquals, assertContains, assertDoesNotContain, assertLength,
+    )
+from sofiatest import exec_test
+
+REMOTE_ICE_ATTRIBUTES = [
+    'ice-ufrag:remoteufrag',
+    'ice-pwd:remotepassword',
+    'candidate:1 1 UDP 2130706431 192.168.0.1 2222 typ host',
+    'candidate:1 2 UDP 2130706430 192.168.0.1 2223 typ host',
+    'candidate:2 1 UDP 1694498815 203.0.113.5 42222 typ srflx '
+        'raddr 192.168.0.1 rport 2222',
+    ]
+
+class Ice(calltest.CallTest):
+
+    def __init__(self, *params, **kwparams):
+        calltest.CallTest.__init__(self, *params, **kwparams)
+        self.transport = cs.CALL_STREAM_TRANSPORT_ICE
+
+    def connect(self):
+        calltest.CallTest.connect(self)
+        self.context.media_attributes = REMOTE_ICE_ATTRIBUTES
+
+    def add_candidates(self, stream):
+        stream.Media.SetCredentials('localufrag', 'localpassword')
+        calltest.CallTest.add_candidates(self, stream)
+
+    def check_endpoint(self, content, endpoint_path):
+        endpoint = self.bus.get_object(self.conn.bus_name, endpoint_path)
+        endpoint_props = endpoint.GetAll(cs.CALL_STREAM_ENDPOINT)
+        assertEquals(('remoteufrag', 'remotepassword'),
+                     endpoint_props['RemoteCredentials'])
+        assertEquals(cs.CALL_STREAM_TRANSPORT_ICE,
+                     endpoint_props['Transport'])
+
+        # All the a=candidate lines are used, not just the c= line
+        candidates = endpoint_props['RemoteCandidates']
+        assertLength(3, candidates)
+        component, ip, port, info = candidates[2]
+        assertEquals((1, '203.0.113.5', 42222), (component, ip, port))
+        assertEquals(cs.CALL_STREAM_CANDIDATE_TYPE_SERVER_REFLEXIVE,
+                     info['type'])
+        assertEquals('192.168.0.1', info['base-ip'])
+        assertEquals(2222, info['base-port'])
+
+    def accept_incoming(self):
+        calltest.CallTest.accept_incoming(self)
+
+        assertContains('a=ice-ufrag:localufrag', self.answer_body)
+        assertContains('a=ice-pwd:localpassword', self.answer_body)
+        assertContains('a=candidate:1 1 UDP 0 192.168.0.1 2222 typ host',
+                       self.answer_body)
+        assertContains('a=candidate:1 2 UDP 0 192.168.0.1 2223 typ host',
+                       self.answer_body)
+
+    def during_call(self):
+        # A candidate found late is sent in a re-INVITE
+        stream = self.contents[0].stream
+        stream.Media.AddCandidates([(1, '198.51.100.7', 3478,
+            {'protocol': cs.MEDIA_STREAM_BASE_PROTO_UDP,
+             'priority': 100,
+             'foundation': '3',
+             'type': cs.CALL_STREAM_CANDIDATE_TYPE_RELAY,
+             'base-ip': '192.168.0.1',
+             'base-port': 2222})])
+
+        reinvite_event = self.q.expect('sip-invite')
+        assertContains('a=candidate:3 1 UDP 100 198.51.100.7 3478 typ relay '
+                       'raddr 192.168.0.1 rport 2222',
+                       reinvite_event.sip_message.body)
+
+        self.context.accept(reinvite_event.sip_message)
+
+        ack_cseq = "%s ACK" % reinvite_event.cseq.split()[0]
+        self.q.expect('sip-ack', cseq=ack_cseq)
+
+        return calltest.CallTest.during_call(self)
+
+class OutgoingIce(calltest.CallTest):
+    """The offer of an outgoing call carries the local ICE attributes,
+    and the ones of the answer are used for the endpoint."""
+
+    def __init__(self, *params, **kwparams):
+        calltest.CallTest.__init__(self, *params, **kwparams)
+        self.transport = cs.CALL_STREAM_TRANSPORT_ICE
+
+    def connect(self):
+        calltest.CallTest.connect(self)
+        self.context.media_attributes = REMOTE_ICE_ATTRIBUTES
+
+    def add_candidates(self, stream):
+        stream.Media.SetCredentials('localufrag', 'localpassword')
+        stream.Media.AddCandidates([
+            (1, '192.168.0.1', 2222,
+             {'protocol': cs.MEDIA_STREAM_BASE_PROTO_UDP,
+              'priority': 2130706431,
+              'foundation': '1',
+              'type': cs.CALL_STREAM_CANDIDATE_TYPE_HOST}),
+            (1, '203.0.113.9', 40000,
+             {'protocol': cs.MEDIA_STREAM_BASE_PROTO_UDP,
+              'priority': 1694498815,
+              'foundation': '2',
+              'type': cs.CALL_STREAM_CANDIDATE_TYPE_SERVER_REFLEXIVE,
+              'base-ip': '192.168.0.1',
+              'base-port': 2222}),
+            # not a numeric address: only the related address is dropped
+            (1, '203.0.113.10', 40002,
+             {'protocol': cs.MEDIA_STREAM_BASE_PROTO_UDP,
+              'priority': 1694498814,
+              'foundation': '4',
+              'type': cs.CALL_STREAM_CANDIDATE_TYPE_SERVER_REFLEXIVE,
+              'base-ip': '192.168.0.1\r\na=x',
+              'base-port': 2224}),
+            # a foundation out of the ice-char set: the candidate is dropped
+            (1, '203.0.113.11', 40004,
+             {'protocol': cs.MEDIA_STREAM_BASE_PROTO_UDP,
+              'priority': 1694498813,
+              'foundation': '5 6',
+              'type': cs.CALL_STREAM_CANDIDATE_TYPE_HOST}),
+            (2, '192.168.0.1', 2223,
+             {'protocol': cs.MEDIA_STREAM_BASE_PROTO_UDP,
+              'priority': 2130706430,
+              'foundation': '1',
+              'type': cs.CALL_STREAM_CANDIDATE_TYPE_HOST}),
+            ])
+        stream.Media.FinishInitialCandidates()
+
+        self.q.expect('dbus-signal', signal='LocalCandidatesAdded',
+                 path=stream.__dbus_object_path__)
+
+    def accept_outgoing(self):
+        offer = self.invite_event.sip_message.body
+
+        assertContains('a=ice-ufrag:localufrag\r\n', offer)
+        assertContains('a=ice-pwd:localpassword\r\n', offer)
+        assertContains('a=candidate:1 1 UDP 2130706431 192.168.0.1 2222 '
+                       'typ host\r\n', offer)
+        assertContains('a=candidate:2 1 UDP 1694498815 203.0.113.9 40000 '
+                       'typ srflx raddr 192.168.0.1 rport 2222\r\n', offer)
+        assertContains('a=candidate:4 1 UDP 1694498814 203.0.113.10 40002 '
+                       'typ srflx\r\n', offer)
+        assertContains('a=candidate:1 2 UDP 2130706430 192.168.0.1 2223 '
+                       'typ host\r\n', offer)
+        assertDoesNotContain('203.0.113.11', offer)
+        assertDoesNotContain('a=x', offer)
+
+        # The offer is echoed back as the answer, so it is replaced with a
+        # description carrying the ICE attributes of the peer
+        self.invite_event.sip_message.body = \
+            self.context.get_call_sdp(self.medias)
+
+        return calltest.CallTest.accept_outgoing(self)
+
+    def check_endpoint(self, content, endpoint_path):
+        endpoint = self.bus.get_object(self.conn.bus_name, endpoint_path)
+        endpoint_props = endpoint.GetAll(cs.CALL_STREAM_ENDPOINT)
+        assertEquals(('remoteufrag', 'remotepassword'),
+                     endpoint_props['RemoteCredentials'])
+        assertEquals(cs.CALL_STREAM_TRANSPORT_ICE,
+                     endpoint_props['Transport'])
+        assertLength(3, endpoint_props['RemoteCandidates'])
+
+class NoRemoteIce(calltest.CallTest):
+    """The peer does not do ICE: its c= line is used, over raw UDP."""
+
+    def __init__(self, *params, **kwparams):
+        calltest.CallTest.__init__(self, *params, **kwparams)
+        self.transport = cs.CALL_STREAM_TRANSPORT_ICE
+
+    def add_candidates(self, stream):
+        stream.Media.SetCredentials('localufrag', 'localpassword')
+        calltest.CallTest.add_candidates(self, stream)
+
+    def check_endpoint(self, content, endpoint_path):
+        endpoint = self.bus.get_object(self.conn.bus_name, endpoint_path)
+        endpoint_props = endpoint.GetAll(cs.CALL_STREAM_ENDPOINT)
+        assertEquals(cs.CALL_STREAM_TRANSPORT_RAW_UDP,
+                     endpoint_props['Transport'])
+        assertEquals(self.context.get_remote_candidates_dbus(),
+                     endpoint_props['RemoteCandidates'])
+
+    def accept_incoming(self):
+        calltest.CallTest.accept_incoming(self)
+
+        assertDoesNotContain('a=ice-ufrag', self.answer_body)
+        assertDoesNotContain('a=candidate', self.answer_body)
+
+if __name__ == '__main__':
+    exec_test(lambda q, b, c, s:
+                  calltest.run_call_test(q, b, c, s, incoming=True,
+                                         klass=Ice),
+              params={'ice': True})
+    exec_test(lambda q, b, c, s:
+                  calltest.run_call_test(q, b, c, s, incoming=False,
+                                         klass=OutgoingIce),
+              params={'ice': True})
+    exec_test(lambda q, b, c, s:
+                  calltest.run_call_test(q, b, c, s, incoming=True,
+                                         klass=NoRemoteIce),
+              params={'ice': True})
@@ -0,0 +1,59 @@
+"""
+Test the connection's memory accounting against the budgets for an idle
+connection and for an active call.
+"""
+
+import calltest
+import constants as cs
+from servicetest import assertContains, assertEquals
+from sofiatest import exec_test
+
+MEMORY_USAGE = 'org.freedesktop.Telepathy.Rakia.Connection.Interface.MemoryUsage'
+
+# Bytes accounted to a registered connection with no channels
+IDLE_CONNECTION_BUDGET = 16 * 1024
+# Bytes accounted to the session of an active call, on top of the above
+ACTIVE_CALL_BUDGET = 32 * 1024
+
+class MemoryUsageTest(calltest.CallTest):
+
+    def get_usage(self):
+        return self.conn.Properties.GetAll(MEMORY_USAGE)
+
+    def connect(self):
+        calltest.CallTest.connect(self)
+
+        assertContains(MEMORY_USAGE,
+            self.conn.Properties.Get(cs.CONN, 'Interfaces'))
+
+        props = self.get_usage()
+        assertEquals(0, props['CallChannels'])
+        assertEquals(0, props['TextChannels'])
+
+        usage = props['MemoryUsage']
+        assertEquals(0, usage['sessions'])
+        assertEquals(0, usage['pending-messages'])
+        assert 0 < usage['connection'] <= usage['total']
+        assert usage['total'] <= IDLE_CONNECTION_BUDGET, usage
+        assertEquals(sum([usage[k] for k in
+                          ['connection', 'sessions', 'pending-messages',
+                           'uris']]),
+                     usage['total'])
+
+    def during_call(self):
+        props = self.get_usage()
+        assertEquals(1, props['CallChannels'])
+
+        # The session holds the remote session description
+        usage = props['MemoryUsage']
+        assert 0 < usage['sessions'] <= ACTIVE_CALL_BUDGET, usage
+        assert usage['total'] - usage['sessions'] <= IDLE_CONNECTION_BUDGET, \
+            usage
+
+if __name__ == '__main__':
+    exec_test(lambda q, b, c, s:
+                  calltest.run_call_test(q, b, c, s, incoming=True,
+                                         klass=MemoryUsageTest))
+    exec_test(lambda q, b, c, s:
+                  calltest.run_call_test(q, b, c, s, incoming=False,
+                                         klass=MemoryUsageTest))
@@ -0,0 +1,106 @@
+"""
+Test that a call using ICE restarts it after a change of the local
+network: the re-INVITE only goes out once the streaming implementation
+has set new credentials and finished a new set of candidates, and
+carries those. Like test-network-change.py, this only runs in the network
+namespace run-test.sh creates for the test.
+"""
+
+import os
+import subprocess
+import sys
+
+import calltest
+import constants as cs
+from servicetest import (
+    EventPattern,
+    assertEquals, assertContains, assertDoesNotContain,
+    )
+from sofiatest import exec_test
+
+from ice import REMOTE_ICE_ATTRIBUTES
+
+IFACE = 'rakiatest0'
+
+def ip(*args):
+    with open(os.devnull, 'w') as null:
+        return subprocess.call(('ip',) + args, stdout=null, stderr=null)
+
+class Handover(calltest.CallTest):
+
+    def __init__(self, *params, **kwparams):
+        calltest.CallTest.__init__(self, *params, **kwparams)
+        self.transport = cs.CALL_STREAM_TRANSPORT_ICE
+
+    def connect(self):
+        calltest.CallTest.connect(self)
+        self.context.media_attributes = REMOTE_ICE_ATTRIBUTES
+
+    def add_candidates(self, stream):
+        stream.Media.SetCredentials('localufrag', 'localpassword')
+        calltest.CallTest.add_candidates(self, stream)
+
+    def during_call(self):
+        stream = self.contents[0].stream
+
+        # Nothing is offered before the new candidates are in
+        self.q.forbid_events([EventPattern('sip-invite')])
+
+        assertEquals(0, ip('addr', 'add', '192.0.2.1/24', 'dev', IFACE))
+
+        self.q.expect('dbus-signal', signal='ICERestartRequested',
+                      path=stream.__dbus_object_path__)
+
+        stream.Media.SetCredentials('newufrag', 'newpassword')
+        stream.Media.AddCandidates([
+            (1, '192.0.2.1', 3333,
+             {'protocol': cs.MEDIA_STREAM_BASE_PROTO_UDP,
+              'priority': 2130706431,
+              'foundation': '7',
+              'type': cs.CALL_STREAM_CANDIDATE_TYPE_HOST}),
+            (2, '192.0.2.1', 3334,
+             {'protocol': cs.MEDIA_STREAM_BASE_PROTO_UDP,
+              'priority': 2130706430,
+              'foundation': '7',
+              'type': cs.CALL_STREAM_CANDIDATE_TYPE_HOST}),
+            ])
+
+        self.q.unforbid_events([EventPattern('sip-invite')])
+        stream.Media.FinishInitialCandidates()
+
+        reinvite_event = self.q.expect('sip-invite')
+        body = reinvite_event.sip_message.body
+        assertContains('a=ice-ufrag:newufrag\r\n', body)
+        assertContains('a=ice-pwd:newpassword\r\n', body)
+        assertContains('a=candidate:7 1 UDP 2130706431 192.0.2.1 3333 '
+                       'typ host\r\n', body)
+        assertContains('a=candidate:7 2 UDP 2130706430 192.0.2.1 3334 '
+                       'typ host\r\n', body)
+        assertDoesNotContain('localufrag', body)
+        assertDoesNotContain('192.168.0.1 2222', body)
+
+        self.context.accept(reinvite_event.sip_message)
+
+        ack_cseq = "%s ACK" % reinvite_event.cseq.split()[0]
+        self.q.expect('sip-ack', cseq=ack_cseq)
+
+        return calltest.CallTest.during_call(self)
+
+if __name__ == '__main__':
+    if not os.environ.get('RAKIA_TEST_NETNS'):
+        sys.exit(77)
+
+    try:
+        if ip('link', 'add', IFACE, 'type', 'dummy') != 0:
+            sys.exit(77)
+    except OSError:
+        # no ip command
+        sys.exit(77)
+
+    try:
+        exec_test(lambda q, b, c, s:
+                      calltest.run_call_test(q, b, c, s, incoming=True,
+                                             klass=Handover),
+                  params={'ice': True})
+    finally:
+        ip('link', 'del', IFACE)
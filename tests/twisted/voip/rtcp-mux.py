@@ -0,0 +1,50 @@
+"""
+Test RTCP multiplexing on the RTP port (RFC 5761) in SDP offer/answer.
+"""
+
+import calltest
+import constants as cs
+from servicetest import (
+    assertEquals, assertContains, assertLength,
+    )
+from sofiatest import exec_test
+
+class RtcpMux(calltest.CallTest):
+
+    def connect(self):
+        calltest.CallTest.connect(self)
+        # Both ends put a=rtcp-mux in their SDP
+        self.context.media_attributes = ['rtcp-mux']
+
+    def accept_incoming(self):
+        calltest.CallTest.accept_incoming(self)
+        assertContains('a=rtcp-mux', self.answer_body)
+
+    def accept_outgoing(self):
+        if not self.incoming:
+            assertContains('a=rtcp-mux', self.invite_event.sip_message.body)
+        calltest.CallTest.accept_outgoing(self)
+
+    def check_endpoint(self, content, endpoint_path):
+        endpoint = self.bus.get_object(self.conn.bus_name, endpoint_path)
+        endpoint_props = endpoint.GetAll(cs.CALL_STREAM_ENDPOINT)
+
+        # Only the RTP component is there, RTCP shares its port
+        candidates = endpoint_props['RemoteCandidates']
+        assertLength(1, candidates)
+        assertEquals(self.context.get_remote_candidates_dbus()[0],
+                     candidates[0])
+        assertEquals(cs.CALL_STREAM_TRANSPORT_RAW_UDP,
+                     endpoint_props['Transport'])
+
+def run_rtcp_mux_test(incoming, klass):
+    exec_test(lambda q, b, c, s:
+                  calltest.run_call_test(q, b, c, s, incoming=incoming,
+                                         klass=klass),
+              params={'rtcp-mux': True})
+
+if __name__ == '__main__':
+    run_rtcp_mux_test(True, RtcpMux)
+    run_rtcp_mux_test(False, RtcpMux)
+    # The remote offer has no a=rtcp-mux, so RTCP keeps its own port
+    run_rtcp_mux_test(True, calltest.CallTest)
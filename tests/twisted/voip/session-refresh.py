@@ -0,0 +1,38 @@
+"""
+Test that a re-INVITE offering the same codecs is answered without a new
+media description being offered to the streaming implementation.
+"""
+
+import calltest
+import constants as cs
+from servicetest import EventPattern, assertEquals
+from sofiatest import exec_test
+
+class SessionRefreshTest(calltest.CallTest):
+
+    def during_call(self):
+        md_offers = [EventPattern('dbus-signal',
+                                  signal='NewMediaDescriptionOffer')]
+        self.q.forbid_events(md_offers)
+
+        for i in range(3):
+            self.context.reinvite()
+
+            acc = self.q.expect('sip-response', call_id=self.context.call_id,
+                                code=200)
+            self.context.check_call_sdp(acc.sip_message.body)
+            self.context.ack(acc.sip_message)
+
+        self.q.unforbid_events(md_offers)
+
+        for c in self.contents:
+            mdo = c.Get(cs.CALL_CONTENT_IFACE_MEDIA, 'MediaDescriptionOffer')
+            assertEquals(('/', {}), mdo)
+
+if __name__ == '__main__':
+    exec_test(lambda q, b, c, s:
+                  calltest.run_call_test(q, b, c, s, incoming=True,
+                                         klass=SessionRefreshTest))
+    exec_test(lambda q, b, c, s:
+                  calltest.run_call_test(q, b, c, s, incoming=False,
+                                         klass=SessionRefreshTest))
@@ -0,0 +1,61 @@
+"""
+Test the call setup timeline on Call channels and its aggregation into
+the connection's setup statistics.
+"""
+
+import calltest
+import constants as cs
+from servicetest import assertContains, assertEquals
+from sofiatest import exec_test
+
+SETUP_TIMELINE = 'org.freedesktop.Telepathy.Rakia.Channel.Interface.SetupTimeline'
+SETUP_STATISTICS = 'org.freedesktop.Telepathy.Rakia.Connection.Interface.SetupStatistics'
+
+class SetupTimelineTest(calltest.CallTest):
+
+    def during_call(self):
+        assertContains(SETUP_TIMELINE,
+            self.chan.Properties.Get(cs.CHANNEL, 'Interfaces'))
+
+        milestones = self.chan.Properties.Get(SETUP_TIMELINE, 'Milestones')
+
+        if self.incoming:
+            expected = ['invite-received', 'incoming-call', 'local-codecs',
+                        'local-candidates', 'answer-sent', 'active']
+        else:
+            expected = ['local-codecs', 'local-candidates', 'invite-sent',
+                        'ack', 'active']
+
+        for name in expected:
+            assertContains(name, milestones)
+
+        # Outgoing calls are offered only once the streaming implementation
+        # has provided codecs and candidates, incoming ones are answered
+        assert milestones['local-codecs'] <= milestones['active']
+        assert milestones['local-candidates'] <= milestones['active']
+        if self.incoming:
+            assert milestones['invite-received'] <= milestones['incoming-call']
+            assert milestones['answer-sent'] <= milestones['active']
+        else:
+            assert milestones['local-candidates'] <= milestones['invite-sent']
+
+    def run(self):
+        calltest.CallTest.run(self)
+
+        assertContains(SETUP_STATISTICS,
+            self.conn.Properties.Get(cs.CONN, 'Interfaces'))
+        props = self.conn.Properties.GetAll(SETUP_STATISTICS)
+        assertEquals(1, props['CallsMeasured'])
+
+        histograms = props['MilestoneHistograms']
+        assertContains('active', histograms)
+        assertEquals(16, len(histograms['active']))
+        assertEquals(1, sum(histograms['active']))
+
+if __name__ == '__main__':
+    exec_test(lambda q, b, c, s:
+                  calltest.run_call_test(q, b, c, s, incoming=True,
+                                         klass=SetupTimelineTest))
+    exec_test(lambda q, b, c, s:
+                  calltest.run_call_test(q, b, c, s, incoming=False,
+                                         klass=SetupTimelineTest))
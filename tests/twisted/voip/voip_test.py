@@ -35,6 +35,10 @@ class VoipTestContext(object):
           'priority': 0})
         ]
 
+    # Branch of the Via header in requests from the remote end; all
+    # requests share it unless a subclass changes it
+    via_branch = 'z9hG4bKXYZ'
+
     _mline_template = 'm=%(mediatype)s %(port)s RTP/AVP %(codec_ids)s'
     _aline_template = 'a=rtpmap:%(codec_id)s %(name)s/%(rate)s'
 
@@ -48,6 +52,8 @@ class VoipTestContext(object):
         self.sip_proxy = sip_proxy
         self._cseq_id = 1
         self.to = None
+        # Extra attribute lines put in each m= section of our SDP
+        self.media_attributes = []
       
     def dbusify_codecs(self, codecs):
         dbussed_codecs = [ (id, name, rate, 1, False, params )
@@ -89,11 +95,13 @@ class VoipTestContext(object):
             't=0 0\r\n'
         for m in medias:
             if m[0]:
-                sdp_string += 'm=' + m[0] + ' %(port)s RTP/AVP 3 8 0\r\n' \
+                sdp_string += 'm=' + m[0] + ' %(port)s RTP/AVP %(codec_ids)s\r\n' \
                     'c=IN IP4 %(ip)s\r\n' \
                     '%(codecs)s\r\n'
                 if m[1]:
                     sdp_string += 'a=' + m[1] + '\r\n'
+                for a in self.media_attributes:
+                    sdp_string += 'a=' + a + '\r\n'
             else:
                 sdp_string += 'm=audio 0 RTP/AVP\r\n'
 
@@ -138,7 +146,7 @@ class VoipTestContext(object):
             for v in vals:
                 msg.addHeader(k, v)
         via = self.sip_proxy.getVia()
-        via.branch = 'z9hG4bKXYZ'
+        via.branch = self.via_branch
         msg.addHeader('via', via.toString())
         _expire, destination = self.sip_proxy.registry.users['testacc']
         self.sip_proxy.sendMessage(destination, msg)